@@ -134,6 +134,9 @@ static int use_mmap = 1;
 #define CHAIN_PINNED(ch)  (((ch)->flags & EVBUFFER_MEM_PINNED_ANY) != 0)
 #define CHAIN_PINNED_R(ch)  (((ch)->flags & EVBUFFER_MEM_PINNED_R) != 0)
 
+/* True iff a read is in progress into the space at the end of 'buf'. */
+#define HAS_PINNED_R(buf) ((buf)->last && CHAIN_PINNED_R((buf)->last))
+
 static void evbuffer_chain_align(struct evbuffer_chain *chain);
 static void evbuffer_deferred_callback(struct deferred_cb *cb, void *arg);
 static int evbuffer_ptr_memcmp(const struct evbuffer *buf,
@@ -436,9 +439,11 @@ evbuffer_run_callbacks(struct evbuffer *buffer, int running_deferred)
 static inline void
 evbuffer_invoke_callbacks(struct evbuffer *buffer)
 {
-	if (buffer->deferred_cbs) {
-		if (buffer->deferred.queued)
-			return;
+	/* Even if the deferred callbacks are already scheduled, the
+	 * NODEFER ones (such as a bufferevent's read watermark) must see
+	 * this change now. */
+	if (buffer->deferred_cbs &&
+	    !event_deferred_cb_is_pending(&buffer->deferred)) {
 		_evbuffer_incref_and_lock(buffer);
 		if (buffer->parent)
 			bufferevent_incref(buffer->parent);
@@ -678,6 +683,69 @@ ZERO_CHAIN(struct evbuffer *dst)
 	dst->total_len = 0;
 }
 
+/* While a read is in progress, the chains it reads into must stay in 'src'.
+ * Take them off the end of 'src' before we move its chains elsewhere, and
+ * store them in *first and *last.  If the first of them holds data, that
+ * data is copied into a new chain that takes its place. */
+static int
+PRESERVE_PINNED(struct evbuffer *src, struct evbuffer_chain **first,
+    struct evbuffer_chain **last)
+{
+	struct evbuffer_chain *chain, **pinned;
+
+	ASSERT_EVBUFFER_LOCKED(src);
+
+	if (!HAS_PINNED_R(src)) {
+		*first = *last = NULL;
+		return 0;
+	}
+
+	pinned = src->last_with_datap;
+	if (!CHAIN_PINNED_R(*pinned))
+		pinned = &(*pinned)->next;
+	EVUTIL_ASSERT(CHAIN_PINNED_R(*pinned));
+	chain = *first = *pinned;
+	*last = src->last;
+
+	if (chain->off) {
+		struct evbuffer_chain *tmp;
+
+		EVUTIL_ASSERT(pinned == src->last_with_datap);
+		if (!(tmp = evbuffer_chain_new(chain->off)))
+			return -1;
+		memcpy(tmp->buffer, chain->buffer + chain->misalign,
+		    chain->off);
+		tmp->off = chain->off;
+		*src->last_with_datap = tmp;
+		src->last = tmp;
+		chain->misalign += chain->off;
+		chain->off = 0;
+	} else {
+		src->last = *src->last_with_datap;
+		*pinned = NULL;
+	}
+
+	return 0;
+}
+
+/* Leave only the chains that PRESERVE_PINNED() took out in 'src'. */
+static inline void
+RESTORE_PINNED(struct evbuffer *src, struct evbuffer_chain *pinned,
+    struct evbuffer_chain *last)
+{
+	ASSERT_EVBUFFER_LOCKED(src);
+
+	if (!pinned) {
+		ZERO_CHAIN(src);
+		return;
+	}
+
+	src->first = pinned;
+	src->last = last;
+	src->last_with_datap = &src->first;
+	src->total_len = 0;
+}
+
 static inline void
 COPY_CHAIN(struct evbuffer *dst, struct evbuffer *src)
 {
@@ -727,6 +795,7 @@ PREPEND_CHAIN(struct evbuffer *dst, struct evbuffer *src)
 int
 evbuffer_add_buffer(struct evbuffer *outbuf, struct evbuffer *inbuf)
 {
+	struct evbuffer_chain *pinned, *last;
 	size_t in_total_len, out_total_len;
 	int result = 0;
 
@@ -742,6 +811,11 @@ evbuffer_add_buffer(struct evbuffer *outbuf, struct evbuffer *inbuf)
 		goto done;
 	}
 
+	if (PRESERVE_PINNED(inbuf, &pinned, &last) < 0) {
+		result = -1;
+		goto done;
+	}
+
 	if (out_total_len == 0) {
 		/* There might be an empty chain at the start of outbuf; free
 		 * it. */
@@ -752,7 +826,7 @@ evbuffer_add_buffer(struct evbuffer *outbuf, struct evbuffer *inbuf)
 	}
 
 	/* remove everything from inbuf */
-	ZERO_CHAIN(inbuf);
+	RESTORE_PINNED(inbuf, pinned, last);
 	inbuf->n_del_for_cb += in_total_len;
 	outbuf->n_add_for_cb += in_total_len;
 
@@ -767,6 +841,7 @@ done:
 int
 evbuffer_prepend_buffer(struct evbuffer *outbuf, struct evbuffer *inbuf)
 {
+	struct evbuffer_chain *pinned, *last;
 	size_t in_total_len, out_total_len;
 	int result = 0;
 
@@ -783,6 +858,11 @@ evbuffer_prepend_buffer(struct evbuffer *outbuf, struct evbuffer *inbuf)
 		goto done;
 	}
 
+	if (PRESERVE_PINNED(inbuf, &pinned, &last) < 0) {
+		result = -1;
+		goto done;
+	}
+
 	if (out_total_len == 0) {
 		/* There might be an empty chain at the start of outbuf; free
 		 * it. */
@@ -793,7 +873,7 @@ evbuffer_prepend_buffer(struct evbuffer *outbuf, struct evbuffer *inbuf)
 	}
 
 	/* remove everything from inbuf */
-	ZERO_CHAIN(inbuf);
+	RESTORE_PINNED(inbuf, pinned, last);
 	inbuf->n_del_for_cb += in_total_len;
 	outbuf->n_add_for_cb += in_total_len;
 
@@ -1805,8 +1885,6 @@ evbuffer_expand(struct evbuffer *buf, size_t datlen)
 #endif
 #define NUM_READ_IOVEC 4
 
-#define EVBUFFER_MAX_READ	4096
-
 /** Helper function to figure out which space to use for reading data into
     an evbuffer.  Internal use only.
 
@@ -36,6 +36,7 @@ extern "C" {
 #include "evthread-internal.h"
 #include "event2/thread.h"
 #include "ratelim-internal.h"
+#include "evslab-internal.h"
 
 /* These flags are reasons that we might be declining to actually enable
    reading or writing on a bufferevent.
@@ -147,6 +148,11 @@ struct bufferevent_private {
 	/** Flag: set if a connect failed prematurely; this is a hack for
 	 * getting around the bufferevent abstraction. */
 	unsigned connection_refused : 1;
+	/** Flags: set on an edge-triggered socket bufferevent when we stopped
+	 * reading (writing) before the socket would block, so no new edge
+	 * will tell us that there is more to do. */
+	unsigned et_read_ready : 1;
+	unsigned et_write_ready : 1;
 	/** Set to the events pending if we have deferred callbacks and
 	 * an events callback is pending. */
 	short eventcb_pending;
@@ -189,7 +195,10 @@ struct bufferevent_private {
 enum bufferevent_ctrl_op {
 	BEV_CTRL_SET_FD,
 	BEV_CTRL_GET_FD,
-	BEV_CTRL_GET_UNDERLYING
+	BEV_CTRL_GET_UNDERLYING,
+	/** Cancel any I/O the bufferevent has handed to the kernel, so that
+	 * it can be freed. */
+	BEV_CTRL_CANCEL_ALL
 };
 
 /** Possible data types for a control callback */
@@ -260,6 +269,13 @@ extern const struct bufferevent_ops bufferevent_ops_async;
 #define BEV_IS_ASYNC(bevp) 0
 #endif
 
+#ifdef _EVENT_HAVE_LINUX_IO_URING_H
+extern const struct bufferevent_ops bufferevent_ops_uring;
+#define BEV_IS_URING(bevp) ((bevp)->be_ops == &bufferevent_ops_uring)
+#else
+#define BEV_IS_URING(bevp) 0
+#endif
+
 /** Initialize the shared parts of a bufferevent. */
 int bufferevent_init_common(struct bufferevent_private *, struct event_base *, const struct bufferevent_ops *, enum bufferevent_options options);
 
@@ -378,6 +394,10 @@ int _bufferevent_decrement_read_buckets(struct bufferevent_private *bev,
     int bytes);
 int _bufferevent_get_read_max(struct bufferevent_private *bev);
 int _bufferevent_get_write_max(struct bufferevent_private *bev);
+/** As bufferevent_remove_from_rate_limit_group(), but only resume reading
+ * and writing if 'unsuspend' is true. */
+int _bufferevent_remove_from_rate_limit_group(struct bufferevent *bev,
+    int unsuspend);
 
 #ifdef __cplusplus
 }
@@ -222,7 +222,7 @@ _bufferevent_run_readcb(struct bufferevent *bufev)
 		return;
 	if (p->options & BEV_OPT_DEFER_CALLBACKS) {
 		p->readcb_pending = 1;
-		if (!p->deferred.queued) {
+		if (!event_deferred_cb_is_pending(&p->deferred)) {
 			bufferevent_incref(bufev);
 			SCHEDULE_DEFERRED(p);
 		}
@@ -241,7 +241,7 @@ _bufferevent_run_writecb(struct bufferevent *bufev)
 		return;
 	if (p->options & BEV_OPT_DEFER_CALLBACKS) {
 		p->writecb_pending = 1;
-		if (!p->deferred.queued) {
+		if (!event_deferred_cb_is_pending(&p->deferred)) {
 			bufferevent_incref(bufev);
 			SCHEDULE_DEFERRED(p);
 		}
@@ -261,7 +261,7 @@ _bufferevent_run_eventcb(struct bufferevent *bufev, short what)
 	if (p->options & BEV_OPT_DEFER_CALLBACKS) {
 		p->eventcb_pending |= what;
 		p->errno_pending = EVUTIL_SOCKET_ERROR();
-		if (!p->deferred.queued) {
+		if (!event_deferred_cb_is_pending(&p->deferred)) {
 			bufferevent_incref(bufev);
 			SCHEDULE_DEFERRED(p);
 		}
@@ -607,8 +607,10 @@ _bufferevent_decref_and_unlock(struct bufferevent *bufev)
 	evbuffer_free(bufev->output);
 
 	if (bufev_private->rate_limiting) {
+		/* Don't unsuspend: that would re-add the events that
+		 * destruct just deleted. */
 		if (bufev_private->rate_limiting->group)
-			bufferevent_remove_from_rate_limit_group(bufev);
+			_bufferevent_remove_from_rate_limit_group(bufev, 0);
 		if (event_initialized(&bufev_private->rate_limiting->refill_bucket_event))
 			event_del(&bufev_private->rate_limiting->refill_bucket_event);
 		event_debug_unassign(&bufev_private->rate_limiting->refill_bucket_event);
@@ -625,7 +627,7 @@ _bufferevent_decref_and_unlock(struct bufferevent *bufev)
 		    EVTHREAD_LOCKTYPE_RECURSIVE);
 
 	/* Free the actual allocated memory. */
-	mm_free(((char*)bufev) - bufev->be_ops->mem_offset);
+	evslab_free(((char*)bufev) - bufev->be_ops->mem_offset);
 
 	/* Release the reference to underlying now that we no longer need the
 	 * reference to it.  We wait this long mainly in case our lock is
@@ -655,6 +657,10 @@ bufferevent_free(struct bufferevent *bufev)
 {
 	BEV_LOCK(bufev);
 	bufferevent_setcb(bufev, NULL, NULL, NULL, NULL);
+	/* A bufferevent with reads or writes in flight holds a reference to
+	 * itself for each; get them back. */
+	if (bufev->be_ops->ctrl)
+		bufev->be_ops->ctrl(bufev, BEV_CTRL_CANCEL_ALL, NULL);
 	_bufferevent_decref_and_unlock(bufev);
 }
 
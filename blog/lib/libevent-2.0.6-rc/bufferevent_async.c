@@ -403,17 +403,18 @@ bufferevent_async_new(struct event_base *base,
 			return NULL;
 	}
 
-	if (!(bev_a = mm_calloc(1, sizeof(struct bufferevent_async))))
+	if (!(bev_a = event_base_alloc_obj(base,
+	    sizeof(struct bufferevent_async))))
 		return NULL;
 
 	bev = &bev_a->bev.bev;
 	if (!(bev->input = evbuffer_overlapped_new(fd))) {
-		mm_free(bev_a);
+		evslab_free(bev_a);
 		return NULL;
 	}
 	if (!(bev->output = evbuffer_overlapped_new(fd))) {
 		evbuffer_free(bev->input);
-		mm_free(bev_a);
+		evslab_free(bev_a);
 		return NULL;
 	}
 
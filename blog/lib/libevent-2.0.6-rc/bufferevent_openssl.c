@@ -1168,7 +1168,8 @@ bufferevent_openssl_new_impl(struct event_base *base,
 	if (underlying != NULL && fd >= 0)
 		return NULL; /* Only one can be set. */
 
-	if (!(bev_ssl = mm_calloc(1, sizeof(struct bufferevent_openssl))))
+	if (!(bev_ssl = event_base_alloc_obj(base,
+	    sizeof(struct bufferevent_openssl))))
 		goto err;
 
 	bev_p = &bev_ssl->bev;
@@ -92,11 +92,12 @@ bufferevent_pair_elt_new(struct event_base *base,
     int options)
 {
 	struct bufferevent_pair *bufev;
-	if (! (bufev = mm_calloc(1, sizeof(struct bufferevent_pair))))
+	if (! (bufev = event_base_alloc_obj(base,
+	    sizeof(struct bufferevent_pair))))
 		return NULL;
 	if (bufferevent_init_common(&bufev->bev, base, &bufferevent_ops_pair,
 		options)) {
-		mm_free(bufev);
+		evslab_free(bufev);
 		return NULL;
 	}
 	if (!evbuffer_add_cb(bufev->bev.bev.output, be_pair_outbuf_cb, bufev)) {
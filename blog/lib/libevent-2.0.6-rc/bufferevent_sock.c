@@ -34,6 +34,7 @@
 #include <sys/time.h>
 #endif
 
+#include <sys/queue.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -63,16 +64,22 @@
 #include "event2/util.h"
 #include "event2/bufferevent.h"
 #include "event2/buffer.h"
+#include "event2/buffer_compat.h"
 #include "event2/bufferevent_struct.h"
 #include "event2/bufferevent_compat.h"
 #include "event2/event.h"
 #include "log-internal.h"
 #include "mm-internal.h"
+#include "event-internal.h"
 #include "bufferevent-internal.h"
+#include "evbuffer-internal.h"
 #include "util-internal.h"
 #ifdef WIN32
 #include "iocp-internal.h"
 #endif
+#ifdef _EVENT_HAVE_LINUX_IO_URING_H
+#include "iouring-internal.h"
+#endif
 
 /* prototypes */
 static int be_socket_enable(struct bufferevent *, short);
@@ -98,6 +105,13 @@ const struct bufferevent_ops bufferevent_ops_socket = {
 #define be_socket_add(ev, t)			\
 	_bufferevent_add_event((ev), (t))
 
+#define BEV_IS_ET(bevp) ((bevp)->options & BEV_OPT_EDGE_TRIGGERED)
+
+/* An edge-triggered bufferevent reads or writes at most this much in one
+ * callback before it lets other events run; then it activates itself to
+ * do the rest. */
+#define BEV_ET_MAX_PER_CB 65536
+
 static void
 bufferevent_socket_outbuf_cb(struct evbuffer *buf,
     const struct evbuffer_cb_info *cbinfo,
@@ -115,6 +129,10 @@ bufferevent_socket_outbuf_cb(struct evbuffer *buf,
 		 * write, and we were not writing.  So, start writing. */
 		be_socket_add(&bufev->ev_write, &bufev->timeout_write);
 		/* XXXX handle failure from be_socket_add */
+		/* If we stopped writing before the socket would block, no
+		 * edge will come to say that it is writable. */
+		if (bufev_p->et_write_ready)
+			event_active(&bufev->ev_write, EV_WRITE, 1);
 	}
 }
 
@@ -125,68 +143,97 @@ bufferevent_readcb(evutil_socket_t fd, short event, void *arg)
 	struct bufferevent_private *bufev_p =
 	    EVUTIL_UPCAST(bufev, struct bufferevent_private, bev);
 	struct evbuffer *input;
-	int res = 0;
+	int res = 0, total = 0, budget;
 	short what = BEV_EVENT_READING;
 	int howmuch = -1, readmax=-1;
+	const int et = BEV_IS_ET(bufev_p);
 
 	_bufferevent_incref_and_lock(bufev);
 
 	if (event == EV_TIMEOUT) {
+		/* An edge-triggered bufferevent keeps its read event while
+		 * reading is suspended; that time doesn't count. */
+		if (bufev_p->read_suspended)
+			goto done;
 		what |= BEV_EVENT_TIMEOUT;
 		goto error;
 	}
 
 	input = bufev->input;
 
-	/*
-	 * If we have a high watermark configured then we don't want to
-	 * read more data than would make us reach the watermark.
-	 */
-	if (bufev->wm_read.high != 0) {
-		howmuch = bufev->wm_read.high - evbuffer_get_length(input);
-		/* we somehow lowered the watermark, stop reading */
-		if (howmuch <= 0) {
-			bufferevent_wm_suspend_read(bufev);
-			goto done;
+	/* In edge-triggered mode, the socket stays "ready" until a read
+	 * tells us otherwise. */
+	if (et)
+		bufev_p->et_read_ready = 1;
+	/* A rate-limited bufferevent reads once per callback, as a
+	 * level-triggered one does, so that the members of a group take
+	 * turns at the group's bucket. */
+	budget = bufev_p->rate_limiting ? 0 : BEV_ET_MAX_PER_CB;
+
+	do {
+		/*
+		 * If we have a high watermark configured then we don't want to
+		 * read more data than would make us reach the watermark.
+		 */
+		howmuch = -1;
+		if (bufev->wm_read.high != 0) {
+			howmuch = bufev->wm_read.high - evbuffer_get_length(input);
+			/* we somehow lowered the watermark, stop reading */
+			if (howmuch <= 0) {
+				bufferevent_wm_suspend_read(bufev);
+				break;
+			}
 		}
-	}
-	readmax = _bufferevent_get_read_max(bufev_p);
-	if (howmuch < 0 || howmuch > readmax) /* The use of -1 for "unlimited"
-					       * uglifies this code. */
-		howmuch = readmax;
-	if (bufev_p->read_suspended)
-		goto done;
+		readmax = _bufferevent_get_read_max(bufev_p);
+		if (howmuch < 0 || howmuch > readmax) /* The use of -1 for "unlimited"
+						       * uglifies this code. */
+			howmuch = readmax;
+		if (bufev_p->read_suspended)
+			break;
 
-	evbuffer_unfreeze(input, 0);
-	res = evbuffer_read(input, fd, howmuch);
-	evbuffer_freeze(input, 0);
-
-	if (res == -1) {
-		int err = evutil_socket_geterror(fd);
-		if (EVUTIL_ERR_RW_RETRIABLE(err))
-			goto reschedule;
-		/* error case */
-		what |= BEV_EVENT_ERROR;
-	} else if (res == 0) {
-		/* eof case */
-		what |= BEV_EVENT_EOF;
-	}
+		evbuffer_unfreeze(input, 0);
+		res = evbuffer_read(input, fd, howmuch);
+		evbuffer_freeze(input, 0);
 
-	if (res <= 0)
-		goto error;
+		if (res == -1) {
+			int err = evutil_socket_geterror(fd);
+			if (EVUTIL_ERR_RW_RETRIABLE(err)) {
+				bufev_p->et_read_ready = 0;
+				break;
+			}
+			/* error case */
+			what |= BEV_EVENT_ERROR;
+		} else if (res == 0) {
+			/* eof case */
+			what |= BEV_EVENT_EOF;
+		}
+
+		if (res <= 0)
+			goto error;
+
+		_bufferevent_decrement_read_buckets(bufev_p, res);
+		total += res;
 
-	_bufferevent_decrement_read_buckets(bufev_p, res);
+		/* A short read emptied the socket; anything that arrives
+		 * later comes with a new edge. */
+		if (res < howmuch && res < EVBUFFER_MAX_READ)
+			bufev_p->et_read_ready = 0;
+	} while (et && bufev_p->et_read_ready && total < budget);
+
+	/* If we stopped only to let other events run, come back soon. */
+	if (bufev_p->et_read_ready && !bufev_p->read_suspended)
+		event_active(&bufev->ev_read, EV_READ, 1);
 
 	/* Invoke the user callback - must always be called last */
-	if (evbuffer_get_length(input) >= bufev->wm_read.low)
+	if (total && evbuffer_get_length(input) >= bufev->wm_read.low)
 		_bufferevent_run_readcb(bufev);
 
 	goto done;
 
- reschedule:
-	goto done;
-
  error:
+	/* Don't lose data that we read before the error or EOF. */
+	if (total && evbuffer_get_length(input) >= bufev->wm_read.low)
+		_bufferevent_run_readcb(bufev);
 	bufferevent_disable(bufev, EV_READ);
 	_bufferevent_run_eventcb(bufev, what);
 
@@ -203,7 +250,8 @@ bufferevent_writecb(evutil_socket_t fd, short event, void *arg)
 	int res = 0;
 	short what = BEV_EVENT_WRITING;
 	int connected = 0;
-	int atmost = -1;
+	int atmost = -1, total = 0, budget;
+	const int et = BEV_IS_ET(bufev_p);
 
 	_bufferevent_incref_and_lock(bufev);
 
@@ -239,6 +287,15 @@ bufferevent_writecb(evutil_socket_t fd, short event, void *arg)
 						BEV_EVENT_CONNECTED);
 				goto done;
 			}
+#endif
+#ifdef _EVENT_HAVE_LINUX_IO_URING_H
+			if (BEV_IS_URING(bufev)) {
+				event_del(&bufev->ev_write);
+				bufferevent_uring_set_connected(bufev);
+				_bufferevent_run_eventcb(bufev,
+						BEV_EVENT_CONNECTED);
+				goto done;
+			}
 #endif
 			_bufferevent_run_eventcb(bufev,
 					BEV_EVENT_CONNECTED);
@@ -251,18 +308,30 @@ bufferevent_writecb(evutil_socket_t fd, short event, void *arg)
 	}
 
 	atmost = _bufferevent_get_write_max(bufev_p);
+	/* As in bufferevent_readcb. */
+	budget = bufev_p->rate_limiting ? 0 : BEV_ET_MAX_PER_CB;
 
 	if (bufev_p->write_suspended)
 		goto done;
 
-	if (evbuffer_get_length(bufev->output)) {
+	/* In edge-triggered mode, keep writing until the socket would
+	 * block, so that the next edge is sure to come. */
+	if (et)
+		bufev_p->et_write_ready = 1;
+
+	while (evbuffer_get_length(bufev->output)) {
 		evbuffer_unfreeze(bufev->output, 1);
 		res = evbuffer_write_atmost(bufev->output, fd, atmost);
 		evbuffer_freeze(bufev->output, 1);
 		if (res == -1) {
 			int err = evutil_socket_geterror(fd);
-			if (EVUTIL_ERR_RW_RETRIABLE(err))
-				goto reschedule;
+			if (EVUTIL_ERR_RW_RETRIABLE(err)) {
+				bufev_p->et_write_ready = 0;
+				if (!total)
+					goto reschedule;
+				res = total;
+				break;
+			}
 			what |= BEV_EVENT_ERROR;
 		} else if (res == 0) {
 			/* eof case
@@ -275,10 +344,17 @@ bufferevent_writecb(evutil_socket_t fd, short event, void *arg)
 			goto error;
 
 		_bufferevent_decrement_write_buckets(bufev_p, res);
+		total += res;
+		if (!et || bufev_p->write_suspended || total >= budget)
+			break;
+		atmost = _bufferevent_get_write_max(bufev_p);
 	}
 
 	if (evbuffer_get_length(bufev->output) == 0) {
 		event_del(&bufev->ev_write);
+	} else if (bufev_p->et_write_ready && !bufev_p->write_suspended) {
+		/* We stopped only to let other events run. */
+		event_active(&bufev->ev_write, EV_WRITE, 1);
 	}
 
 	/*
@@ -306,6 +382,22 @@ bufferevent_writecb(evutil_socket_t fd, short event, void *arg)
 	_bufferevent_decref_and_unlock(bufev);
 }
 
+/* Set up the read and write events of a socket bufferevent for 'fd'. */
+static void
+be_socket_assign(struct bufferevent *bufev, evutil_socket_t fd)
+{
+	struct bufferevent_private *bufev_p =
+	    EVUTIL_UPCAST(bufev, struct bufferevent_private, bev);
+	const short et = BEV_IS_ET(bufev_p) ? EV_ET : 0;
+
+	event_assign(&bufev->ev_read, bufev->ev_base, fd,
+	    EV_READ|EV_PERSIST|et, bufferevent_readcb, bufev);
+	event_assign(&bufev->ev_write, bufev->ev_base, fd,
+	    EV_WRITE|EV_PERSIST|et, bufferevent_writecb, bufev);
+	bufev_p->et_read_ready = bufev_p->et_write_ready = 0;
+	event_base_busy_poll_socket(bufev->ev_base, fd);
+}
+
 struct bufferevent *
 bufferevent_socket_new(struct event_base *base, evutil_socket_t fd,
     int options)
@@ -317,21 +409,27 @@ bufferevent_socket_new(struct event_base *base, evutil_socket_t fd,
 	if (base && event_base_get_iocp(base))
 		return bufferevent_async_new(base, fd, options);
 #endif
+#ifdef _EVENT_HAVE_LINUX_IO_URING_H
+	if (base && event_base_uses_uring_bufferevents(base))
+		return bufferevent_uring_new(base, fd, options);
+#endif
 
-	if ((bufev_p = mm_calloc(1, sizeof(struct bufferevent_private)))== NULL)
+	if ((bufev_p = event_base_alloc_obj(base,
+	    sizeof(struct bufferevent_private))) == NULL)
 		return NULL;
 
 	if (bufferevent_init_common(bufev_p, base, &bufferevent_ops_socket,
 				    options) < 0) {
-		mm_free(bufev_p);
+		evslab_free(bufev_p);
 		return NULL;
 	}
 	bufev = &bufev_p->bev;
 
-	event_assign(&bufev->ev_read, bufev->ev_base, fd,
-	    EV_READ|EV_PERSIST, bufferevent_readcb, bufev);
-	event_assign(&bufev->ev_write, bufev->ev_base, fd,
-	    EV_WRITE|EV_PERSIST, bufferevent_writecb, bufev);
+	if ((options & BEV_OPT_EDGE_TRIGGERED) &&
+	    !(event_base_get_features(bufev->ev_base) & EV_FEATURE_ET))
+		bufev_p->options &= ~BEV_OPT_EDGE_TRIGGERED;
+
+	be_socket_assign(bufev, fd);
 
 	evbuffer_add_cb(bufev->output, bufferevent_socket_outbuf_cb, bufev);
 
@@ -385,15 +483,14 @@ bufferevent_socket_connect(struct bufferevent *bev,
 		if (r < 0)
 			goto freesock;
 	}
-#ifdef WIN32
-	/* ConnectEx() isn't always around, even when IOCP is enabled.
-	 * Here, we borrow the socket object's write handler to fall back
-	 * on a non-blocking connect() when ConnectEx() is unavailable. */
-	if (BEV_IS_ASYNC(bev)) {
+	/* ConnectEx() isn't always around, even when IOCP is enabled, and
+	 * io_uring bufferevents don't connect with io_uring at all.  Here,
+	 * we borrow the socket object's write handler to fall back on a
+	 * non-blocking connect(). */
+	if (BEV_IS_ASYNC(bev) || BEV_IS_URING(bev)) {
 		event_assign(&bev->ev_write, bev->ev_base, fd,
 		    EV_WRITE|EV_PERSIST, bufferevent_writecb, bev);
 	}
-#endif
 	bufferevent_setfd(bev, fd);
 	if (r == 0) {
 		if (! be_socket_enable(bev, EV_WRITE)) {
@@ -540,13 +637,22 @@ bufferevent_new(evutil_socket_t fd,
 static int
 be_socket_enable(struct bufferevent *bufev, short event)
 {
+	struct bufferevent_private *bufev_p =
+	    EVUTIL_UPCAST(bufev, struct bufferevent_private, bev);
 	if (event & EV_READ) {
 		if (be_socket_add(&bufev->ev_read,&bufev->timeout_read) == -1)
 			return -1;
+		/* An edge-triggered socket that we stopped reading early
+		 * won't get another edge for the data it already has. */
+		if (bufev_p->et_read_ready && (bufev->enabled & EV_READ))
+			event_active(&bufev->ev_read, EV_READ, 1);
 	}
 	if (event & EV_WRITE) {
 		if (be_socket_add(&bufev->ev_write,&bufev->timeout_write) == -1)
 			return -1;
+		if (bufev_p->et_write_ready && (bufev->enabled & EV_WRITE) &&
+		    evbuffer_get_length(bufev->output))
+			event_active(&bufev->ev_write, EV_WRITE, 1);
 	}
 	return 0;
 }
@@ -557,13 +663,24 @@ be_socket_disable(struct bufferevent *bufev, short event)
 	struct bufferevent_private *bufev_p =
 	    EVUTIL_UPCAST(bufev, struct bufferevent_private, bev);
 	if (event & EV_READ) {
-		if (event_del(&bufev->ev_read) == -1)
-			return -1;
+		/* If reading is only suspended, an edge-triggered bufferevent
+		 * leaves its event registered (bufferevent_readcb ignores it
+		 * meanwhile), so that a watermark crossing costs no changes
+		 * to the backend. */
+		if (!BEV_IS_ET(bufev_p) || !(bufev->enabled & EV_READ)) {
+			if (event_del(&bufev->ev_read) == -1)
+				return -1;
+			/* We may miss edges while the event is gone. */
+			if (BEV_IS_ET(bufev_p))
+				bufev_p->et_read_ready = 1;
+		}
 	}
 	/* Don't actually disable the write if we are trying to connect. */
 	if ((event & EV_WRITE) && ! bufev_p->connecting) {
 		if (event_del(&bufev->ev_write) == -1)
 			return -1;
+		if (BEV_IS_ET(bufev_p))
+			bufev_p->et_write_ready = 1;
 	}
 	return 0;
 }
@@ -616,10 +733,7 @@ be_socket_setfd(struct bufferevent *bufev, evutil_socket_t fd)
 	event_del(&bufev->ev_read);
 	event_del(&bufev->ev_write);
 
-	event_assign(&bufev->ev_read, bufev->ev_base, fd,
-	    EV_READ|EV_PERSIST, bufferevent_readcb, bufev);
-	event_assign(&bufev->ev_write, bufev->ev_base, fd,
-	    EV_WRITE|EV_PERSIST, bufferevent_writecb, bufev);
+	be_socket_assign(bufev, fd);
 
 	if (fd >= 0)
 		bufferevent_enable(bufev, bufev->enabled);
@@ -665,6 +779,8 @@ bufferevent_base_set(struct event_base *base, struct bufferevent *bufev)
 		goto done;
 
 	res = event_base_set(base, &bufev->ev_write);
+	if (res == 0)
+		event_base_busy_poll_socket(base, event_get_fd(&bufev->ev_read));
 done:
 	BEV_UNLOCK(bufev);
 	return res;
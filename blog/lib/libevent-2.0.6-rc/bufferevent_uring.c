@@ -0,0 +1,649 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "event2/event-config.h"
+
+#ifdef _EVENT_HAVE_LINUX_IO_URING_H
+
+#include <sys/types.h>
+#ifdef _EVENT_HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _EVENT_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "event2/util.h"
+#include "event2/bufferevent.h"
+#include "event2/buffer.h"
+#include "event2/buffer_compat.h"
+#include "event2/bufferevent_struct.h"
+#include "event2/event.h"
+#include "log-internal.h"
+#include "mm-internal.h"
+#include "bufferevent-internal.h"
+#include "evbuffer-internal.h"
+#include "util-internal.h"
+#include "iouring-internal.h"
+
+/*
+  A bufferevent that hands its reads and writes to the kernel as io_uring
+  requests, the way bufferevent_async hands them to an IOCP port.  Instead
+  of waiting for the socket to be readable and then calling recv(), we
+  queue a recvmsg() straight into the free space at the end of the input
+  buffer; instead of waiting for it to be writable and then calling send(),
+  we queue a sendmsg() straight out of the chains at the front of the
+  output buffer.  The requests go out with the backend's next batch, so a
+  busy connection costs no system calls of its own.
+
+  The kernel owns those chains until the request completes, so we pin them
+  with EVBUFFER_MEM_PINNED_R or _W, and freeze the end of the input buffer
+  or the start of the output buffer, just as buffer_iocp.c does.  Each
+  request in flight also holds a reference to the bufferevent.
+ */
+
+/* Most iovecs we hand to one sendmsg(). */
+#define URING_MAX_WRITE_IOVECS 16
+/* How much we read at a time when there is no high-water mark. */
+#define URING_READ_SIZE 16384
+
+/* prototypes */
+static int be_uring_enable(struct bufferevent *, short);
+static int be_uring_disable(struct bufferevent *, short);
+static void be_uring_destruct(struct bufferevent *);
+static int be_uring_flush(struct bufferevent *, short, enum bufferevent_flush_mode);
+static int be_uring_ctrl(struct bufferevent *, enum bufferevent_ctrl_op, union bufferevent_ctrl_data *);
+
+struct bufferevent_uring {
+	struct bufferevent_private bev;
+	evutil_socket_t fd;
+
+	struct event_uring_op read_op;
+	struct msghdr read_msg;
+	struct iovec read_iov[2];
+	/** The first chain pinned for the read, and how many are pinned. */
+	struct evbuffer_chain *read_pinned;
+	int n_read_pinned;
+
+	struct event_uring_op write_op;
+	struct msghdr write_msg;
+	struct iovec write_iov[URING_MAX_WRITE_IOVECS];
+	/** The first chain pinned for the write, and how many are pinned. */
+	struct evbuffer_chain *write_pinned;
+	int n_write_pinned;
+
+	/** Runs from the loop after we're enabled, to start reading or
+	 * writing. */
+	struct deferred_cb enable_cb;
+
+	unsigned read_in_progress : 1;
+	unsigned write_in_progress : 1;
+	/** True if we've asked the kernel to cancel the read. */
+	unsigned read_canceling : 1;
+	unsigned write_canceling : 1;
+	unsigned ok : 1;
+};
+
+const struct bufferevent_ops bufferevent_ops_uring = {
+	"socket_uring",
+	evutil_offsetof(struct bufferevent_uring, bev.bev),
+	be_uring_enable,
+	be_uring_disable,
+	be_uring_destruct,
+	_bufferevent_generic_adj_timeouts,
+	be_uring_flush,
+	be_uring_ctrl,
+};
+
+static inline struct bufferevent_uring *
+upcast(struct bufferevent *bev)
+{
+	struct bufferevent_uring *bev_u;
+	if (bev->be_ops != &bufferevent_ops_uring)
+		return NULL;
+	bev_u = EVUTIL_UPCAST(bev, struct bufferevent_uring, bev.bev);
+	return bev_u;
+}
+
+/** Unpin 'n' chains starting at 'chain'.  Unpinning a chain that was
+ * drained while pinned frees it, so we look at its successor first. */
+static void
+pin_release(struct evbuffer_chain *chain, int n, unsigned flag)
+{
+	struct evbuffer_chain *next;
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		EVUTIL_ASSERT(chain);
+		next = chain->next;
+		_evbuffer_chain_unpin(chain, flag);
+		chain = next;
+	}
+}
+
+static int
+bev_uring_launch_read(struct bufferevent_uring *b, size_t at_most)
+{
+	struct bufferevent *bev = &b->bev.bev;
+	struct evbuffer *buf = bev->input;
+	struct evbuffer_chain *chain, **chainp;
+	struct evbuffer_iovec vecs[2];
+	int i, nvecs, r = -1;
+
+	EVBUFFER_LOCK(buf);
+	if (buf->freeze_end)
+		goto done;
+	if (_evbuffer_expand_fast(buf, at_most, 2) == -1)
+		goto done;
+	evbuffer_freeze(buf, 0);
+
+	nvecs = _evbuffer_read_setup_vecs(buf, at_most, vecs, 2, &chainp, 1);
+	chain = b->read_pinned = *chainp;
+	for (i = 0; i < nvecs; ++i) {
+		EVUTIL_ASSERT(chain);
+		_evbuffer_chain_pin(chain, EVBUFFER_MEM_PINNED_R);
+		b->read_iov[i].iov_base = vecs[i].iov_base;
+		b->read_iov[i].iov_len = vecs[i].iov_len;
+		chain = chain->next;
+	}
+	b->n_read_pinned = nvecs;
+
+	memset(&b->read_msg, 0, sizeof(b->read_msg));
+	b->read_msg.msg_iov = b->read_iov;
+	b->read_msg.msg_iovlen = nvecs;
+
+	bufferevent_incref(bev);
+	if (event_uring_recvmsg(bev->ev_base, b->fd, &b->read_msg,
+		&b->read_op) < 0) {
+		pin_release(b->read_pinned, nvecs, EVBUFFER_MEM_PINNED_R);
+		evbuffer_unfreeze(buf, 0);
+		bufferevent_decref(bev);
+		goto done;
+	}
+	b->read_in_progress = 1;
+	r = 0;
+done:
+	EVBUFFER_UNLOCK(buf);
+	return r;
+}
+
+/* Put the 'nbytes' the kernel read for us into the input buffer. */
+static void
+bev_uring_commit_read(struct bufferevent_uring *b, size_t nbytes)
+{
+	struct evbuffer *buf = b->bev.bev.input;
+	struct evbuffer_iovec iov[2];
+	int n_vec;
+
+	EVBUFFER_LOCK(buf);
+	evbuffer_unfreeze(buf, 0);
+
+	iov[0].iov_base = b->read_iov[0].iov_base;
+	if (nbytes <= b->read_iov[0].iov_len) {
+		iov[0].iov_len = nbytes;
+		n_vec = 1;
+	} else {
+		iov[0].iov_len = b->read_iov[0].iov_len;
+		iov[1].iov_base = b->read_iov[1].iov_base;
+		iov[1].iov_len = nbytes - iov[0].iov_len;
+		n_vec = 2;
+	}
+	if (evbuffer_commit_space(buf, iov, n_vec) < 0)
+		EVUTIL_ASSERT(0);
+
+	pin_release(b->read_pinned, b->n_read_pinned, EVBUFFER_MEM_PINNED_R);
+	b->read_pinned = NULL;
+	b->n_read_pinned = 0;
+	EVBUFFER_UNLOCK(buf);
+}
+
+static int
+bev_uring_launch_write(struct bufferevent_uring *b, size_t at_most)
+{
+	struct bufferevent *bev = &b->bev.bev;
+	struct evbuffer *buf = bev->output;
+	struct evbuffer_chain *chain;
+	int i, r = -1;
+
+	EVBUFFER_LOCK(buf);
+	if (buf->freeze_start)
+		goto done;
+	if (at_most > buf->total_len)
+		at_most = buf->total_len;
+	evbuffer_freeze(buf, 1);
+
+	chain = b->write_pinned = buf->first;
+	for (i = 0; i < URING_MAX_WRITE_IOVECS && chain && at_most;
+	     ++i, chain = chain->next) {
+		struct iovec *iov = &b->write_iov[i];
+		_evbuffer_chain_pin(chain, EVBUFFER_MEM_PINNED_W);
+		iov->iov_base = chain->buffer + chain->misalign;
+		iov->iov_len = chain->off < at_most ? chain->off : at_most;
+		at_most -= iov->iov_len;
+	}
+	b->n_write_pinned = i;
+
+	memset(&b->write_msg, 0, sizeof(b->write_msg));
+	b->write_msg.msg_iov = b->write_iov;
+	b->write_msg.msg_iovlen = i;
+
+	bufferevent_incref(bev);
+	if (event_uring_sendmsg(bev->ev_base, b->fd, &b->write_msg,
+		&b->write_op) < 0) {
+		pin_release(b->write_pinned, i, EVBUFFER_MEM_PINNED_W);
+		evbuffer_unfreeze(buf, 1);
+		bufferevent_decref(bev);
+		goto done;
+	}
+	b->write_in_progress = 1;
+	r = 0;
+done:
+	EVBUFFER_UNLOCK(buf);
+	return r;
+}
+
+/* Take the 'nbytes' the kernel sent for us out of the output buffer. */
+static void
+bev_uring_commit_write(struct bufferevent_uring *b, size_t nbytes)
+{
+	struct evbuffer *buf = b->bev.bev.output;
+
+	EVBUFFER_LOCK(buf);
+	evbuffer_unfreeze(buf, 1);
+	evbuffer_drain(buf, nbytes);
+	pin_release(b->write_pinned, b->n_write_pinned,
+	    EVBUFFER_MEM_PINNED_W);
+	b->write_pinned = NULL;
+	b->n_write_pinned = 0;
+	EVBUFFER_UNLOCK(buf);
+}
+
+static void
+bev_uring_consider_writing(struct bufferevent_uring *b)
+{
+	struct bufferevent *bev = &b->bev.bev;
+	size_t at_most;
+	int limit;
+
+	/* Don't write if there's a write in progress, or we do not
+	 * want to write. */
+	if (!b->ok || b->write_in_progress || !(bev->enabled&EV_WRITE))
+		return;
+	/* Don't write if there's nothing to write */
+	if (!(at_most = evbuffer_get_length(bev->output)))
+		return;
+
+	limit = _bufferevent_get_write_max(&b->bev);
+	if (at_most >= (size_t)limit)
+		at_most = limit;
+
+	if (b->bev.write_suspended || !at_most)
+		return;
+
+	if (bev_uring_launch_write(b, at_most) < 0) {
+		bufferevent_disable(bev, EV_WRITE);
+		_bufferevent_run_eventcb(bev,
+		    BEV_EVENT_WRITING|BEV_EVENT_ERROR);
+		return;
+	}
+	/* The write timeout runs while we have something to write. */
+	BEV_RESET_GENERIC_WRITE_TIMEOUT(bev);
+}
+
+static void
+bev_uring_consider_reading(struct bufferevent_uring *b)
+{
+	struct bufferevent *bev = &b->bev.bev;
+	size_t cur_size;
+	size_t read_high;
+	size_t at_most;
+	int limit;
+
+	/* Don't read if there is a read in progress, or we do not
+	 * want to read. */
+	if (!b->ok || b->read_in_progress || !(bev->enabled&EV_READ))
+		return;
+
+	/* Don't read if we're full */
+	cur_size = evbuffer_get_length(bev->input);
+	read_high = bev->wm_read.high;
+	if (read_high) {
+		if (cur_size >= read_high)
+			return;
+		at_most = read_high - cur_size;
+	} else {
+		at_most = URING_READ_SIZE;
+	}
+
+	limit = _bufferevent_get_read_max(&b->bev);
+	if (at_most >= (size_t)limit)
+		at_most = limit;
+
+	/* A read of nothing would look like EOF. */
+	if (b->bev.read_suspended || !at_most)
+		return;
+
+	if (bev_uring_launch_read(b, at_most) < 0) {
+		bufferevent_disable(bev, EV_READ);
+		_bufferevent_run_eventcb(bev,
+		    BEV_EVENT_READING|BEV_EVENT_ERROR);
+	}
+}
+
+static void
+read_complete(struct deferred_cb *cb, void *arg)
+{
+	struct bufferevent_uring *b = arg;
+	struct bufferevent *bev = &b->bev.bev;
+	int res = b->read_op.res;
+	short what = BEV_EVENT_READING;
+
+	BEV_LOCK(bev);
+	EVUTIL_ASSERT(b->read_in_progress);
+
+	bev_uring_commit_read(b, res > 0 ? res : 0);
+	b->read_in_progress = 0;
+	b->read_canceling = 0;
+
+	if (res > 0) {
+		BEV_RESET_GENERIC_READ_TIMEOUT(bev);
+		_bufferevent_decrement_read_buckets(&b->bev, res);
+		if (evbuffer_get_length(bev->input) >= bev->wm_read.low)
+			_bufferevent_run_readcb(bev);
+		bev_uring_consider_reading(b);
+	} else if (res == -ECANCELED || res == -EAGAIN || res == -EINTR) {
+		/* We asked for this, or the kernel gave up early: just try
+		 * again if we still want to read. */
+		bev_uring_consider_reading(b);
+	} else {
+		if (res == 0) {
+			what |= BEV_EVENT_EOF;
+		} else {
+			what |= BEV_EVENT_ERROR;
+			EVUTIL_SET_SOCKET_ERROR(-res);
+		}
+		bufferevent_disable(bev, EV_READ);
+		_bufferevent_run_eventcb(bev, what);
+	}
+
+	/* Drop the reference the read held. */
+	_bufferevent_decref_and_unlock(bev);
+}
+
+static void
+write_complete(struct deferred_cb *cb, void *arg)
+{
+	struct bufferevent_uring *b = arg;
+	struct bufferevent *bev = &b->bev.bev;
+	int res = b->write_op.res;
+	short what = BEV_EVENT_WRITING;
+
+	BEV_LOCK(bev);
+	EVUTIL_ASSERT(b->write_in_progress);
+
+	bev_uring_commit_write(b, res > 0 ? res : 0);
+	b->write_in_progress = 0;
+	b->write_canceling = 0;
+
+	if (res > 0) {
+		_bufferevent_decrement_write_buckets(&b->bev, res);
+		if (evbuffer_get_length(bev->output) == 0)
+			BEV_DEL_GENERIC_WRITE_TIMEOUT(bev);
+		if (evbuffer_get_length(bev->output) <= bev->wm_write.low)
+			_bufferevent_run_writecb(bev);
+		bev_uring_consider_writing(b);
+	} else if (res == -ECANCELED || res == -EAGAIN || res == -EINTR) {
+		bev_uring_consider_writing(b);
+	} else {
+		/* As in bufferevent_sock, a 0 from a write is taken to mean
+		 * EOF, though an ECONNRESET is more likely. */
+		if (res == 0) {
+			what |= BEV_EVENT_EOF;
+		} else {
+			what |= BEV_EVENT_ERROR;
+			EVUTIL_SET_SOCKET_ERROR(-res);
+		}
+		bufferevent_disable(bev, EV_WRITE);
+		_bufferevent_run_eventcb(bev, what);
+	}
+
+	/* Drop the reference the write held. */
+	_bufferevent_decref_and_unlock(bev);
+}
+
+static void
+be_uring_outbuf_callback(struct evbuffer *buf,
+    const struct evbuffer_cb_info *cbinfo,
+    void *arg)
+{
+	struct bufferevent *bev = arg;
+	struct bufferevent_uring *bev_u = upcast(bev);
+
+	/* If we added data to the outbuf and were not writing before,
+	 * we may want to write now. */
+
+	_bufferevent_incref_and_lock(bev);
+
+	if (cbinfo->n_added)
+		bev_uring_consider_writing(bev_u);
+
+	_bufferevent_decref_and_unlock(bev);
+}
+
+static void
+be_uring_inbuf_callback(struct evbuffer *buf,
+    const struct evbuffer_cb_info *cbinfo,
+    void *arg)
+{
+	struct bufferevent *bev = arg;
+	struct bufferevent_uring *bev_u = upcast(bev);
+
+	/* If we drained data from the inbuf and were not reading before,
+	 * we may want to read now */
+
+	_bufferevent_incref_and_lock(bev);
+
+	if (cbinfo->n_deleted)
+		bev_uring_consider_reading(bev_u);
+
+	_bufferevent_decref_and_unlock(bev);
+}
+
+static void
+enable_complete(struct deferred_cb *cb, void *arg)
+{
+	struct bufferevent_uring *b = arg;
+	struct bufferevent *bev = &b->bev.bev;
+
+	BEV_LOCK(bev);
+	bev_uring_consider_reading(b);
+	bev_uring_consider_writing(b);
+	/* Drop the reference we took when we scheduled this. */
+	_bufferevent_decref_and_unlock(bev);
+}
+
+static int
+be_uring_enable(struct bufferevent *buf, short what)
+{
+	struct bufferevent_uring *bev_u = upcast(buf);
+
+	/* Until we're connected, just remember what to do once we are;
+	 * bufferevent_uring_set_connected() calls us again. */
+	if (!bev_u->ok)
+		return 0;
+
+	if (what & EV_READ)
+		BEV_RESET_GENERIC_READ_TIMEOUT(buf);
+
+	/* Once we queue a read, its size is fixed.  Wait until the loop
+	 * runs, so that a watermark set right after enabling the
+	 * bufferevent still applies to the first read.  The request would
+	 * not go out any sooner anyway. */
+	if (!event_deferred_cb_is_pending(&bev_u->enable_cb)) {
+		bufferevent_incref(buf);
+		event_deferred_cb_schedule(
+		    event_base_get_deferred_cb_queue(buf->ev_base),
+		    &bev_u->enable_cb);
+	}
+	return 0;
+}
+
+static int
+be_uring_disable(struct bufferevent *bev, short what)
+{
+	struct bufferevent_uring *bev_u = upcast(bev);
+
+	if (what & EV_READ)
+		BEV_DEL_GENERIC_READ_TIMEOUT(bev);
+	/* While we connect, ev_write is waiting for the connect to finish;
+	 * leave it be. */
+	if ((what & EV_WRITE) && !bev_u->bev.connecting)
+		BEV_DEL_GENERIC_WRITE_TIMEOUT(bev);
+
+	/* A read we have queued would otherwise go on taking data off the
+	 * socket.  A queued write is left alone: it only sends what was
+	 * already in the output buffer when we queued it. */
+	if ((what & EV_READ) && bev_u->read_in_progress &&
+	    !bev_u->read_canceling) {
+		if (event_uring_cancel(bev->ev_base, &bev_u->read_op) == 0)
+			bev_u->read_canceling = 1;
+	}
+
+	return 0;
+}
+
+static void
+be_uring_destruct(struct bufferevent *bev)
+{
+	struct bufferevent_private *bev_p = BEV_UPCAST(bev);
+	struct bufferevent_uring *bev_u = upcast(bev);
+
+	EVUTIL_ASSERT(!bev_u->write_in_progress && !bev_u->read_in_progress);
+
+	if ((bev_p->options & BEV_OPT_CLOSE_ON_FREE) && bev_u->fd >= 0)
+		evutil_closesocket(bev_u->fd);
+	/* This also deletes ev_write in case non-blocking connect was
+	 * used. */
+	_bufferevent_del_generic_timeout_cbs(bev);
+}
+
+static int
+be_uring_flush(struct bufferevent *bev, short what,
+    enum bufferevent_flush_mode mode)
+{
+	return 0;
+}
+
+struct bufferevent *
+bufferevent_uring_new(struct event_base *base,
+    evutil_socket_t fd, int options)
+{
+	struct bufferevent_uring *bev_u;
+	struct bufferevent *bev;
+
+	if (!event_base_uses_uring_bufferevents(base))
+		return NULL;
+
+	if (!(bev_u = event_base_alloc_obj(base,
+	    sizeof(struct bufferevent_uring))))
+		return NULL;
+
+	if (bufferevent_init_common(&bev_u->bev, base, &bufferevent_ops_uring,
+		options)<0) {
+		evslab_free(bev_u);
+		return NULL;
+	}
+	bev = &bev_u->bev.bev;
+
+	evbuffer_add_cb(bev->input, be_uring_inbuf_callback, bev);
+	evbuffer_add_cb(bev->output, be_uring_outbuf_callback, bev);
+	evbuffer_defer_callbacks(bev->input, base);
+	evbuffer_defer_callbacks(bev->output, base);
+
+	event_uring_op_init(&bev_u->read_op, read_complete, bev_u);
+	event_uring_op_init(&bev_u->write_op, write_complete, bev_u);
+	event_deferred_cb_init(&bev_u->enable_cb, enable_complete, bev_u);
+
+	bev_u->fd = fd;
+	bev_u->ok = fd >= 0;
+	_bufferevent_init_generic_timeout_cbs(bev);
+
+	return bev;
+}
+
+void
+bufferevent_uring_set_connected(struct bufferevent *bev)
+{
+	struct bufferevent_uring *bev_u = upcast(bev);
+	bev_u->ok = 1;
+	_bufferevent_init_generic_timeout_cbs(bev);
+	/* Now's a good time to consider reading/writing */
+	be_uring_enable(bev, bev->enabled);
+}
+
+static int
+be_uring_ctrl(struct bufferevent *bev, enum bufferevent_ctrl_op op,
+    union bufferevent_ctrl_data *data)
+{
+	struct bufferevent_uring *bev_u = upcast(bev);
+
+	switch (op) {
+	case BEV_CTRL_GET_FD:
+		data->fd = bev_u->fd;
+		return 0;
+	case BEV_CTRL_SET_FD:
+		/* A queued read or write still refers to the old fd. */
+		if (bev_u->read_in_progress || bev_u->write_in_progress)
+			return -1;
+		bev_u->fd = data->fd;
+		bev_u->ok = data->fd >= 0;
+		/* Start whatever was enabled while we had no fd. */
+		if (bev_u->ok)
+			be_uring_enable(bev, bev->enabled);
+		return 0;
+	case BEV_CTRL_CANCEL_ALL:
+		/* Don't start anything new once these finish. */
+		bev_u->ok = 0;
+		if (bev_u->read_in_progress && !bev_u->read_canceling &&
+		    event_uring_cancel(bev->ev_base, &bev_u->read_op) == 0)
+			bev_u->read_canceling = 1;
+		if (bev_u->write_in_progress && !bev_u->write_canceling &&
+		    event_uring_cancel(bev->ev_base, &bev_u->write_op) == 0)
+			bev_u->write_canceling = 1;
+		return 0;
+	case BEV_CTRL_GET_UNDERLYING:
+	default:
+		return -1;
+	}
+}
+
+#endif /* _EVENT_HAVE_LINUX_IO_URING_H */
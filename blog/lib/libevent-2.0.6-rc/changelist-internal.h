@@ -77,9 +77,27 @@ struct event_change {
 /* Set for adding edge-triggered events. */
 #define EV_CHANGE_ET      EV_ET
 
+/** Per-fd structure for use with changelists.  It keeps track, for each fd or
+ * signal using the changelist, of where its entry in the changelist is.
+ */
+struct event_changelist_fdinfo {
+	int idxplus1; /* this is the index +1, so that memset(0) will make it
+		       * a no-such-element */
+	/* For backends that keep track of it: the events (EV_READ, EV_WRITE
+	 * and EV_ET) that the kernel is watching for on this fd, or 0. */
+	ev_uint8_t kernel_events;
+	/* True if every event on the fd has been deleted since the
+	 * changelist was last applied.  The fd may have been closed, and
+	 * its number reused, since then. */
+	ev_uint8_t emptied;
+	/* For io_uring: bumped whenever we replace the fd's poll request, so
+	 * that we can tell its completions from those of the old one. */
+	ev_uint16_t generation;
+};
+
 /* The value of fdinfo_size that a backend should use if it is letting
  * changelist handle its add and delete functions. */
-#define EVENT_CHANGELIST_FDINFO_SIZE sizeof(int)
+#define EVENT_CHANGELIST_FDINFO_SIZE sizeof(struct event_changelist_fdinfo)
 
 /** Set up the data fields in a changelist. */
 void event_changelist_init(struct event_changelist *changelist);
@@ -88,6 +106,14 @@ void event_changelist_init(struct event_changelist *changelist);
  * after making all the changes in the changelist. */
 void event_changelist_remove_all(struct event_changelist *changelist,
     struct event_base *base);
+/** Return the fdinfo for the fd or signal that 'change' is about. */
+struct event_changelist_fdinfo *event_change_get_fdinfo(
+    struct event_base *base, const struct event_change *change);
+/** Return the events (EV_READ, EV_WRITE and EV_ET) that should be enabled
+ * on an fd once 'change' has been made to it, given that the kernel is
+ * watching for 'kernel_events' now. */
+int event_change_get_events(const struct event_change *change,
+    int kernel_events);
 /** Free all memory held in a changelist. */
 void event_changelist_freemem(struct event_changelist *changelist);
 
@@ -32,6 +32,14 @@ extern "C" {
 
 #include "event2/event-config.h"
 #include <sys/queue.h>
+#include "mpsc-internal.h"
+
+/* If we can, events and deferred callbacks that other threads activate
+ * go through a lock-free inbox that the loop drains, instead of taking
+ * the base's lock. */
+#if defined(EVMPSC_LOCKFREE) && !defined(_EVENT_DISABLE_THREAD_SUPPORT)
+#define EVENT_USE_INBOX 1
+#endif
 
 struct deferred_cb;
 
@@ -48,6 +56,12 @@ struct deferred_cb {
 	deferred_cb_fn cb;
 	/** The function's second argument. */
 	void *arg;
+#ifdef EVENT_USE_INBOX
+	/** Links to the next deferred_cb in the queue's inbox. */
+	struct evmpsc_node inbox_node;
+	/** True iff this deferred_cb is in its queue's inbox. */
+	int inbox_queued;
+#endif
 };
 
 /** A deferred_cb_queue is a list of deferred_cb that we can add to and run. */
@@ -65,6 +79,12 @@ struct deferred_cb_queue {
 	/** Deferred callback management: a list of deferred callbacks to
 	 * run active the active events. */
 	TAILQ_HEAD (deferred_cb_list, deferred_cb) deferred_cb_list;
+
+#ifdef EVENT_USE_INBOX
+	/** Deferred callbacks scheduled from other threads, waiting for the
+	 * loop to move them onto deferred_cb_list. */
+	struct evmpsc_queue inbox;
+#endif
 };
 
 /**
@@ -83,6 +103,18 @@ void event_deferred_cb_cancel(struct deferred_cb_queue *, struct deferred_cb *);
    Activate a deferred_cb if it is not currently scheduled in an event_base.
  */
 void event_deferred_cb_schedule(struct deferred_cb_queue *, struct deferred_cb *);
+/**
+   True iff a deferred_cb is scheduled and has not run yet: either on its
+   queue, or still in the queue's inbox after a schedule from another
+   thread.  Callers that take a reference for each schedule must test
+   this, not 'queued'.
+ */
+#ifdef EVENT_USE_INBOX
+#define event_deferred_cb_is_pending(cb)				\
+	((cb)->queued || EVMPSC_LOAD(&(cb)->inbox_queued))
+#else
+#define event_deferred_cb_is_pending(cb) ((cb)->queued)
+#endif
 
 #ifdef _EVENT_DISABLE_THREAD_SUPPORT
 #define LOCK_DEFERRED_QUEUE(q) (void)0
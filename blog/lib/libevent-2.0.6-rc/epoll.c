@@ -34,6 +34,9 @@
 #endif
 #include <sys/queue.h>
 #include <sys/epoll.h>
+#ifdef _EVENT_HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
 #include <signal.h>
 #include <limits.h>
 #include <stdio.h>
@@ -56,7 +59,13 @@
 struct epollop {
 	struct epoll_event *events;
 	int nevents;
+	int max_nevents;
 	int epfd;
+	/* With EVENT_BASE_FLAG_PRECISE_TIMER, a timerfd in epfd that we arm
+	 * with each timeout in place of epoll_wait()'s own; otherwise -1. */
+	int timerfd;
+	/* True if we have armed timerfd since we last disarmed it. */
+	int timerfd_armed;
 };
 
 static void *epoll_init(struct event_base *);
@@ -114,8 +123,38 @@ epoll_init(struct event_base *base)
 		return (NULL);
 	}
 	epollop->nevents = INITIAL_NEVENT;
+	epollop->max_nevents = base->max_dispatch_events ?
+	    base->max_dispatch_events : MAX_NEVENT;
+	if (epollop->max_nevents < INITIAL_NEVENT)
+		epollop->nevents = epollop->max_nevents;
+	base->dispatch_stats.nevents = epollop->nevents;
+	base->dispatch_stats.max_nevents = epollop->max_nevents;
+
+	epollop->timerfd = -1;
+#ifdef _EVENT_HAVE_SYS_TIMERFD_H
+	if (base->flags & EVENT_BASE_FLAG_PRECISE_TIMER) {
+		int fd = timerfd_create(CLOCK_MONOTONIC,
+		    TFD_NONBLOCK|TFD_CLOEXEC);
+		if (fd >= 0) {
+			struct epoll_event epev;
+			memset(&epev, 0, sizeof(epev));
+			epev.data.fd = fd;
+			epev.events = EPOLLIN;
+			if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &epev) == 0) {
+				epollop->timerfd = fd;
+			} else {
+				event_warn("epoll_ctl(timerfd)");
+				close(fd);
+			}
+		} else {
+			event_warn("timerfd_create");
+		}
+	}
+#endif
 
-	evsig_init(base);
+	if (!(base->flags & EVENT_BASE_FLAG_SIGNALFD) ||
+	    evsigfd_init(base) < 0)
+		evsig_init(base);
 
 	return (epollop);
 }
@@ -144,6 +183,86 @@ epoll_op_to_string(int op)
 	    "???";
 }
 
+/* Helper: tell the kernel to watch for 'events' (EV_READ, EV_WRITE and
+ * EV_ET) on 'fd'. */
+static int
+epoll_ctl_events(struct event_base *base, int op, evutil_socket_t fd,
+    int events)
+{
+	struct epollop *epollop = base->evbase;
+	struct epoll_event epev;
+
+	memset(&epev, 0, sizeof(epev));
+	epev.data.fd = fd;
+	if (events & EV_READ)
+		epev.events |= EPOLLIN;
+	if (events & EV_WRITE)
+		epev.events |= EPOLLOUT;
+	if (events & EV_ET)
+		epev.events |= EPOLLET;
+	++base->dispatch_stats.n_change_syscalls;
+	return epoll_ctl(epollop->epfd, op, fd, &epev);
+}
+
+/* Apply one change when EVENT_BASE_FLAG_EPOLL_SKIP_REDUNDANT is set.  The
+ * fdinfo tells us what the kernel is already watching for, so we can leave
+ * out changes that would not alter that, and know whether we need an ADD,
+ * a MOD or a DEL instead of guessing from old_events. */
+static void
+epoll_apply_tracked_change(struct event_base *base, struct event_change *ch)
+{
+	struct event_changelist_fdinfo *fdinfo =
+	    event_change_get_fdinfo(base, ch);
+	int have = fdinfo->kernel_events;
+	int want = event_change_get_events(ch, have);
+	int op, res;
+
+	if (want == 0 && have == 0) {
+		++base->dispatch_stats.n_changes_skipped;
+		return;
+	}
+	if (want == have && !fdinfo->emptied) {
+		++base->dispatch_stats.n_changes_skipped;
+		return;
+	}
+
+	if (want == 0)
+		op = EPOLL_CTL_DEL;
+	else if (have == 0 || want == have)
+		op = EPOLL_CTL_ADD; /* a new fd, or maybe one */
+	else
+		op = EPOLL_CTL_MOD;
+
+	res = epoll_ctl_events(base, op, ch->fd, want ? want : have);
+	if (res == -1) {
+		if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+			/* The fd was closed and reopened. */
+			res = epoll_ctl_events(base, EPOLL_CTL_ADD, ch->fd,
+			    want);
+		} else if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+			/* It was the same fd after all. */
+			res = want == have ? 0 :
+			    epoll_ctl_events(base, EPOLL_CTL_MOD, ch->fd,
+				want);
+		} else if (op == EPOLL_CTL_DEL &&
+		    (errno == ENOENT || errno == EBADF || errno == EPERM)) {
+			/* Closed before we got here; nothing to delete. */
+			res = 0;
+		}
+	}
+
+	if (res == -1) {
+		event_warn("Epoll %s on fd %d failed.  Kernel events were %d; "
+		    "wanted %d",
+		    epoll_op_to_string(op), ch->fd, have, want);
+		/* We don't know what the kernel has; make sure we ask it
+		 * again next time. */
+		fdinfo->kernel_events = 0;
+	} else {
+		fdinfo->kernel_events = want;
+	}
+}
+
 static int
 epoll_apply_changes(struct event_base *base)
 {
@@ -154,6 +273,14 @@ epoll_apply_changes(struct event_base *base)
 	int i;
 	int op, events;
 
+	base->dispatch_stats.n_changes += changelist->n_changes;
+	if (base->flags & EVENT_BASE_FLAG_EPOLL_SKIP_REDUNDANT) {
+		for (i = 0; i < changelist->n_changes; ++i)
+			epoll_apply_tracked_change(base,
+			    &changelist->changes[i]);
+		return (0);
+	}
+
 	for (i = 0; i < changelist->n_changes; ++i) {
 		int precautionary_add = 0;
 		ch = &changelist->changes[i];
@@ -235,18 +362,22 @@ epoll_apply_changes(struct event_base *base)
 			}
 		}
 
-		if (!events)
+		if (!events) {
+			++base->dispatch_stats.n_changes_skipped;
 			continue;
+		}
 
 		memset(&epev, 0, sizeof(epev));
 		epev.data.fd = ch->fd;
 		epev.events = events;
+		++base->dispatch_stats.n_change_syscalls;
 		if (epoll_ctl(epollop->epfd, op, ch->fd, &epev) == -1) {
 			if (op == EPOLL_CTL_MOD && errno == ENOENT) {
 				/* If a MOD operation fails with ENOENT, the
 				 * fd was probably closed and re-opened.  We
 				 * should retry the operation as an ADD.
 				 */
+				++base->dispatch_stats.n_change_syscalls;
 				if (epoll_ctl(epollop->epfd, EPOLL_CTL_ADD, ch->fd, &epev) == -1) {
 					event_warn("Epoll MOD retried as ADD; that failed too");
 				} else {
@@ -289,12 +420,69 @@ epoll_apply_changes(struct event_base *base)
 	return (0);
 }
 
+#ifdef _EVENT_HAVE_SYS_TIMERFD_H
+/* Arm our timerfd to go off after 'tv', or disarm it if 'tv' is NULL.
+ * Arming or disarming it also clears any expiry we haven't seen yet. */
 static int
-epoll_dispatch(struct event_base *base, struct timeval *tv)
+epoll_arm_timerfd(struct epollop *epollop, const struct timeval *tv)
+{
+	struct itimerspec is;
+
+	if (tv == NULL && !epollop->timerfd_armed)
+		return (0);
+
+	memset(&is, 0, sizeof(is));
+	if (tv != NULL) {
+		is.it_value.tv_sec = tv->tv_sec;
+		is.it_value.tv_nsec = tv->tv_usec * 1000;
+	}
+	if (timerfd_settime(epollop->timerfd, 0, &is, NULL) == -1) {
+		event_warn("timerfd_settime");
+		return (-1);
+	}
+	epollop->timerfd_armed = tv != NULL;
+	return (0);
+}
+#endif
+
+/* Activate the events for the first 'n' entries that epoll_wait()
+ * returned, through 'activate': evmap_io_active(), or
+ * evmap_io_active_unlocked() if we don't hold th_base_lock. */
+static void
+epoll_activate(struct event_base *base, int n,
+    void (*activate)(struct event_base *, evutil_socket_t, short))
 {
 	struct epollop *epollop = base->evbase;
 	struct epoll_event *events = epollop->events;
-	int i, res;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		int what = events[i].events;
+		short ev = 0;
+
+		if (what & (EPOLLHUP|EPOLLERR)) {
+			ev = EV_READ | EV_WRITE;
+		} else {
+			if (what & EPOLLIN)
+				ev |= EV_READ;
+			if (what & EPOLLOUT)
+				ev |= EV_WRITE;
+		}
+
+		if (!events)
+			continue;
+		if (events[i].data.fd == epollop->timerfd)
+			continue;
+
+		activate(base, events[i].data.fd, ev | EV_ET);
+	}
+}
+
+static int
+epoll_dispatch(struct event_base *base, struct timeval *tv)
+{
+	struct epollop *epollop = base->evbase;
+	int res, unlocked = EVMAP_IO_ACTIVE_UNLOCKED(base);
 	long timeout = -1;
 
 	if (tv != NULL) {
@@ -306,12 +494,27 @@ epoll_dispatch(struct event_base *base, struct timeval *tv)
 		}
 	}
 
+#ifdef _EVENT_HAVE_SYS_TIMERFD_H
+	/* Let the timerfd wake us at the deadline, rounded to no more
+	 * than a microsecond, and wait on epoll_wait() for as long as it
+	 * takes.  If we can't arm it, fall back to the rounded timeout. */
+	if (epollop->timerfd >= 0 && timeout != 0 &&
+	    epoll_arm_timerfd(epollop, tv) == 0)
+		timeout = -1;
+#endif
+
 	epoll_apply_changes(base);
 	event_changelist_remove_all(&base->changelist, base);
 
 	EVBASE_RELEASE_LOCK(base, th_base_lock);
 
-	res = epoll_wait(epollop->epfd, events, epollop->nevents, timeout);
+	res = epoll_wait(epollop->epfd, epollop->events, epollop->nevents,
+	    timeout);
+
+	/* Find the ready events before taking the lock back, so that
+	 * threads adding and deleting events don't wait on us meanwhile. */
+	if (unlocked && res > 0)
+		epoll_activate(base, res, evmap_io_active_unlocked);
 
 	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
 
@@ -329,37 +532,28 @@ epoll_dispatch(struct event_base *base, struct timeval *tv)
 
 	event_debug(("%s: epoll_wait reports %d", __func__, res));
 	EVUTIL_ASSERT(res <= epollop->nevents);
+	base->dispatch_stats.n_ready += res;
 
-	for (i = 0; i < res; i++) {
-		int what = events[i].events;
-		short ev = 0;
-
-		if (what & (EPOLLHUP|EPOLLERR)) {
-			ev = EV_READ | EV_WRITE;
-		} else {
-			if (what & EPOLLIN)
-				ev |= EV_READ;
-			if (what & EPOLLOUT)
-				ev |= EV_WRITE;
-		}
-
-		if (!events)
-			continue;
-
-		evmap_io_active(base, events[i].data.fd, ev | EV_ET);
-	}
+	if (!unlocked)
+		epoll_activate(base, res, evmap_io_active);
 
-	if (res == epollop->nevents && epollop->nevents < MAX_NEVENT) {
+	if (res == epollop->nevents)
+		++base->dispatch_stats.n_full;
+	if (res == epollop->nevents &&
+	    epollop->nevents < epollop->max_nevents) {
 		/* We used all of the event space this time.  We should
 		   be ready for more events next time. */
 		int new_nevents = epollop->nevents * 2;
 		struct epoll_event *new_events;
 
+		if (new_nevents > epollop->max_nevents)
+			new_nevents = epollop->max_nevents;
 		new_events = mm_realloc(epollop->events,
 		    new_nevents * sizeof(struct epoll_event));
 		if (new_events) {
 			epollop->events = new_events;
 			epollop->nevents = new_nevents;
+			base->dispatch_stats.nevents = new_nevents;
 		}
 	}
 
@@ -377,6 +571,8 @@ epoll_dealloc(struct event_base *base)
 		mm_free(epollop->events);
 	if (epollop->epfd >= 0)
 		close(epollop->epfd);
+	if (epollop->timerfd >= 0)
+		close(epollop->timerfd);
 
 	memset(epollop, 0, sizeof(struct epollop));
 	mm_free(epollop);
@@ -55,6 +55,9 @@ extern "C" {
 #define MIN_BUFFER_SIZE	1024
 #endif
 
+/* The most that evbuffer_read() will read from a socket in one call. */
+#define EVBUFFER_MAX_READ	4096
+
 /** A single evbuffer callback for an evbuffer. This function will be invoked
  * when bytes are added to or removed from the evbuffer. */
 struct evbuffer_cb_entry {
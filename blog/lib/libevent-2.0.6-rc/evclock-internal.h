@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _EVCLOCK_INTERNAL_H_
+#define _EVCLOCK_INTERNAL_H_
+
+/*
+  The clock behind an event_base's notion of "now".  Readings are in
+  nanoseconds; event.c turns them into the timevals it keeps its timeouts
+  in.  Apart from EVCLOCK_REALTIME, which is what EVENT_CLOCK_DEFAULT
+  becomes on systems without CLOCK_MONOTONIC, every source is monotonic.
+ */
+
+#include "event2/event-config.h"
+#include "event2/event.h"
+
+/** EVENT_CLOCK_DEFAULT resolves to one of these two. */
+#define EVCLOCK_MONOTONIC 100
+#define EVCLOCK_REALTIME 101
+
+struct evclock {
+	/** An event_clock_source other than EVENT_CLOCK_DEFAULT, or one of
+	 * the EVCLOCK_* values above. */
+	int source;
+	/** For EVENT_CLOCK_EXTERNAL. */
+	ev_uint64_t (*fn)(void *arg);
+	void *arg;
+	/** For EVENT_CLOCK_TSC: the counter and CLOCK_MONOTONIC read at the
+	 * same moment, and nanoseconds per tick, times 2^32. */
+	ev_uint64_t tsc0;
+	ev_uint64_t ns0;
+	ev_uint64_t tsc_mult;
+	/** For EVENT_CLOCK_SIMULATED: the virtual time. */
+	ev_uint64_t sim_ns;
+};
+
+/** Set up 'c' to read 'source', or the default clock if 'source' is not
+ * available here. */
+void evclock_init(struct evclock *c, enum event_clock_source source,
+    ev_uint64_t (*fn)(void *arg), void *arg);
+
+/** Set '*ns' to the current reading of 'c'.  Return 0 on success, -1 on
+ * failure. */
+int evclock_gettime(struct evclock *c, ev_uint64_t *ns);
+
+/** Read the system's monotonic clock (or gettimeofday() if there is
+ * none), whatever the base's clock is. */
+int evclock_gettime_system(ev_uint64_t *ns);
+
+/** Move the time of an EVENT_CLOCK_SIMULATED clock forward by 'ns'. */
+#define evclock_advance(c, ns) ((c)->sim_ns += (ns))
+
+/** Return the event_clock_source that 'c' reads. */
+enum event_clock_source evclock_source(const struct evclock *c);
+
+#define evclock_is_monotonic(c) ((c)->source != EVCLOCK_REALTIME)
+/** True iff 'c' doesn't follow the real time. */
+#define evclock_is_virtual(c)					\
+	((c)->source == EVENT_CLOCK_EXTERNAL ||			\
+	    (c)->source == EVENT_CLOCK_SIMULATED)
+
+#endif /* _EVCLOCK_INTERNAL_H_ */
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "event2/event-config.h"
+
+#ifdef WIN32
+#include <winsock2.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#endif
+#include <sys/types.h>
+#ifdef _EVENT_HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <time.h>
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__SIZEOF_INT128__) && \
+    defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#include <cpuid.h>
+#define EVCLOCK_HAVE_TSC
+#endif
+
+#include "event2/util.h"
+#include "evclock-internal.h"
+#include "log-internal.h"
+
+#if defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+#define EVCLOCK_HAVE_MONOTONIC
+#endif
+
+#ifdef EVCLOCK_HAVE_MONOTONIC
+static int
+read_clock(clockid_t id, ev_uint64_t *ns)
+{
+	struct timespec ts;
+	if (clock_gettime(id, &ts) == -1)
+		return -1;
+	*ns = (ev_uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	return 0;
+}
+#endif
+
+static int
+read_realtime(ev_uint64_t *ns)
+{
+	struct timeval tv;
+	if (evutil_gettimeofday(&tv, NULL) == -1)
+		return -1;
+	*ns = (ev_uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+	return 0;
+}
+
+#ifdef EVCLOCK_HAVE_TSC
+/* How long to watch the counter against CLOCK_MONOTONIC. */
+#define TSC_CALIBRATE_NSEC 5000000
+/* Counter ticks per millisecond, once we've measured it. */
+static ev_uint32_t tsc_khz;
+
+static inline ev_uint64_t
+read_tsc(void)
+{
+	ev_uint32_t lo, hi;
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((ev_uint64_t)hi << 32) | lo;
+}
+
+/* Return true iff the counter ticks at a constant rate, in every power
+ * state, on every core. */
+static int
+tsc_is_invariant(void)
+{
+	unsigned a, b, c, d;
+	if (!__get_cpuid(0x80000007, &a, &b, &c, &d))
+		return 0;
+	return (d & (1u << 8)) != 0;
+}
+
+/* Return the counter's rate in ticks per millisecond, or 0 if we can't
+ * use it. */
+static ev_uint32_t
+tsc_calibrate(void)
+{
+	ev_uint64_t ns_start, ns, tsc_start, tsc;
+
+	if (tsc_khz)
+		return tsc_khz;
+	if (!tsc_is_invariant())
+		return 0;
+
+	if (read_clock(CLOCK_MONOTONIC, &ns_start) == -1)
+		return 0;
+	tsc_start = read_tsc();
+	do {
+		if (read_clock(CLOCK_MONOTONIC, &ns) == -1)
+			return 0;
+		tsc = read_tsc();
+	} while (ns - ns_start < TSC_CALIBRATE_NSEC);
+
+	/* Two bases created at once may both get here; they'll store much
+	 * the same number. */
+	tsc_khz = (ev_uint32_t)((tsc - tsc_start) * 1000000 / (ns - ns_start));
+	return tsc_khz;
+}
+
+static int
+tsc_init(struct evclock *c)
+{
+	ev_uint32_t khz = tsc_calibrate();
+	if (!khz)
+		return -1;
+	c->tsc_mult = ((ev_uint64_t)1000000 << 32) / khz;
+	if (read_clock(CLOCK_MONOTONIC, &c->ns0) == -1)
+		return -1;
+	c->tsc0 = read_tsc();
+	return 0;
+}
+#endif
+
+void
+evclock_init(struct evclock *c, enum event_clock_source source,
+    ev_uint64_t (*fn)(void *arg), void *arg)
+{
+	ev_uint64_t ns;
+
+	c->source = source;
+	c->fn = fn;
+	c->arg = arg;
+	c->tsc0 = c->ns0 = c->tsc_mult = 0;
+	c->sim_ns = 0;
+
+	switch (source) {
+	case EVENT_CLOCK_EXTERNAL:
+		if (fn)
+			return;
+		break;
+	case EVENT_CLOCK_SIMULATED:
+		/* Not zero: gettime() takes a zero tv_sec to mean "nothing
+		 * cached". */
+		c->sim_ns = 1000000000;
+		return;
+	case EVENT_CLOCK_MONOTONIC_COARSE:
+#if defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC_COARSE)
+		if (read_clock(CLOCK_MONOTONIC_COARSE, &ns) == 0)
+			return;
+#endif
+		break;
+	case EVENT_CLOCK_TSC:
+#ifdef EVCLOCK_HAVE_TSC
+		if (tsc_init(c) == 0)
+			return;
+#endif
+		break;
+	default:
+		break;
+	}
+
+	if (source != EVENT_CLOCK_DEFAULT)
+		event_debug(("%s: clock source %d is not available; using the "
+			"default", __func__, (int)source));
+
+#ifdef EVCLOCK_HAVE_MONOTONIC
+	if (read_clock(CLOCK_MONOTONIC, &ns) == 0) {
+		c->source = EVCLOCK_MONOTONIC;
+		return;
+	}
+#endif
+	(void)ns;
+	c->source = EVCLOCK_REALTIME;
+}
+
+int
+evclock_gettime(struct evclock *c, ev_uint64_t *ns)
+{
+	switch (c->source) {
+#ifdef EVCLOCK_HAVE_MONOTONIC
+	case EVCLOCK_MONOTONIC:
+		return read_clock(CLOCK_MONOTONIC, ns);
+#endif
+#if defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC_COARSE)
+	case EVENT_CLOCK_MONOTONIC_COARSE:
+		return read_clock(CLOCK_MONOTONIC_COARSE, ns);
+#endif
+#ifdef EVCLOCK_HAVE_TSC
+	case EVENT_CLOCK_TSC: {
+		ev_uint64_t delta = read_tsc() - c->tsc0;
+		*ns = c->ns0 +
+		    (ev_uint64_t)(((unsigned __int128)delta * c->tsc_mult) >> 32);
+		return 0;
+	}
+#endif
+	case EVENT_CLOCK_EXTERNAL:
+		*ns = c->fn(c->arg);
+		return 0;
+	case EVENT_CLOCK_SIMULATED:
+		*ns = c->sim_ns;
+		return 0;
+	default:
+		return read_realtime(ns);
+	}
+}
+
+int
+evclock_gettime_system(ev_uint64_t *ns)
+{
+#ifdef EVCLOCK_HAVE_MONOTONIC
+	if (read_clock(CLOCK_MONOTONIC, ns) == 0)
+		return 0;
+#endif
+	return read_realtime(ns);
+}
+
+enum event_clock_source
+evclock_source(const struct evclock *c)
+{
+	if (c->source == EVCLOCK_MONOTONIC || c->source == EVCLOCK_REALTIME)
+		return EVENT_CLOCK_DEFAULT;
+	return (enum event_clock_source)c->source;
+}
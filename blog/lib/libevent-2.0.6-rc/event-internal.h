@@ -35,9 +35,12 @@ extern "C" {
 #include <sys/queue.h>
 #include "event2/event_struct.h"
 #include "minheap-internal.h"
+#include "minheap4-internal.h"
 #include "evsignal-internal.h"
 #include "mm-internal.h"
 #include "defer-internal.h"
+#include "evclock-internal.h"
+#include "evslab-internal.h"
 
 /* map union members back */
 
@@ -54,6 +57,7 @@ extern "C" {
 #define EV_CLOSURE_NONE 0
 #define EV_CLOSURE_SIGNAL 1
 #define EV_CLOSURE_PERSIST 2
+#define EV_CLOSURE_GROUP 3
 
 /** Structure to define the backend of a given event_base. */
 struct eventop {
@@ -106,6 +110,13 @@ struct eventop {
 #define EVMAP_USE_HT
 #endif
 
+/* If we can hand events to the loop through its inbox, backends can look
+   up the events on a ready fd without th_base_lock; see
+   evmap_io_active_unlocked(). */
+#if defined(EVENT_USE_INBOX) && !defined(EVMAP_USE_HT)
+#define EVMAP_ACTIVE_UNLOCKED 1
+#endif
+
 /* #define HT_CACHE_HASH_VALS */
 
 #ifdef EVMAP_USE_HT
@@ -113,16 +124,27 @@ struct eventop {
 struct event_map_entry;
 HT_HEAD(event_io_map, event_map_entry);
 #else
-#define event_io_map event_signal_map
+struct evmap_io_dir;
+/* Used to map fds to a list of events.  The fds are split into chunks of
+   consecutive values, each an array of entries allocated at once, with a
+   lock of its own for lookups that don't hold th_base_lock; see evmap.c.
+*/
+struct event_io_map {
+	/* The chunks.  The directory is replaced, never reallocated, when it
+	 * grows, and the old one is kept until the map is cleared, so no
+	 * entry ever moves, and a lookup without th_base_lock that races
+	 * with growth sees the old directory or the new one. */
+	struct evmap_io_dir *dir;
+	/* The size of an entry: a struct evmap_io and the backend's fdinfo */
+	size_t entry_size;
+	/* One more than the highest fd that the directory has room for */
+	int nentries;
+};
 #endif
 
-/* Used to map signal numbers to a list of events.  If EVMAP_USE_HT is not
-   defined, this structure is also used as event_io_map, which maps fds to a
-   list of events.
-*/
+/* Used to map signal numbers to a list of events. */
 struct event_signal_map {
-	/* An array of evmap_io * or of evmap_signal *; empty entries are
-	 * set to NULL. */
+	/* An array of evmap_signal *; empty entries are set to NULL. */
 	void **entries;
 	/* The number of entries available in entries */
 	int nentries;
@@ -145,6 +167,51 @@ struct common_timeout_list {
 	struct event_base *base;
 };
 
+/* The table of recently used timeout durations that
+ * EVENT_BASE_FLAG_AUTO_COMMON_TIMEOUTS keeps has this many slots, in
+ * pairs: a duration can go in either slot of the pair it hashes to. */
+#define AUTO_TIMEOUT_SLOTS 64
+
+/* One slot in that table. */
+struct auto_timeout_slot {
+	/* A duration that event_add() has seen. */
+	struct timeval duration;
+	/* How often we have seen 'duration', less how often we have seen
+	 * other durations that map to this slot since. */
+	unsigned hits;
+	/* The common timeout for 'duration' once we have made one, or NULL.
+	 * A slot with a common timeout keeps its duration for good. */
+	const struct timeval *common;
+};
+
+/* A member of an event_group.  Its ev_closure is EV_CLOSURE_GROUP; when it
+ * is active, it sits on its group's ready list instead of an active queue.
+ **/
+struct event_group_member {
+	/* Must be first, so that event_free() frees the whole member. */
+	struct event ev;
+	struct event_group *group;
+	TAILQ_ENTRY(event_group_member) next;
+};
+
+struct event_group {
+	struct event_base *base;
+	event_group_cb cb;
+	void *arg;
+	/* Members that are ready, linked through ev_active_next. */
+	struct event_list ready;
+	/* Every member of the group. */
+	TAILQ_HEAD(event_group_memberq, event_group_member) members;
+	/* Active whenever 'ready' is nonempty; its callback delivers the
+	 * batch. */
+	struct event dispatch_ev;
+	/* Set while the callback is running, so that event_group_free can
+	 * leave freeing the group to the dispatcher. */
+	int dispatching;
+	int freed;
+	struct event_group_item items[EVENT_GROUP_MAX_BATCH];
+};
+
 struct event_change;
 
 /* List of 'changes' since the last call to eventop.dispatch.  Only maintained
@@ -163,6 +230,9 @@ extern int _event_debug_mode_on;
 #define EVENT_DEBUG_MODE_IS_ON() (0)
 #endif
 
+/* The most object sizes that event_base_alloc_obj() keeps slabs for. */
+#define EVENT_BASE_N_SLABS 8
+
 struct event_base {
 	/** Function pointers and other data to describe this event_base's
 	 * backend. */
@@ -186,6 +256,10 @@ struct event_base {
 	int event_count;
 	/** Number of total events active in this event_base */
 	int event_count_active;
+	/** Number of operations in flight that are not events, but should
+	 * keep the loop running until they finish, such as io_uring
+	 * requests. */
+	int virtual_event_count;
 
 	/** Set if we should terminate the loop once we're done processing
 	 * events. */
@@ -215,6 +289,11 @@ struct event_base {
 	int n_common_timeouts;
 	/** The total size of common_timeout_queues. */
 	int n_common_timeouts_allocated;
+	/** If EVENT_BASE_FLAG_AUTO_COMMON_TIMEOUTS is on, the durations we
+	 * might make common timeouts for; otherwise NULL. */
+	struct auto_timeout_slot *auto_timeouts;
+	/** The number of common timeouts we made on our own. */
+	int n_auto_common_timeouts;
 
 	/** The event whose callback is executing right now */
 	struct event *current_event;
@@ -229,14 +308,17 @@ struct event_base {
 	/** Mapping from signal numbers to enabled (added) events. */
 	struct event_signal_map sigmap;
 
-	/** All events that have been enabled (added) in this event_base */
-	struct event_list eventqueue;
-
 	/** Stored timeval; used to detect when time is running backwards. */
 	struct timeval event_tv;
 
 	/** Priority queue of events with timeouts. */
 	struct min_heap timeheap;
+	/** Used instead of timeheap if the base was made with
+	 * EVENT_BASE_FLAG_TIMER_HEAP4. */
+	struct min_heap4 timeheap4;
+	/** If the base was made with EVENT_BASE_FLAG_TIMER_WHEEL, this holds
+	 * the events with timeouts instead of timeheap. */
+	struct timewheel *timewheel;
 
 	/** Stored timeval: used to avoid calling gettimeofday too often. */
 	struct timeval tv_cache;
@@ -259,6 +341,50 @@ struct event_base {
 
 	/** Flags that this base was configured with */
 	enum event_base_config_flag flags;
+	/** The most events the backend may report at once, or 0 for its
+	 * default. */
+	int max_dispatch_events;
+	/** Stop running callbacks at priority limit_callbacks_after_prio or
+	 * lower (numerically higher) after this many, or 0 for no limit... */
+	int max_dispatch_callbacks;
+	/** ...or after this many nanoseconds, or 0 for no limit. */
+	ev_uint64_t max_dispatch_nsec;
+	int limit_callbacks_after_prio;
+	/** Most deferred callbacks to run per iteration, or 0 for no limit. */
+	int max_deferred_callbacks;
+	/** How long to poll the backend without blocking before we block
+	 * in it, or zero not to. */
+	struct timeval busy_poll;
+	/** The SO_BUSY_POLL value for the sockets of listeners and socket
+	 * bufferevents, or 0 to leave them alone. */
+	int busy_poll_socket_usec;
+	/** The CPUs to pin the loop thread to, or NULL to leave it alone. */
+	int *cpus;
+	int n_cpus;
+	/** The NUMA node that our slabs and loop thread take memory from,
+	 * or -1 for no node in particular. */
+	int numa_node;
+	/** Set once we have pinned a loop thread; 'pinned_thread' is the
+	 * one we pinned last. */
+	int loop_pinned;
+	unsigned long pinned_thread;
+	/** If set, run up to priority_weights[i] callbacks at each priority i
+	 * per iteration, round-robin, instead of running only the most
+	 * urgent priority. */
+	int *priority_weights;
+	/** Where gettime() gets the time when it isn't cached. */
+	struct evclock clock;
+	/** Slabs for the objects allocated by event_base_alloc_obj(), one
+	 * per object size, in the order they were first needed. */
+	struct evslab *slabs[EVENT_BASE_N_SLABS];
+	/** Counters for event_base_get_dispatch_stats(). */
+	struct event_dispatch_stats dispatch_stats;
+	/** Counters for event_base_get_loop_stats(), or NULL if they are not
+	 * being collected. */
+	struct event_loop_stats *loop_stats;
+	/** Callbacks that run at least this many microseconds get logged;
+	 * 0 for never. */
+	ev_uint64_t slow_callback_usec;
 
 	/* Notify main thread to wake up break, etc. */
 	/** A socketpair used by some th_notify functions to wake up the main
@@ -269,6 +395,15 @@ struct event_base {
 	struct event th_notify;
 	/** A function used to wake up the main thread from another thread. */
 	int (*th_notify_fn)(struct event_base *base);
+#ifdef EVENT_USE_INBOX
+	/** Set while a wakeup is on its way to the main thread, so that
+	 * other threads need not send another.  Cleared when th_notify's
+	 * callback drains the wakeup. */
+	int th_notify_pending;
+	/** Events activated from other threads, waiting for the loop to put
+	 * them on the active queues. */
+	struct evmpsc_queue inbox;
+#endif
 };
 
 struct event_config_entry {
@@ -284,6 +419,25 @@ struct event_config {
 
 	enum event_method_feature require_features;
 	enum event_base_config_flag flags;
+	/** The most events the backend may report at once, or 0 for its
+	 * default. */
+	int max_dispatch_events;
+	/** Limits on running callbacks; see the fields of the same names in
+	 * event_base. */
+	int max_dispatch_callbacks;
+	struct timeval max_dispatch_interval;
+	int limit_callbacks_after_prio;
+	int max_deferred_callbacks;
+	struct timeval busy_poll;
+	int busy_poll_socket_usec;
+	/** See event_config_set_cpu_affinity(); NULL if not set. */
+	int *cpus;
+	int n_cpus;
+	/** The clock to give the base, and for EVENT_CLOCK_EXTERNAL, the
+	 * function that reads it. */
+	enum event_clock_source clock_source;
+	ev_uint64_t (*clock_fn)(void *arg);
+	void *clock_arg;
 };
 
 /* Internal use only: Functions that might be missing from <sys/queue.h> */
@@ -311,6 +465,27 @@ int _evsig_set_handler(struct event_base *base, int evsignal,
 int _evsig_restore_handler(struct event_base *base, int evsignal);
 
 void event_active_nolock(struct event *ev, int res, short count);
+#ifdef EVENT_USE_INBOX
+/* Put 'ev' in its base's inbox, to become active with 'res' when the
+ * loop next drains it.  Doesn't need th_base_lock, and doesn't wake the
+ * loop. */
+void event_active_later(struct event *ev, short res);
+#endif
+
+/** Count one more (or one fewer) operation that keeps event_base_loop()
+ * from exiting for lack of events.  Caller must hold th_base_lock. */
+void event_base_add_virtual(struct event_base *base);
+void event_base_del_virtual(struct event_base *base);
+
+/** Set SO_BUSY_POLL on 'fd' if 'base' was configured to with
+ * event_config_set_busy_poll().  Failures are ignored. */
+void event_base_busy_poll_socket(struct event_base *base, evutil_socket_t fd);
+
+/** Ask the kernel to hand the connections of listening socket 'fd' to
+ * 'base' when they arrive on a CPU that its loop is pinned to, if 'base'
+ * was configured with event_config_set_cpu_affinity().  Failures are
+ * ignored. */
+void event_base_steer_listener(struct event_base *base, evutil_socket_t fd);
 
 #ifdef __cplusplus
 }
@@ -42,6 +42,7 @@
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #ifdef _EVENT_HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -64,10 +65,12 @@
 #include "event2/util.h"
 #include "log-internal.h"
 #include "evmap-internal.h"
+#include "timewheel-internal.h"
 #include "iocp-internal.h"
 #include "changelist-internal.h"
 #include "ht-internal.h"
 #include "util-internal.h"
+#include "evnuma-internal.h"
 
 #ifdef _EVENT_HAVE_EVENT_PORTS
 extern const struct eventop evportops;
@@ -81,6 +84,9 @@ extern const struct eventop pollops;
 #ifdef _EVENT_HAVE_EPOLL
 extern const struct eventop epollops;
 #endif
+#if defined(_EVENT_HAVE_EPOLL) && defined(_EVENT_HAVE_LINUX_IO_URING_H)
+extern const struct eventop iouringops;
+#endif
 #ifdef _EVENT_HAVE_WORKING_KQUEUE
 extern const struct eventop kqops;
 #endif
@@ -99,6 +105,9 @@ static const struct eventop *eventops[] = {
 #ifdef _EVENT_HAVE_WORKING_KQUEUE
 	&kqops,
 #endif
+#if defined(_EVENT_HAVE_EPOLL) && defined(_EVENT_HAVE_LINUX_IO_URING_H)
+	&iouringops,
+#endif
 #ifdef _EVENT_HAVE_EPOLL
 	&epollops,
 #endif
@@ -122,10 +131,6 @@ struct event_base *event_global_current_base_ = NULL;
 #define current_base event_global_current_base_
 extern struct event_base *evsig_base;
 
-/* Global state */
-
-static int use_monotonic;
-
 /* Prototypes */
 static inline int event_add_internal(struct event *ev,
     const struct timeval *tv, int tv_is_absolute);
@@ -136,16 +141,34 @@ static void	event_queue_remove(struct event_base *, struct event *, int);
 static int	event_haveevents(struct event_base *);
 
 static void	event_process_active(struct event_base *);
+static int	event_base_busy_poll(struct event_base *, struct timeval *);
 
 static int	timeout_next(struct event_base *, struct timeval **);
 static void	timeout_process(struct event_base *);
 static void	timeout_correct(struct event_base *, struct timeval *);
+static inline struct event *timeheap_top(struct event_base *);
 
 static inline void	event_signal_closure(struct event_base *, struct event *ev);
 static inline void	event_persist_closure(struct event_base *, struct event *ev);
+static inline void	event_persist_reschedule(struct event_base *, struct event *ev);
+static void	event_group_member_free(struct event *ev);
 
 static int	evthread_notify_base(struct event_base *base);
 
+#ifdef EVENT_USE_INBOX
+/* True if event_active() and event_deferred_cb_schedule(), called from
+ * this thread, should use 'base's inbox: the base is locked, and its loop
+ * is running in some other thread that we know how to wake up. */
+#define EVBASE_USE_INBOX(base)						\
+	((base)->th_base_lock && (base)->th_notify_fn &&		\
+	    (base)->running_loop && !EVBASE_IN_THREAD(base))
+
+static void	event_base_drain_inbox(struct event_base *base, int all);
+static int	event_base_drain_inbox_one(struct event_base *base);
+static void	event_drain_inbox_for(struct event *ev);
+static int	deferred_cb_drain_inbox_one(struct deferred_cb_queue *queue);
+#endif
+
 #ifndef _EVENT_DISABLE_DEBUG_MODE
 /* These functions implement a hashtable of which 'struct event *' structures
  * have been setup or added.  We don't want to trust the content of the struct
@@ -312,33 +335,15 @@ HT_GENERATE(event_debug_map, event_debug_entry, node, hash_debug_entry,
 #define EVENT_BASE_ASSERT_LOCKED(base)		\
 	EVLOCK_ASSERT_LOCKED((base)->th_base_lock)
 
-/* The first time this function is called, it sets use_monotonic to 1
- * if we have a clock function that supports monotonic time */
-static void
-detect_monotonic(void)
-{
-#if defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
-	struct timespec	ts;
-	static int use_monotonic_initialized = 0;
-
-	if (use_monotonic_initialized)
-		return;
-
-	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
-		use_monotonic = 1;
-
-	use_monotonic_initialized = 1;
-#endif
-}
-
 /** Set 'tp' to the current time according to 'base'.  We must hold the lock
- * on 'base'.  If there is a cached time, return it.  Otherwise, use
- * clock_gettime or gettimeofday as appropriate to find out the right time.
- * Return 0 on success, -1 on failure.
+ * on 'base'.  If there is a cached time, return it.  Otherwise, read the
+ * base's clock.  Return 0 on success, -1 on failure.
  */
 static int
 gettime(struct event_base *base, struct timeval *tp)
 {
+	ev_uint64_t ns;
+
 	EVENT_BASE_ASSERT_LOCKED(base);
 
 	if (base->tv_cache.tv_sec) {
@@ -346,20 +351,11 @@ gettime(struct event_base *base, struct timeval *tp)
 		return (0);
 	}
 
-#if defined(_EVENT_HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
-	if (use_monotonic) {
-		struct timespec	ts;
-
-		if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
-			return (-1);
-
-		tp->tv_sec = ts.tv_sec;
-		tp->tv_usec = ts.tv_nsec / 1000;
-		return (0);
-	}
-#endif
-
-	return (evutil_gettimeofday(tp, NULL));
+	if (evclock_gettime(&base->clock, &ns) == -1)
+		return (-1);
+	tp->tv_sec = ns / 1000000000;
+	tp->tv_usec = (ns % 1000000000) / 1000;
+	return (0);
 }
 
 int
@@ -459,11 +455,175 @@ event_base_get_features(const struct event_base *base)
 	return base->evsel->features;
 }
 
+int
+event_base_get_dispatch_stats(struct event_base *base,
+    struct event_dispatch_stats *stats)
+{
+	if (!base || !stats)
+		return -1;
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	*stats = base->dispatch_stats;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return 0;
+}
+
+/* Return a timestamp in microseconds, ignoring the time cache.  A virtual
+ * clock may not move while callbacks run, so we use the system clock
+ * instead of that. */
+static ev_uint64_t
+loop_stats_now(struct event_base *base)
+{
+	ev_uint64_t ns = 0;
+	if (evclock_is_virtual(&base->clock))
+		evclock_gettime_system(&ns);
+	else
+		evclock_gettime(&base->clock, &ns);
+	return ns / 1000;
+}
+
+/* Record a wait in the backend that started at 'started', and begin a new
+ * iteration. */
+static void
+loop_stats_dispatched(struct event_base *base, ev_uint64_t started)
+{
+	struct event_loop_stats *st = base->loop_stats;
+	ev_uint64_t usec = loop_stats_now(base) - started;
+
+	++st->n_iterations;
+	st->dispatch_usec += usec;
+	st->last_dispatch_usec = usec;
+	st->last_callback_usec = 0;
+}
+
+/* Note how many events are active at each priority, and return the time
+ * at which we start running them. */
+static ev_uint64_t
+loop_stats_begin_callbacks(struct event_base *base)
+{
+	struct event_loop_stats *st = base->loop_stats;
+	struct event *ev;
+	int i;
+
+	memset(st->n_active_by_priority, 0, sizeof(st->n_active_by_priority));
+	for (i = 0; i < base->nactivequeues; ++i) {
+		int slot = i < EVENT_LOOP_STATS_PRIORITIES ?
+		    i : EVENT_LOOP_STATS_PRIORITIES - 1;
+		TAILQ_FOREACH(ev, &base->activequeues[i], ev_active_next)
+			++st->n_active_by_priority[slot];
+	}
+	return loop_stats_now(base);
+}
+
+static void
+loop_stats_end_callbacks(struct event_base *base, ev_uint64_t started)
+{
+	struct event_loop_stats *st = base->loop_stats;
+	ev_uint64_t usec = loop_stats_now(base) - started;
+
+	st->callback_usec += usec;
+	st->last_callback_usec += usec;
+	if (st->last_callback_usec > st->max_callback_usec)
+		st->max_callback_usec = st->last_callback_usec;
+}
+
+/* Record one callback, for 'fd' at priority 'pri', that started running at
+ * 'started', and complain if it was slow. */
+static void
+loop_stats_callback(struct event_base *base, evutil_socket_t fd,
+    void (*cb)(evutil_socket_t, short, void *), int pri, ev_uint64_t started)
+{
+	struct event_loop_stats *st = base->loop_stats;
+	ev_uint64_t usec = loop_stats_now(base) - started;
+	ev_uint64_t t;
+	int bucket = 0;
+
+	for (t = usec; t && bucket < EVENT_LOOP_STATS_HIST_BUCKETS - 1; t >>= 1)
+		++bucket;
+	++st->callback_hist[bucket];
+	++st->n_callbacks;
+	if (pri >= EVENT_LOOP_STATS_PRIORITIES)
+		pri = EVENT_LOOP_STATS_PRIORITIES - 1;
+	++st->n_callbacks_by_priority[pri];
+
+	if (base->slow_callback_usec && usec >= base->slow_callback_usec) {
+		++st->n_slow_callbacks;
+		event_warnx("Slow callback: %p on fd %d ran for %lu usec",
+		    (void *)cb, (int)fd, (unsigned long)usec);
+	}
+}
+
+int
+event_base_enable_loop_stats(struct event_base *base,
+    const struct timeval *slow_threshold)
+{
+	int r = 0;
+	if (!base)
+		return -1;
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (!base->loop_stats) {
+		base->loop_stats = mm_calloc(1, sizeof(struct event_loop_stats));
+		if (!base->loop_stats) {
+			event_warn("%s: calloc", __func__);
+			r = -1;
+			goto done;
+		}
+	}
+	if (slow_threshold)
+		base->slow_callback_usec =
+		    ((ev_uint64_t)slow_threshold->tv_sec) * 1000000 +
+		    slow_threshold->tv_usec;
+	else
+		base->slow_callback_usec = 0;
+done:
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
+int
+event_base_disable_loop_stats(struct event_base *base)
+{
+	if (!base)
+		return -1;
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (base->loop_stats) {
+		mm_free(base->loop_stats);
+		base->loop_stats = NULL;
+	}
+	base->slow_callback_usec = 0;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return 0;
+}
+
+int
+event_base_get_loop_stats(struct event_base *base,
+    struct event_loop_stats *stats)
+{
+	int r = -1;
+	if (!base || !stats)
+		return -1;
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (base->loop_stats) {
+		*stats = *base->loop_stats;
+		stats->n_active = base->event_count_active;
+		stats->n_deferred = base->defer_queue.active_count;
+		stats->n_timeouts = min_heap_size(&base->timeheap) +
+		    min_heap4_size(&base->timeheap4);
+		if (base->timewheel)
+			stats->n_timeouts += base->timewheel->n;
+		r = 0;
+	}
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
 void
 event_deferred_cb_queue_init(struct deferred_cb_queue *cb)
 {
 	memset(cb, 0, sizeof(struct deferred_cb_queue));
 	TAILQ_INIT(&cb->deferred_cb_list);
+#ifdef EVENT_USE_INBOX
+	evmpsc_init(&cb->inbox);
+#endif
 }
 
 /** Helper for the deferred_cb queue: wake up the event base. */
@@ -516,8 +676,8 @@ event_disable_debug_mode(void)
 }
 #endif
 
-struct event_base *
-event_base_new_with_config(const struct event_config *cfg)
+static struct event_base *
+event_base_new_on_node(const struct event_config *cfg, int node)
 {
 	int i;
 	struct event_base *base;
@@ -534,21 +694,49 @@ event_base_new_with_config(const struct event_config *cfg)
 		event_warn("%s: calloc", __func__);
 		return NULL;
 	}
-	detect_monotonic();
+	base->numa_node = node;
+	if (cfg)
+		evclock_init(&base->clock, cfg->clock_source, cfg->clock_fn,
+		    cfg->clock_arg);
+	else
+		evclock_init(&base->clock, EVENT_CLOCK_DEFAULT, NULL, NULL);
 	gettime(base, &base->event_tv);
 
 	min_heap_ctor(&base->timeheap);
-	TAILQ_INIT(&base->eventqueue);
+	min_heap4_ctor(&base->timeheap4);
+	if (cfg && (cfg->flags & EVENT_BASE_FLAG_TIMER_WHEEL)) {
+		if ((base->timewheel = timewheel_new(&base->event_tv)) ==
+		    NULL) {
+			event_warn("%s: calloc", __func__);
+			mm_free(base);
+			return NULL;
+		}
+	}
 	base->sig.ev_signal_pair[0] = -1;
 	base->sig.ev_signal_pair[1] = -1;
+	base->sig.sigfd = -1;
 	base->th_notify_fd[0] = -1;
 	base->th_notify_fd[1] = -1;
 
 	event_deferred_cb_queue_init(&base->defer_queue);
 	base->defer_queue.notify_fn = notify_base_cbq_callback;
 	base->defer_queue.notify_arg = base;
-	if (cfg)
+#ifdef EVENT_USE_INBOX
+	evmpsc_init(&base->inbox);
+#endif
+	if (cfg) {
 		base->flags = cfg->flags;
+		base->max_dispatch_events = cfg->max_dispatch_events;
+		base->max_dispatch_callbacks = cfg->max_dispatch_callbacks;
+		base->max_dispatch_nsec =
+		    (ev_uint64_t)cfg->max_dispatch_interval.tv_sec * 1000000000 +
+		    (ev_uint64_t)cfg->max_dispatch_interval.tv_usec * 1000;
+		base->limit_callbacks_after_prio =
+		    cfg->limit_callbacks_after_prio;
+		base->max_deferred_callbacks = cfg->max_deferred_callbacks;
+		base->busy_poll = cfg->busy_poll;
+		base->busy_poll_socket_usec = cfg->busy_poll_socket_usec;
+	}
 
 	evmap_io_initmap(&base->io);
 	evmap_signal_initmap(&base->sigmap);
@@ -558,6 +746,10 @@ event_base_new_with_config(const struct event_config *cfg)
 
 	should_check_environment =
 	    !(cfg && (cfg->flags & EVENT_BASE_FLAG_IGNORE_ENV));
+	if (should_check_environment && evutil_getenv("EVENT_SIGNALFD"))
+		base->flags |= EVENT_BASE_FLAG_SIGNALFD;
+	if (should_check_environment && evutil_getenv("EVENT_PRECISE_TIMER"))
+		base->flags |= EVENT_BASE_FLAG_PRECISE_TIMER;
 
 	for (i = 0; eventops[i] && !base->evbase; i++) {
 		if (cfg != NULL) {
@@ -590,6 +782,30 @@ event_base_new_with_config(const struct event_config *cfg)
 	if (evutil_getenv("EVENT_SHOW_METHOD"))
 		event_msgx("libevent using: %s", base->evsel->name);
 
+	if (should_check_environment &&
+	    evutil_getenv("EVENT_AUTO_COMMON_TIMEOUTS"))
+		base->flags |= EVENT_BASE_FLAG_AUTO_COMMON_TIMEOUTS;
+	if (base->flags & EVENT_BASE_FLAG_AUTO_COMMON_TIMEOUTS) {
+		base->auto_timeouts = mm_calloc(AUTO_TIMEOUT_SLOTS,
+		    sizeof(struct auto_timeout_slot));
+		if (base->auto_timeouts == NULL) {
+			event_warn("%s: calloc", __func__);
+			event_base_free(base);
+			return NULL;
+		}
+	}
+
+	if (cfg && cfg->n_cpus) {
+		base->cpus = mm_calloc(cfg->n_cpus, sizeof(int));
+		if (base->cpus == NULL) {
+			event_warn("%s: calloc", __func__);
+			event_base_free(base);
+			return NULL;
+		}
+		memcpy(base->cpus, cfg->cpus, cfg->n_cpus * sizeof(int));
+		base->n_cpus = cfg->n_cpus;
+	}
+
 	/* allocate a single active event queue */
 	if (event_base_priority_init(base, 1) < 0) {
 		event_base_free(base);
@@ -622,6 +838,26 @@ event_base_new_with_config(const struct event_config *cfg)
 	return (base);
 }
 
+struct event_base *
+event_base_new_with_config(const struct event_config *cfg)
+{
+	struct event_base *base;
+	struct evnuma_policy old;
+	int node = -1, preferred = 0;
+
+	if (cfg && (cfg->flags & EVENT_BASE_FLAG_NUMA_LOCAL) && cfg->n_cpus)
+		node = evnuma_cpu_node(cfg->cpus[0]);
+	/* Whatever memory the base gets fresh from the kernel while we set
+	 * it up comes from its node.  Memory that the heap had already will
+	 * stay where it was. */
+	if (node >= 0)
+		preferred = (evnuma_prefer_node(node, &old) == 0);
+	base = event_base_new_on_node(cfg, node);
+	if (preferred)
+		evnuma_restore_policy(&old);
+	return base;
+}
+
 int
 event_base_start_iocp(struct event_base *base)
 {
@@ -639,6 +875,17 @@ event_base_start_iocp(struct event_base *base)
 #endif
 }
 
+/* Helper for event_base_free: delete 'ev' unless it is internal. */
+static int
+event_base_free_del_cb(struct event_base *base, struct event *ev, void *arg)
+{
+	if (!(ev->ev_flags & EVLIST_INTERNAL)) {
+		event_del(ev);
+		++*(int *)arg;
+	}
+	return (0);
+}
+
 void
 event_base_free(struct event_base *base)
 {
@@ -655,6 +902,12 @@ event_base_free(struct event_base *base)
 	/* XXX(niels) - check for internal events first */
 	EVUTIL_ASSERT(base);
 
+#ifdef EVENT_USE_INBOX
+	/* Anything another thread activated goes on the active queues, so
+	 * that we delete it along with everything else. */
+	event_base_drain_inbox(base, 1);
+#endif
+
 	/* threading fds if we have them */
 	if (base->th_notify_fd[0] != -1) {
 		event_del(&base->th_notify);
@@ -667,15 +920,13 @@ event_base_free(struct event_base *base)
 	}
 
 	/* Delete all non-internal events. */
-	for (ev = TAILQ_FIRST(&base->eventqueue); ev; ) {
-		struct event *next = TAILQ_NEXT(ev, ev_next);
-		if (!(ev->ev_flags & EVLIST_INTERNAL)) {
-			event_del(ev);
-			++n_deleted;
-		}
-		ev = next;
+	evmap_foreach_event(base, event_base_free_del_cb, &n_deleted);
+	while ((ev = timeheap_top(base)) != NULL) {
+		event_del(ev);
+		++n_deleted;
 	}
-	while ((ev = min_heap_top(&base->timeheap)) != NULL) {
+	while (base->timewheel &&
+	    (ev = timewheel_any(base->timewheel)) != NULL) {
 		event_del(ev);
 		++n_deleted;
 	}
@@ -697,6 +948,10 @@ event_base_free(struct event_base *base)
 	}
 	if (base->common_timeout_queues)
 		mm_free(base->common_timeout_queues);
+	if (base->auto_timeouts)
+		mm_free(base->auto_timeouts);
+	if (base->cpus)
+		mm_free(base->cpus);
 
 	for (i = 0; i < base->nactivequeues; ++i) {
 		for (ev = TAILQ_FIRST(&base->activequeues[i]); ev; ) {
@@ -721,10 +976,19 @@ event_base_free(struct event_base *base)
 
 	EVUTIL_ASSERT(min_heap_empty(&base->timeheap));
 	min_heap_dtor(&base->timeheap);
+	EVUTIL_ASSERT(min_heap4_empty(&base->timeheap4));
+	min_heap4_dtor(&base->timeheap4);
+	if (base->timewheel)
+		timewheel_free(base->timewheel);
+
+	/* Anything still allocated from these keeps them alive. */
+	for (i = 0; i < EVENT_BASE_N_SLABS && base->slabs[i]; ++i)
+		evslab_release(base->slabs[i]);
 
 	mm_free(base->activequeues);
+	if (base->priority_weights)
+		mm_free(base->priority_weights);
 
-	EVUTIL_ASSERT(TAILQ_EMPTY(&base->eventqueue));
 
 	evmap_io_clear(&base->io);
 	evmap_signal_clear(&base->sigmap);
@@ -734,17 +998,43 @@ event_base_free(struct event_base *base)
 	EVTHREAD_FREE_LOCK(base->current_event_lock,
 	    EVTHREAD_LOCKTYPE_RECURSIVE);
 
+	if (base->loop_stats)
+		mm_free(base->loop_stats);
 	mm_free(base);
 }
 
+struct event_reinit_list {
+	struct event **events;
+	int n;
+};
+
+/* Helper for event_reinit: count the events to re-add, or, once there is
+ * room for them, remember them. */
+static int
+event_reinit_collect_cb(struct event_base *base, struct event *ev, void *arg)
+{
+	struct event_reinit_list *l = arg;
+
+	if (!(ev->ev_flags & EVLIST_INSERTED))
+		return (0);
+	if (l->events)
+		l->events[l->n] = ev;
+	++l->n;
+	return (0);
+}
+
 /* reinitialize the event base after a fork */
 int
 event_reinit(struct event_base *base)
 {
 	const struct eventop *evsel;
-	int res = 0;
+	struct event_reinit_list added;
+	int res = 0, i;
 	struct event *ev;
 
+	added.events = NULL;
+	added.n = 0;
+
 	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
 
 	evsel = base->evsel;
@@ -765,6 +1055,18 @@ event_reinit(struct event_base *base)
 		base->sig.ev_signal_added = 0;
 	}
 
+	/* The maps are about to be cleared, so note what was in them. */
+	evmap_foreach_event(base, event_reinit_collect_cb, &added);
+	if (added.n) {
+		added.events = mm_calloc(added.n, sizeof(struct event *));
+		if (added.events == NULL) {
+			res = -1;
+			goto done;
+		}
+		added.n = 0;
+		evmap_foreach_event(base, event_reinit_collect_cb, &added);
+	}
+
 	if (base->evsel->dealloc != NULL)
 		base->evsel->dealloc(base);
 	base->evbase = evsel->init(base);
@@ -779,7 +1081,8 @@ event_reinit(struct event_base *base)
 	evmap_io_clear(&base->io);
 	evmap_signal_clear(&base->sigmap);
 
-	TAILQ_FOREACH(ev, &base->eventqueue, ev_next) {
+	for (i = 0; i < added.n; ++i) {
+		ev = added.events[i];
 		if (ev->ev_events & (EV_READ|EV_WRITE)) {
 			if (evmap_io_add(base, ev->ev_fd, ev) == -1)
 				res = -1;
@@ -790,6 +1093,8 @@ event_reinit(struct event_base *base)
 	}
 
 done:
+	if (added.events)
+		mm_free(added.events);
 	EVBASE_RELEASE_LOCK(base, th_base_lock);
 	return (res);
 }
@@ -856,6 +1161,8 @@ event_config_free(struct event_config *cfg)
 		TAILQ_REMOVE(&cfg->entries, entry, next);
 		event_config_entry_free(entry);
 	}
+	if (cfg->cpus)
+		mm_free(cfg->cpus);
 	mm_free(cfg);
 }
 
@@ -868,6 +1175,191 @@ event_config_set_flag(struct event_config *cfg, int flag)
 	return 0;
 }
 
+int
+event_config_set_max_dispatch_events(struct event_config *cfg, int max_events)
+{
+	if (!cfg || max_events < 1)
+		return -1;
+	cfg->max_dispatch_events = max_events;
+	return 0;
+}
+
+int
+event_config_set_max_dispatch_interval(struct event_config *cfg,
+    const struct timeval *max_interval, int max_callbacks, int min_priority)
+{
+	if (!cfg || min_priority < 0)
+		return -1;
+	if (max_interval)
+		cfg->max_dispatch_interval = *max_interval;
+	else
+		evutil_timerclear(&cfg->max_dispatch_interval);
+	cfg->max_dispatch_callbacks = max_callbacks > 0 ? max_callbacks : 0;
+	cfg->limit_callbacks_after_prio = min_priority;
+	return 0;
+}
+
+int
+event_config_set_max_deferred_callbacks(struct event_config *cfg,
+    int max_callbacks)
+{
+	if (!cfg || max_callbacks < 0)
+		return -1;
+	cfg->max_deferred_callbacks = max_callbacks;
+	return 0;
+}
+
+int
+event_config_set_busy_poll(struct event_config *cfg,
+    const struct timeval *spin, int socket_usec)
+{
+	if (!cfg || socket_usec < 0)
+		return -1;
+	if (spin) {
+		if (spin->tv_sec < 0 || spin->tv_usec < 0 ||
+		    spin->tv_usec >= 1000000)
+			return -1;
+		cfg->busy_poll = *spin;
+	} else {
+		evutil_timerclear(&cfg->busy_poll);
+	}
+	cfg->busy_poll_socket_usec = socket_usec;
+	return 0;
+}
+
+void
+event_base_busy_poll_socket(struct event_base *base, evutil_socket_t fd)
+{
+#ifdef SO_BUSY_POLL
+	int usec;
+
+	if (base == NULL || fd < 0)
+		return;
+	usec = base->busy_poll_socket_usec;
+	if (usec <= 0)
+		return;
+	if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, (void *)&usec,
+		sizeof(usec)) == -1)
+		event_debug(("%s: setsockopt(%d, SO_BUSY_POLL): %s",
+		    __func__, (int)fd, strerror(errno)));
+#endif
+}
+
+int
+event_config_set_cpu_affinity(struct event_config *cfg, const int *cpus,
+    int n_cpus)
+{
+	int *copy = NULL;
+	int i;
+
+	if (!cfg || n_cpus < 0 || (n_cpus && !cpus))
+		return -1;
+	for (i = 0; i < n_cpus; ++i) {
+		if (cpus[i] < 0)
+			return -1;
+	}
+	if (n_cpus) {
+		if ((copy = mm_calloc(n_cpus, sizeof(int))) == NULL)
+			return -1;
+		memcpy(copy, cpus, n_cpus * sizeof(int));
+	}
+	if (cfg->cpus)
+		mm_free(cfg->cpus);
+	cfg->cpus = copy;
+	cfg->n_cpus = n_cpus;
+	return 0;
+}
+
+int
+event_base_get_numa_node(const struct event_base *base)
+{
+	return base->numa_node;
+}
+
+void
+event_base_steer_listener(struct event_base *base, evutil_socket_t fd)
+{
+#ifdef SO_INCOMING_CPU
+	if (base == NULL || fd < 0 || base->n_cpus == 0)
+		return;
+	if (setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, (void *)&base->cpus[0],
+		sizeof(int)) == -1)
+		event_debug(("%s: setsockopt(%d, SO_INCOMING_CPU): %s",
+		    __func__, (int)fd, strerror(errno)));
+#endif
+}
+
+/* Pin the calling thread, which is about to run base's loop, to the
+ * base's CPUs, and have it prefer the base's node for the memory it
+ * touches: evbuffer chains, backend arrays and the like.  Only the first
+ * loop on each thread does any work. */
+static void
+event_base_pin_loop_thread(struct event_base *base)
+{
+	unsigned long id = EVTHREAD_GET_ID();
+
+	if (base->loop_pinned && base->pinned_thread == id)
+		return;
+	base->loop_pinned = 1;
+	base->pinned_thread = id;
+
+	if (evnuma_pin_thread(base->cpus, base->n_cpus) < 0)
+		event_warn("%s: sched_setaffinity", __func__);
+	if (base->numa_node >= 0 &&
+	    evnuma_prefer_node(base->numa_node, NULL) < 0)
+		event_debug(("%s: set_mempolicy: %s", __func__,
+			strerror(errno)));
+}
+
+int
+event_config_set_clock(struct event_config *cfg,
+    enum event_clock_source source)
+{
+	if (!cfg || source < EVENT_CLOCK_DEFAULT ||
+	    source > EVENT_CLOCK_SIMULATED || source == EVENT_CLOCK_EXTERNAL)
+		return -1;
+	cfg->clock_source = source;
+	cfg->clock_fn = NULL;
+	cfg->clock_arg = NULL;
+	return 0;
+}
+
+int
+event_config_set_clock_fn(struct event_config *cfg,
+    ev_uint64_t (*clock_fn)(void *arg), void *arg)
+{
+	if (!cfg || !clock_fn)
+		return -1;
+	cfg->clock_source = EVENT_CLOCK_EXTERNAL;
+	cfg->clock_fn = clock_fn;
+	cfg->clock_arg = arg;
+	return 0;
+}
+
+enum event_clock_source
+event_base_get_clock(const struct event_base *base)
+{
+	return evclock_source(&base->clock);
+}
+
+int
+event_base_advance_time(struct event_base *base, const struct timeval *tv)
+{
+	int r = -1;
+	if (!base || !tv || tv->tv_sec < 0 || tv->tv_usec < 0)
+		return -1;
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (base->clock.source == EVENT_CLOCK_SIMULATED) {
+		evclock_advance(&base->clock,
+		    (ev_uint64_t)tv->tv_sec * 1000000000 +
+		    (ev_uint64_t)tv->tv_usec * 1000);
+		clear_time_cache(base);
+		r = 0;
+	}
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
 int
 event_config_avoid_method(struct event_config *cfg, const char *method)
 {
@@ -917,6 +1409,10 @@ event_base_priority_init(struct event_base *base, int npriorities)
 		mm_free(base->activequeues);
 		base->nactivequeues = 0;
 	}
+	if (base->priority_weights) {
+		mm_free(base->priority_weights);
+		base->priority_weights = NULL;
+	}
 
 	/* Allocate our priority queues */
 	base->activequeues = (struct event_list *)
@@ -934,12 +1430,39 @@ event_base_priority_init(struct event_base *base, int npriorities)
 	return (0);
 }
 
+int
+event_base_set_priority_weights(struct event_base *base, const int *weights)
+{
+	int *w = NULL;
+	int i, r = -1;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (weights) {
+		for (i = 0; i < base->nactivequeues; ++i)
+			if (weights[i] < 1)
+				goto done;
+		w = mm_calloc(base->nactivequeues, sizeof(int));
+		if (w == NULL) {
+			event_warn("%s: calloc", __func__);
+			goto done;
+		}
+		memcpy(w, weights, base->nactivequeues * sizeof(int));
+	}
+	if (base->priority_weights)
+		mm_free(base->priority_weights);
+	base->priority_weights = w;
+	r = 0;
+done:
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
 /* Returns true iff we're currently watching any events. */
 static int
 event_haveevents(struct event_base *base)
 {
 	/* Caller must hold th_base_lock */
-	return (base->event_count > 0);
+	return (base->event_count > 0 || base->virtual_event_count > 0);
 }
 
 /* "closure" function called when processing active signal events */
@@ -1010,12 +1533,35 @@ is_same_common_timeout(const struct timeval *tv1, const struct timeval *tv2)
 	    (tv2->tv_usec & ~MICROSECONDS_MASK);
 }
 
-/** Requires that 'tv' is a common timeout.  Return the corresponding
- * common_timeout_list. */
-static inline struct common_timeout_list *
-get_common_timeout_list(struct event_base *base, const struct timeval *tv)
+/** Requires that 'tv' is a common timeout.  Return the corresponding
+ * common_timeout_list. */
+static inline struct common_timeout_list *
+get_common_timeout_list(struct event_base *base, const struct timeval *tv)
+{
+	return base->common_timeout_queues[COMMON_TIMEOUT_IDX(tv)];
+}
+
+/** Return true iff 'base' keeps its timeouts in timeheap4. */
+#define USE_HEAP4(base) ((base)->flags & EVENT_BASE_FLAG_TIMER_HEAP4)
+
+/** Return the earliest timeout in whichever heap 'base' uses. */
+static inline struct event *
+timeheap_top(struct event_base *base)
+{
+	if (USE_HEAP4(base))
+		return min_heap4_top(&base->timeheap4);
+	return min_heap_top(&base->timeheap);
+}
+
+/** Return true iff the (non-common) timeout on 'ev' is the next one 'base'
+ * will need to wake up for.  Both heaps keep min_heap_idx up to date. */
+static inline int
+timeout_is_top(struct event_base *base, struct event *ev)
 {
-	return base->common_timeout_queues[COMMON_TIMEOUT_IDX(tv)];
+	if (base->timewheel)
+		return !is_common_timeout(&ev->ev_timeout, base) &&
+		    timewheel_elt_is_top(base->timewheel, ev);
+	return min_heap_elt_is_top(ev);
 }
 
 #if 0
@@ -1143,11 +1689,74 @@ done:
 	return result;
 }
 
-/* Closure function invoked when we're activating a persistent event. */
+/* How much more often than its rivals for a slot a duration must be used
+ * before we make it a common timeout. */
+#define AUTO_COMMON_TIMEOUT_HITS 8
+/* The most common timeouts we make on our own; the rest of
+ * MAX_COMMON_TIMEOUTS are left for event_base_init_common_timeout(). */
+#define MAX_AUTO_COMMON_TIMEOUTS 32
+
+/* For EVENT_BASE_FLAG_AUTO_COMMON_TIMEOUTS: note that event_add() was
+ * called with the relative timeout 'tv', and return the common timeout to
+ * use in its place, or 'tv' itself if it has none (yet). */
+static const struct timeval *
+auto_common_timeout(struct event_base *base, const struct timeval *tv)
+{
+	struct auto_timeout_slot *pair, *slot;
+	ev_uint32_t h;
+
+	if (tv->tv_sec < 0 || tv->tv_usec < 0 || tv->tv_usec >= 1000000 ||
+	    (tv->tv_sec == 0 && tv->tv_usec == 0))
+		return tv;
+
+	h = ((ev_uint32_t)tv->tv_sec * 1000003u + (ev_uint32_t)tv->tv_usec)
+	    * 2654435761u;
+	pair = &base->auto_timeouts[(h >> 16) % AUTO_TIMEOUT_SLOTS & ~1];
+
+	if (evutil_timercmp(&pair[0].duration, tv, ==))
+		slot = &pair[0];
+	else if (evutil_timercmp(&pair[1].duration, tv, ==))
+		slot = &pair[1];
+	else {
+		/* A duration we aren't tracking: wear down the weaker slot
+		 * of the pair that can still change hands, and take it over
+		 * once it has no hits left. */
+		if (pair[0].common)
+			slot = pair[1].common ? NULL : &pair[1];
+		else if (pair[1].common)
+			slot = &pair[0];
+		else
+			slot = pair[0].hits <= pair[1].hits ? &pair[0] :
+			    &pair[1];
+		if (slot && slot->hits && --slot->hits)
+			return tv;
+		if (slot) {
+			slot->duration = *tv;
+			slot->hits = 0;
+		}
+	}
+	if (slot == NULL)
+		return tv;
+
+	if (slot->common)
+		return slot->common;
+	if (++slot->hits >= AUTO_COMMON_TIMEOUT_HITS &&
+	    base->n_auto_common_timeouts < MAX_AUTO_COMMON_TIMEOUTS &&
+	    base->n_common_timeouts < MAX_COMMON_TIMEOUTS) {
+		slot->common = event_base_init_common_timeout(base, tv);
+		if (slot->common) {
+			++base->n_auto_common_timeouts;
+			return slot->common;
+		}
+	}
+	return tv;
+}
+
+/* Reschedule the persistent event 'ev', which is about to run, if it has a
+ * timeout. */
 static inline void
-event_persist_closure(struct event_base *base, struct event *ev)
+event_persist_reschedule(struct event_base *base, struct event *ev)
 {
-	/* reschedule the persistent event if we have a timeout. */
 	if (ev->ev_io_timeout.tv_sec || ev->ev_io_timeout.tv_usec) {
 		/* If there was a timeout, we want it to run at an interval of
 		 * ev_io_timeout after the last time it was _scheduled_ for,
@@ -1182,23 +1791,61 @@ event_persist_closure(struct event_base *base, struct event *ev)
 		}
 		event_add_internal(ev, &run_at, 1);
 	}
+}
+
+/* Closure function invoked when we're activating a persistent event. */
+static inline void
+event_persist_closure(struct event_base *base, struct event *ev)
+{
+	event_persist_reschedule(base, ev);
 	EVBASE_RELEASE_LOCK(base, th_base_lock);
 	(*ev->ev_callback)((int)ev->ev_fd, ev->ev_res, ev->ev_arg);
 }
 
+/* What's left of the callbacks and time that event_process_active may
+ * spend on limited priorities before going back to the backend. */
+struct dispatch_budget {
+	/** Callbacks left, if max_dispatch_callbacks is set. */
+	int callbacks;
+	/** When to stop, by base->clock, or 0 for never. */
+	ev_uint64_t deadline;
+	/** Set once we've run out of either. */
+	int exhausted;
+};
+
+/* Charge one callback to 'budget'.  Return true if it's now exhausted. */
+static int
+dispatch_budget_charge(struct event_base *base, struct dispatch_budget *budget)
+{
+	ev_uint64_t now;
+
+	if (base->max_dispatch_callbacks && --budget->callbacks <= 0)
+		budget->exhausted = 1;
+	else if (budget->deadline &&
+	    evclock_gettime(&base->clock, &now) == 0 &&
+	    now >= budget->deadline)
+		budget->exhausted = 1;
+	return budget->exhausted;
+}
+
 /*
-  Helper for event_process_active to process all the events in a single queue,
+  Helper for event_process_active to process the events in a single queue,
   releasing the lock as we go.  This function requires that the lock be held
-  when it's invoked.  Returns -1 if we get a signal or an event_break that
-  means we should stop processing any active events now.  Otherwise returns
-  the number of non-internal events that we processed.
+  when it's invoked.  We stop after max_to_process events, or when 'budget'
+  (if it isn't NULL) is exhausted.  Returns -1 if we get a signal or an
+  event_break that means we should stop processing any active events now.
+  Otherwise returns the number of non-internal events that we processed.
 */
 static int
 event_process_active_single_queue(struct event_base *base,
-    struct event_list *activeq)
+    struct event_list *activeq, int max_to_process,
+    struct dispatch_budget *budget)
 {
 	struct event *ev;
-	int count = 0;
+	int count = 0, n_run = 0;
+	evutil_socket_t cb_fd = -1;
+	void (*cb_fn)(evutil_socket_t, short, void *) = NULL;
+	ev_uint64_t cb_started;
 
 	EVUTIL_ASSERT(activeq != NULL);
 
@@ -1219,6 +1866,15 @@ event_process_active_single_queue(struct event_base *base,
 
 		base->current_event = ev;
 
+		/* The callback may free ev, so remember what to report now. */
+		if (EVUTIL_UNLIKELY(base->loop_stats != NULL)) {
+			cb_fd = ev->ev_fd;
+			cb_fn = ev->ev_callback;
+			cb_started = loop_stats_now(base);
+		} else {
+			cb_started = 0;
+		}
+
 		EVBASE_ACQUIRE_LOCK(base, current_event_lock);
 
 		switch (ev->ev_closure) {
@@ -1240,24 +1896,35 @@ event_process_active_single_queue(struct event_base *base,
 		EVBASE_ACQUIRE_LOCK(base, th_base_lock);
 		base->current_event = NULL;
 
+		if (cb_started && base->loop_stats)
+			loop_stats_callback(base, cb_fd, cb_fn,
+			    (int)(activeq - base->activequeues), cb_started);
+
 		if (base->event_break)
 			return -1;
+		if (budget && dispatch_budget_charge(base, budget))
+			break;
+		if (++n_run >= max_to_process)
+			break;
 	}
 	return count;
 }
 
 /*
-   Process all the defered_cb entries in 'queue'.  If *breakptr becomes set to
-   1, stop.  Requires that we start out holding the lock on 'queue'; releases
-   the lock around 'queue' for each deferred_cb we process.
+   Process up to max_to_process of the defered_cb entries in 'queue'.  If
+   *breakptr becomes set to 1, stop.  Requires that we start out holding the
+   lock on 'queue'; releases the lock around 'queue' for each deferred_cb we
+   process.
  */
 static int
-event_process_deferred_callbacks(struct deferred_cb_queue *queue, int *breakptr)
+event_process_deferred_callbacks(struct deferred_cb_queue *queue, int *breakptr,
+    int max_to_process)
 {
 	int count = 0;
 	struct deferred_cb *cb;
 
-	while ((cb = TAILQ_FIRST(&queue->deferred_cb_list))) {
+	while (count < max_to_process &&
+	    (cb = TAILQ_FIRST(&queue->deferred_cb_list))) {
 		cb->queued = 0;
 		TAILQ_REMOVE(&queue->deferred_cb_list, cb, cb_next);
 		--queue->active_count;
@@ -1265,10 +1932,10 @@ event_process_deferred_callbacks(struct deferred_cb_queue *queue, int *breakptr)
 
 		cb->cb(cb, cb->arg);
 		++count;
-		if (*breakptr)
-			return -1;
 
 		LOCK_DEFERRED_QUEUE(queue);
+		if (*breakptr)
+			return -1;
 	}
 	return count;
 }
@@ -1276,7 +1943,9 @@ event_process_deferred_callbacks(struct deferred_cb_queue *queue, int *breakptr)
 /*
  * Active events are stored in priority queues.  Lower priorities are always
  * process before higher priorities.  Low priority events can starve high
- * priority ones.
+ * priority ones, unless the base has priority weights: then we take up to
+ * weight[i] events from each queue in turn.  Either way, the dispatch
+ * budget can cut us short, leaving the rest for the next iteration.
  */
 
 static void
@@ -1284,23 +1953,50 @@ event_process_active(struct event_base *base)
 {
 	/* Caller must hold th_base_lock */
 	struct event_list *activeq = NULL;
-	int i, c;
+	struct dispatch_budget budget, *limit;
+	const int *weights = base->priority_weights;
+	int i, c, limit_after_prio = base->limit_callbacks_after_prio;
+	ev_uint64_t started = 0;
+
+	if (EVUTIL_UNLIKELY(base->loop_stats != NULL))
+		started = loop_stats_begin_callbacks(base);
+
+	budget.callbacks = base->max_dispatch_callbacks;
+	budget.deadline = 0;
+	budget.exhausted = 0;
+	if (base->max_dispatch_nsec &&
+	    evclock_gettime(&base->clock, &budget.deadline) == 0)
+		budget.deadline += base->max_dispatch_nsec;
+	if (!base->max_dispatch_callbacks && !budget.deadline)
+		limit_after_prio = INT_MAX;
 
 	for (i = 0; i < base->nactivequeues; ++i) {
 		if (TAILQ_FIRST(&base->activequeues[i]) != NULL) {
 			activeq = &base->activequeues[i];
-			c = event_process_active_single_queue(base, activeq);
+			limit = i >= limit_after_prio ?
+			    &budget : NULL;
+			c = event_process_active_single_queue(base, activeq,
+			    weights ? weights[i] : INT_MAX, limit);
 			if (c < 0)
-				return;
-			else if (c > 0)
+				goto done;
+			else if (budget.exhausted)
+				break;
+			else if (c > 0 && !weights)
 				break; /* Processed a real event; do not
 					* consider lower-priority events */
 			/* If we get here, all of the events we processed
-			 * were internal.  Continue. */
+			 * were internal, or we're sharing out the iteration
+			 * by weight.  Continue. */
 		}
 	}
 
-	event_process_deferred_callbacks(&base->defer_queue,&base->event_break);
+	event_process_deferred_callbacks(&base->defer_queue, &base->event_break,
+	    base->max_deferred_callbacks ? base->max_deferred_callbacks :
+	    INT_MAX);
+
+done:
+	if (started && base->loop_stats)
+		loop_stats_end_callbacks(base, started);
 }
 
 /*
@@ -1406,7 +2102,9 @@ event_base_loop(struct event_base *base, int flags)
 	const struct eventop *evsel = base->evsel;
 	struct timeval tv;
 	struct timeval *tv_p;
+	struct timeval sim_wait;
 	int res, done, retval = 0;
+	ev_uint64_t dispatch_started;
 
 	/* Grab the lock.  We will release it inside evsel.dispatch, and again
 	 * as we invoke user callbacks. */
@@ -1423,17 +2121,22 @@ event_base_loop(struct event_base *base, int flags)
 
 	clear_time_cache(base);
 
-	if (base->sig.ev_signal_added)
+	if (base->sig.ev_signal_added && base->sig.sigfd < 0)
 		evsig_base = base;
 	done = 0;
 
 #ifndef _EVENT_DISABLE_THREAD_SUPPORT
 	base->th_owner_id = EVTHREAD_GET_ID();
 #endif
+	if (base->n_cpus)
+		event_base_pin_loop_thread(base);
 
 	base->event_gotterm = base->event_break = 0;
 
 	while (!done) {
+#ifdef EVENT_USE_INBOX
+		event_base_drain_inbox(base, 0);
+#endif
 		/* Terminate the loop if we have been asked to */
 		if (base->event_gotterm) {
 			break;
@@ -1468,7 +2171,26 @@ event_base_loop(struct event_base *base, int flags)
 
 		clear_time_cache(base);
 
-		res = evsel->dispatch(base, tv_p);
+		/* In simulated time, we don't wait for the next timeout; we
+		 * only check whether anything is ready, and if nothing is,
+		 * skip ahead to the timeout. */
+		evutil_timerclear(&sim_wait);
+		if (base->clock.source == EVENT_CLOCK_SIMULATED && tv_p &&
+		    evutil_timerisset(tv_p)) {
+			sim_wait = *tv_p;
+			evutil_timerclear(tv_p);
+		}
+
+		++base->dispatch_stats.n_dispatch;
+		dispatch_started = EVUTIL_UNLIKELY(base->loop_stats != NULL) ?
+		    loop_stats_now(base) : 0;
+		res = 0;
+		if (evutil_timerisset(&base->busy_poll) &&
+		    (tv_p == NULL || evutil_timerisset(tv_p)) &&
+		    base->clock.source != EVENT_CLOCK_SIMULATED)
+			res = event_base_busy_poll(base, tv_p);
+		if (res == 0)
+			res = evsel->dispatch(base, tv_p);
 
 		if (res == -1) {
 			event_debug(("%s: dispatch returned unsuccessfully.",
@@ -1476,9 +2198,21 @@ event_base_loop(struct event_base *base, int flags)
 			retval = -1;
 			goto done;
 		}
+#ifdef EVENT_USE_INBOX
+		/* The backend may have activated fds through the inbox. */
+		event_base_drain_inbox(base, 0);
+#endif
+
+		if (evutil_timerisset(&sim_wait) && !N_ACTIVE_CALLBACKS(base))
+			evclock_advance(&base->clock,
+			    (ev_uint64_t)sim_wait.tv_sec * 1000000000 +
+			    (ev_uint64_t)sim_wait.tv_usec * 1000);
 
 		update_time_cache(base);
 
+		if (dispatch_started && base->loop_stats)
+			loop_stats_dispatched(base, dispatch_started);
+
 		timeout_process(base);
 
 		if (N_ACTIVE_CALLBACKS(base)) {
@@ -1499,6 +2233,47 @@ done:
 	return (retval);
 }
 
+/* Poll the backend of 'base' without blocking, again and again, until
+ * something becomes active or base->busy_poll passes.  If 'tv_p' is not
+ * NULL, stop when it passes too, and take the time we spent off it.
+ * Return 1 if something became active, 0 if the caller should go on to
+ * block in the backend, or -1 on error. */
+static int
+event_base_busy_poll(struct event_base *base, struct timeval *tv_p)
+{
+	const struct eventop *evsel = base->evsel;
+	struct timeval zero, limit, start, now, spent;
+
+	limit = base->busy_poll;
+	if (tv_p && evutil_timercmp(tv_p, &limit, <))
+		limit = *tv_p;
+
+	gettime(base, &start);
+	do {
+		evutil_timerclear(&zero);
+		++base->dispatch_stats.n_busy_polls;
+		if (evsel->dispatch(base, &zero) == -1)
+			return (-1);
+#ifdef EVENT_USE_INBOX
+		event_base_drain_inbox(base, 0);
+#endif
+		if (N_ACTIVE_CALLBACKS(base)) {
+			++base->dispatch_stats.n_busy_poll_hits;
+			return (1);
+		}
+		gettime(base, &now);
+		evutil_timersub(&now, &start, &spent);
+	} while (evutil_timercmp(&spent, &limit, <));
+
+	if (tv_p) {
+		if (evutil_timercmp(&spent, tv_p, <))
+			evutil_timersub(tv_p, &spent, tv_p);
+		else
+			evutil_timerclear(tv_p);
+	}
+	return (0);
+}
+
 /* Sets up an event for processing once */
 struct event_once {
 	struct event ev;
@@ -1516,7 +2291,7 @@ event_once_cb(evutil_socket_t fd, short events, void *arg)
 
 	(*eonce->cb)(fd, events, eonce->arg);
 	event_debug_unassign(&eonce->ev);
-	mm_free(eonce);
+	evslab_free(eonce);
 }
 
 /* not threadsafe, event scheduled once. */
@@ -1543,7 +2318,8 @@ event_base_once(struct event_base *base, evutil_socket_t fd, short events,
 	if (events & (EV_SIGNAL|EV_PERSIST))
 		return (-1);
 
-	if ((eonce = mm_calloc(1, sizeof(struct event_once))) == NULL)
+	if ((eonce = event_base_alloc_obj(base,
+	    sizeof(struct event_once))) == NULL)
 		return (-1);
 
 	eonce->cb = callback;
@@ -1562,14 +2338,14 @@ event_base_once(struct event_base *base, evutil_socket_t fd, short events,
 		event_assign(&eonce->ev, base, fd, events, event_once_cb, eonce);
 	} else {
 		/* Bad event combination */
-		mm_free(eonce);
+		evslab_free(eonce);
 		return (-1);
 	}
 
 	if (res == 0)
 		res = event_add(&eonce->ev, tv);
 	if (res != 0) {
-		mm_free(eonce);
+		evslab_free(eonce);
 		return (res);
 	}
 
@@ -1594,6 +2370,8 @@ event_assign(struct event *ev, struct event_base *base, evutil_socket_t fd, shor
 	ev->ev_flags = EVLIST_INIT;
 	ev->ev_ncalls = 0;
 	ev->ev_pncalls = NULL;
+	ev->ev_inbox_next = NULL;
+	ev->ev_inbox_res = 0;
 
 	if (events & EV_SIGNAL) {
 		if ((events & (EV_READ|EV_WRITE)) != 0) {
@@ -1647,15 +2425,41 @@ event_set(struct event *ev, evutil_socket_t fd, short events,
 	EVUTIL_ASSERT(r == 0);
 }
 
+void *
+event_base_alloc_obj(struct event_base *base, size_t size)
+{
+	struct evslab *slab = NULL;
+	int i;
+
+	if (base == NULL)
+		return evslab_alloc_unpooled(size);
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	for (i = 0; i < EVENT_BASE_N_SLABS; ++i) {
+		if (base->slabs[i] == NULL) {
+			slab = base->slabs[i] = evslab_new_on_node(size,
+			    base->numa_node);
+			break;
+		}
+		if (evslab_obj_size(base->slabs[i]) == size) {
+			slab = base->slabs[i];
+			break;
+		}
+	}
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	return slab ? evslab_alloc(slab) : evslab_alloc_unpooled(size);
+}
+
 struct event *
 event_new(struct event_base *base, evutil_socket_t fd, short events, void (*cb)(evutil_socket_t, short, void *), void *arg)
 {
 	struct event *ev;
-	ev = mm_malloc(sizeof(struct event));
+	ev = event_base_alloc_obj(base, sizeof(struct event));
 	if (ev == NULL)
 		return (NULL);
 	if (event_assign(ev, base, fd, events, cb, arg) < 0) {
-		mm_free(ev);
+		evslab_free(ev);
 		return (NULL);
 	}
 
@@ -1667,10 +2471,15 @@ event_free(struct event *ev)
 {
 	_event_debug_assert_is_setup(ev);
 
+	if (ev->ev_closure == EV_CLOSURE_GROUP) {
+		event_group_member_free(ev);
+		return;
+	}
+
 	/* make sure that this event won't be coming back to haunt us. */
 	event_del(ev);
 	_event_debug_note_teardown(ev);
-	mm_free(ev);
+	evslab_free(ev);
 
 }
 
@@ -1683,6 +2492,165 @@ event_debug_unassign(struct event *ev)
 	ev->ev_flags &= ~EVLIST_INIT;
 }
 
+/*
+ * Event groups.  A member is an ordinary persistent event, except that when
+ * it becomes active it goes on its group's ready list (see
+ * event_queue_insert) rather than on an active queue.  The first member to
+ * become ready activates the group's dispatch_ev, whose callback takes the
+ * whole list under one lock and hands it to the user in one call.
+ */
+
+static void
+event_group_dispatch_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct event_group *group = arg;
+	struct event_base *base = group->base;
+	struct event *ev;
+	int n = 0;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	while (n < EVENT_GROUP_MAX_BATCH &&
+	    (ev = TAILQ_FIRST(&group->ready)) != NULL) {
+		struct event_group_item *item = &group->items[n++];
+		event_queue_remove(base, ev, EVLIST_ACTIVE);
+		event_persist_reschedule(base, ev);
+		item->fd = ev->ev_fd;
+		item->what = ev->ev_res;
+		item->arg = ev->ev_arg;
+		item->ev = ev;
+	}
+	group->dispatching = 1;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	if (n)
+		group->cb(group, group->items, n, group->arg);
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	group->dispatching = 0;
+	if (group->freed) {
+		/* event_group_free was called from the callback. */
+		EVBASE_RELEASE_LOCK(base, th_base_lock);
+		mm_free(group);
+		return;
+	}
+	/* Whatever didn't fit in this batch goes in the next one. */
+	if (TAILQ_FIRST(&group->ready) != NULL)
+		event_active_nolock(&group->dispatch_ev, EV_READ, 1);
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+}
+
+struct event_group *
+event_group_new(struct event_base *base, event_group_cb cb, void *arg)
+{
+	struct event_group *group;
+
+	if (cb == NULL)
+		return (NULL);
+	if ((group = mm_calloc(1, sizeof(struct event_group))) == NULL)
+		return (NULL);
+	group->base = base;
+	group->cb = cb;
+	group->arg = arg;
+	TAILQ_INIT(&group->ready);
+	TAILQ_INIT(&group->members);
+	event_assign(&group->dispatch_ev, base, -1, 0,
+	    event_group_dispatch_cb, group);
+
+	return (group);
+}
+
+struct event *
+event_group_add(struct event_group *group, evutil_socket_t fd, short events,
+    void *arg)
+{
+	struct event_base *base = group->base;
+	struct event_group_member *m;
+
+	if (!(events & (EV_READ|EV_WRITE)) || (events & EV_SIGNAL))
+		return (NULL);
+	if ((m = event_base_alloc_obj(base,
+	    sizeof(struct event_group_member))) == NULL)
+		return (NULL);
+	if (event_assign(&m->ev, base, fd, events | EV_PERSIST, NULL,
+		arg) < 0) {
+		evslab_free(m);
+		return (NULL);
+	}
+	m->ev.ev_closure = EV_CLOSURE_GROUP;
+	m->group = group;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	TAILQ_INSERT_TAIL(&group->members, m, next);
+	if (event_add_internal(&m->ev, NULL, 0) < 0) {
+		TAILQ_REMOVE(&group->members, m, next);
+		EVBASE_RELEASE_LOCK(base, th_base_lock);
+		_event_debug_note_teardown(&m->ev);
+		evslab_free(m);
+		return (NULL);
+	}
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	return (&m->ev);
+}
+
+int
+event_group_priority_set(struct event_group *group, int pri)
+{
+	return event_priority_set(&group->dispatch_ev, pri);
+}
+
+/* Called by event_free() for a group member. */
+static void
+event_group_member_free(struct event *ev)
+{
+	struct event_group_member *m =
+	    EVUTIL_UPCAST(ev, struct event_group_member, ev);
+	struct event_base *base = ev->ev_base;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+#ifdef EVENT_USE_INBOX
+	/* The member's memory is about to go back to the slab; it can't
+	 * stay in the inbox. */
+	event_drain_inbox_for(ev);
+#endif
+	event_del_internal(ev);
+	TAILQ_REMOVE(&m->group->members, m, next);
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	_event_debug_note_teardown(ev);
+	evslab_free(m);
+}
+
+void
+event_group_free(struct event_group *group)
+{
+	struct event_base *base = group->base;
+	struct event_group_member *m;
+	int dispatching;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	while ((m = TAILQ_FIRST(&group->members)) != NULL) {
+#ifdef EVENT_USE_INBOX
+		event_drain_inbox_for(&m->ev);
+#endif
+		event_del_internal(&m->ev);
+		TAILQ_REMOVE(&group->members, m, next);
+		_event_debug_note_teardown(&m->ev);
+		evslab_free(m);
+	}
+#ifdef EVENT_USE_INBOX
+	event_drain_inbox_for(&group->dispatch_ev);
+#endif
+	event_del_internal(&group->dispatch_ev);
+	_event_debug_note_teardown(&group->dispatch_ev);
+	dispatching = group->dispatching;
+	group->freed = 1;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	if (!dispatching)
+		mm_free(group);
+}
+
 /*
  * Set's the priority of an event - if an event is already scheduled
  * changing the priority is going to fail.
@@ -1719,6 +2687,8 @@ event_pending(const struct event *ev, short event, struct timeval *tv)
 		flags |= (ev->ev_events & (EV_READ|EV_WRITE|EV_SIGNAL));
 	if (ev->ev_flags & EVLIST_ACTIVE)
 		flags |= ev->ev_res;
+	/* Activated by another thread, but the loop hasn't got to it. */
+	flags |= ev->ev_inbox_res;
 	if (ev->ev_flags & EVLIST_TIMEOUT)
 		flags |= EV_TIMEOUT;
 
@@ -1865,8 +2835,103 @@ evthread_notify_base(struct event_base *base)
 {
 	if (!base->th_notify_fn)
 		return -1;
+#ifdef EVENT_USE_INBOX
+	/* One wakeup on the way is enough: the loop will look at everything
+	 * that has changed when it gets it. */
+	if (EVMPSC_XCHG(&base->th_notify_pending, 1))
+		return 0;
+	if (base->th_notify_fn(base) < 0) {
+		EVMPSC_STORE(&base->th_notify_pending, 0);
+		return -1;
+	}
+	return 0;
+#else
 	return base->th_notify_fn(base);
+#endif
+}
+
+#ifdef EVENT_USE_INBOX
+/* Helpers for event_base_drain_inbox(): put an event or deferred_cb that
+ * another thread handed us where it would have gone without the inbox.
+ * We clear its inbox state first, so that anyone who activates it from
+ * now on has to push it again. */
+static void
+event_take_from_inbox(struct event *ev)
+{
+	event_active_nolock(ev, EVMPSC_XCHG(&ev->ev_inbox_res, 0), 1);
+}
+
+static void
+deferred_cb_take_from_inbox(struct deferred_cb_queue *queue,
+    struct deferred_cb *cb)
+{
+	if (!cb->queued) {
+		cb->queued = 1;
+		TAILQ_INSERT_TAIL(&queue->deferred_cb_list, cb, cb_next);
+		++queue->active_count;
+	}
+	/* Only now, so that event_deferred_cb_is_pending() never sees the
+	 * callback as neither queued nor in the inbox. */
+	EVMPSC_XCHG(&cb->inbox_queued, 0);
+}
+
+/* Take the oldest event from 'base's inbox, waiting out a push in
+ * progress.  Returns 0 if the inbox is empty.  Caller must hold
+ * th_base_lock. */
+static int
+event_base_drain_inbox_one(struct event_base *base)
+{
+	struct evmpsc_node *node = evmpsc_wait(&base->inbox);
+	if (!node)
+		return 0;
+	event_take_from_inbox(EVUTIL_UPCAST(node, struct event,
+		ev_inbox_next));
+	return 1;
+}
+
+/* If another thread activated 'ev', make it really active, so that
+ * deleting or freeing it cancels that too.  Caller must hold
+ * th_base_lock. */
+static void
+event_drain_inbox_for(struct event *ev)
+{
+	while (EVMPSC_LOAD(&ev->ev_inbox_res) &&
+	    event_base_drain_inbox_one(ev->ev_base))
+		;
+}
+
+/* Likewise for 'queue's inbox.  Caller must hold the queue's lock. */
+static int
+deferred_cb_drain_inbox_one(struct deferred_cb_queue *queue)
+{
+	struct evmpsc_node *node = evmpsc_wait(&queue->inbox);
+	if (!node)
+		return 0;
+	deferred_cb_take_from_inbox(queue,
+	    EVUTIL_UPCAST(node, struct deferred_cb, inbox_node));
+	return 1;
+}
+
+/* Take everything that other threads have activated or scheduled on
+ * 'base'.  Unless 'all' is set, stop at a push that is still in
+ * progress: the thread making it will wake us up again once it is done.
+ * Caller must hold th_base_lock. */
+static void
+event_base_drain_inbox(struct event_base *base, int all)
+{
+	struct deferred_cb_queue *queue = &base->defer_queue;
+	struct evmpsc_node *(*pop)(struct evmpsc_queue *) =
+	    all ? evmpsc_wait : evmpsc_pop;
+	struct evmpsc_node *node;
+
+	while ((node = pop(&base->inbox)) != NULL)
+		event_take_from_inbox(EVUTIL_UPCAST(node, struct event,
+			ev_inbox_next));
+	while ((node = pop(&queue->inbox)) != NULL)
+		deferred_cb_take_from_inbox(queue,
+		    EVUTIL_UPCAST(node, struct deferred_cb, inbox_node));
 }
+#endif
 
 /* Implementation function to add an event.  Works just like event_add,
  * except: 1) it requires that we have the lock.  2) if tv_is_absolute is set,
@@ -1898,8 +2963,13 @@ event_add_internal(struct event *ev, const struct timeval *tv,
 	 * prepare for timeout insertion further below, if we get a
 	 * failure on any step, we should not change any state.
 	 */
-	if (tv != NULL && !(ev->ev_flags & EVLIST_TIMEOUT)) {
-		if (min_heap_reserve(&base->timeheap,
+	if (tv != NULL && !(ev->ev_flags & EVLIST_TIMEOUT) &&
+	    base->timewheel == NULL) {
+		if (USE_HEAP4(base)) {
+			if (min_heap4_reserve(&base->timeheap4,
+				1 + min_heap4_size(&base->timeheap4)) == -1)
+				return (-1);  /* ENOMEM == errno */
+		} else if (min_heap_reserve(&base->timeheap,
 			1 + min_heap_size(&base->timeheap)) == -1)
 			return (-1);  /* ENOMEM == errno */
 	}
@@ -1936,6 +3006,10 @@ event_add_internal(struct event *ev, const struct timeval *tv,
 		struct timeval now;
 		int common_timeout;
 
+		if (base->auto_timeouts && !tv_is_absolute &&
+		    !is_common_timeout(tv, base))
+			tv = auto_common_timeout(base, tv);
+
 		/*
 		 * for persistent timeout events, we remember the
 		 * timeout value and re-add the event.
@@ -1951,7 +3025,7 @@ event_add_internal(struct event *ev, const struct timeval *tv,
 		 */
 		if (ev->ev_flags & EVLIST_TIMEOUT) {
 			/* XXX I believe this is needless. */
-			if (min_heap_elt_is_top(ev))
+			if (timeout_is_top(base, ev))
 				notify = 1;
 			event_queue_remove(base, ev, EVLIST_TIMEOUT);
 		}
@@ -2005,7 +3079,7 @@ event_add_internal(struct event *ev, const struct timeval *tv,
 			 * was before: if so, we will need to tell the main
 			 * thread to wake up earlier than it would
 			 * otherwise. */
-			if (min_heap_elt_is_top(ev))
+			if (timeout_is_top(base, ev))
 				notify = 1;
 		}
 	}
@@ -2029,6 +3103,9 @@ event_del(struct event *ev)
 
 	EVBASE_ACQUIRE_LOCK(ev->ev_base, th_base_lock);
 
+#ifdef EVENT_USE_INBOX
+	event_drain_inbox_for(ev);
+#endif
 	res = event_del_internal(ev);
 
 	EVBASE_RELEASE_LOCK(ev->ev_base, th_base_lock);
@@ -2089,10 +3166,22 @@ event_del_internal(struct event *ev)
 
 	if (ev->ev_flags & EVLIST_INSERTED) {
 		event_queue_remove(base, ev, EVLIST_INSERTED);
-		if (ev->ev_events & (EV_READ|EV_WRITE))
+		if (ev->ev_events & (EV_READ|EV_WRITE)) {
 			res = evmap_io_del(base, ev->ev_fd, ev);
-		else
+#ifdef EVMAP_ACTIVE_UNLOCKED
+			/* The loop may have found the event ready, without
+			 * th_base_lock, just before evmap_io_del() took it
+			 * off its fd.  Don't let that activate it later. */
+			if (EVMPSC_LOAD(&ev->ev_inbox_res)) {
+				event_drain_inbox_for(ev);
+				if (ev->ev_flags & EVLIST_ACTIVE)
+					event_queue_remove(base, ev,
+					    EVLIST_ACTIVE);
+			}
+#endif
+		} else {
 			res = evmap_signal_del(base, ev->ev_fd, ev);
+		}
 		if (res == 1) {
 			/* evmap says we need to notify the main thread. */
 			notify = 1;
@@ -2115,6 +3204,19 @@ event_del_internal(struct event *ev)
 void
 event_active(struct event *ev, int res, short ncalls)
 {
+#ifdef EVENT_USE_INBOX
+	/* From another thread, leave the event in the inbox rather than
+	 * contending for the lock with the loop.  Signal events need their
+	 * ncalls, so they take the slow way. */
+	if (res && !(ev->ev_events & EV_SIGNAL) &&
+	    EVBASE_USE_INBOX(ev->ev_base)) {
+		_event_debug_assert_is_setup(ev);
+		event_active_later(ev, (short)res);
+		evthread_notify_base(ev->ev_base);
+		return;
+	}
+#endif
+
 	EVBASE_ACQUIRE_LOCK(ev->ev_base, th_base_lock);
 
 	_event_debug_assert_is_setup(ev);
@@ -2125,6 +3227,16 @@ event_active(struct event *ev, int res, short ncalls)
 }
 
 
+#ifdef EVENT_USE_INBOX
+void
+event_active_later(struct event *ev, short res)
+{
+	if (EVMPSC_OR(&ev->ev_inbox_res, res) == 0)
+		evmpsc_push(&ev->ev_base->inbox,
+		    (struct evmpsc_node *)&ev->ev_inbox_next);
+}
+#endif
+
 void
 event_active_nolock(struct event *ev, int res, short ncalls)
 {
@@ -2176,6 +3288,13 @@ event_deferred_cb_cancel(struct deferred_cb_queue *queue,
 	}
 
 	LOCK_DEFERRED_QUEUE(queue);
+#ifdef EVENT_USE_INBOX
+	/* Get it out of the inbox, where we can't remove it from the
+	 * middle. */
+	while (EVMPSC_LOAD(&cb->inbox_queued) &&
+	    deferred_cb_drain_inbox_one(queue))
+		;
+#endif
 	if (cb->queued) {
 		TAILQ_REMOVE(&queue->deferred_cb_list, cb, cb_next);
 		--queue->active_count;
@@ -2195,6 +3314,16 @@ event_deferred_cb_schedule(struct deferred_cb_queue *queue,
 			return;
 	}
 
+#ifdef EVENT_USE_INBOX
+	if (queue->notify_fn == notify_base_cbq_callback &&
+	    EVBASE_USE_INBOX((struct event_base *)queue->notify_arg)) {
+		if (!EVMPSC_XCHG(&cb->inbox_queued, 1))
+			evmpsc_push(&queue->inbox, &cb->inbox_node);
+		evthread_notify_base(queue->notify_arg);
+		return;
+	}
+#endif
+
 	LOCK_DEFERRED_QUEUE(queue);
 	if (!cb->queued) {
 		cb->queued = 1;
@@ -2215,14 +3344,23 @@ timeout_next(struct event_base *base, struct timeval **tv_p)
 	struct timeval now;
 	struct event *ev;
 	struct timeval *tv = *tv_p;
+	struct timeval when;
 	int res = 0;
 
-	ev = min_heap_top(&base->timeheap);
+	if (base->timewheel) {
+		if (!timewheel_next(base->timewheel, &when)) {
+			*tv_p = NULL;
+			goto out;
+		}
+	} else {
+		ev = timeheap_top(base);
 
-	if (ev == NULL) {
-		/* if no time-based events are active wait for I/O */
-		*tv_p = NULL;
-		goto out;
+		if (ev == NULL) {
+			/* if no time-based events are active wait for I/O */
+			*tv_p = NULL;
+			goto out;
+		}
+		when = ev->ev_timeout;
 	}
 
 	if (gettime(base, &now) == -1) {
@@ -2230,12 +3368,12 @@ timeout_next(struct event_base *base, struct timeval **tv_p)
 		goto out;
 	}
 
-	if (evutil_timercmp(&ev->ev_timeout, &now, <=)) {
+	if (evutil_timercmp(&when, &now, <=)) {
 		evutil_timerclear(tv);
 		goto out;
 	}
 
-	evutil_timersub(&ev->ev_timeout, &now, tv);
+	evutil_timersub(&when, &now, tv);
 
 	EVUTIL_ASSERT(tv->tv_sec >= 0);
 	EVUTIL_ASSERT(tv->tv_usec >= 0);
@@ -2260,7 +3398,7 @@ timeout_correct(struct event_base *base, struct timeval *tv)
 	struct timeval off;
 	int i;
 
-	if (use_monotonic)
+	if (evclock_is_monotonic(&base->clock))
 		return;
 
 	/* Check if time is running backwards */
@@ -2277,14 +3415,23 @@ timeout_correct(struct event_base *base, struct timeval *tv)
 
 	/*
 	 * We can modify the key element of the node without destroying
-	 * the minheap property, because we change every element.
+	 * the minheap property, because we change every element.  The
+	 * wheel has to be rebuilt around the new time.
 	 */
+	if (base->timewheel)
+		timewheel_correct(base->timewheel, &off, tv);
 	pev = base->timeheap.p;
 	size = base->timeheap.n;
 	for (; size-- > 0; ++pev) {
 		struct timeval *ev_tv = &(**pev).ev_timeout;
 		evutil_timersub(ev_tv, &off, ev_tv);
 	}
+	for (i = 0; i < (int)base->timeheap4.n; ++i) {
+		struct min_heap4_entry *ent = &base->timeheap4.p[i];
+		struct timeval *ev_tv = &ent->ev->ev_timeout;
+		evutil_timersub(ev_tv, &off, ev_tv);
+		ent->key = min_heap4_key(ev_tv);
+	}
 	for (i=0; i<base->n_common_timeouts; ++i) {
 		struct event *ev;
 		struct common_timeout_list *ctl =
@@ -2311,13 +3458,28 @@ timeout_process(struct event_base *base)
 	struct timeval now;
 	struct event *ev;
 
-	if (min_heap_empty(&base->timeheap)) {
+	if (base->timewheel) {
+		if (timewheel_empty(base->timewheel))
+			return;
+		gettime(base, &now);
+		timewheel_advance(base->timewheel, &now);
+		while ((ev = timewheel_first_due(base->timewheel))) {
+			event_del_internal(ev);
+
+			event_debug(("timeout_process: call %p",
+				 ev->ev_callback));
+			event_active_nolock(ev, EV_TIMEOUT, 1);
+		}
+		return;
+	}
+
+	if ((ev = timeheap_top(base)) == NULL) {
 		return;
 	}
 
 	gettime(base, &now);
 
-	while ((ev = min_heap_top(&base->timeheap))) {
+	while ((ev = timeheap_top(base))) {
 		if (evutil_timercmp(&ev->ev_timeout, &now, >))
 			break;
 
@@ -2348,9 +3510,15 @@ event_queue_remove(struct event_base *base, struct event *ev, int queue)
 	ev->ev_flags &= ~queue;
 	switch (queue) {
 	case EVLIST_INSERTED:
-		TAILQ_REMOVE(&base->eventqueue, ev, ev_next);
+		/* The event's fd or signal map entry is its list. */
 		break;
 	case EVLIST_ACTIVE:
+		if (ev->ev_closure == EV_CLOSURE_GROUP) {
+			struct event_group *group = EVUTIL_UPCAST(ev,
+			    struct event_group_member, ev)->group;
+			TAILQ_REMOVE(&group->ready, ev, ev_active_next);
+			break;
+		}
 		base->event_count_active--;
 		TAILQ_REMOVE(&base->activequeues[ev->ev_pri],
 		    ev, ev_active_next);
@@ -2361,6 +3529,10 @@ event_queue_remove(struct event_base *base, struct event *ev, int queue)
 			    get_common_timeout_list(base, &ev->ev_timeout);
 			TAILQ_REMOVE(&ctl->events, ev,
 			    ev_timeout_pos.ev_next_with_common_timeout);
+		} else if (base->timewheel) {
+			timewheel_erase(base->timewheel, ev);
+		} else if (USE_HEAP4(base)) {
+			min_heap4_erase(&base->timeheap4, ev);
 		} else {
 			min_heap_erase(&base->timeheap, ev);
 		}
@@ -2422,9 +3594,19 @@ event_queue_insert(struct event_base *base, struct event *ev, int queue)
 	ev->ev_flags |= queue;
 	switch (queue) {
 	case EVLIST_INSERTED:
-		TAILQ_INSERT_TAIL(&base->eventqueue, ev, ev_next);
 		break;
 	case EVLIST_ACTIVE:
+		if (ev->ev_closure == EV_CLOSURE_GROUP) {
+			/* Group members wait on their group's ready list; the
+			 * group's own event delivers them all at once. */
+			struct event_group *group = EVUTIL_UPCAST(ev,
+			    struct event_group_member, ev)->group;
+			TAILQ_INSERT_TAIL(&group->ready, ev, ev_active_next);
+			if (!(group->dispatch_ev.ev_flags & EVLIST_ACTIVE))
+				event_active_nolock(&group->dispatch_ev,
+				    EV_READ, 1);
+			break;
+		}
 		base->event_count_active++;
 		TAILQ_INSERT_TAIL(&base->activequeues[ev->ev_pri],
 		    ev,ev_active_next);
@@ -2434,6 +3616,10 @@ event_queue_insert(struct event_base *base, struct event *ev, int queue)
 			struct common_timeout_list *ctl =
 			    get_common_timeout_list(base, &ev->ev_timeout);
 			insert_common_timeout_inorder(ctl, ev);
+		} else if (base->timewheel) {
+			timewheel_insert(base->timewheel, ev);
+		} else if (USE_HEAP4(base)) {
+			min_heap4_push(&base->timeheap4, ev);
 		} else
 			min_heap_push(&base->timeheap, ev);
 		break;
@@ -2552,6 +3738,9 @@ evthread_notify_drain_eventfd(evutil_socket_t fd, short what, void *arg)
 	if (r<0 && errno != EAGAIN) {
 		event_sock_warn(fd, "Error reading from eventfd");
 	}
+#ifdef EVENT_USE_INBOX
+	EVMPSC_XCHG(&((struct event_base *)arg)->th_notify_pending, 0);
+#endif
 }
 #endif
 
@@ -2566,6 +3755,10 @@ evthread_notify_drain_default(evutil_socket_t fd, short what, void *arg)
 	while (read(fd, (char*)buf, sizeof(buf)) > 0)
 		;
 #endif
+#ifdef EVENT_USE_INBOX
+	/* Only now that the wakeup is gone may anyone send another. */
+	EVMPSC_XCHG(&((struct event_base *)arg)->th_notify_pending, 0);
+#endif
 }
 
 int
@@ -2635,27 +3828,36 @@ evthread_make_base_notifiable(struct event_base *base)
 	return event_add(&base->th_notify, NULL);
 }
 
+/* Helper for event_base_dump_events. */
+static int
+dump_inserted_event_cb(struct event_base *base, struct event *e, void *arg)
+{
+	FILE *output = arg;
+
+	if (!(e->ev_flags & EVLIST_INSERTED))
+		return (0);
+	fprintf(output, "  %p [fd %ld]%s%s%s%s%s\n",
+			(void*)e, (long)e->ev_fd,
+			(e->ev_events&EV_READ)?" Read":"",
+			(e->ev_events&EV_WRITE)?" Write":"",
+			(e->ev_events&EV_SIGNAL)?" Signal":"",
+			(e->ev_events&EV_TIMEOUT)?" Timeout":"",
+			(e->ev_events&EV_PERSIST)?" Persist":"");
+	return (0);
+}
+
 void
 event_base_dump_events(struct event_base *base, FILE *output)
 {
 	struct event *e;
 	int i;
 	fprintf(output, "Inserted events:\n");
-	TAILQ_FOREACH(e, &base->eventqueue, ev_next) {
-		fprintf(output, "  %p [fd %ld]%s%s%s%s%s\n",
-				(void*)e, (long)e->ev_fd,
-				(e->ev_events&EV_READ)?" Read":"",
-				(e->ev_events&EV_WRITE)?" Write":"",
-				(e->ev_events&EV_SIGNAL)?" Signal":"",
-				(e->ev_events&EV_TIMEOUT)?" Timeout":"",
-				(e->ev_events&EV_PERSIST)?" Persist":"");
-
-	}
+	evmap_foreach_event(base, dump_inserted_event_cb, output);
 	for (i = 0; i < base->nactivequeues; ++i) {
 		if (TAILQ_EMPTY(&base->activequeues[i]))
 			continue;
 		fprintf(output, "Active events [priority %d]:\n", i);
-		TAILQ_FOREACH(e, &base->eventqueue, ev_next) {
+		TAILQ_FOREACH(e, &base->activequeues[i], ev_active_next) {
 			fprintf(output, "  %p [fd %ld]%s%s%s%s\n",
 					(void*)e, (long)e->ev_fd,
 					(e->ev_res&EV_READ)?" Read active":"",
@@ -2665,3 +3867,16 @@ event_base_dump_events(struct event_base *base, FILE *output)
 		}
 	}
 }
+
+void
+event_base_add_virtual(struct event_base *base)
+{
+	++base->virtual_event_count;
+}
+
+void
+event_base_del_virtual(struct event_base *base)
+{
+	EVUTIL_ASSERT(base->virtual_event_count > 0);
+	--base->virtual_event_count;
+}
@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "event2/event-config.h"
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/queue.h>
+#ifdef _EVENT_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef _EVENT_HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+#include <sys/socket.h>
+#include <errno.h>
+#include <string.h>
+
+#include "event2/event.h"
+#include "event2/event_struct.h"
+#include "event2/thread.h"
+#include "event2/pool.h"
+#include "event2/util.h"
+#include "event-internal.h"
+#include "evthread-internal.h"
+#include "log-internal.h"
+#include "mm-internal.h"
+#include "mpsc-internal.h"
+#include "evnuma-internal.h"
+#include "util-internal.h"
+
+#ifdef _EVENT_DISABLE_THREAD_SUPPORT
+#error "event_base_pool needs thread support"
+#endif
+#ifndef EVMPSC_LOCKFREE
+#error "event_base_pool needs a compiler with atomic builtins"
+#endif
+
+/* Closures to run per callback, so that a flood of posts can't keep a
+ * loop from its I/O for long. */
+#define POOL_MAX_CLOSURES_PER_WAKEUP 256
+
+/* The most CPUs we spread a pool's loops over. */
+#define POOL_MAX_CPUS 1024
+
+struct pool_closure {
+	struct evmpsc_node node;
+	void (*fn)(void *);
+	void *arg;
+};
+
+struct pool_loop {
+	struct event_base_pool *pool;
+	struct event_base *base;
+	pthread_t thread;
+	unsigned running : 1;
+
+	struct evmpsc_queue inbox;
+	/** Set by whichever poster finds it clear, which then wakes the
+	 * loop; the loop clears it again just before it drains the inbox.
+	 * Everyone else posting in between can skip the wakeup. */
+	int wakeup_pending;
+	/** Closures posted but not yet run. */
+	int n_pending;
+	/** Set to make the loop exit after its next drain. */
+	int stop;
+
+	/** [0] is what the loop reads from, [1] what other threads write to.
+	 * With an eventfd they are the same. */
+	evutil_socket_t wake_fd[2];
+	struct event wake_ev;
+};
+
+struct event_base_pool {
+	int n_loops;
+	struct pool_loop *loops;
+	/** Held while starting the threads, so that none of them runs a
+	 * callback before every loop's 'thread' and 'running' are set. */
+	pthread_mutex_t start_lock;
+};
+
+static void
+pool_wake(struct pool_loop *loop)
+{
+#if defined(_EVENT_HAVE_EVENTFD) && defined(_EVENT_HAVE_SYS_EVENTFD_H)
+	if (loop->wake_fd[0] == loop->wake_fd[1]) {
+		ev_uint64_t msg = 1;
+		if (write(loop->wake_fd[1], &msg, sizeof(msg)) < 0 &&
+		    errno != EAGAIN)
+			event_sock_warn(loop->wake_fd[1], "%s: write", __func__);
+		return;
+	}
+#endif
+	/* EAGAIN just means the loop already has a wakeup waiting. */
+	if (send(loop->wake_fd[1], "", 1, 0) < 0 &&
+	    !EVUTIL_ERR_RW_RETRIABLE(evutil_socket_geterror(loop->wake_fd[1])))
+		event_sock_warn(loop->wake_fd[1], "%s: send", __func__);
+}
+
+static void
+pool_drain_wake_fd(struct pool_loop *loop)
+{
+	char buf[64];
+	while (recv(loop->wake_fd[0], buf, sizeof(buf), 0) > 0)
+		;
+}
+
+static void
+pool_inbox_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct pool_loop *loop = arg;
+	struct evmpsc_node *node;
+	int n = 0;
+
+#if defined(_EVENT_HAVE_EVENTFD) && defined(_EVENT_HAVE_SYS_EVENTFD_H)
+	if (loop->wake_fd[0] == loop->wake_fd[1]) {
+		ev_uint64_t msg;
+		if (read(fd, &msg, sizeof(msg)) < 0 && errno != EAGAIN)
+			event_sock_warn(fd, "%s: read", __func__);
+	} else
+#endif
+		pool_drain_wake_fd(loop);
+
+	/* From here on, a poster has to wake us again: anything it pushes
+	 * after we have looked at the inbox would otherwise sit there. */
+	EVMPSC_XCHG(&loop->wakeup_pending, 0);
+
+	while ((node = evmpsc_pop(&loop->inbox)) != NULL) {
+		struct pool_closure *c = (struct pool_closure *)node;
+		c->fn(c->arg);
+		mm_free(c);
+		EVMPSC_ADD(&loop->n_pending, -1);
+		if (++n == POOL_MAX_CLOSURES_PER_WAKEUP &&
+		    !evmpsc_empty(&loop->inbox)) {
+			/* Come back after the loop has had a look at
+			 * everything else. */
+			event_active(&loop->wake_ev, EV_READ, 1);
+			return;
+		}
+	}
+
+	if (EVMPSC_LOAD(&loop->stop))
+		event_base_loopbreak(loop->base);
+}
+
+/* Make the base for loop number 'idx' when 'cfg' asks for NUMA-local
+ * bases but names no CPUs: pin it to the idx'th of the CPUs we may run
+ * on, going round again if there are more loops than CPUs. */
+static struct event_base *
+pool_new_placed_base(struct event_config *cfg, int idx)
+{
+	int cpus[POOL_MAX_CPUS];
+	struct event_base *base;
+	int n;
+
+	n = evnuma_allowed_cpus(cpus, POOL_MAX_CPUS);
+	if (n <= 0)
+		return event_base_new_with_config(cfg);
+	if (event_config_set_cpu_affinity(cfg, &cpus[idx % n], 1) < 0)
+		return NULL;
+	base = event_base_new_with_config(cfg);
+	event_config_set_cpu_affinity(cfg, NULL, 0);
+	return base;
+}
+
+static int
+pool_loop_init(struct event_base_pool *pool, struct pool_loop *loop,
+    int idx, struct event_config *cfg)
+{
+	loop->pool = pool;
+	loop->wake_fd[0] = loop->wake_fd[1] = -1;
+	evmpsc_init(&loop->inbox);
+
+	if (!cfg)
+		loop->base = event_base_new();
+	else if ((cfg->flags & EVENT_BASE_FLAG_NUMA_LOCAL) && !cfg->n_cpus)
+		loop->base = pool_new_placed_base(cfg, idx);
+	else
+		loop->base = event_base_new_with_config(cfg);
+	if (!loop->base)
+		return -1;
+
+#if defined(_EVENT_HAVE_EVENTFD) && defined(_EVENT_HAVE_SYS_EVENTFD_H)
+	loop->wake_fd[0] = loop->wake_fd[1] = eventfd(0, 0);
+#endif
+	if (loop->wake_fd[0] < 0 &&
+	    evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, loop->wake_fd) < 0) {
+		event_sock_warn(-1, "%s: socketpair", __func__);
+		return -1;
+	}
+	evutil_make_socket_nonblocking(loop->wake_fd[0]);
+	evutil_make_socket_nonblocking(loop->wake_fd[1]);
+	evutil_make_socket_closeonexec(loop->wake_fd[0]);
+	evutil_make_socket_closeonexec(loop->wake_fd[1]);
+
+	event_assign(&loop->wake_ev, loop->base, loop->wake_fd[0],
+	    EV_READ|EV_PERSIST, pool_inbox_cb, loop);
+	return event_add(&loop->wake_ev, NULL);
+}
+
+static void
+pool_loop_clear(struct pool_loop *loop)
+{
+	struct evmpsc_node *node;
+
+	if (loop->base)
+		event_base_free(loop->base);
+	if (loop->wake_fd[0] >= 0)
+		EVUTIL_CLOSESOCKET(loop->wake_fd[0]);
+	if (loop->wake_fd[1] >= 0 && loop->wake_fd[1] != loop->wake_fd[0])
+		EVUTIL_CLOSESOCKET(loop->wake_fd[1]);
+	while ((node = evmpsc_wait(&loop->inbox)) != NULL)
+		mm_free(node);
+}
+
+struct event_base_pool *
+event_base_pool_new(int n_loops, struct event_config *cfg)
+{
+	struct event_base_pool *pool;
+	int i;
+
+	if (n_loops < 1)
+		return NULL;
+	if (!_evthread_lock_fns.lock && evthread_use_pthreads() < 0)
+		return NULL;
+
+	if (!(pool = mm_calloc(1, sizeof(*pool))))
+		return NULL;
+	if (!(pool->loops = mm_calloc(n_loops, sizeof(struct pool_loop)))) {
+		mm_free(pool);
+		return NULL;
+	}
+	if (pthread_mutex_init(&pool->start_lock, NULL)) {
+		mm_free(pool->loops);
+		mm_free(pool);
+		return NULL;
+	}
+	pool->n_loops = n_loops;
+	for (i = 0; i < n_loops; ++i) {
+		if (pool_loop_init(pool, &pool->loops[i], i, cfg) < 0) {
+			pool->n_loops = i + 1;
+			event_base_pool_free(pool);
+			return NULL;
+		}
+	}
+	return pool;
+}
+
+static void *
+pool_loop_thread(void *arg)
+{
+	struct pool_loop *loop = arg;
+
+	pthread_mutex_lock(&loop->pool->start_lock);
+	pthread_mutex_unlock(&loop->pool->start_lock);
+
+	if (event_base_loop(loop->base, 0) < 0)
+		event_warnx("%s: event_base_loop failed", __func__);
+	return NULL;
+}
+
+int
+event_base_pool_start(struct event_base_pool *pool)
+{
+	int i, r = 0;
+
+	pthread_mutex_lock(&pool->start_lock);
+	for (i = 0; i < pool->n_loops; ++i) {
+		struct pool_loop *loop = &pool->loops[i];
+		if (loop->running)
+			continue;
+		EVMPSC_STORE(&loop->stop, 0);
+		if (pthread_create(&loop->thread, NULL, pool_loop_thread,
+			loop)) {
+			event_warnx("%s: pthread_create failed", __func__);
+			r = -1;
+			break;
+		}
+		loop->running = 1;
+	}
+	pthread_mutex_unlock(&pool->start_lock);
+
+	if (r < 0)
+		event_base_pool_stop(pool);
+	return r;
+}
+
+int
+event_base_pool_stop(struct event_base_pool *pool)
+{
+	int i, r = 0;
+
+	if (event_base_pool_current(pool) >= 0)
+		return -1;
+
+	/* Ask every loop first, then wait, so that they wind down in
+	 * parallel.  We go through the inbox rather than calling
+	 * event_base_loopbreak() directly, since a loop that hasn't started
+	 * yet would forget the break when it did. */
+	for (i = 0; i < pool->n_loops; ++i) {
+		struct pool_loop *loop = &pool->loops[i];
+		if (!loop->running)
+			continue;
+		EVMPSC_STORE(&loop->stop, 1);
+		if (!EVMPSC_XCHG(&loop->wakeup_pending, 1))
+			pool_wake(loop);
+	}
+	for (i = 0; i < pool->n_loops; ++i) {
+		struct pool_loop *loop = &pool->loops[i];
+		if (!loop->running)
+			continue;
+		if (pthread_join(loop->thread, NULL))
+			r = -1;
+		loop->running = 0;
+	}
+	return r;
+}
+
+void
+event_base_pool_free(struct event_base_pool *pool)
+{
+	int i;
+
+	/* From inside the pool, the loops can't be stopped, and freeing
+	 * their bases under them would be worse than leaking them. */
+	if (event_base_pool_stop(pool) < 0) {
+		event_warnx("%s: couldn't stop the pool; not freeing it",
+		    __func__);
+		return;
+	}
+	for (i = 0; i < pool->n_loops; ++i)
+		pool_loop_clear(&pool->loops[i]);
+	pthread_mutex_destroy(&pool->start_lock);
+	mm_free(pool->loops);
+	mm_free(pool);
+}
+
+int
+event_base_pool_size(struct event_base_pool *pool)
+{
+	return pool->n_loops;
+}
+
+struct event_base *
+event_base_pool_get_base(struct event_base_pool *pool, int idx)
+{
+	if (idx < 0 || idx >= pool->n_loops)
+		return NULL;
+	return pool->loops[idx].base;
+}
+
+/* How busy a loop is: its events, plus the closures it has yet to run. */
+static int
+pool_loop_load(struct pool_loop *loop)
+{
+	struct event_base *base = loop->base;
+	int n;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	n = base->event_count + base->event_count_active;
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return n + EVMPSC_LOAD(&loop->n_pending);
+}
+
+/* Return the least busy loop whose base is on NUMA node 'node', or of
+ * all the loops if 'node' is -1; or -1 if no loop is on 'node'. */
+static int
+pool_least_loaded(struct event_base_pool *pool, int node)
+{
+	int i, best = -1, best_load = 0;
+
+	for (i = 0; i < pool->n_loops; ++i) {
+		int load;
+		if (node >= 0 &&
+		    event_base_get_numa_node(pool->loops[i].base) != node)
+			continue;
+		load = pool_loop_load(&pool->loops[i]);
+		if (best < 0 || load < best_load) {
+			best = i;
+			best_load = load;
+		}
+	}
+	return best;
+}
+
+int
+event_base_pool_assign(struct event_base_pool *pool, evutil_socket_t fd,
+    int how)
+{
+	int cur, node, best;
+
+	switch (how) {
+	case EVENT_BASE_POOL_BY_HASH:
+		if (fd < 0)
+			return -1;
+		return (int)((unsigned)fd % (unsigned)pool->n_loops);
+	case EVENT_BASE_POOL_BY_LOAD:
+		return pool_least_loaded(pool, -1);
+	case EVENT_BASE_POOL_BY_NODE:
+		if ((cur = event_base_pool_current(pool)) >= 0)
+			node = event_base_get_numa_node(pool->loops[cur].base);
+		else
+			node = evnuma_cpu_node(evnuma_current_cpu());
+		if (node >= 0 && (best = pool_least_loaded(pool, node)) >= 0)
+			return best;
+		return pool_least_loaded(pool, -1);
+	default:
+		return -1;
+	}
+}
+
+int
+event_base_pool_current(struct event_base_pool *pool)
+{
+	pthread_t self = pthread_self();
+	int i;
+
+	for (i = 0; i < pool->n_loops; ++i) {
+		struct pool_loop *loop = &pool->loops[i];
+		if (loop->running && pthread_equal(loop->thread, self))
+			return i;
+	}
+	return -1;
+}
+
+int
+event_base_pool_post(struct event_base_pool *pool, int idx,
+    void (*fn)(void *), void *arg)
+{
+	struct pool_loop *loop;
+	struct pool_closure *c;
+
+	if (idx < 0) {
+		int i, best = 0, n;
+		int best_n = EVMPSC_LOAD(&pool->loops[0].n_pending);
+		for (i = 1; i < pool->n_loops && best_n; ++i) {
+			n = EVMPSC_LOAD(&pool->loops[i].n_pending);
+			if (n < best_n) {
+				best = i;
+				best_n = n;
+			}
+		}
+		idx = best;
+	} else if (idx >= pool->n_loops) {
+		return -1;
+	}
+	loop = &pool->loops[idx];
+
+	if (!(c = mm_malloc(sizeof(*c))))
+		return -1;
+	c->fn = fn;
+	c->arg = arg;
+	EVMPSC_ADD(&loop->n_pending, 1);
+	evmpsc_push(&loop->inbox, &c->node);
+	if (!EVMPSC_XCHG(&loop->wakeup_pending, 1))
+		pool_wake(loop);
+	return 0;
+}
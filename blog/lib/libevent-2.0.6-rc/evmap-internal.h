@@ -77,6 +77,22 @@ int evmap_io_del(struct event_base *base, evutil_socket_t fd, struct event *ev);
 */
 void evmap_io_active(struct event_base *base, evutil_socket_t fd, short events);
 
+#ifdef EVMAP_ACTIVE_UNLOCKED
+/** As evmap_io_active(), but for a backend's dispatch function to call
+    from the loop's thread after releasing th_base_lock, so that finding
+    the events on a ready fd neither waits for threads that are adding and
+    deleting events nor makes them wait.  The events go through the base's
+    inbox, and become active when the loop next drains it.  Only for bases
+    where EVMAP_IO_ACTIVE_UNLOCKED() is true.
+*/
+void evmap_io_active_unlocked(struct event_base *base, evutil_socket_t fd,
+    short events);
+#define EVMAP_IO_ACTIVE_UNLOCKED(base) ((base)->th_base_lock != NULL)
+#else
+#define evmap_io_active_unlocked evmap_io_active
+#define EVMAP_IO_ACTIVE_UNLOCKED(base) 0
+#endif
+
 
 /* These functions behave in the same way as evmap_io_*, except they work on
  * signals rather than fds.  signals use a linear map everywhere; fds use
@@ -87,4 +103,16 @@ void evmap_signal_active(struct event_base *base, evutil_socket_t signum, int nc
 
 void *evmap_io_get_fdinfo(struct event_io_map *ctx, evutil_socket_t fd);
 
+typedef int (*evmap_event_foreach_fn)(struct event_base *,
+    struct event *, void *);
+
+/** Call 'fn' on every event that has been added to a fd or a signal in
+    'base', stopping as soon as it returns nonzero.  'fn' may delete the
+    event that it was called on, but no other.
+
+    @return the last value returned by 'fn', or 0.
+ */
+int evmap_foreach_event(struct event_base *base, evmap_event_foreach_fn fn,
+    void *arg);
+
 #endif /* _EVMAP_H_ */
@@ -50,12 +50,15 @@
 #include "evmap-internal.h"
 #include "mm-internal.h"
 #include "changelist-internal.h"
+#include "evthread-internal.h"
 
 /** An entry for an evmap_io list: notes all the events that want to read or
 	write on a given fd, and the number of each.
   */
 struct evmap_io {
-	struct event_list events;
+	/* Linked through ev_io_next, in the order they were added.  There
+	 * are seldom more than two, so a singly-linked list will do. */
+	struct event *events;
 	ev_uint16_t nread;
 	ev_uint16_t nwrite;
 };
@@ -63,9 +66,31 @@ struct evmap_io {
 /* An entry for an evmap_signal list: notes all the events that want to know
    when a signal triggers. */
 struct evmap_signal {
-	struct event_list events;
+	/* Linked through ev_signal_next. */
+	struct event *events;
 };
 
+/* Append 'ev' to the list of events starting at '*headp', linked through
+   'field'. */
+#define EVMAP_LIST_APPEND(headp, ev, field)				\
+	do {								\
+		struct event **_pp = (headp);				\
+		while (*_pp != NULL)					\
+			_pp = &(*_pp)->field;				\
+		(ev)->field = NULL;					\
+		*_pp = (ev);						\
+	} while (0)
+
+/* Remove 'ev', which must be present, from the list of events starting at
+   '*headp', linked through 'field'. */
+#define EVMAP_LIST_REMOVE(headp, ev, field)				\
+	do {								\
+		struct event **_pp = (headp);				\
+		while (*_pp != (ev))					\
+			_pp = &(*_pp)->field;				\
+		*_pp = (ev)->field;					\
+	} while (0)
+
 /* On some platforms, fds start at 0 and increment by 1 as they are
    allocated, and old numbers get used.  For these platforms, we
    implement io maps just like signal maps: as an array of pointers to
@@ -135,6 +160,10 @@ HT_GENERATE(event_io_map, event_map_entry, map_node, hashsocket, eqsocket,
 		(x) = &_ent->ent.type;					\
 	} while (0)
 
+/* Nothing looks up a hashtable entry without th_base_lock. */
+#define EVMAP_IO_LOCK_LIST(base, fd) _EVUTIL_NIL_STMT
+#define EVMAP_IO_UNLOCK_LIST(base, fd) _EVUTIL_NIL_STMT
+
 void evmap_io_initmap(struct event_io_map *ctx)
 {
 	HT_INIT(event_io_map, ctx);
@@ -172,22 +201,199 @@ void evmap_io_clear(struct event_io_map *ctx)
 		(x) = (struct type *)((map)->entries[slot]);		\
 	} while (0)
 
-/* If we aren't using hashtables, then define the IO_SLOT macros and functions
-   as thin aliases over the SIGNAL_SLOT versions. */
+/* If we aren't using hashtables, the io map is split into chunks: fd f
+   lives in chunk f >> EVMAP_IO_CHUNK_BITS, an array of EVMAP_IO_CHUNK_SIZE
+   entries (each a struct evmap_io followed by the backend's fdinfo) that is
+   allocated, zeroed, the first time an fd in its range is added.  A zeroed
+   entry is an fd with no events, so an fd costs no allocation of its own,
+   and a new high fd costs at most a new chunk and a bigger directory,
+   rather than a realloc and copy of one entry pointer per fd below it.
+
+   Everything but evmap_io_active_unlocked() runs with th_base_lock held.
+   That one runs in the loop's thread without it, so that finding the
+   events on a ready fd does not wait for threads adding and deleting
+   events, or make them wait.  It needs three things: chunks and entries
+   that never move or go away until the map is cleared; a directory that
+   is replaced, not reallocated, when it grows, and is read and published
+   with atomic loads and stores; and a spin lock in each chunk, which
+   evmap_io_add() and evmap_io_del() hold while they change one of its
+   event lists.  It is only ever held for a walk or a change of one list,
+   and an uncontended mutex would cost an add or a delete about as much
+   as the rest of evmap_io_add() or evmap_io_del(). */
 #ifndef EVMAP_USE_HT
-#define GET_IO_SLOT(x,map,slot,type) GET_SIGNAL_SLOT(x,map,slot,type)
+#define EVMAP_IO_CHUNK_BITS 8
+#define EVMAP_IO_CHUNK_SIZE (1 << EVMAP_IO_CHUNK_BITS)
+/* Chunks in the first directory */
+#define EVMAP_IO_MIN_CHUNKS 4
+
+struct evmap_io_chunk {
+	/* Nonzero while someone holds the chunk's spin lock.  Pointer sized,
+	 * so that the entries after it stay aligned. */
+	ev_intptr_t busy;
+	/* EVMAP_IO_CHUNK_SIZE entries follow. */
+};
+
+struct evmap_io_dir {
+	/* The directory this one replaced, or NULL.  It may still be in
+	 * use by evmap_io_active_unlocked(), so we keep it until the map is
+	 * cleared. */
+	struct evmap_io_dir *prev;
+	int nchunks;
+	/* nchunks pointers to chunks, or NULL for chunks not yet needed */
+	struct evmap_io_chunk *chunks[1];
+};
+
+#ifdef EVMAP_ACTIVE_UNLOCKED
+#define EVMAP_IO_LOAD(p) EVMPSC_LOAD(p)
+#define EVMAP_IO_STORE(p, v) EVMPSC_STORE(p, v)
+#else
+#define EVMAP_IO_LOAD(p) (*(p))
+#define EVMAP_IO_STORE(p, v) (*(p) = (v))
+#endif
+
+#define GET_IO_SLOT(x,map,slot,type)				\
+	(x) = evmap_io_find((map), (slot))
 #define GET_IO_SLOT_AND_CTOR(x,map,slot,type,ctor,fdinfo_len)	\
-	GET_SIGNAL_SLOT_AND_CTOR(x,map,slot,type,ctor,fdinfo_len)
-#define FDINFO_OFFSET sizeof(struct evmap_io)
+	(x) = evmap_io_find_or_create((map), (slot), (fdinfo_len))
+
+/* Return the chunk for 'fd' in 'map', or NULL if no fd in its range has
+ * been added. */
+static inline struct evmap_io_chunk *
+evmap_io_find_chunk(struct event_io_map *map, evutil_socket_t fd)
+{
+	const struct evmap_io_dir *dir = EVMAP_IO_LOAD(&map->dir);
+	int chunk = (int)(fd >> EVMAP_IO_CHUNK_BITS);
+
+	if (fd < 0 || dir == NULL || chunk >= dir->nchunks)
+		return (NULL);
+	return EVMAP_IO_LOAD(&dir->chunks[chunk]);
+}
+
+/* Return the entry for 'fd' in 'map', or NULL if no fd in its chunk has
+ * been added. */
+static inline struct evmap_io *
+evmap_io_find(struct event_io_map *map, evutil_socket_t fd)
+{
+	struct evmap_io_chunk *chunk = evmap_io_find_chunk(map, fd);
+
+	if (chunk == NULL)
+		return (NULL);
+	return (struct evmap_io *)((char *)(chunk + 1) +
+	    (fd & (EVMAP_IO_CHUNK_SIZE - 1)) * map->entry_size);
+}
+
+/* As evmap_io_find, but make room for 'fd' if there is none.  Returns NULL
+ * on failure. */
+static struct evmap_io *
+evmap_io_find_or_create(struct event_io_map *map, evutil_socket_t fd,
+    size_t fdinfo_len)
+{
+	struct evmap_io_dir *dir = map->dir;
+	int chunk = (int)(fd >> EVMAP_IO_CHUNK_BITS);
+
+	if (map->entry_size == 0) {
+		const size_t align = sizeof(void *);
+		map->entry_size = (sizeof(struct evmap_io) + fdinfo_len +
+		    align - 1) / align * align;
+	}
+
+	if (dir == NULL || chunk >= dir->nchunks) {
+		struct evmap_io_dir *newdir;
+		int n = dir ? dir->nchunks : EVMAP_IO_MIN_CHUNKS;
+
+		while (n <= chunk)
+			n <<= 1;
+		newdir = mm_calloc(1, sizeof(struct evmap_io_dir) +
+		    (n - 1) * sizeof(struct evmap_io_chunk *));
+		if (newdir == NULL)
+			return (NULL);
+		newdir->nchunks = n;
+		if (dir)
+			memcpy(newdir->chunks, dir->chunks,
+			    dir->nchunks * sizeof(struct evmap_io_chunk *));
+		newdir->prev = dir;
+		EVMAP_IO_STORE(&map->dir, newdir);
+		dir = newdir;
+		map->nentries = n << EVMAP_IO_CHUNK_BITS;
+	}
+
+	if (dir->chunks[chunk] == NULL) {
+		struct evmap_io_chunk *c = mm_calloc(1,
+		    sizeof(struct evmap_io_chunk) +
+		    EVMAP_IO_CHUNK_SIZE * map->entry_size);
+		if (c == NULL)
+			return (NULL);
+		EVMAP_IO_STORE(&dir->chunks[chunk], c);
+	}
+
+	return evmap_io_find(map, fd);
+}
+
+#ifdef EVMAP_ACTIVE_UNLOCKED
+static inline void
+evmap_io_chunk_lock(struct evmap_io_chunk *chunk)
+{
+	while (EVMPSC_XCHG(&chunk->busy, 1))
+		EVMPSC_YIELD();
+}
+
+static inline void
+evmap_io_chunk_unlock(struct evmap_io_chunk *chunk)
+{
+	EVMPSC_STORE(&chunk->busy, 0);
+}
+
+/* Hold the lock of the chunk for 'fd', which must exist, while changing
+ * its list of events.  Only the loop's thread takes it without
+ * th_base_lock, so the loop's thread itself, and bases without locking,
+ * don't bother.  Caller must hold th_base_lock, which keeps th_owner_id
+ * still. */
+#define EVMAP_IO_NEED_LIST_LOCK(base)					\
+	((base)->th_base_lock != NULL && !EVBASE_IN_THREAD(base))
+#define EVMAP_IO_LOCK_LIST(base, fd)					\
+	do {								\
+		if (EVMAP_IO_NEED_LIST_LOCK(base))			\
+			evmap_io_chunk_lock(				\
+			    evmap_io_find_chunk(&(base)->io, (fd)));	\
+	} while (0)
+#define EVMAP_IO_UNLOCK_LIST(base, fd)					\
+	do {								\
+		if (EVMAP_IO_NEED_LIST_LOCK(base))			\
+			evmap_io_chunk_unlock(				\
+			    evmap_io_find_chunk(&(base)->io, (fd)));	\
+	} while (0)
+#else
+#define EVMAP_IO_LOCK_LIST(base, fd) _EVUTIL_NIL_STMT
+#define EVMAP_IO_UNLOCK_LIST(base, fd) _EVUTIL_NIL_STMT
+#endif
+
 void
-evmap_io_initmap(struct event_io_map* ctx)
+evmap_io_initmap(struct event_io_map *ctx)
 {
-	evmap_signal_initmap(ctx);
+	ctx->dir = NULL;
+	ctx->entry_size = 0;
+	ctx->nentries = 0;
 }
+
 void
-evmap_io_clear(struct event_io_map* ctx)
+evmap_io_clear(struct event_io_map *ctx)
 {
-	evmap_signal_clear(ctx);
+	struct evmap_io_dir *dir = ctx->dir;
+	int i;
+
+	if (dir != NULL) {
+		/* Older directories hold no chunks the newest one lacks. */
+		for (i = 0; i < dir->nchunks; ++i) {
+			if (dir->chunks[i])
+				mm_free(dir->chunks[i]);
+		}
+	}
+	while (dir != NULL) {
+		struct evmap_io_dir *prev = dir->prev;
+		mm_free(dir);
+		dir = prev;
+	}
+	evmap_io_initmap(ctx);
 }
 #endif
 
@@ -244,14 +450,17 @@ evmap_signal_clear(struct event_signal_map *ctx)
 
 /* code specific to file descriptors */
 
-/** Constructor for struct evmap_io */
+#ifdef EVMAP_USE_HT
+/** Constructor for struct evmap_io.  (Without the hashtable, a zeroed entry
+ * is already a valid one.) */
 static void
 evmap_io_init(struct evmap_io *entry)
 {
-	TAILQ_INIT(&entry->events);
+	entry->events = NULL;
 	entry->nread = 0;
 	entry->nwrite = 0;
 }
+#endif
 
 
 /* return -1 on error, 0 on success if nothing changed in the event backend,
@@ -271,14 +480,12 @@ evmap_io_add(struct event_base *base, evutil_socket_t fd, struct event *ev)
 	if (fd < 0)
 		return 0;
 
-#ifndef EVMAP_USE_HT
-	if (fd >= io->nentries) {
-		if (evmap_make_space(io, fd, sizeof(struct evmap_io *)) == -1)
-			return (-1);
-	}
-#endif
 	GET_IO_SLOT_AND_CTOR(ctx, io, fd, evmap_io, evmap_io_init,
 						 evsel->fdinfo_len);
+#ifndef EVMAP_USE_HT
+	if (ctx == NULL)
+		return (-1);
+#endif
 
 	nread = ctx->nread;
 	nwrite = ctx->nwrite;
@@ -302,7 +509,7 @@ evmap_io_add(struct event_base *base, evutil_socket_t fd, struct event *ev)
 		return -1;
 	}
 	if (EVENT_DEBUG_MODE_IS_ON() &&
-	    (old_ev = TAILQ_FIRST(&ctx->events)) &&
+	    (old_ev = ctx->events) &&
 	    (old_ev->ev_events&EV_ET) != (ev->ev_events&EV_ET)) {
 		event_warnx("Tried to mix edge-triggered and non-edge-triggered"
 		    " events on fd %d", (int)fd);
@@ -322,7 +529,9 @@ evmap_io_add(struct event_base *base, evutil_socket_t fd, struct event *ev)
 
 	ctx->nread = (ev_uint16_t) nread;
 	ctx->nwrite = (ev_uint16_t) nwrite;
-	TAILQ_INSERT_TAIL(&ctx->events, ev, ev_io_next);
+	EVMAP_IO_LOCK_LIST(base, fd);
+	EVMAP_LIST_APPEND(&ctx->events, ev, ev_io_next);
+	EVMAP_IO_UNLOCK_LIST(base, fd);
 
 	return (retval);
 }
@@ -343,12 +552,9 @@ evmap_io_del(struct event_base *base, evutil_socket_t fd, struct event *ev)
 
 	EVUTIL_ASSERT(fd == ev->ev_fd);
 
-#ifndef EVMAP_USE_HT
-	if (fd >= io->nentries)
-		return (-1);
-#endif
-
 	GET_IO_SLOT(ctx, io, fd, evmap_io);
+	if (ctx == NULL)
+		return (-1);
 
 	nread = ctx->nread;
 	nwrite = ctx->nwrite;
@@ -378,7 +584,9 @@ evmap_io_del(struct event_base *base, evutil_socket_t fd, struct event *ev)
 
 	ctx->nread = nread;
 	ctx->nwrite = nwrite;
-	TAILQ_REMOVE(&ctx->events, ev, ev_io_next);
+	EVMAP_IO_LOCK_LIST(base, fd);
+	EVMAP_LIST_REMOVE(&ctx->events, ev, ev_io_next);
+	EVMAP_IO_UNLOCK_LIST(base, fd);
 
 	return (retval);
 }
@@ -390,24 +598,41 @@ evmap_io_active(struct event_base *base, evutil_socket_t fd, short events)
 	struct evmap_io *ctx;
 	struct event *ev;
 
-#ifndef EVMAP_USE_HT
-	EVUTIL_ASSERT(fd < io->nentries);
-#endif
 	GET_IO_SLOT(ctx, io, fd, evmap_io);
 
 	EVUTIL_ASSERT(ctx);
-	TAILQ_FOREACH(ev, &ctx->events, ev_io_next) {
+	for (ev = ctx->events; ev; ev = ev->ev_io_next) {
 		if (ev->ev_events & events)
 			event_active_nolock(ev, ev->ev_events & events, 1);
 	}
 }
 
+#ifdef EVMAP_ACTIVE_UNLOCKED
+void
+evmap_io_active_unlocked(struct event_base *base, evutil_socket_t fd,
+    short events)
+{
+	struct evmap_io_chunk *chunk = evmap_io_find_chunk(&base->io, fd);
+	struct evmap_io *ctx;
+	struct event *ev;
+
+	EVUTIL_ASSERT(chunk);
+	ctx = evmap_io_find(&base->io, fd);
+	evmap_io_chunk_lock(chunk);
+	for (ev = ctx->events; ev; ev = ev->ev_io_next) {
+		if (ev->ev_events & events)
+			event_active_later(ev, ev->ev_events & events);
+	}
+	evmap_io_chunk_unlock(chunk);
+}
+#endif
+
 /* code specific to signals */
 
 static void
 evmap_signal_init(struct evmap_signal *entry)
 {
-	TAILQ_INIT(&entry->events);
+	entry->events = NULL;
 }
 
 
@@ -426,13 +651,13 @@ evmap_signal_add(struct event_base *base, int sig, struct event *ev)
 	GET_SIGNAL_SLOT_AND_CTOR(ctx, map, sig, evmap_signal, evmap_signal_init,
 	    base->evsigsel->fdinfo_len);
 
-	if (TAILQ_EMPTY(&ctx->events)) {
+	if (ctx->events == NULL) {
 		if (evsel->add(base, ev->ev_fd, 0, EV_SIGNAL, NULL)
 		    == -1)
 			return (-1);
 	}
 
-	TAILQ_INSERT_TAIL(&ctx->events, ev, ev_signal_next);
+	EVMAP_LIST_APPEND(&ctx->events, ev, ev_signal_next);
 
 	return (1);
 }
@@ -449,12 +674,12 @@ evmap_signal_del(struct event_base *base, int sig, struct event *ev)
 
 	GET_SIGNAL_SLOT(ctx, map, sig, evmap_signal);
 
-	if (TAILQ_FIRST(&ctx->events) == TAILQ_LAST(&ctx->events, event_list)) {
+	if (ctx->events == ev && ev->ev_signal_next == NULL) {
 		if (evsel->del(base, ev->ev_fd, 0, EV_SIGNAL, NULL) == -1)
 			return (-1);
 	}
 
-	TAILQ_REMOVE(&ctx->events, ev, ev_signal_next);
+	EVMAP_LIST_REMOVE(&ctx->events, ev, ev_signal_next);
 
 	return (1);
 }
@@ -469,10 +694,58 @@ evmap_signal_active(struct event_base *base, evutil_socket_t sig, int ncalls)
 	EVUTIL_ASSERT(sig < map->nentries);
 	GET_SIGNAL_SLOT(ctx, map, sig, evmap_signal);
 
-	TAILQ_FOREACH(ev, &ctx->events, ev_signal_next)
+	for (ev = ctx->events; ev; ev = ev->ev_signal_next)
 		event_active_nolock(ev, EV_SIGNAL, ncalls);
 }
 
+/* Call fn on each event in the list starting at 'ev', linked through
+   'field'.  fn may remove the event it is called on. */
+#define EVMAP_LIST_FOREACH_SAFE(ev, field, fn, base, arg, r)		\
+	do {								\
+		struct event *_next;					\
+		for (; (ev) != NULL; (ev) = _next) {			\
+			_next = (ev)->field;				\
+			if (((r) = (fn)((base), (ev), (arg))) != 0)	\
+				return (r);				\
+		}							\
+	} while (0)
+
+int
+evmap_foreach_event(struct event_base *base, evmap_event_foreach_fn fn,
+    void *arg)
+{
+	struct event_signal_map *sigmap = &base->sigmap;
+	struct evmap_signal *sctx;
+	struct evmap_io *ctx;
+	struct event *ev;
+	int i, r = 0;
+#ifdef EVMAP_USE_HT
+	struct event_map_entry **ent;
+
+	HT_FOREACH(ent, event_io_map, &base->io) {
+		ctx = &(*ent)->ent.evmap_io;
+		ev = ctx->events;
+		EVMAP_LIST_FOREACH_SAFE(ev, ev_io_next, fn, base, arg, r);
+	}
+#else
+	for (i = 0; i < base->io.nentries; ++i) {
+		GET_IO_SLOT(ctx, &base->io, i, evmap_io);
+		if (ctx == NULL)
+			continue;
+		ev = ctx->events;
+		EVMAP_LIST_FOREACH_SAFE(ev, ev_io_next, fn, base, arg, r);
+	}
+#endif
+	for (i = 0; i < sigmap->nentries; ++i) {
+		GET_SIGNAL_SLOT(sctx, sigmap, i, evmap_signal);
+		if (sctx == NULL)
+			continue;
+		ev = sctx->events;
+		EVMAP_LIST_FOREACH_SAFE(ev, ev_signal_next, fn, base, arg, r);
+	}
+	return (r);
+}
+
 void *
 evmap_io_get_fdinfo(struct event_io_map *map, evutil_socket_t fd)
 {
@@ -484,14 +757,6 @@ evmap_io_get_fdinfo(struct event_io_map *map, evutil_socket_t fd)
 		return NULL;
 }
 
-/** Per-fd structure for use with changelists.  It keeps track, for each fd or
- * signal using the changelist, of where its entry in the changelist is.
- */
-struct event_changelist_fdinfo {
-	int idxplus1; /* this is the index +1, so that memset(0) will make it
-		       * a no-such-element */
-};
-
 void
 event_changelist_init(struct event_changelist *changelist)
 {
@@ -501,7 +766,7 @@ event_changelist_init(struct event_changelist *changelist)
 }
 
 /** Helper: return the changelist_fdinfo corresponding to a given change. */
-static inline struct event_changelist_fdinfo *
+struct event_changelist_fdinfo *
 event_change_get_fdinfo(struct event_base *base,
     const struct event_change *change)
 {
@@ -537,12 +802,10 @@ event_changelist_check(struct event_base *base)
 	}
 
 	for (i = 0; i < base->io.nentries; ++i) {
-		struct evmap_io *io = base->io.entries[i];
-		struct event_changelist_fdinfo *f;
-		if (!io)
+		struct event_changelist_fdinfo *f =
+		    evmap_io_get_fdinfo(&base->io, i);
+		if (!f)
 			continue;
-		f = (void*)
-		    ( ((char*)io) + sizeof(struct evmap_io) );
 		if (f->idxplus1) {
 			struct event_change *c = &changelist->changes[f->idxplus1 - 1];
 			EVUTIL_ASSERT(c->fd == i);
@@ -553,6 +816,34 @@ event_changelist_check(struct event_base *base)
 #define event_changelist_check(base)  ((void)0)
 #endif
 
+int
+event_change_get_events(const struct event_change *ch, int kernel_events)
+{
+	int events = 0;
+
+	if (ch->read_change & EV_CHANGE_ADD)
+		events |= EV_READ;
+	else if (!(ch->read_change & EV_CHANGE_DEL) &&
+	    (ch->old_events & EV_READ))
+		events |= EV_READ;
+	if (ch->write_change & EV_CHANGE_ADD)
+		events |= EV_WRITE;
+	else if (!(ch->write_change & EV_CHANGE_DEL) &&
+	    (ch->old_events & EV_WRITE))
+		events |= EV_WRITE;
+	/* Edge-triggering is per fd in the kernel.  Keep it unless we are
+	 * adding an event that doesn't ask for it. */
+	if (events) {
+		if ((ch->read_change|ch->write_change) & EV_CHANGE_ADD) {
+			if ((ch->read_change|ch->write_change) & EV_ET)
+				events |= EV_ET;
+		} else {
+			events |= kernel_events & EV_ET;
+		}
+	}
+	return events;
+}
+
 void
 event_changelist_remove_all(struct event_changelist *changelist,
     struct event_base *base)
@@ -567,6 +858,7 @@ event_changelist_remove_all(struct event_changelist *changelist,
 		    event_change_get_fdinfo(base, ch);
 		EVUTIL_ASSERT(fdinfo->idxplus1 == i + 1);
 		fdinfo->idxplus1 = 0;
+		fdinfo->emptied = 0;
 	}
 
 	changelist->n_changes = 0;
@@ -685,6 +977,10 @@ event_changelist_del(struct event_base *base, evutil_socket_t fd, short old, sho
 	if (!change)
 		return -1;
 
+	/* Nothing is left on the fd, so the program is free to close it. */
+	if (!(old & ~events & (EV_READ|EV_WRITE)))
+		fdinfo->emptied = 1;
+
 	/* A delete removes any previous add, rather than replacing it:
 	   on those platforms where "add, delete, dispatch" is not the same
 	   as "no-op, dispatch", we want the no-op behavior.
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _EVNUMA_INTERNAL_H_
+#define _EVNUMA_INTERNAL_H_
+
+/*
+  CPU affinity and NUMA placement for event_bases that are configured with
+  event_config_set_cpu_affinity().  On Linux, these pin threads with
+  sched_setaffinity(), find out which node a CPU is on from sysfs, and set
+  memory policies with the mbind() and set_mempolicy() system calls, so
+  that we need not link against libnuma.  Elsewhere, or on a kernel
+  without NUMA support, everything here fails harmlessly: CPUs have no
+  node, and memory comes from wherever mm_malloc() gets it.
+ */
+
+#include "event2/event-config.h"
+#include <sys/types.h>
+
+/** Return the NUMA node that 'cpu' is on, or -1 if we can't tell. */
+int evnuma_cpu_node(int cpu);
+/** Return the CPU that the calling thread is running on, or -1. */
+int evnuma_current_cpu(void);
+/** Store up to 'max' of the CPUs that the calling thread may run on in
+ * 'cpus', and return how many there are, or -1 on error. */
+int evnuma_allowed_cpus(int *cpus, int max);
+
+/** Restrict the calling thread to 'cpus'.  Return 0 on success, -1 on
+ * failure. */
+int evnuma_pin_thread(const int *cpus, int n_cpus);
+
+/** The memory policy of a thread, as saved by evnuma_prefer_node(). */
+struct evnuma_policy {
+	int mode;
+	unsigned long nodes[4];
+};
+
+/** Make the calling thread take the pages it touches from now on from
+ * 'node' while that node has room.  If 'old' is not NULL, save the
+ * thread's previous policy there, for evnuma_restore_policy().  Return 0
+ * on success, -1 on failure. */
+int evnuma_prefer_node(int node, struct evnuma_policy *old);
+/** Give the calling thread back the policy saved in 'old'. */
+void evnuma_restore_policy(const struct evnuma_policy *old);
+
+/** Return 'size' zeroed bytes of memory that prefers 'node', or NULL on
+ * failure.  The memory is mapped on its own, so that its placement
+ * does not depend on whoever touched the heap before us.  Free it with
+ * evnuma_free(), giving the same size. */
+void *evnuma_alloc(size_t size, int node);
+void evnuma_free(void *p, size_t size);
+
+#endif /* _EVNUMA_INTERNAL_H_ */
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#ifdef _EVENT_HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+#ifdef _EVENT_HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+#ifdef _EVENT_HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef _EVENT_HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <dirent.h>
+#endif
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "event2/util.h"
+#include "evnuma-internal.h"
+#include "log-internal.h"
+
+#if defined(SYS_mbind) && defined(SYS_set_mempolicy) && \
+    defined(SYS_get_mempolicy) && defined(_EVENT_HAVE_MMAP) && \
+    defined(_EVENT_HAVE_SYS_MMAN_H)
+#define EVNUMA_MEMPOLICY
+#endif
+
+/* From <numaif.h>, which is only there if libnuma is. */
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT 0
+#define MPOL_PREFERRED 1
+#endif
+
+/* The most nodes our masks have room for. */
+#define EVNUMA_MAX_NODES \
+	((int)(sizeof(((struct evnuma_policy *)0)->nodes) * 8))
+#define EVNUMA_BITS_PER_LONG ((int)(sizeof(unsigned long) * 8))
+
+int
+evnuma_cpu_node(int cpu)
+{
+#ifdef __linux__
+	char path[64];
+	DIR *dir;
+	struct dirent *ent;
+	int node = -1;
+
+	if (cpu < 0)
+		return -1;
+	/* The kernel links each CPU's directory to its node's, as nodeN,
+	 * if it was built with NUMA support. */
+	evutil_snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d",
+	    cpu);
+	if ((dir = opendir(path)) == NULL)
+		return -1;
+	while ((ent = readdir(dir)) != NULL) {
+		if (!strncmp(ent->d_name, "node", 4) &&
+		    ent->d_name[4] >= '0' && ent->d_name[4] <= '9') {
+			node = atoi(ent->d_name + 4);
+			break;
+		}
+	}
+	closedir(dir);
+	return node;
+#else
+	return -1;
+#endif
+}
+
+int
+evnuma_current_cpu(void)
+{
+#ifdef _EVENT_HAVE_SCHED_GETCPU
+	return sched_getcpu();
+#else
+	return -1;
+#endif
+}
+
+int
+evnuma_allowed_cpus(int *cpus, int max)
+{
+#ifdef _EVENT_HAVE_SCHED_SETAFFINITY
+	cpu_set_t set;
+	int cpu, n = 0;
+
+	if (sched_getaffinity(0, sizeof(set), &set) < 0)
+		return -1;
+	for (cpu = 0; cpu < CPU_SETSIZE && n < max; ++cpu) {
+		if (CPU_ISSET(cpu, &set))
+			cpus[n++] = cpu;
+	}
+	return n;
+#else
+	return -1;
+#endif
+}
+
+int
+evnuma_pin_thread(const int *cpus, int n_cpus)
+{
+#ifdef _EVENT_HAVE_SCHED_SETAFFINITY
+	cpu_set_t set;
+	int i;
+
+	CPU_ZERO(&set);
+	for (i = 0; i < n_cpus; ++i) {
+		if (cpus[i] < 0 || cpus[i] >= CPU_SETSIZE) {
+			errno = EINVAL;
+			return -1;
+		}
+		CPU_SET(cpus[i], &set);
+	}
+	/* On Linux, pid 0 means the calling thread, not the process. */
+	return sched_setaffinity(0, sizeof(set), &set);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+#ifdef EVNUMA_MEMPOLICY
+static int
+evnuma_node_mask(int node, unsigned long *mask)
+{
+	if (node < 0 || node >= EVNUMA_MAX_NODES) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(mask, 0, sizeof(((struct evnuma_policy *)0)->nodes));
+	mask[node / EVNUMA_BITS_PER_LONG] |=
+	    1UL << (node % EVNUMA_BITS_PER_LONG);
+	return 0;
+}
+#endif
+
+int
+evnuma_prefer_node(int node, struct evnuma_policy *old)
+{
+#ifdef EVNUMA_MEMPOLICY
+	struct evnuma_policy want;
+
+	if (evnuma_node_mask(node, want.nodes) < 0)
+		return -1;
+	if (old) {
+		memset(old, 0, sizeof(*old));
+		if (syscall(SYS_get_mempolicy, &old->mode, old->nodes,
+			(unsigned long)EVNUMA_MAX_NODES, NULL, 0UL) < 0)
+			return -1;
+	}
+	/* The kernel reads one bit fewer than maxnode says. */
+	if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, want.nodes,
+		(unsigned long)EVNUMA_MAX_NODES + 1) < 0)
+		return -1;
+	return 0;
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+void
+evnuma_restore_policy(const struct evnuma_policy *old)
+{
+#ifdef EVNUMA_MEMPOLICY
+	if (syscall(SYS_set_mempolicy, old->mode,
+		old->mode == MPOL_DEFAULT ? NULL : old->nodes,
+		(unsigned long)EVNUMA_MAX_NODES + 1) < 0)
+		event_debug(("%s: set_mempolicy: %s", __func__,
+			strerror(errno)));
+#endif
+}
+
+void *
+evnuma_alloc(size_t size, int node)
+{
+#ifdef EVNUMA_MEMPOLICY
+	unsigned long mask[sizeof(((struct evnuma_policy *)0)->nodes) /
+	    sizeof(unsigned long)];
+	void *p;
+
+	if (evnuma_node_mask(node, mask) < 0)
+		return NULL;
+	p = mmap(NULL, size, PROT_READ|PROT_WRITE,
+	    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	/* No page has been touched yet, so they will all be placed by this
+	 * policy.  If it can't be set, the memory is still good. */
+	if (syscall(SYS_mbind, p, (unsigned long)size, MPOL_PREFERRED, mask,
+		(unsigned long)EVNUMA_MAX_NODES + 1, 0U) < 0)
+		event_debug(("%s: mbind: %s", __func__, strerror(errno)));
+	return p;
+#else
+	return NULL;
+#endif
+}
+
+void
+evnuma_free(void *p, size_t size)
+{
+#ifdef EVNUMA_MEMPOLICY
+	munmap(p, size);
+#endif
+}
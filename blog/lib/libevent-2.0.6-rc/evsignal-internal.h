@@ -46,8 +46,19 @@ struct evsig_info {
 	ev_sighandler_t **sh_old;
 #endif
 	int sh_old_max;
+	/* The signalfd that we read signals from, or -1 if we use a signal
+	 * handler and ev_signal_pair. */
+	int sigfd;
+#ifdef _EVENT_HAVE_SYS_SIGNALFD_H
+	/* The signals that sigfd watches. */
+	sigset_t sigfd_mask;
+	/* The signals in sigfd_mask that were not blocked until we blocked
+	 * them, and that we unblock when we stop watching them. */
+	sigset_t sigfd_blocked;
+#endif
 };
 int evsig_init(struct event_base *);
+int evsigfd_init(struct event_base *);
 void evsig_process(struct event_base *);
 void evsig_dealloc(struct event_base *);
 
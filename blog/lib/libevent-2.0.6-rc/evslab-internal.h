@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _EVSLAB_INTERNAL_H_
+#define _EVSLAB_INTERNAL_H_
+
+/*
+  A slab allocator for objects of one size, so that an event_base can hand
+  out struct events, bufferevents and the like without a trip to malloc for
+  each.  Objects are carved out of chunks of a few kilobytes and go back on
+  a free list when released; the chunks themselves are only returned to
+  mm_free when the slab is destroyed.
+
+  Every object is preceded by a pointer to its slab, so evslab_free() can
+  put it back without being told where it came from.  That also lets an
+  object outlive the event_base that owns its slab: evslab_release() only
+  marks the slab as orphaned, and the last evslab_free() destroys it.
+ */
+
+#include "event2/event-config.h"
+#include <sys/types.h>
+
+struct evslab;
+
+/** Return a new slab for objects of 'size' bytes, or NULL on failure. */
+struct evslab *evslab_new(size_t size);
+/** As evslab_new(), but take the slab's chunks from memory on NUMA node
+ * 'node' where we can, or from anywhere if 'node' is -1. */
+struct evslab *evslab_new_on_node(size_t size, int node);
+/** Give up the owner's reference to 'slab'.  Its memory is freed as soon
+ * as every object allocated from it has been freed. */
+void evslab_release(struct evslab *slab);
+
+/** Return a zeroed object from 'slab', or NULL on failure. */
+void *evslab_alloc(struct evslab *slab);
+/** Return a zeroed object of 'size' bytes that belongs to no slab, but can
+ * be freed with evslab_free() all the same. */
+void *evslab_alloc_unpooled(size_t size);
+/** Free an object returned by evslab_alloc() or evslab_alloc_unpooled(). */
+void evslab_free(void *obj);
+
+/** Return the size of the objects in 'slab'. */
+size_t evslab_obj_size(const struct evslab *slab);
+
+struct event_base;
+/** Return a zeroed object of 'size' bytes, taken from a slab belonging to
+ * 'base' if it has one (or room for one) for objects of that size.  Free
+ * it with evslab_free(), even after 'base' itself is gone.  Defined in
+ * event.c. */
+void *event_base_alloc_obj(struct event_base *base, size_t size);
+
+#endif /* _EVSLAB_INTERNAL_H_ */
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#include <string.h>
+
+#include "event2/util.h"
+#include "evslab-internal.h"
+#include "evnuma-internal.h"
+#include "mm-internal.h"
+#include "evthread-internal.h"
+
+/* Comes before every object, and says which slab it goes back to; NULL for
+ * an unpooled object.  The other members make sure that the object after
+ * it is aligned for anything. */
+union evslab_header {
+	struct evslab *slab;
+	void *p;
+	double d;
+	ev_uint64_t u;
+};
+
+/* Comes before the objects in each chunk. */
+union evslab_chunk {
+	struct {
+		union evslab_chunk *next;
+		/** The size of the chunk if it came from evnuma_alloc(), or
+		 * 0 if it came from mm_malloc(). */
+		size_t mapped;
+	} c;
+	union evslab_header align;
+};
+
+/* About how big a chunk we allocate at a time... */
+#define EVSLAB_CHUNK_SIZE 16384
+/* ...unless the objects are so big that this many wouldn't fit. */
+#define EVSLAB_MIN_PER_CHUNK 8
+
+struct evslab {
+	/** The size of each object, and the distance from one object's
+	 * header to the next. */
+	size_t size;
+	size_t stride;
+	int per_chunk;
+	/** Objects ready to hand out, linked through their first word. */
+	void *free_list;
+	/** Every chunk we have allocated. */
+	union evslab_chunk *chunks;
+	/** The NUMA node to allocate chunks on, or -1 for anywhere. */
+	int node;
+	/** The number of objects that have been handed out and not freed. */
+	int n_live;
+	/** Set once evslab_release() has been called. */
+	int released;
+	void *lock;
+};
+
+struct evslab *
+evslab_new(size_t size)
+{
+	return evslab_new_on_node(size, -1);
+}
+
+struct evslab *
+evslab_new_on_node(size_t size, int node)
+{
+	struct evslab *slab;
+	const size_t align = sizeof(union evslab_header);
+
+	if ((slab = mm_calloc(1, sizeof(struct evslab))) == NULL)
+		return (NULL);
+	/* Free objects hold a pointer to the next one. */
+	if (size < sizeof(void *))
+		size = sizeof(void *);
+	slab->size = size;
+	slab->stride = align + (size + align - 1) / align * align;
+	slab->per_chunk = (int)((EVSLAB_CHUNK_SIZE - sizeof(union evslab_chunk))
+	    / slab->stride);
+	if (slab->per_chunk < EVSLAB_MIN_PER_CHUNK)
+		slab->per_chunk = EVSLAB_MIN_PER_CHUNK;
+	slab->node = node;
+	EVTHREAD_ALLOC_LOCK(slab->lock, 0);
+
+	return (slab);
+}
+
+static void
+evslab_destroy(struct evslab *slab)
+{
+	union evslab_chunk *chunk;
+
+	while ((chunk = slab->chunks) != NULL) {
+		slab->chunks = chunk->c.next;
+		if (chunk->c.mapped)
+			evnuma_free(chunk, chunk->c.mapped);
+		else
+			mm_free(chunk);
+	}
+	EVTHREAD_FREE_LOCK(slab->lock, 0);
+	mm_free(slab);
+}
+
+void
+evslab_release(struct evslab *slab)
+{
+	int destroy;
+
+	EVLOCK_LOCK(slab->lock, 0);
+	slab->released = 1;
+	destroy = (slab->n_live == 0);
+	EVLOCK_UNLOCK(slab->lock, 0);
+
+	if (destroy)
+		evslab_destroy(slab);
+}
+
+/* Add a chunk's worth of objects to the free list.  Requires the lock. */
+static int
+evslab_grow(struct evslab *slab)
+{
+	union evslab_chunk *chunk = NULL;
+	size_t size;
+	char *p;
+	int i;
+
+	size = sizeof(union evslab_chunk) + slab->per_chunk * slab->stride;
+	/* If the node has no memory to spare, or we can't place memory on
+	 * it, any memory will do. */
+	if (slab->node >= 0 && (chunk = evnuma_alloc(size, slab->node)))
+		chunk->c.mapped = size;
+	else if ((chunk = mm_malloc(size)) != NULL)
+		chunk->c.mapped = 0;
+	if (chunk == NULL)
+		return (-1);
+	chunk->c.next = slab->chunks;
+	slab->chunks = chunk;
+
+	/* Thread the objects onto the free list back to front, so that
+	 * they get handed out in address order. */
+	p = (char *)(chunk + 1) + slab->per_chunk * slab->stride;
+	for (i = 0; i < slab->per_chunk; ++i) {
+		union evslab_header *h;
+		p -= slab->stride;
+		h = (union evslab_header *)p;
+		h->slab = slab;
+		*(void **)(h + 1) = slab->free_list;
+		slab->free_list = h + 1;
+	}
+	return (0);
+}
+
+void *
+evslab_alloc(struct evslab *slab)
+{
+	void *obj;
+
+	EVLOCK_LOCK(slab->lock, 0);
+	if (slab->free_list == NULL && evslab_grow(slab) < 0) {
+		EVLOCK_UNLOCK(slab->lock, 0);
+		return (NULL);
+	}
+	obj = slab->free_list;
+	slab->free_list = *(void **)obj;
+	++slab->n_live;
+	EVLOCK_UNLOCK(slab->lock, 0);
+
+	memset(obj, 0, slab->size);
+	return (obj);
+}
+
+void *
+evslab_alloc_unpooled(size_t size)
+{
+	union evslab_header *h;
+
+	h = mm_calloc(1, sizeof(union evslab_header) + size);
+	if (h == NULL)
+		return (NULL);
+	h->slab = NULL;
+	return (h + 1);
+}
+
+void
+evslab_free(void *obj)
+{
+	union evslab_header *h = ((union evslab_header *)obj) - 1;
+	struct evslab *slab = h->slab;
+	int destroy;
+
+	if (slab == NULL) {
+		mm_free(h);
+		return;
+	}
+
+	EVLOCK_LOCK(slab->lock, 0);
+	*(void **)obj = slab->free_list;
+	slab->free_list = obj;
+	destroy = (--slab->n_live == 0 && slab->released);
+	EVLOCK_UNLOCK(slab->lock, 0);
+
+	if (destroy)
+		evslab_destroy(slab);
+}
+
+size_t
+evslab_obj_size(const struct evslab *slab)
+{
+	return slab->size;
+}
@@ -112,6 +112,19 @@ struct evhttp_cb {
 /* both the http server as well as the rpc system need to queue connections */
 TAILQ_HEAD(evconq, evhttp_connection);
 
+/* a header sent with every reply that does not set it itself; the line is
+ * formatted once, when the header is added */
+struct evhttp_default_header {
+	TAILQ_ENTRY(evhttp_default_header) next;
+
+	size_t key_len;
+	size_t line_len;
+	char *line;			/* "Key: value\r\n" */
+	/* set for Content-* headers, which are left out of replies that
+	 * have no body */
+	int body_only;
+};
+
 /* each bound socket is stored in one of these */
 struct evhttp_bound_socket {
 	TAILQ_ENTRY(evhttp_bound_socket) (next);
@@ -141,6 +154,14 @@ struct evhttp {
 	void *gencbarg;
 
 	struct event_base *base;
+
+	TAILQ_HEAD(defaultq, evhttp_default_header) default_headers;
+
+	/* "Date: ...\r\n", rebuilt only when the event loop's cached clock
+	 * reaches a new second (date_tick) */
+	char date_line[64];
+	size_t date_line_len;
+	time_t date_tick;
 };
 
 /* resets the connection; can be reused for more requests */
@@ -398,58 +398,109 @@ evhttp_is_connection_keepalive(struct evkeyvalq* headers)
 	    && evutil_ascii_strncasecmp(connection, "keep-alive", 10) == 0);
 }
 
+/*
+ * Appends a Date: line to the output.  A server keeps the formatted line
+ * and only calls strftime again once its event loop's cached clock has
+ * moved to a new second, so a busy server formats the date once a second
+ * instead of once per reply.  The loop's clock may be monotonic, so it only
+ * says when to refresh; the date itself still comes from time().
+ */
 static void
-evhttp_maybe_add_date_header(struct evkeyvalq *headers)
+evhttp_add_date_line(struct evhttp_connection *evcon, struct evbuffer *output)
 {
-	if (evhttp_find_header(headers, "Date") == NULL) {
-		char date[50];
+	struct evhttp *http = evcon->http_server;
+	struct timeval tick;
+	char line[64];
+	size_t len;
 #ifndef WIN32
-		struct tm cur;
+	struct tm cur;
 #endif
-		struct tm *cur_p;
-		time_t t = time(NULL);
+	struct tm *cur_p;
+	time_t t;
+
+	if (event_base_gettimeofday_cached(evcon->base, &tick) == -1)
+		tick.tv_sec = 0;
+	if (http != NULL && http->date_line_len != 0 &&
+	    tick.tv_sec != 0 && http->date_tick == tick.tv_sec) {
+		evbuffer_add(output, http->date_line, http->date_line_len);
+		return;
+	}
+
+	t = time(NULL);
 #ifdef WIN32
-		cur_p = gmtime(&t);
+	cur_p = gmtime(&t);
 #else
-		gmtime_r(&t, &cur);
-		cur_p = &cur;
+	gmtime_r(&t, &cur);
+	cur_p = &cur;
 #endif
-		if (strftime(date, sizeof(date),
-			"%a, %d %b %Y %H:%M:%S GMT", cur_p) != 0) {
-			evhttp_add_header(headers, "Date", date);
-		}
+	len = strftime(line, sizeof(line),
+	    "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", cur_p);
+	if (len == 0)
+		return;
+
+	if (http != NULL) {
+		memcpy(http->date_line, line, len);
+		http->date_line_len = len;
+		http->date_tick = tick.tv_sec;
+	}
+	evbuffer_add(output, line, len);
+}
+
+static struct evhttp_default_header *
+evhttp_find_default_header(struct evhttp *http, const char *key)
+{
+	struct evhttp_default_header *header;
+	size_t key_len;
+
+	if (http == NULL)
+		return (NULL);
+
+	key_len = strlen(key);
+	TAILQ_FOREACH(header, &http->default_headers, next) {
+		if (header->key_len == key_len &&
+		    evutil_ascii_strncasecmp(header->line, key, key_len) == 0)
+			return (header);
 	}
+
+	return (NULL);
 }
 
 static void
-evhttp_maybe_add_content_length_header(struct evkeyvalq *headers,
-    long content_length)
+evhttp_maybe_add_content_length_line(struct evkeyvalq *headers,
+    struct evbuffer *output, long content_length)
 {
 	if (evhttp_find_header(headers, "Transfer-Encoding") == NULL &&
 	    evhttp_find_header(headers,	"Content-Length") == NULL) {
-		char len[12];
-		evutil_snprintf(len, sizeof(len), "%ld", content_length);
-		evhttp_add_header(headers, "Content-Length", len);
+		evbuffer_add_printf(output, "Content-Length: %ld\r\n",
+		    content_length);
 	}
 }
 
 /*
- * Create the headers needed for an HTTP reply
+ * Create the headers needed for an HTTP reply.  Date, Content-Length and
+ * the server's default headers go straight into the output rather than
+ * into output_headers, so that a typical reply allocates no headers.
  */
 
 static void
 evhttp_make_header_response(struct evhttp_connection *evcon,
     struct evhttp_request *req)
 {
+	struct evbuffer *output = bufferevent_get_output(evcon->bufev);
+	struct evhttp *http = evcon->http_server;
+	struct evhttp_default_header *header;
+	int needs_body;
 	int is_keepalive = evhttp_is_connection_keepalive(req->input_headers);
-	evbuffer_add_printf(bufferevent_get_output(evcon->bufev),
+	evbuffer_add_printf(output,
 	    "HTTP/%d.%d %d %s\r\n",
 	    req->major, req->minor, req->response_code,
 	    req->response_code_line);
 
 	if (req->major == 1) {
-		if (req->minor == 1)
-			evhttp_maybe_add_date_header(req->output_headers);
+		if (req->minor == 1 &&
+		    evhttp_find_header(req->output_headers, "Date") == NULL &&
+		    evhttp_find_default_header(http, "Date") == NULL)
+			evhttp_add_date_line(evcon, output);
 
 		/*
 		 * if the protocol is 1.0; and the connection was keep-alive
@@ -466,8 +517,8 @@ evhttp_make_header_response(struct evhttp_connection *evcon,
 			 * user did not give it, this is required for
 			 * persistent connections to work.
 			 */
-			evhttp_maybe_add_content_length_header(
-				req->output_headers,
+			evhttp_maybe_add_content_length_line(
+				req->output_headers, output,
 				(long)evbuffer_get_length(req->output_buffer));
 		}
 	}
@@ -475,7 +526,8 @@ evhttp_make_header_response(struct evhttp_connection *evcon,
 	/* Potentially add headers for unidentified content. */
 	if (evhttp_response_needs_body(req)) {
 		if (evhttp_find_header(req->output_headers,
-			"Content-Type") == NULL) {
+			"Content-Type") == NULL &&
+		    evhttp_find_default_header(http, "Content-Type") == NULL) {
 			evhttp_add_header(req->output_headers,
 			    "Content-Type", "text/html; charset=ISO-8859-1");
 		}
@@ -488,6 +540,26 @@ evhttp_make_header_response(struct evhttp_connection *evcon,
 		    evhttp_add_header(req->output_headers, "Connection", "close");
 		evhttp_remove_header(req->output_headers, "Proxy-Connection");
 	}
+
+	if (http == NULL)
+		return;
+	needs_body = evhttp_response_needs_body(req);
+	TAILQ_FOREACH(header, &http->default_headers, next) {
+		int overridden = 0;
+		struct evkeyval *set;
+		if (header->body_only && !needs_body)
+			continue;
+		TAILQ_FOREACH(set, req->output_headers, next) {
+			if (strlen(set->key) == header->key_len &&
+			    evutil_ascii_strncasecmp(set->key, header->line,
+				header->key_len) == 0) {
+				overridden = 1;
+				break;
+			}
+		}
+		if (!overridden)
+			evbuffer_add(output, header->line, header->line_len);
+	}
 }
 
 void
@@ -895,6 +967,9 @@ evhttp_read_cb(struct bufferevent *bufev, void *arg)
 
 	switch (evcon->state) {
 	case EVCON_READING_FIRSTLINE:
+		if (!evutil_timerisset(&req->read_start))
+			event_base_gettimeofday_cached(evcon->base,
+			    &req->read_start);
 		evhttp_read_firstline(evcon, req);
 		/* note the request may have been freed in
 		 * evhttp_read_body */
@@ -2010,6 +2085,9 @@ evhttp_send_done(struct evhttp_connection *evcon, void *arg)
 	    evhttp_is_connection_close(req->flags, req->input_headers) ||
 	    evhttp_is_connection_close(req->flags, req->output_headers);
 
+	if (req->on_complete_cb != NULL)
+		req->on_complete_cb(req, req->on_complete_cb_arg);
+
 	EVUTIL_ASSERT(req->flags & EVHTTP_REQ_OWN_CONNECTION);
 	evhttp_request_free(req);
 
@@ -2697,6 +2775,7 @@ evhttp_new_object(void)
 	TAILQ_INIT(&http->callbacks);
 	TAILQ_INIT(&http->connections);
 	TAILQ_INIT(&http->virtualhosts);
+	TAILQ_INIT(&http->default_headers);
 
 	return (http);
 }
@@ -2735,6 +2814,7 @@ evhttp_free(struct evhttp* http)
 	struct evhttp_connection *evcon;
 	struct evhttp_bound_socket *bound;
 	struct evhttp* vhost;
+	struct evhttp_default_header *header;
 
 	/* Remove the accepting part */
 	while ((bound = TAILQ_FIRST(&http->sockets)) != NULL) {
@@ -2762,6 +2842,12 @@ evhttp_free(struct evhttp* http)
 		evhttp_free(vhost);
 	}
 
+	while ((header = TAILQ_FIRST(&http->default_headers)) != NULL) {
+		TAILQ_REMOVE(&http->default_headers, header, next);
+		mm_free(header->line);
+		mm_free(header);
+	}
+
 	if (http->vhost_pattern != NULL)
 		mm_free(http->vhost_pattern);
 
@@ -2806,6 +2892,67 @@ evhttp_set_timeout(struct evhttp* http, int timeout_in_secs)
 	http->timeout = timeout_in_secs;
 }
 
+int
+evhttp_get_connection_count(struct evhttp *http)
+{
+	struct evhttp_connection *evcon;
+	int n = 0;
+
+	TAILQ_FOREACH(evcon, &http->connections, next)
+		++n;
+	return (n);
+}
+
+int
+evhttp_close_idle_connections(struct evhttp *http)
+{
+	struct evhttp_connection *evcon, *next;
+	int n = 0;
+
+	for (evcon = TAILQ_FIRST(&http->connections); evcon; evcon = next) {
+		next = TAILQ_NEXT(evcon, next);
+		/* No byte of the next request has arrived. */
+		if (evcon->state != EVCON_READING_FIRSTLINE ||
+		    evbuffer_get_length(bufferevent_get_input(evcon->bufev)))
+			continue;
+		evhttp_connection_free(evcon);
+		++n;
+	}
+	return (n);
+}
+
+int
+evhttp_add_default_header(struct evhttp *http,
+    const char *key, const char *value)
+{
+	struct evhttp_default_header *header;
+	size_t key_len = strlen(key), value_len = strlen(value);
+
+	if (strchr(key, '\r') != NULL || strchr(key, '\n') != NULL ||
+	    !evhttp_header_is_valid_value(value)) {
+		event_debug(("%s: dropping illegal header\n", __func__));
+		return (-1);
+	}
+
+	if ((header = mm_calloc(1, sizeof(*header))) == NULL) {
+		event_warn("%s: calloc", __func__);
+		return (-1);
+	}
+	header->key_len = key_len;
+	header->line_len = key_len + 2 + value_len + 2;
+	header->body_only = !evutil_ascii_strncasecmp(key, "Content-", 8);
+	if ((header->line = mm_malloc(header->line_len + 1)) == NULL) {
+		mm_free(header);
+		event_warn("%s: malloc", __func__);
+		return (-1);
+	}
+	evutil_snprintf(header->line, header->line_len + 1, "%s: %s\r\n",
+	    key, value);
+
+	TAILQ_INSERT_TAIL(&http->default_headers, header, next);
+	return (0);
+}
+
 void
 evhttp_set_max_headers_size(struct evhttp* http, ev_ssize_t max_headers_size)
 {
@@ -2938,6 +3085,9 @@ evhttp_request_free(struct evhttp_request *req)
 		return;
 	}
 
+	if (req->on_free_cb != NULL)
+		req->on_free_cb(req, req->on_free_cb_arg);
+
 	if (req->remote_host != NULL)
 		mm_free(req->remote_host);
 	if (req->uri != NULL)
@@ -2986,6 +3136,22 @@ evhttp_request_set_chunked_cb(struct evhttp_request *req,
 	req->chunk_cb = cb;
 }
 
+void
+evhttp_request_set_on_complete_cb(struct evhttp_request *req,
+    void (*cb)(struct evhttp_request *, void *), void *cb_arg)
+{
+	req->on_complete_cb = cb;
+	req->on_complete_cb_arg = cb_arg;
+}
+
+void
+evhttp_request_set_on_free_cb(struct evhttp_request *req,
+    void (*cb)(struct evhttp_request *, void *), void *cb_arg)
+{
+	req->on_free_cb = cb;
+	req->on_free_cb_arg = cb_arg;
+}
+
 /*
  * Allows for inspection of the request URI
  */
@@ -3021,6 +3187,19 @@ struct evbuffer *evhttp_request_get_output_buffer(struct evhttp_request *req)
 	return (req->output_buffer);
 }
 
+int
+evhttp_request_get_response_code(const struct evhttp_request *req)
+{
+	return (req->response_code);
+}
+
+void
+evhttp_request_get_start_time(const struct evhttp_request *req,
+    struct timeval *tv)
+{
+	*tv = req->read_start;
+}
+
 
 /*
  * Takes a file descriptor to read a request from.
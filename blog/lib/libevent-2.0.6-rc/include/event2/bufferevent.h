@@ -125,7 +125,16 @@ enum bufferevent_options {
 	* bufferevent.  This option currently requires that
 	* BEV_OPT_DEFER_CALLBACKS also be set; a future version of Libevent
 	* might remove the requirement.*/
-	BEV_OPT_UNLOCK_CALLBACKS = (1<<3)
+	BEV_OPT_UNLOCK_CALLBACKS = (1<<3),
+
+	/** If set, a socket bufferevent asks the backend for edge-triggered
+	 * events, and reads (or writes) until the socket would block, the
+	 * read high-water mark is reached, or a rate limit runs out,
+	 * rather than once per callback.  Reaching the high-water mark
+	 * leaves the read event registered instead of deleting and later
+	 * re-adding it.  Ignored by other bufferevent types, and by socket
+	 * bufferevents whose base lacks EV_FEATURE_ET. */
+	BEV_OPT_EDGE_TRIGGERED = (1<<4)
 };
 
 /**
@@ -191,7 +191,83 @@ enum event_base_config_flag {
 	/** Instead of checking the current time every time the event loop is
 	    ready to run timeout callbacks, check after each timeout callback.
 	 */
-	EVENT_BASE_FLAG_NO_CACHE_TIME = 0x08
+	EVENT_BASE_FLAG_NO_CACHE_TIME = 0x08,
+	/** Keep timeouts in a hierarchical timing wheel instead of a binary
+	    heap.  Adding and deleting a timeout take constant time however
+	    many are pending, which pays off when a program re-arms a great
+	    many of them.  Timeouts are rounded up to the next millisecond:
+	    they never fire early, but may fire up to a millisecond late.
+	 */
+	EVENT_BASE_FLAG_TIMER_WHEEL = 0x10,
+	/** Keep timeouts in a 4-ary heap that stores each timeout next to
+	    its event pointer, instead of the default binary heap of event
+	    pointers.  It needs fewer cache misses per operation once there
+	    are many thousands of timeouts.  Ignored along with
+	    EVENT_BASE_FLAG_TIMER_WHEEL.
+	 */
+	EVENT_BASE_FLAG_TIMER_HEAP4 = 0x20,
+	/** With epoll, remember which events the kernel is watching for on
+	    each fd, and skip epoll_ctl calls that would not change them.
+	    Only use this if your program never closes an fd while it still
+	    has events added: Libevent cannot see a close, and would go on
+	    believing the kernel still watches the fd.  (Closing an fd after
+	    deleting its events, and reusing its number right away, is fine.)
+	 */
+	EVENT_BASE_FLAG_EPOLL_SKIP_REDUNDANT = 0x40,
+	/** With io_uring, make bufferevent_socket_new() return bufferevents
+	    that hand their reads and writes to the kernel as io_uring
+	    requests, instead of waiting for the socket to be ready and then
+	    calling recv() and send().  Like the IOCP bufferevents on
+	    Windows, they always have deferred callbacks.  Ignored with any
+	    other backend.  bufferevent_new(), which has no base to look at,
+	    still makes ordinary socket bufferevents, and so does evhttp.
+	 */
+	EVENT_BASE_FLAG_URING_BUFFEREVENTS = 0x80,
+	/** Keep track of which timeout durations event_add() sees most
+	    often, and give each of the busiest ones a common timeout queue
+	    (see event_base_init_common_timeout()) without being asked, so
+	    that adding and deleting those timeouts takes constant time.
+	    Up to 32 queues are made this way.  Setting the
+	    EVENT_AUTO_COMMON_TIMEOUTS environment variable has the same
+	    effect, unless EVENT_BASE_FLAG_IGNORE_ENV is set.
+	 */
+	EVENT_BASE_FLAG_AUTO_COMMON_TIMEOUTS = 0x100,
+	/** With the epoll and io_uring backends on Linux, receive signals
+	    through a signalfd that belongs to this event_base, rather than
+	    through a signal handler that wakes up whichever base last
+	    added a signal event.  Signals are read in batches, and several
+	    bases can each watch their own signals.
+
+	    A signal that has a signal event is blocked with
+	    pthread_sigmask() (or sigprocmask(), in a build without thread
+	    support) in the thread that adds the event, and is unblocked again when
+	    its last event is deleted.  A signal sent to the process can
+	    still go to another thread that does not block it, so threaded
+	    programs should block the signals they watch before starting
+	    their other threads.  Setting the EVENT_SIGNALFD environment
+	    variable has the same effect as this flag, unless
+	    EVENT_BASE_FLAG_IGNORE_ENV is set.  Ignored with other
+	    backends, or if signalfd() is not available.
+	 */
+	EVENT_BASE_FLAG_SIGNALFD = 0x200,
+	/** With the epoll backend on Linux, wake up for the next timeout
+	    with a timerfd that is armed to the microsecond, and let
+	    epoll_wait() block with no timeout of its own.  Otherwise,
+	    epoll_wait() rounds each timeout up to a whole millisecond.
+	    This costs one more system call per loop iteration that waits
+	    for a timeout.  Setting the EVENT_PRECISE_TIMER environment
+	    variable has the same effect, unless EVENT_BASE_FLAG_IGNORE_ENV
+	    is set.  The io_uring backend always waits with this precision,
+	    so it ignores the flag, as do the other backends.
+	 */
+	EVENT_BASE_FLAG_PRECISE_TIMER = 0x400,
+	/** Keep the base's memory on the NUMA node of the first CPU given
+	    to event_config_set_cpu_affinity(): the base itself, as far as
+	    it can be, the events and bufferevents allocated for it, and
+	    whatever its loop thread allocates while the loop runs.  Has no
+	    effect without a CPU set, or on systems without NUMA support.
+	 */
+	EVENT_BASE_FLAG_NUMA_LOCAL = 0x800
 };
 
 /**
@@ -199,6 +275,132 @@ enum event_base_config_flag {
  */
 int event_base_get_features(const struct event_base *base);
 
+/**
+   Counters kept by an event_base's backend as it waits for events.
+
+   Every backend counts n_dispatch; so far only epoll and io_uring keep the
+   others.  io_uring has no ready array: nevents and max_nevents give the
+   size of its completion queue, and n_change_syscalls counts the
+   io_uring_enter calls that submitted changes.
+ */
+struct event_dispatch_stats {
+	/** Number of times the backend waited for events. */
+	ev_uint64_t n_dispatch;
+	/** Total number of ready fds it reported. */
+	ev_uint64_t n_ready;
+	/** Number of waits that filled the whole ready array. */
+	ev_uint64_t n_full;
+	/** Number of queued fd changes applied before waiting. */
+	ev_uint64_t n_changes;
+	/** Number of syscalls made to apply them. */
+	ev_uint64_t n_change_syscalls;
+	/** Number of changes that needed no syscall at all. */
+	ev_uint64_t n_changes_skipped;
+	/** Number of times the loop polled the backend without blocking
+	    while busy-polling; see event_config_set_busy_poll(). */
+	ev_uint64_t n_busy_polls;
+	/** Number of busy-polling spells that found something to do before
+	    they ran out of time. */
+	ev_uint64_t n_busy_poll_hits;
+	/** Current size of the ready array. */
+	int nevents;
+	/** Size the ready array may grow to. */
+	int max_nevents;
+};
+
+/**
+   Copy the dispatch counters of an event_base into 'stats'.
+
+   @return 0 on success, -1 on failure.
+ */
+int event_base_get_dispatch_stats(struct event_base *base,
+    struct event_dispatch_stats *stats);
+
+/** Number of buckets in event_loop_stats.callback_hist. */
+#define EVENT_LOOP_STATS_HIST_BUCKETS 20
+/** Number of priorities event_loop_stats tracks separately. */
+#define EVENT_LOOP_STATS_PRIORITIES 8
+
+/**
+   What an event_base's loop has been doing since
+   event_base_enable_loop_stats() was called.
+
+   Times are in microseconds.  "Callback time" covers the whole of
+   processing the active events, including deferred callbacks; the
+   per-callback counters and the histogram cover event callbacks only.
+   Priorities of EVENT_LOOP_STATS_PRIORITIES-1 and above share the last
+   entry of the per-priority arrays.
+ */
+struct event_loop_stats {
+	/** Number of loop iterations. */
+	ev_uint64_t n_iterations;
+	/** Total time spent waiting in the backend. */
+	ev_uint64_t dispatch_usec;
+	/** Total time spent running callbacks. */
+	ev_uint64_t callback_usec;
+	/** Time the most recent iteration spent waiting in the backend. */
+	ev_uint64_t last_dispatch_usec;
+	/** Time the most recent iteration spent running callbacks. */
+	ev_uint64_t last_callback_usec;
+	/** The most time any one iteration spent running callbacks. */
+	ev_uint64_t max_callback_usec;
+	/** Number of event callbacks run. */
+	ev_uint64_t n_callbacks;
+	/** Number of them that ran for at least the slow-callback
+	 * threshold. */
+	ev_uint64_t n_slow_callbacks;
+	/** Callback durations.  Bucket 0 counts callbacks that took less
+	 * than a microsecond; bucket i counts those that took at least
+	 * 2^(i-1) and less than 2^i microseconds.  The last bucket also
+	 * counts everything longer. */
+	ev_uint64_t callback_hist[EVENT_LOOP_STATS_HIST_BUCKETS];
+	/** Number of event callbacks run at each priority. */
+	ev_uint64_t n_callbacks_by_priority[EVENT_LOOP_STATS_PRIORITIES];
+	/** Number of events that were active at each priority when the
+	 * most recent iteration started running callbacks. */
+	int n_active_by_priority[EVENT_LOOP_STATS_PRIORITIES];
+	/** Number of events active right now. */
+	int n_active;
+	/** Number of deferred callbacks queued right now. */
+	int n_deferred;
+	/** Number of entries in the timeout heap (or wheel) right now.  A
+	    common timeout queue is one entry, however many events it holds. */
+	int n_timeouts;
+};
+
+/**
+   Start collecting event_loop_stats for an event_base.
+
+   Collection is off by default; while it is off, the loop pays one
+   branch for each place it would have recorded something.  If it is
+   already on, the counters are kept and only the threshold changes.
+
+   @param base the event_base to instrument
+   @param slow_threshold if not NULL, log a warning giving the fd and the
+      callback function whenever an event callback runs for at least this
+      long.
+   @return 0 on success, -1 on failure.
+   @see event_base_disable_loop_stats(), event_base_get_loop_stats()
+ */
+int event_base_enable_loop_stats(struct event_base *base,
+    const struct timeval *slow_threshold);
+
+/**
+   Stop collecting event_loop_stats for an event_base, and discard the
+   counters collected so far.
+
+   @return 0 on success, -1 on failure.
+ */
+int event_base_disable_loop_stats(struct event_base *base);
+
+/**
+   Copy the loop statistics of an event_base into 'stats'.
+
+   @return 0 on success, -1 if collection is not enabled.
+ */
+int event_base_get_loop_stats(struct event_base *base,
+    struct event_loop_stats *stats);
+
 /**
    Enters a required event method feature that the application demands.
 
@@ -226,6 +428,211 @@ int event_config_require_features(struct event_config *cfg, int feature);
  * will be initialized, and how they'll work. */
 int event_config_set_flag(struct event_config *cfg, int flag);
 
+/**
+   Set the most events the backend may report from a single wait.
+
+   The array that receives ready events starts small and doubles whenever
+   a wait fills it, up to this size.  A bigger maximum lets a busy loop
+   pick up all of its ready fds in one syscall.  Currently only epoll
+   looks at this; its default maximum is 4096.
+
+   @param cfg the event configuration object
+   @param max_events the largest number of events to report at once
+   @return 0 on success, -1 on failure.
+ */
+int event_config_set_max_dispatch_events(struct event_config *cfg,
+    int max_events);
+
+/**
+   Bound the work the event loop does between checks for new events.
+
+   By default, each iteration of the loop runs every active event of the
+   most urgent priority that has any, however many there are and however
+   long they take, before it asks the backend for new events again.  With
+   a limit, it goes back to the backend after max_callbacks callbacks, or
+   after max_interval has passed, whichever comes first; the events it
+   didn't get to stay active for the next iteration.
+
+   @param cfg the event configuration object
+   @param max_interval if not NULL, how long to run callbacks before
+      checking for events again
+   @param max_callbacks if positive, how many callbacks to run before
+      checking for events again
+   @param min_priority only callbacks at this priority and lower
+      (numerically higher) count towards the limits, or are stopped by
+      them.  Use 0 to limit all of them.
+   @return 0 on success, -1 on failure.
+   @see event_base_set_priority_weights()
+ */
+int event_config_set_max_dispatch_interval(struct event_config *cfg,
+    const struct timeval *max_interval, int max_callbacks,
+    int min_priority);
+
+/**
+   Limit how many deferred callbacks (such as those of bufferevents
+   created with BEV_OPT_DEFER_CALLBACKS) the loop runs per iteration.
+
+   This budget is separate from the one set with
+   event_config_set_max_dispatch_interval().
+
+   @param cfg the event configuration object
+   @param max_callbacks the most to run per iteration, or 0 for no limit
+   @return 0 on success, -1 on failure.
+ */
+int event_config_set_max_deferred_callbacks(struct event_config *cfg,
+    int max_callbacks);
+
+/**
+   Make the loop spin for a while before it goes to sleep.
+
+   Normally, when the loop has nothing to do, it blocks in the backend
+   (in epoll_wait(), say) until an event is ready or the next timeout is
+   due.  Waking up from that sleep adds latency.  With busy polling, the
+   loop first polls the backend without blocking, over and over, for up
+   to 'spin' (or until the next timeout, if that comes sooner).  It
+   blocks only if nothing turns up in that time.  This trades CPU time
+   for latency: the loop thread uses a whole CPU whenever events are
+   less than 'spin' apart.  It is of no use if the loop thread has no
+   CPU of its own.
+
+   On Linux, 'socket_usec' also asks the kernel to busy-poll the device
+   queue of each socket that an evconnlistener accepts or that a socket
+   bufferevent is given.  It does this by setting the SO_BUSY_POLL
+   socket option to that many microseconds.  Raising it above the
+   net.core.busy_read sysctl needs CAP_NET_ADMIN.  Sockets on which the
+   option can't be set are used as they are.
+
+   @param cfg the event configuration object
+   @param spin how long to poll before blocking, or NULL or zero not to
+      busy-poll
+   @param socket_usec if positive, the SO_BUSY_POLL value for sockets
+   @return 0 on success, -1 on failure.
+   @see event_base_get_dispatch_stats()
+ */
+int event_config_set_busy_poll(struct event_config *cfg,
+    const struct timeval *spin, int socket_usec);
+
+/**
+   Pin the thread that runs the event_base's loop to a set of CPUs.
+
+   Whenever event_base_loop() starts on a thread that it has not pinned
+   already, it restricts that thread to 'cpus' with sched_setaffinity().
+   The thread stays pinned after the loop exits.  Listeners on the base
+   ask the kernel, with SO_INCOMING_CPU, for the connections that arrive
+   on the first CPU in the set; this matters when several listeners
+   share a port with SO_REUSEPORT, one per base.
+
+   With EVENT_BASE_FLAG_NUMA_LOCAL as well, the base's memory is kept on
+   the NUMA node of the first CPU, so that a server with one base per
+   node (or per CPU) does not pay for remote memory accesses.  The
+   connections that a listener accepts on the base stay on that node, so
+   long as their bufferevents are made on the same base.
+
+   This is only implemented on Linux.  Elsewhere, the base is created
+   all the same, and its loop runs wherever the scheduler puts it.
+
+   @param cfg the event configuration object
+   @param cpus the CPUs to run the loop on, numbered as the kernel does
+   @param n_cpus the number of CPUs in 'cpus', or 0 to leave the loop
+     thread alone
+   @return 0 on success, -1 on failure.
+   @see event_base_get_numa_node()
+ */
+int event_config_set_cpu_affinity(struct event_config *cfg,
+    const int *cpus, int n_cpus);
+
+/**
+   Return the NUMA node that an event_base keeps its memory on, or -1 if
+   it was not configured with EVENT_BASE_FLAG_NUMA_LOCAL and a CPU set,
+   or the system doesn't say which node that CPU is on.
+
+   @see event_config_set_cpu_affinity()
+ */
+int event_base_get_numa_node(const struct event_base *base);
+
+/**
+   Where an event_base gets the time for its timeouts, its cached time,
+   and everything built on them, such as rate limiting.
+
+   @see event_config_set_clock()
+ */
+enum event_clock_source {
+	/** CLOCK_MONOTONIC if the system has it, otherwise gettimeofday()
+	    with a correction when the clock goes backwards. */
+	EVENT_CLOCK_DEFAULT = 0,
+	/** CLOCK_MONOTONIC_COARSE, which Linux can read without leaving user
+	    space, but which only advances once per scheduler tick (typically
+	    1-4 msec).  Timeouts may fire up to one tick late. */
+	EVENT_CLOCK_MONOTONIC_COARSE = 1,
+	/** The CPU's time stamp counter, calibrated against CLOCK_MONOTONIC
+	    when the base is created.  Only available on x86 CPUs with an
+	    invariant TSC. */
+	EVENT_CLOCK_TSC = 2,
+	/** A function supplied with event_config_set_clock_fn(). */
+	EVENT_CLOCK_EXTERNAL = 3,
+	/** Virtual time, for reproducible tests and load simulations.  It
+	    starts at one second, and moves only when event_base_advance_time()
+	    is called, or when the loop runs out of things to do: instead of
+	    waiting for the next timeout, the loop polls the backend and, if
+	    nothing is ready, jumps straight to the timeout.  A day of timers
+	    can thus run in well under a second.
+
+	    Real I/O does not mix well with virtual time, since nothing waits
+	    for it.  Connect the parts of the program under test with
+	    bufferevent_pair_new() instead of sockets.  Waits with no timeout
+	    at all still block for real.
+	 */
+	EVENT_CLOCK_SIMULATED = 4
+};
+
+/**
+   Choose the clock an event_base will use.
+
+   If the clock is not available on this system, the base falls back to
+   EVENT_CLOCK_DEFAULT; event_base_get_clock() tells you which one it
+   ended up with.
+
+   @param cfg the event configuration object
+   @param source one of the event_clock_source values, other than
+      EVENT_CLOCK_EXTERNAL
+   @return 0 on success, -1 on failure.
+ */
+int event_config_set_clock(struct event_config *cfg,
+    enum event_clock_source source);
+
+/**
+   Make an event_base take its time from a function.
+
+   The function returns the current time in nanoseconds.  It must never
+   go backwards, and it is called with the base's lock held, so it must
+   not call back into the base.  This is meant for tests and simulations
+   that need to control the passing of time.
+
+   @param cfg the event configuration object
+   @param clock_fn the function to call
+   @param arg an argument to pass to clock_fn
+   @return 0 on success, -1 on failure.
+ */
+int event_config_set_clock_fn(struct event_config *cfg,
+    ev_uint64_t (*clock_fn)(void *arg), void *arg);
+
+/**
+   Return the event_clock_source that an event_base is using.
+ */
+enum event_clock_source event_base_get_clock(const struct event_base *base);
+
+/**
+   Move the virtual time of an EVENT_CLOCK_SIMULATED event_base forward.
+
+   Timeouts that expire as a result run the next time the loop looks at
+   its timeouts.
+
+   @param base the event_base
+   @param tv how far to move the time
+   @return 0 on success, -1 if the base does not use simulated time.
+ */
+int event_base_advance_time(struct event_base *base, const struct timeval *tv);
+
 /**
   Initialize the event API.
 
@@ -470,6 +877,87 @@ struct event *event_new(struct event_base *, evutil_socket_t, short, event_callb
  */
 void event_free(struct event *);
 
+/**
+   @name Event groups
+
+   An event group collects many similar events (say, the sockets of every
+   client of a server) under one callback.  Each time the loop finds some
+   of them ready, it calls the group's callback once with an array of all
+   of them, instead of calling a callback for each: the locking and queue
+   work that the loop does around each callback is paid once per batch,
+   and the callback can handle the sockets in a tight loop.
+
+   Members are always persistent.  They can be deleted with event_del()
+   and re-added with event_add(), with or without a timeout, like any other
+   event; a member that times out is reported with EV_TIMEOUT.  A member
+   must be freed with event_free() or event_group_free(), and only from the
+   thread running the loop, since a batch being delivered may refer to it.
+
+   @{
+ */
+
+struct event_group;
+
+/** One ready member of an event group, as reported to its callback. */
+struct event_group_item {
+	/** The member's file descriptor. */
+	evutil_socket_t fd;
+	/** What happened: some of EV_TIMEOUT, EV_READ and EV_WRITE. */
+	short what;
+	/** The argument given to event_group_add(). */
+	void *arg;
+	/** The member itself. */
+	struct event *ev;
+};
+
+/** The most members that are delivered in a single batch.  If more are
+ * ready, the group callback is invoked again for the rest. */
+#define EVENT_GROUP_MAX_BATCH 256
+
+/** A function to handle a batch of ready group members.  'items' holds
+ * 'n_items' entries, and is only valid until the function returns. */
+typedef void (*event_group_cb)(struct event_group *,
+    const struct event_group_item *items, int n_items, void *arg);
+
+/**
+  Create a new event group.
+
+  @param base the event_base whose loop should deliver the group's events
+  @param cb the function to invoke with each batch of ready members
+  @param arg the last argument to pass to cb
+  @return a new event group, or NULL on error.
+ */
+struct event_group *event_group_new(struct event_base *base,
+    event_group_cb cb, void *arg);
+
+/**
+  Create a new member of an event group and add it.
+
+  @param group the group to add to
+  @param fd the file descriptor to monitor
+  @param events EV_READ and/or EV_WRITE
+  @param arg the value to report in the member's event_group_item
+  @return the new member, or NULL on error.
+ */
+struct event *event_group_add(struct event_group *group, evutil_socket_t fd,
+    short events, void *arg);
+
+/**
+  Set the priority at which a group's batches run.  Defaults to the middle
+  priority of the base, as for events.
+
+  @see event_priority_set()
+ */
+int event_group_priority_set(struct event_group *group, int priority);
+
+/**
+  Free an event group along with all of its members.  It is safe to call
+  this from the group's own callback.
+ */
+void event_group_free(struct event_group *group);
+
+/**@}*/
+
 /**
   Schedule a one-time event
 
@@ -659,6 +1147,28 @@ ev_uint32_t event_get_version_number(void);
  */
 int	event_base_priority_init(struct event_base *, int);
 
+/**
+  Share each iteration of the loop among the priorities, instead of
+  letting the most urgent one starve the others.
+
+  By default, an iteration runs only the active events of the most urgent
+  priority that has any.  With weights, it visits every priority, most
+  urgent first, and runs up to weights[i] active events at priority i
+  before going back to check for new events.  Events left over stay active
+  for the next iteration.  The limits from
+  event_config_set_max_dispatch_interval() still apply.
+
+  Calling event_base_priority_init() with a different number of priorities
+  drops the weights.
+
+  @param eb the event_base structure returned by event_base_new()
+  @param weights one positive weight for each priority, or NULL to go back
+     to the default
+  @return 0 if successful, or -1 if an error occurred
+  @see event_base_priority_init()
+ */
+int	event_base_set_priority_weights(struct event_base *eb,
+    const int *weights);
 
 /**
   Assign a priority to an event.
@@ -72,42 +72,49 @@ struct {								\
 struct event_base;
 struct event {
 	TAILQ_ENTRY (event) (ev_active_next);
-	TAILQ_ENTRY (event) (ev_next);
 	/* for managing timeouts */
 	union {
 		TAILQ_ENTRY (event) (ev_next_with_common_timeout);
 		int min_heap_idx;
 	} ev_timeout_pos;
-	evutil_socket_t ev_fd;
 
 	struct event_base *ev_base;
 
 	union {
 		/* used for io events */
 		struct {
-			TAILQ_ENTRY (event) (ev_io_next);
+			/* the next event on the same fd */
+			struct event *ev_io_next;
 			struct timeval ev_timeout;
 		} ev_io;
 
 		/* used by signal events */
 		struct {
-			TAILQ_ENTRY (event) (ev_signal_next);
+			/* the next event on the same signal */
+			struct event *ev_signal_next;
 			short ev_ncalls;
 			/* Allows deletes in callback */
 			short *ev_pncalls;
 		} ev_signal;
 	} _ev;
 
+	evutil_socket_t ev_fd;
 	short ev_events;
 	short ev_res;		/* result passed to event callback */
 	short ev_flags;
 	ev_uint8_t ev_pri;	/* smaller numbers are higher priority */
 	ev_uint8_t ev_closure;
+	/* for event_active() from other threads: accumulates the results
+	 * until the loop picks them up */
+	short ev_inbox_res;
 	struct timeval ev_timeout;
 
 	/* allows us to adopt for different types of events */
 	void (*ev_callback)(evutil_socket_t, short, void *arg);
 	void *ev_arg;
+
+	/* links the event into its base's inbox */
+	struct event *ev_inbox_next;
 };
 
 /*
@@ -242,6 +242,51 @@ int evhttp_remove_virtual_host(struct evhttp* http, struct evhttp* vhost);
  */
 void evhttp_set_timeout(struct evhttp *http, int timeout_in_secs);
 
+/**
+ * Return the number of connections that an HTTP server has accepted and
+ * not yet closed: those with a request being read or answered, and idle
+ * keep-alive connections waiting for their next request.
+ *
+ * @param http an evhttp object
+ * @see evhttp_close_idle_connections()
+ */
+int evhttp_get_connection_count(struct evhttp *http);
+
+/**
+ * Close every connection of an HTTP server that is waiting for its next
+ * request and has not received any of it yet.  Connections that are
+ * reading or answering a request are left alone.  Useful when a server
+ * is shutting down gracefully, and wants its keep-alive clients to take
+ * their next requests elsewhere.
+ *
+ * @param http an evhttp object
+ * @return the number of connections closed
+ */
+int evhttp_close_idle_connections(struct evhttp *http);
+
+/**
+ * Add a header to every reply sent by an HTTP server.
+ *
+ * The header line is formatted once, here, and copied into each reply
+ * that does not set the same header in its own output headers.  This is
+ * cheaper than calling evhttp_add_header() from every callback, which
+ * allocates for each reply.  Adding a default Content-Type also replaces
+ * the built-in "text/html; charset=ISO-8859-1" fallback.  Headers whose
+ * names start with "Content-" describe a body, so they are left out of
+ * replies that have none: 1xx, 204 and 304 replies, and replies to HEAD.
+ *
+ * Default headers are taken from the server that accepted the
+ * connection, even when a virtual host handles the request.
+ *
+ * @param http an evhttp object
+ * @param key the header name
+ * @param value the header value
+ * @return 0 on success, -1 if the header is illegal or on failure
+ * @see evhttp_add_header()
+ */
+int evhttp_add_default_header(struct evhttp *http,
+    const char *key, const char *value);
+
 /* Request/Response functionality */
 
 /**
@@ -344,6 +389,33 @@ struct evhttp_request *evhttp_request_new(
 void evhttp_request_set_chunked_cb(struct evhttp_request *,
     void (*cb)(struct evhttp_request *, void *));
 
+/**
+ * Register a callback to be invoked once the reply to an incoming request
+ * has been completely written to the connection.  The callback runs just
+ * before the request object is freed, so it may still inspect the request
+ * but must not keep a pointer to it.
+ *
+ * @param req the incoming request
+ * @param cb the callback, or NULL to remove a previously set callback
+ * @param cb_arg an argument to pass to the callback
+ */
+void evhttp_request_set_on_complete_cb(struct evhttp_request *req,
+    void (*cb)(struct evhttp_request *, void *), void *cb_arg);
+
+/**
+ * Register a callback to be invoked when a request object is freed.
+ * Unlike the on-complete callback, this runs however the request ends:
+ * after its reply has been written, or when its connection fails or the
+ * client goes away first.  It runs before anything is freed, so it may
+ * still inspect the request.
+ *
+ * @param req the request
+ * @param cb the callback, or NULL to remove a previously set callback
+ * @param cb_arg an argument to pass to the callback
+ */
+void evhttp_request_set_on_free_cb(struct evhttp_request *req,
+    void (*cb)(struct evhttp_request *, void *), void *cb_arg);
+
 /** Frees the request object and removes associated events. */
 void evhttp_request_free(struct evhttp_request *req);
 
@@ -459,6 +531,17 @@ struct evkeyvalq *evhttp_request_get_output_headers(struct evhttp_request *req);
 struct evbuffer *evhttp_request_get_input_buffer(struct evhttp_request *req);
 /** Returns the output buffer */
 struct evbuffer *evhttp_request_get_output_buffer(struct evhttp_request *req);
+/** Returns the response code that was sent, or 0 if none has been set */
+int evhttp_request_get_response_code(const struct evhttp_request *req);
+/**
+   Sets 'tv' to the time at which the first byte of the request was read,
+   as reported by event_base_gettimeofday_cached().  Compare it against
+   event_base_gettimeofday_cached() on the same base to find out how long
+   the request has been in flight.  'tv' is cleared if nothing has been
+   read yet.
+ */
+void evhttp_request_get_start_time(const struct evhttp_request *req,
+    struct timeval *tv);
 
 /* Interfaces for dealing with HTTP headers */
 
@@ -116,6 +116,24 @@ struct {
 	 * the regular callback.
 	 */
 	void (*chunk_cb)(struct evhttp_request *, void *);
+
+	/* When the first byte of this request was read, according to
+	 * event_base_gettimeofday_cached(). */
+	struct timeval read_start;
+
+	/*
+	 * Callback invoked once the reply has been completely written,
+	 * just before the request is freed.
+	 */
+	void (*on_complete_cb)(struct evhttp_request *, void *);
+	void *on_complete_cb_arg;
+
+	/*
+	 * Callback invoked when the request is freed, whether or not a
+	 * reply was ever written.
+	 */
+	void (*on_free_cb)(struct evhttp_request *, void *);
+	void *on_free_cb_arg;
 };
 
 #ifdef __cplusplus
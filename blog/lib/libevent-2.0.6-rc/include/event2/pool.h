@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _EVENT2_POOL_H_
+#define _EVENT2_POOL_H_
+
+/** @file pool.h
+
+  Running several event loops at once, one per thread.
+
+  An event_base_pool owns N event_bases and a thread for each, so that a
+  server can spread its connections over several cores without writing its
+  own threading.  Each connection should live on one loop: pick it with
+  event_base_pool_assign(), and then add events and bufferevents to that
+  loop's base as usual.
+
+  To hand work from one loop to another, post a closure with
+  event_base_pool_post().  Closures go through a lock-free queue per loop,
+  and wake the loop at most once per batch, no matter how many closures
+  are posted before it gets around to running them.
+
+  The pool is implemented with pthreads; link against libevent_pthreads.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <event2/event.h>
+
+struct event_base_pool;
+
+/** For event_base_pool_assign(): choose a loop by hashing the
+ * fd, so that the same fd always maps to the same loop. */
+#define EVENT_BASE_POOL_BY_HASH	0
+/** For event_base_pool_assign(): choose the loop with the fewest
+ * events and outstanding closures. */
+#define EVENT_BASE_POOL_BY_LOAD	1
+/** For event_base_pool_assign(): choose the loop with the fewest events
+ * and outstanding closures among those whose bases are on the same NUMA
+ * node as the caller, so that a connection accepted on one loop stays on
+ * that loop's node.  The caller's node is that of its loop, if it is one
+ * of the pool's threads, or else that of the CPU it is running on.  If no
+ * loop is on that node, this is the same as EVENT_BASE_POOL_BY_LOAD.
+ * @see event_base_get_numa_node() */
+#define EVENT_BASE_POOL_BY_NODE	2
+
+/**
+   Create a pool of event loops.
+
+   Turns on pthreads locking (see evthread_use_pthreads()) if it is not on
+   already, since the pool's bases are used from more than one thread.
+   The loops do not run until event_base_pool_start() is called.
+
+   If 'cfg' sets EVENT_BASE_FLAG_NUMA_LOCAL but no CPUs (see
+   event_config_set_cpu_affinity()), each loop is pinned to one of the
+   CPUs that the calling thread may run on, in turn, and keeps its memory
+   on that CPU's node.
+
+   @param n_loops the number of loops and threads; at least 1.
+   @param cfg a configuration for each of the bases, or NULL for the
+     default.
+   @return a new pool, or NULL on error.
+ */
+struct event_base_pool *event_base_pool_new(int n_loops,
+    struct event_config *cfg);
+
+/**
+   Start a thread for every loop in the pool, each running
+   event_base_loop().  The loops keep running, even with no events added,
+   until event_base_pool_stop() is called.
+
+   @return 0 on success, -1 on failure (in which case no loop is left
+     running).
+ */
+int event_base_pool_start(struct event_base_pool *pool);
+
+/**
+   Make every loop in the pool exit once it has finished its current
+   callback, and wait for the threads to finish.  Must not be called from
+   one of the pool's own threads.
+
+   @return 0 on success, -1 on failure.
+ */
+int event_base_pool_stop(struct event_base_pool *pool);
+
+/**
+   Stop the pool if it is running, and free it and its bases.  Closures
+   that were posted but have not run yet are discarded.  Must not be
+   called from one of the pool's own threads: the pool can't be stopped
+   from there, so it is left running and is not freed.
+ */
+void event_base_pool_free(struct event_base_pool *pool);
+
+/** Return the number of loops in the pool. */
+int event_base_pool_size(struct event_base_pool *pool);
+
+/** Return the base of loop number 'idx', or NULL if there is none. */
+struct event_base *event_base_pool_get_base(struct event_base_pool *pool,
+    int idx);
+
+/**
+   Choose the loop that should handle 'fd'.
+
+   @param how EVENT_BASE_POOL_BY_HASH, EVENT_BASE_POOL_BY_LOAD or
+     EVENT_BASE_POOL_BY_NODE.
+   @return the index of the chosen loop, or -1 on error.
+ */
+int event_base_pool_assign(struct event_base_pool *pool,
+    evutil_socket_t fd, int how);
+
+/**
+   Return the index of the loop that the calling thread runs, or -1 if it
+   is not one of the pool's threads.
+ */
+int event_base_pool_current(struct event_base_pool *pool);
+
+/**
+   Arrange for fn(arg) to run in loop number 'idx', from the loop's own
+   thread, as part of an ordinary callback.  Closures posted to the same
+   loop run in the order they were posted.  Safe to call from any thread,
+   including the loop's own.
+
+   @param idx the loop to run 'fn' in, or -1 for the one with the fewest
+     closures waiting.
+   @return 0 on success, -1 on failure.
+ */
+int event_base_pool_post(struct event_base_pool *pool, int idx,
+    void (*fn)(void *), void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _EVENT2_POOL_H_ */
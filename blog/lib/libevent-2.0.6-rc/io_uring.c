@@ -0,0 +1,739 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "event2/event-config.h"
+
+#ifdef _EVENT_HAVE_LINUX_IO_URING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#ifdef _EVENT_HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <endian.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "event-internal.h"
+#include "evsignal-internal.h"
+#include "event2/thread.h"
+#include "evthread-internal.h"
+#include "log-internal.h"
+#include "evmap-internal.h"
+#include "changelist-internal.h"
+#include "iouring-internal.h"
+
+/*
+  An io_uring backend.  Each fd with events gets one poll request in the
+  ring.  All the changes queued since the last dispatch become poll add and
+  poll remove entries in the submission queue, and a single io_uring_enter()
+  both submits them and waits for completions.
+
+  A multishot poll only reports new readiness, as EPOLLET does, so we use
+  one only when the fd's events are edge-triggered.  Otherwise we use a
+  oneshot poll and, after it fires, add it again with the next batch: a new
+  poll request checks the fd's state right away, which gives us the
+  level-triggered behavior the rest of libevent expects without any extra
+  syscalls.
+
+  The ring holds a reference to each fd it polls, so an fd whose events
+  have been deleted is not really closed until the next dispatch.
+
+  Other parts of libevent can queue requests of their own with the
+  event_uring_* functions; they go out with the next batch.  Their
+  user_data is a pointer to their event_uring_op, and a poll's is its fd
+  and generation with the low bit set, so we can tell the two apart.
+ */
+
+struct iouringop {
+	int ring_fd;
+	/* The process that set up the ring.  After a fork, the child shares
+	 * it with us until event_reinit() makes it a new one. */
+	pid_t pid;
+
+	/* The submission queue. */
+	void *sq_ring;
+	size_t sq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned *sq_khead;
+	unsigned *sq_ktail;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	/* Our tail; the kernel sees it when we submit. */
+	unsigned sq_tail;
+
+	/* The completion queue. */
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_cqe *cqes;
+	unsigned *cq_khead;
+	unsigned *cq_ktail;
+	unsigned cq_mask;
+	unsigned cq_entries;
+	/* Held while reaping completions.  The loop reaps ready fds without
+	 * th_base_lock, but other threads reap with it (see
+	 * iouring_submit()), so this comes after th_base_lock when both are
+	 * held. */
+	void *cq_lock;
+	/* What a reap without th_base_lock found, for the next reap with it
+	 * to add to the dispatch stats. */
+	ev_uint64_t n_ready;
+	ev_uint64_t n_full;
+
+	/* Fds whose poll request has finished but whose events are still
+	 * wanted. */
+	evutil_socket_t *rearm;
+	int n_rearm;
+	int rearm_alloc;
+};
+
+static void *iouring_init(struct event_base *);
+static int iouring_dispatch(struct event_base *, struct timeval *);
+static void iouring_dealloc(struct event_base *);
+
+const struct eventop iouringops = {
+	"io_uring",
+	iouring_init,
+	event_changelist_add,
+	event_changelist_del,
+	iouring_dispatch,
+	iouring_dealloc,
+	1, /* need reinit */
+	EV_FEATURE_ET|EV_FEATURE_O1,
+	EVENT_CHANGELIST_FDINFO_SIZE
+};
+
+#define IOURING_SQ_ENTRIES 4096
+#define MAX_NEVENT 4096
+
+/* Set in an fd's kernel_events when its poll request has finished and it
+ * is waiting on the rearm list. */
+#define IOURING_REARM 0x80
+
+/* user_data for requests whose completions we don't care about. */
+#define IOURING_UD_IGNORE (~(ev_uint64_t)0)
+#define IOURING_UD_POLL 1
+#define IOURING_UD(fd, gen) (((ev_uint64_t)(gen) << 34) |	\
+	    ((ev_uint64_t)(ev_uint32_t)(fd) << 2) | IOURING_UD_POLL)
+#define IOURING_UD_FD(ud) ((evutil_socket_t)(ev_uint32_t)((ud) >> 2))
+#define IOURING_UD_GEN(ud) ((ev_uint16_t)((ud) >> 34))
+
+/* The ring is shared with the kernel; these keep the compiler and the CPU
+ * from reordering our accesses to its head and tail counters. */
+#define ring_load_acquire(p) \
+	(__extension__ ({ unsigned _v = *(volatile unsigned *)(p); \
+	    __sync_synchronize(); _v; }))
+#define ring_store_release(p, v) do {		\
+		__sync_synchronize();			\
+		*(volatile unsigned *)(p) = (v);	\
+	} while (0)
+
+static int
+sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+#ifdef __NR_io_uring_setup
+	return syscall(__NR_io_uring_setup, entries, p);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+    unsigned flags, void *arg, size_t argsz)
+{
+#ifdef __NR_io_uring_enter
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+	    flags, arg, argsz);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+static void
+iouring_unmap(struct iouringop *iop)
+{
+	if (iop->sqes && iop->sqes != MAP_FAILED)
+		munmap(iop->sqes, iop->sqes_size);
+	if (iop->cq_ring && iop->cq_ring != MAP_FAILED &&
+	    iop->cq_ring != iop->sq_ring)
+		munmap(iop->cq_ring, iop->cq_ring_size);
+	if (iop->sq_ring && iop->sq_ring != MAP_FAILED)
+		munmap(iop->sq_ring, iop->sq_ring_size);
+	if (iop->ring_fd >= 0)
+		close(iop->ring_fd);
+}
+
+static void *
+iouring_init(struct event_base *base)
+{
+	struct iouringop *iop;
+	struct io_uring_params p;
+	unsigned *array;
+	unsigned cq_entries, i;
+	char *sq, *cq;
+
+	cq_entries = base->max_dispatch_events ?
+	    base->max_dispatch_events : MAX_NEVENT;
+	if (cq_entries < 2 * IOURING_SQ_ENTRIES)
+		cq_entries = 2 * IOURING_SQ_ENTRIES;
+
+	if (!(iop = mm_calloc(1, sizeof(struct iouringop))))
+		return (NULL);
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE|IORING_SETUP_SUBMIT_ALL;
+	p.cq_entries = cq_entries;
+	iop->ring_fd = sys_io_uring_setup(IOURING_SQ_ENTRIES, &p);
+	if (iop->ring_fd == -1 && errno == EINVAL) {
+		/* Older kernels don't know SUBMIT_ALL. */
+		memset(&p, 0, sizeof(p));
+		p.flags = IORING_SETUP_CQSIZE;
+		p.cq_entries = cq_entries;
+		iop->ring_fd = sys_io_uring_setup(IOURING_SQ_ENTRIES, &p);
+	}
+	if (iop->ring_fd == -1) {
+		if (errno != ENOSYS && errno != EPERM)
+			event_warn("io_uring_setup");
+		mm_free(iop);
+		return (NULL);
+	}
+	/* We need completions never to be dropped, timeouts on
+	 * io_uring_enter, and multishot poll.  The last has no feature bit of
+	 * its own; it came in 5.13 with RSRC_TAGS. */
+	if ((p.features & (IORING_FEAT_NODROP|IORING_FEAT_EXT_ARG|
+		    IORING_FEAT_RSRC_TAGS)) !=
+	    (IORING_FEAT_NODROP|IORING_FEAT_EXT_ARG|IORING_FEAT_RSRC_TAGS)) {
+		event_debug(("%s: kernel is too old (features %x)", __func__,
+			p.features));
+		close(iop->ring_fd);
+		mm_free(iop);
+		return (NULL);
+	}
+	evutil_make_socket_closeonexec(iop->ring_fd);
+	iop->pid = getpid();
+
+	iop->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	iop->cq_ring_size = p.cq_off.cqes +
+	    p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (iop->cq_ring_size > iop->sq_ring_size)
+			iop->sq_ring_size = iop->cq_ring_size;
+		iop->cq_ring_size = iop->sq_ring_size;
+	}
+	iop->sq_ring = mmap(NULL, iop->sq_ring_size, PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_POPULATE, iop->ring_fd, IORING_OFF_SQ_RING);
+	if (iop->sq_ring == MAP_FAILED)
+		goto err;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		iop->cq_ring = iop->sq_ring;
+	} else {
+		iop->cq_ring = mmap(NULL, iop->cq_ring_size,
+		    PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		    iop->ring_fd, IORING_OFF_CQ_RING);
+		if (iop->cq_ring == MAP_FAILED)
+			goto err;
+	}
+	iop->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	iop->sqes = mmap(NULL, iop->sqes_size, PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_POPULATE, iop->ring_fd, IORING_OFF_SQES);
+	if (iop->sqes == MAP_FAILED)
+		goto err;
+
+	sq = iop->sq_ring;
+	iop->sq_khead = (unsigned *)(sq + p.sq_off.head);
+	iop->sq_ktail = (unsigned *)(sq + p.sq_off.tail);
+	iop->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+	iop->sq_entries = p.sq_entries;
+	iop->sq_tail = *iop->sq_ktail;
+	/* We always fill the sqes in ring order, so the index array never
+	 * needs to change. */
+	array = (unsigned *)(sq + p.sq_off.array);
+	for (i = 0; i < p.sq_entries; ++i)
+		array[i] = i;
+
+	cq = iop->cq_ring;
+	iop->cq_khead = (unsigned *)(cq + p.cq_off.head);
+	iop->cq_ktail = (unsigned *)(cq + p.cq_off.tail);
+	iop->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+	iop->cq_entries = p.cq_entries;
+	iop->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	base->dispatch_stats.nevents = iop->cq_entries;
+	base->dispatch_stats.max_nevents = iop->cq_entries;
+
+	/* th_base_lock doesn't exist yet, so we can't tell whether the base
+	 * will have one; this is NULL if locking isn't on at all. */
+	EVTHREAD_ALLOC_LOCK(iop->cq_lock, 0);
+
+	if (!(base->flags & EVENT_BASE_FLAG_SIGNALFD) ||
+	    evsigfd_init(base) < 0)
+		evsig_init(base);
+
+	return (iop);
+err:
+	event_warn("%s: mmap", __func__);
+	iouring_unmap(iop);
+	mm_free(iop);
+	return (NULL);
+}
+
+static void iouring_reap(struct event_base *base, int unlocked);
+
+/* Hand every queued sqe to the kernel without waiting for anything. */
+static int
+iouring_submit(struct event_base *base)
+{
+	struct iouringop *iop = base->evbase;
+	unsigned to_submit;
+	int res;
+
+	ring_store_release(iop->sq_ktail, iop->sq_tail);
+	to_submit = iop->sq_tail - ring_load_acquire(iop->sq_khead);
+	++base->dispatch_stats.n_change_syscalls;
+	res = sys_io_uring_enter(iop->ring_fd, to_submit, 0, 0, NULL, 0);
+	if (res == -1 && (errno == EBUSY || errno == EAGAIN)) {
+		/* The completion queue is backed up.  Empty it and retry. */
+		iouring_reap(base, 0);
+		++base->dispatch_stats.n_change_syscalls;
+		res = sys_io_uring_enter(iop->ring_fd, to_submit, 0,
+		    IORING_ENTER_GETEVENTS, NULL, 0);
+	}
+	if (res == -1 && errno != EINTR) {
+		event_warn("io_uring_enter");
+		return (-1);
+	}
+	return (0);
+}
+
+static struct io_uring_sqe *
+iouring_get_sqe(struct event_base *base)
+{
+	struct iouringop *iop = base->evbase;
+	struct io_uring_sqe *sqe;
+
+	if (iop->sq_tail - ring_load_acquire(iop->sq_khead) ==
+	    iop->sq_entries) {
+		if (iouring_submit(base) == -1 ||
+		    iop->sq_tail - ring_load_acquire(iop->sq_khead) ==
+		    iop->sq_entries)
+			return (NULL);
+	}
+	sqe = &iop->sqes[iop->sq_tail & iop->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	++iop->sq_tail;
+	return (sqe);
+}
+
+/* Queue a poll for 'events' (EV_READ, EV_WRITE and EV_ET) on 'fd'. */
+static int
+iouring_poll_add(struct event_base *base, evutil_socket_t fd, int events,
+    ev_uint16_t gen)
+{
+	struct io_uring_sqe *sqe = iouring_get_sqe(base);
+	ev_uint32_t mask = 0;
+
+	if (!sqe) {
+		event_warnx("%s: no room to poll fd %d", __func__, fd);
+		return (-1);
+	}
+	if (events & EV_READ)
+		mask |= POLLIN;
+	if (events & EV_WRITE)
+		mask |= POLLOUT;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	mask = (mask << 16) | (mask >> 16);
+#endif
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = mask;
+	if (events & EV_ET)
+		sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = IOURING_UD(fd, gen);
+	return (0);
+}
+
+static int
+iouring_poll_remove(struct event_base *base, evutil_socket_t fd,
+    ev_uint16_t gen)
+{
+	struct io_uring_sqe *sqe = iouring_get_sqe(base);
+
+	if (!sqe) {
+		event_warnx("%s: no room to stop polling fd %d", __func__, fd);
+		return (-1);
+	}
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = IOURING_UD(fd, gen);
+	sqe->user_data = IOURING_UD_IGNORE;
+	return (0);
+}
+
+static void
+iouring_apply_change(struct event_base *base, struct event_change *ch)
+{
+	struct event_changelist_fdinfo *fdinfo =
+	    event_change_get_fdinfo(base, ch);
+	int have = fdinfo->kernel_events & ~IOURING_REARM;
+	int in_flight = have && !(fdinfo->kernel_events & IOURING_REARM);
+	int want = event_change_get_events(ch, have);
+
+	/* If the fd was emptied, it may have been closed and reopened, and
+	 * a request still in flight would be polling the old file. */
+	if (want == have && !(fdinfo->emptied && in_flight)) {
+		++base->dispatch_stats.n_changes_skipped;
+		return;
+	}
+
+	if (in_flight)
+		iouring_poll_remove(base, ch->fd, fdinfo->generation);
+	++fdinfo->generation;
+	fdinfo->kernel_events = 0;
+	if (want && iouring_poll_add(base, ch->fd, want,
+		fdinfo->generation) == 0)
+		fdinfo->kernel_events = want;
+}
+
+static void
+iouring_apply_rearms(struct event_base *base)
+{
+	struct iouringop *iop = base->evbase;
+	struct event_changelist_fdinfo *fdinfo;
+	int i, events;
+
+	for (i = 0; i < iop->n_rearm; ++i) {
+		evutil_socket_t fd = iop->rearm[i];
+		fdinfo = evmap_io_get_fdinfo(&base->io, fd);
+		if (!fdinfo || !(fdinfo->kernel_events & IOURING_REARM))
+			continue; /* Changed or deleted since. */
+		events = fdinfo->kernel_events & ~IOURING_REARM;
+		fdinfo->kernel_events = 0;
+		if (iouring_poll_add(base, fd, events,
+			fdinfo->generation) == 0)
+			fdinfo->kernel_events = events;
+	}
+	iop->n_rearm = 0;
+}
+
+static void
+iouring_need_rearm(struct event_base *base, evutil_socket_t fd,
+    struct event_changelist_fdinfo *fdinfo)
+{
+	struct iouringop *iop = base->evbase;
+
+	if (iop->n_rearm == iop->rearm_alloc) {
+		int n = iop->rearm_alloc ? iop->rearm_alloc * 2 : 64;
+		evutil_socket_t *r = mm_realloc(iop->rearm, n * sizeof(*r));
+		if (!r) {
+			event_warn("%s: realloc", __func__);
+			fdinfo->kernel_events = 0;
+			return;
+		}
+		iop->rearm = r;
+		iop->rearm_alloc = n;
+	}
+	iop->rearm[iop->n_rearm++] = fd;
+	fdinfo->kernel_events |= IOURING_REARM;
+}
+
+/* Activate the events for every completion in the queue.  If 'unlocked',
+ * we're in the loop's thread without th_base_lock: we activate through
+ * evmap_io_active_unlocked(), and leave everything from the first finished
+ * request on for a reap with the lock.  The generations and kernel_events
+ * of our fdinfos are only changed by the loop's thread or by a reap, so we
+ * may use them here. */
+static void
+iouring_reap(struct event_base *base, int unlocked)
+{
+	struct iouringop *iop = base->evbase;
+	unsigned head, tail;
+
+	EVLOCK_LOCK(iop->cq_lock, 0);
+	head = *iop->cq_khead;
+	tail = ring_load_acquire(iop->cq_ktail);
+	if (tail - head >= iop->cq_entries)
+		++iop->n_full;
+
+	for (; head != tail; ++head) {
+		struct io_uring_cqe *cqe = &iop->cqes[head & iop->cq_mask];
+		struct event_changelist_fdinfo *fdinfo;
+		evutil_socket_t fd;
+		short ev = 0;
+
+		if (cqe->user_data == IOURING_UD_IGNORE)
+			continue;
+		if (!(cqe->user_data & IOURING_UD_POLL)) {
+			struct event_uring_op *op = (struct event_uring_op *)
+			    (uintptr_t)cqe->user_data;
+			if (unlocked)
+				break;
+			op->res = cqe->res;
+			event_base_del_virtual(base);
+			event_deferred_cb_schedule(&base->defer_queue,
+			    &op->cb);
+			continue;
+		}
+		fd = IOURING_UD_FD(cqe->user_data);
+		fdinfo = evmap_io_get_fdinfo(&base->io, fd);
+		if (!fdinfo ||
+		    fdinfo->generation != IOURING_UD_GEN(cqe->user_data))
+			continue; /* From a request we have since replaced. */
+
+		if (cqe->res < 0) {
+			if (cqe->res != -ECANCELED) {
+				errno = -cqe->res;
+				event_warn("%s: poll on fd %d failed",
+				    __func__, fd);
+			}
+			fdinfo->kernel_events = 0;
+			continue;
+		}
+		if (!(cqe->flags & IORING_CQE_F_MORE))
+			iouring_need_rearm(base, fd, fdinfo);
+
+		if (cqe->res & (POLLHUP|POLLERR)) {
+			ev = EV_READ | EV_WRITE;
+		} else {
+			if (cqe->res & POLLIN)
+				ev |= EV_READ;
+			if (cqe->res & POLLOUT)
+				ev |= EV_WRITE;
+		}
+		if (ev) {
+			++iop->n_ready;
+			if (unlocked)
+				evmap_io_active_unlocked(base, fd, ev | EV_ET);
+			else
+				evmap_io_active(base, fd, ev | EV_ET);
+		}
+	}
+	ring_store_release(iop->cq_khead, head);
+
+	if (!unlocked) {
+		base->dispatch_stats.n_ready += iop->n_ready;
+		base->dispatch_stats.n_full += iop->n_full;
+		iop->n_ready = iop->n_full = 0;
+	}
+	EVLOCK_UNLOCK(iop->cq_lock, 0);
+}
+
+static int
+iouring_dispatch(struct event_base *base, struct timeval *tv)
+{
+	struct iouringop *iop = base->evbase;
+	struct event_changelist *changelist = &base->changelist;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned flags = IORING_ENTER_GETEVENTS;
+	unsigned to_submit, min_complete = 1;
+	void *argp = NULL;
+	size_t argsz = 0;
+	int i, res;
+
+	base->dispatch_stats.n_changes += changelist->n_changes;
+	for (i = 0; i < changelist->n_changes; ++i)
+		iouring_apply_change(base, &changelist->changes[i]);
+	event_changelist_remove_all(changelist, base);
+	iouring_apply_rearms(base);
+
+	if (tv != NULL) {
+		if (tv->tv_sec == 0 && tv->tv_usec == 0) {
+			min_complete = 0;
+		} else {
+			memset(&arg, 0, sizeof(arg));
+			ts.tv_sec = tv->tv_sec;
+			ts.tv_nsec = tv->tv_usec * 1000;
+			arg.ts = (ev_uint64_t)(uintptr_t)&ts;
+			flags |= IORING_ENTER_EXT_ARG;
+			argp = &arg;
+			argsz = sizeof(arg);
+		}
+	}
+
+	ring_store_release(iop->sq_ktail, iop->sq_tail);
+	to_submit = iop->sq_tail - ring_load_acquire(iop->sq_khead);
+	if (to_submit)
+		++base->dispatch_stats.n_change_syscalls;
+
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+	res = sys_io_uring_enter(iop->ring_fd, to_submit, min_complete, flags,
+	    argp, argsz);
+
+	/* Hand the ready fds to the loop before taking the lock back, so
+	 * threads adding and deleting events don't wait on us for it. */
+	if (EVMAP_IO_ACTIVE_UNLOCKED(base))
+		iouring_reap(base, 1);
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+
+	if (res == -1) {
+		if (errno == EINTR) {
+			evsig_process(base);
+		} else if (errno != ETIME && errno != EBUSY &&
+		    errno != EAGAIN) {
+			event_warn("io_uring_enter");
+			return (-1);
+		}
+	} else if (base->sig.evsig_caught) {
+		evsig_process(base);
+	}
+
+	iouring_reap(base, 0);
+
+	return (0);
+}
+
+void
+event_uring_op_init(struct event_uring_op *op, deferred_cb_fn cb, void *arg)
+{
+	memset(op, 0, sizeof(*op));
+	event_deferred_cb_init(&op->cb, cb, arg);
+}
+
+int
+event_base_uses_uring_bufferevents(struct event_base *base)
+{
+	return base->evsel == &iouringops &&
+	    (base->flags & EVENT_BASE_FLAG_URING_BUFFEREVENTS);
+}
+
+/* Queue a request for 'op'.  If we're not in the loop's thread, the loop
+ * may be asleep in io_uring_enter() and would not see the request until
+ * something else woke it, so we submit it right away. */
+static int
+iouring_queue_op(struct event_base *base, int opcode, evutil_socket_t fd,
+    void *addr, int msg_flags, struct event_uring_op *op)
+{
+	struct io_uring_sqe *sqe;
+	int r = -1;
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	if (base->evsel != &iouringops)
+		goto done;
+	if (!(sqe = iouring_get_sqe(base)))
+		goto done;
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (ev_uint64_t)(uintptr_t)addr;
+	if (opcode != IORING_OP_ASYNC_CANCEL) {
+		sqe->len = 1;
+		sqe->msg_flags = msg_flags;
+		sqe->user_data = (ev_uint64_t)(uintptr_t)op;
+		event_base_add_virtual(base);
+	} else {
+		sqe->user_data = IOURING_UD_IGNORE;
+	}
+	r = 0;
+	/* If this fails, the request is still queued, and goes out with the
+	 * next batch. */
+	if (!EVBASE_IN_THREAD(base))
+		iouring_submit(base);
+done:
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+	return r;
+}
+
+int
+event_uring_recvmsg(struct event_base *base, evutil_socket_t fd,
+    struct msghdr *msg, struct event_uring_op *op)
+{
+	return iouring_queue_op(base, IORING_OP_RECVMSG, fd, msg, 0, op);
+}
+
+int
+event_uring_sendmsg(struct event_base *base, evutil_socket_t fd,
+    struct msghdr *msg, struct event_uring_op *op)
+{
+	return iouring_queue_op(base, IORING_OP_SENDMSG, fd, msg,
+	    MSG_NOSIGNAL, op);
+}
+
+int
+event_uring_cancel(struct event_base *base, struct event_uring_op *op)
+{
+	return iouring_queue_op(base, IORING_OP_ASYNC_CANCEL, -1, op, 0,
+	    NULL);
+}
+
+/* The kernel tears a ring down asynchronously once we close it, and the
+ * fds it polls stay open until it has.  A program that frees its base and
+ * then binds the same address again would fail, so we take our polls out
+ * first. */
+static void
+iouring_cancel_all(struct event_base *base)
+{
+	struct iouringop *iop = base->evbase;
+	struct event_changelist_fdinfo *fdinfo;
+	unsigned to_submit;
+	int fd;
+
+	for (fd = 0; fd < base->io.nentries; ++fd) {
+		fdinfo = evmap_io_get_fdinfo(&base->io, fd);
+		if (!fdinfo || !fdinfo->kernel_events ||
+		    (fdinfo->kernel_events & IOURING_REARM))
+			continue;
+		iouring_poll_remove(base, fd, fdinfo->generation);
+		fdinfo->kernel_events = 0;
+	}
+
+	ring_store_release(iop->sq_ktail, iop->sq_tail);
+	to_submit = iop->sq_tail - ring_load_acquire(iop->sq_khead);
+	if (to_submit)
+		sys_io_uring_enter(iop->ring_fd, to_submit, to_submit,
+		    IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static void
+iouring_dealloc(struct event_base *base)
+{
+	struct iouringop *iop = base->evbase;
+
+	evsig_dealloc(base);
+	/* Don't cancel the polls of a parent we share the ring with. */
+	if (iop->pid == getpid())
+		iouring_cancel_all(base);
+	iouring_unmap(iop);
+	if (iop->rearm)
+		mm_free(iop->rearm);
+	EVTHREAD_FREE_LOCK(iop->cq_lock, 0);
+
+	memset(iop, 0, sizeof(struct iouringop));
+	mm_free(iop);
+}
+
+#endif /* _EVENT_HAVE_LINUX_IO_URING_H */
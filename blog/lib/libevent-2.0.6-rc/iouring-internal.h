@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _EVENT_IOURING_INTERNAL_H
+#define _EVENT_IOURING_INTERNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "event2/event-config.h"
+#include "event2/util.h"
+#include "defer-internal.h"
+
+/*
+  Requests other than polls that callers can hand to the io_uring backend.
+  When one completes, its result is stored in the op and its deferred_cb is
+  scheduled on the base, so it runs from the event loop like any other
+  deferred callback.  Until then, the request counts as a virtual event,
+  and keeps event_base_loop() from returning.
+
+  The kernel may read and write the memory that a request points to until
+  the request completes, so the caller must keep the op, its msghdr, and
+  the buffers they describe alive and in place until the callback runs,
+  even if the request is canceled.
+ */
+
+struct event_base;
+struct msghdr;
+
+/** Internal use only.  One outstanding io_uring request. */
+struct event_uring_op {
+	/** Scheduled when the request completes. */
+	struct deferred_cb cb;
+	/** What the request returned: a byte count, or -errno. */
+	int res;
+};
+
+/** Initialize 'op' to run 'cb' with 'arg' when a request completes. */
+void event_uring_op_init(struct event_uring_op *op, deferred_cb_fn cb,
+    void *arg);
+
+/** Return true iff 'base' uses io_uring, and was configured to use it for
+ * bufferevents too. */
+int event_base_uses_uring_bufferevents(struct event_base *base);
+
+/** Queue a recvmsg() on 'fd' into 'msg'.  Return 0 on success, -1 if
+ * 'base' doesn't use io_uring or the queue is full. */
+int event_uring_recvmsg(struct event_base *base, evutil_socket_t fd,
+    struct msghdr *msg, struct event_uring_op *op);
+/** Queue a sendmsg() on 'fd' from 'msg'.  We never raise SIGPIPE. */
+int event_uring_sendmsg(struct event_base *base, evutil_socket_t fd,
+    struct msghdr *msg, struct event_uring_op *op);
+/** Ask the kernel to cancel the request for 'op'.  Its callback still
+ * runs, most likely with res set to -ECANCELED. */
+int event_uring_cancel(struct event_base *base, struct event_uring_op *op);
+
+struct bufferevent *bufferevent_uring_new(struct event_base *base,
+    evutil_socket_t fd, int options);
+void bufferevent_uring_set_connected(struct bufferevent *bev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
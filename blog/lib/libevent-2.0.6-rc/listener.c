@@ -34,6 +34,7 @@
 #include <mswsock.h>
 #endif
 #include <errno.h>
+#include <sys/queue.h>
 #ifdef _EVENT_HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
@@ -51,6 +52,7 @@
 #include "mm-internal.h"
 #include "util-internal.h"
 #include "log-internal.h"
+#include "event-internal.h"
 #ifdef WIN32
 #include "iocp-internal.h"
 #include "defer-internal.h"
@@ -133,6 +135,7 @@ evconnlistener_new(struct event_base *base,
 		if (listen(fd, 128) < 0)
 			return NULL;
 	}
+	event_base_steer_listener(base, fd);
 
 	lev = mm_calloc(1, sizeof(struct evconnlistener_event));
 	if (!lev)
@@ -290,6 +293,8 @@ listener_read_cb(evutil_socket_t fd, short what, void *p)
 
 		if (!(lev->flags & LEV_OPT_LEAVE_SOCKETS_BLOCKING))
 			evutil_make_socket_nonblocking(new_fd);
+		event_base_busy_poll_socket(evconnlistener_get_base(lev),
+		    new_fd);
 
 		lev->cb(lev, new_fd, (struct sockaddr*)&ss, (int)socklen,
 		    lev->user_data);
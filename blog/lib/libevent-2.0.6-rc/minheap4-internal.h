@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _MIN_HEAP4_H_
+#define _MIN_HEAP4_H_
+
+/*
+  A 4-ary min-heap of timeouts that keeps each event's key in the heap
+  array itself, next to the event pointer.  Comparing keys never touches
+  the events, and the four children of a node share one 64-byte cache
+  line, so each level of a sift costs one cache miss instead of one per
+  event compared, and the tree is half as deep as a binary one.  Events
+  still learn their index through ev_timeout_pos.min_heap_idx, exactly as
+  with min_heap, so min_heap_elem_init() and min_heap_elt_is_top() work
+  for either heap.
+ */
+
+#include "event2/event-config.h"
+#include "event2/event.h"
+#include "event2/event_struct.h"
+#include "event2/util.h"
+#include "util-internal.h"
+#include "mm-internal.h"
+
+#include <string.h>
+
+struct min_heap4_entry
+{
+	ev_uint64_t key;
+	struct event* ev;
+};
+
+typedef struct min_heap4
+{
+	struct min_heap4_entry* p;
+	void* mem;
+	unsigned n, a;
+} min_heap4_t;
+
+#define MIN_HEAP4_ALIGN 64
+
+static inline void	     min_heap4_ctor(min_heap4_t* s);
+static inline void	     min_heap4_dtor(min_heap4_t* s);
+static inline ev_uint64_t    min_heap4_key(const struct timeval* tv);
+static inline int	     min_heap4_empty(min_heap4_t* s);
+static inline unsigned	     min_heap4_size(min_heap4_t* s);
+static inline struct event*  min_heap4_top(min_heap4_t* s);
+static inline int	     min_heap4_reserve(min_heap4_t* s, unsigned n);
+static inline int	     min_heap4_push(min_heap4_t* s, struct event* e);
+static inline struct event*  min_heap4_pop(min_heap4_t* s);
+static inline int	     min_heap4_erase(min_heap4_t* s, struct event* e);
+static inline void	     min_heap4_shift_up_(min_heap4_t* s, unsigned hole_index, struct min_heap4_entry x);
+static inline void	     min_heap4_shift_down_(min_heap4_t* s, unsigned hole_index, struct min_heap4_entry x);
+
+void min_heap4_ctor(min_heap4_t* s) { s->p = 0; s->mem = 0; s->n = 0; s->a = 0; }
+void min_heap4_dtor(min_heap4_t* s) { if (s->mem) mm_free(s->mem); }
+int min_heap4_empty(min_heap4_t* s) { return 0u == s->n; }
+unsigned min_heap4_size(min_heap4_t* s) { return s->n; }
+struct event* min_heap4_top(min_heap4_t* s) { return s->n ? s->p->ev : 0; }
+
+/* Timeouts are never negative, and 2^64 microseconds is plenty. */
+ev_uint64_t min_heap4_key(const struct timeval* tv)
+{
+	return (ev_uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+int min_heap4_push(min_heap4_t* s, struct event* e)
+{
+	struct min_heap4_entry x;
+	if (min_heap4_reserve(s, s->n + 1))
+		return -1;
+	x.key = min_heap4_key(&e->ev_timeout);
+	x.ev = e;
+	min_heap4_shift_up_(s, s->n++, x);
+	return 0;
+}
+
+struct event* min_heap4_pop(min_heap4_t* s)
+{
+	if (s->n)
+	{
+		struct event* e = s->p->ev;
+		min_heap4_shift_down_(s, 0u, s->p[--s->n]);
+		e->ev_timeout_pos.min_heap_idx = -1;
+		return e;
+	}
+	return 0;
+}
+
+int min_heap4_erase(min_heap4_t* s, struct event* e)
+{
+	unsigned idx = e->ev_timeout_pos.min_heap_idx;
+	if (((unsigned int)-1) != idx)
+	{
+		struct min_heap4_entry last = s->p[--s->n];
+		/* As in min_heap_erase: the last element takes e's place, and
+		   moves either up or down, never both. */
+		if (idx > 0 && s->p[(idx - 1) / 4].key > last.key)
+			min_heap4_shift_up_(s, idx, last);
+		else
+			min_heap4_shift_down_(s, idx, last);
+		e->ev_timeout_pos.min_heap_idx = -1;
+		return 0;
+	}
+	return -1;
+}
+
+/* The array is placed so that element 1, and so every group of siblings
+   4i+1 .. 4i+4, starts on a MIN_HEAP4_ALIGN boundary. */
+int min_heap4_reserve(min_heap4_t* s, unsigned n)
+{
+	if (s->a < n)
+	{
+		void* mem;
+		struct min_heap4_entry* p;
+		ev_uintptr_t addr;
+		unsigned a = s->a ? s->a * 2 : 8;
+		if (a < n)
+			a = n;
+		if (!(mem = mm_malloc(a * sizeof *p + MIN_HEAP4_ALIGN)))
+			return -1;
+		addr = (ev_uintptr_t)mem + sizeof *p + MIN_HEAP4_ALIGN - 1;
+		addr &= ~(ev_uintptr_t)(MIN_HEAP4_ALIGN - 1);
+		p = (struct min_heap4_entry*)(addr - sizeof *p);
+		if (s->n)
+			memcpy(p, s->p, s->n * sizeof *p);
+		if (s->mem)
+			mm_free(s->mem);
+		s->mem = mem;
+		s->p = p;
+		s->a = a;
+	}
+	return 0;
+}
+
+void min_heap4_shift_up_(min_heap4_t* s, unsigned hole_index, struct min_heap4_entry x)
+{
+	while (hole_index)
+	{
+		unsigned parent = (hole_index - 1) / 4;
+		if (!(s->p[parent].key > x.key))
+			break;
+		s->p[hole_index] = s->p[parent];
+		s->p[hole_index].ev->ev_timeout_pos.min_heap_idx = hole_index;
+		hole_index = parent;
+	}
+	s->p[hole_index] = x;
+	x.ev->ev_timeout_pos.min_heap_idx = hole_index;
+}
+
+void min_heap4_shift_down_(min_heap4_t* s, unsigned hole_index, struct min_heap4_entry x)
+{
+	unsigned first;
+	while ((first = 4 * hole_index + 1) < s->n)
+	{
+		unsigned end = first + 4 < s->n ? first + 4 : s->n;
+		unsigned min_child = first, i;
+		for (i = first + 1; i < end; ++i)
+			if (s->p[i].key < s->p[min_child].key)
+				min_child = i;
+		if (!(x.key > s->p[min_child].key))
+			break;
+		s->p[hole_index] = s->p[min_child];
+		s->p[hole_index].ev->ev_timeout_pos.min_heap_idx = hole_index;
+		hole_index = min_child;
+	}
+	s->p[hole_index] = x;
+	x.ev->ev_timeout_pos.min_heap_idx = hole_index;
+}
+
+#endif /* _MIN_HEAP4_H_ */
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _MPSC_INTERNAL_H_
+#define _MPSC_INTERNAL_H_
+
+/*
+  An intrusive multi-producer, single-consumer queue, after Dmitry
+  Vyukov's: any number of threads may push without taking a lock, and the
+  one thread that owns the queue pops.  A push is a single atomic exchange,
+  so posting work to another thread never waits for that thread.
+
+  The queue keeps a stub node so that it is never structurally empty.  A
+  producer that has swapped itself in as the head but not yet linked the
+  old head to it leaves the queue briefly unreadable past that point, and
+  evmpsc_pop() returns NULL there even though evmpsc_empty() is false.
+  That is fine for a consumer that the producers wake up after pushing:
+  the producer in the middle of its push has yet to do so.  A consumer
+  that needs to see one particular node should use evmpsc_wait().
+
+  Only available when the compiler has atomic builtins; EVMPSC_LOCKFREE is
+  defined when it does.
+ */
+
+#include "event2/event-config.h"
+
+#if defined(__GNUC__)
+#define EVMPSC_LOCKFREE 1
+
+#ifdef WIN32
+#include <windows.h>
+#define EVMPSC_YIELD() SwitchToThread()
+#else
+#include <sched.h>
+#define EVMPSC_YIELD() sched_yield()
+#endif
+
+#if defined(__ATOMIC_ACQUIRE)
+#define EVMPSC_XCHG(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define EVMPSC_LOAD(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define EVMPSC_STORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define EVMPSC_ADD(p, n) __atomic_add_fetch((p), (n), __ATOMIC_RELAXED)
+#define EVMPSC_OR(p, v) __atomic_fetch_or((p), (v), __ATOMIC_SEQ_CST)
+#else
+/* Older compilers only have the __sync builtins.
+ * __sync_lock_test_and_set() is only an acquire barrier, so put a full
+ * barrier in front of it to publish whatever the caller wrote first. */
+#define EVMPSC_XCHG(p, v) \
+	(__sync_synchronize(), __sync_lock_test_and_set((p), (v)))
+#define EVMPSC_LOAD(p) \
+	(__extension__ ({ __typeof__(*(p)) _v = *(volatile __typeof__(*(p)) *)(p); \
+	    __sync_synchronize(); _v; }))
+#define EVMPSC_STORE(p, v) do {				\
+		__sync_synchronize();				\
+		*(volatile __typeof__(*(p)) *)(p) = (v);	\
+	} while (0)
+#define EVMPSC_ADD(p, n) __sync_add_and_fetch((p), (n))
+#define EVMPSC_OR(p, v) __sync_fetch_and_or((p), (v))
+#endif
+
+struct evmpsc_node {
+	struct evmpsc_node *next;
+};
+
+struct evmpsc_queue {
+	/** The most recently pushed node; producers swap themselves in
+	 * here. */
+	struct evmpsc_node *head;
+	/** The next node to pop.  Only the consumer touches this. */
+	struct evmpsc_node *tail;
+	struct evmpsc_node stub;
+};
+
+static inline void
+evmpsc_init(struct evmpsc_queue *q)
+{
+	q->stub.next = NULL;
+	q->head = q->tail = &q->stub;
+}
+
+/** Append 'n' to 'q'.  Safe to call from any thread. */
+static inline void
+evmpsc_push(struct evmpsc_queue *q, struct evmpsc_node *n)
+{
+	struct evmpsc_node *prev;
+	n->next = NULL;
+	prev = EVMPSC_XCHG(&q->head, n);
+	EVMPSC_STORE(&prev->next, n);
+}
+
+/** Remove and return the oldest node in 'q', or NULL if it is empty or
+ * a push is halfway done.  Only the queue's consumer may call this. */
+static inline struct evmpsc_node *
+evmpsc_pop(struct evmpsc_queue *q)
+{
+	struct evmpsc_node *tail = q->tail;
+	struct evmpsc_node *next = EVMPSC_LOAD(&tail->next);
+
+	if (tail == &q->stub) {
+		if (next == NULL)
+			return NULL;
+		q->tail = tail = next;
+		next = EVMPSC_LOAD(&tail->next);
+	}
+	if (next) {
+		q->tail = next;
+		return tail;
+	}
+	if (EVMPSC_LOAD(&q->head) != tail)
+		return NULL;
+	/* 'tail' is the last node: put the stub behind it so that we can
+	 * hand it out without emptying the list. */
+	evmpsc_push(q, &q->stub);
+	next = EVMPSC_LOAD(&tail->next);
+	if (next) {
+		q->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+/** Return true if 'q' has nothing to pop.  Only meaningful in the
+ * consumer. */
+static inline int
+evmpsc_empty(struct evmpsc_queue *q)
+{
+	return q->tail == &q->stub && EVMPSC_LOAD(&q->stub.next) == NULL &&
+	    EVMPSC_LOAD(&q->head) == &q->stub;
+}
+
+/** Like evmpsc_pop(), but if a push is halfway done, give its producer a
+ * chance to finish it and try again.  Returns NULL only if 'q' is
+ * empty. */
+static inline struct evmpsc_node *
+evmpsc_wait(struct evmpsc_queue *q)
+{
+	struct evmpsc_node *n;
+	while ((n = evmpsc_pop(q)) == NULL && !evmpsc_empty(q))
+		EVMPSC_YIELD();
+	return n;
+}
+
+#endif /* __GNUC__ */
+
+#endif /* _MPSC_INTERNAL_H_ */
@@ -53,6 +53,14 @@
 #ifdef _EVENT_HAVE_FCNTL_H
 #include <fcntl.h>
 #endif
+#ifdef _EVENT_HAVE_SYS_SIGNALFD_H
+#include <sys/signalfd.h>
+#endif
+#if defined(_EVENT_HAVE_SYS_SIGNALFD_H) && defined(_EVENT_HAVE_PTHREADS) && \
+    !defined(_EVENT_DISABLE_THREAD_SUPPORT)
+#include <pthread.h>
+#define EVSIGFD_USE_PTHREAD_SIGMASK
+#endif
 
 #include "event2/event.h"
 #include "event2/event_struct.h"
@@ -61,6 +69,7 @@
 #include "evsignal-internal.h"
 #include "log-internal.h"
 #include "evmap-internal.h"
+#include "evthread-internal.h"
 
 static int evsig_add(struct event_base *, int, short, short, void *);
 static int evsig_del(struct event_base *, int, short, short, void *);
@@ -75,6 +84,21 @@ static const struct eventop evsigops = {
 	0, 0, 0
 };
 
+#ifdef _EVENT_HAVE_SYS_SIGNALFD_H
+static int evsigfd_add(struct event_base *, int, short, short, void *);
+static int evsigfd_del(struct event_base *, int, short, short, void *);
+
+static const struct eventop evsigfdops = {
+	"signalfd",
+	NULL,
+	evsigfd_add,
+	evsigfd_del,
+	NULL,
+	NULL,
+	0, 0, 0
+};
+#endif
+
 struct event_base *evsig_base = NULL;
 
 static void evsig_handler(int sig);
@@ -314,6 +338,171 @@ evsig_process(struct event_base *base)
 	}
 }
 
+#ifdef _EVENT_HAVE_SYS_SIGNALFD_H
+/* Callback for when our signalfd is readable: read every signal that is
+ * waiting on it, and activate the events for each signal once. */
+static void
+evsigfd_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct event_base *base = arg;
+	struct signalfd_siginfo info[16];
+	int ncaught[NSIG];
+	ev_ssize_t n;
+	int i;
+
+	memset(ncaught, 0, sizeof(ncaught));
+	do {
+		n = read(fd, info, sizeof(info));
+		for (i = 0; i < n / (ev_ssize_t)sizeof(info[0]); ++i) {
+			if (info[i].ssi_signo < NSIG)
+				++ncaught[info[i].ssi_signo];
+		}
+	} while (n == sizeof(info));
+	if (n == -1 && errno != EAGAIN && errno != EINTR)
+		event_warn("%s: read", __func__);
+
+	EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+	for (i = 1; i < NSIG; ++i) {
+		if (ncaught[i])
+			evmap_signal_active(base, i, ncaught[i]);
+	}
+	EVBASE_RELEASE_LOCK(base, th_base_lock);
+}
+#endif
+
+/* Use a signalfd for the signals of 'base' instead of a signal handler.
+ * Returns -1 if we can't, in which case the caller should use
+ * evsig_init(). */
+int
+evsigfd_init(struct event_base *base)
+{
+#ifdef _EVENT_HAVE_SYS_SIGNALFD_H
+	int fd;
+
+	sigemptyset(&base->sig.sigfd_mask);
+	sigemptyset(&base->sig.sigfd_blocked);
+	fd = signalfd(-1, &base->sig.sigfd_mask, SFD_NONBLOCK|SFD_CLOEXEC);
+	if (fd == -1) {
+		event_debug(("%s: signalfd: %s", __func__, strerror(errno)));
+		return -1;
+	}
+
+	base->sig.sigfd = fd;
+	base->sig.sh_old = NULL;
+	base->sig.sh_old_max = 0;
+	base->sig.evsig_caught = 0;
+	memset(&base->sig.evsigcaught, 0, sizeof(sig_atomic_t)*NSIG);
+
+	event_assign(&base->sig.ev_signal, base, fd, EV_READ | EV_PERSIST,
+	    evsigfd_cb, base);
+
+	base->sig.ev_signal.ev_flags |= EVLIST_INTERNAL;
+
+	base->evsigsel = &evsigfdops;
+	base->evsigbase = &base->sig;
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+#ifdef _EVENT_HAVE_SYS_SIGNALFD_H
+/* Change the calling thread's signal mask.  sigprocmask() is unspecified
+ * in a process with several threads, so use pthread_sigmask() when we
+ * might be in one.  Returns -1 and sets errno on failure. */
+static int
+evsigfd_sigmask(int how, const sigset_t *set, sigset_t *oset)
+{
+#ifdef EVSIGFD_USE_PTHREAD_SIGMASK
+	int r = pthread_sigmask(how, set, oset);
+	if (r != 0) {
+		errno = r;
+		return (-1);
+	}
+	return (0);
+#else
+	return sigprocmask(how, set, oset);
+#endif
+}
+
+static int
+evsigfd_add(struct event_base *base, int evsignal, short old, short events,
+    void *p)
+{
+	struct evsig_info *sig = &base->sig;
+	sigset_t set, oset;
+	(void)p;
+
+	EVUTIL_ASSERT(evsignal >= 0 && evsignal < NSIG);
+
+	event_debug(("%s: %d: adding to signalfd", __func__, evsignal));
+
+	/* Block the signal first, so that one that comes in before the
+	 * signalfd is watching for it stays pending for us to read. */
+	sigemptyset(&set);
+	sigaddset(&set, evsignal);
+	if (evsigfd_sigmask(SIG_BLOCK, &set, &oset) == -1) {
+		event_warn("%s: sigmask", __func__);
+		return (-1);
+	}
+	if (!sigismember(&oset, evsignal))
+		sigaddset(&sig->sigfd_blocked, evsignal);
+
+	sigaddset(&sig->sigfd_mask, evsignal);
+	if (signalfd(sig->sigfd, &sig->sigfd_mask, 0) == -1) {
+		event_warn("signalfd");
+		goto err;
+	}
+
+	if (!sig->ev_signal_added) {
+		if (event_add(&sig->ev_signal, NULL))
+			goto err;
+		sig->ev_signal_added = 1;
+	}
+
+	return (0);
+err:
+	sigdelset(&sig->sigfd_mask, evsignal);
+	if (sigismember(&sig->sigfd_blocked, evsignal)) {
+		sigdelset(&sig->sigfd_blocked, evsignal);
+		evsigfd_sigmask(SIG_UNBLOCK, &set, NULL);
+	}
+	return (-1);
+}
+
+static int
+evsigfd_del(struct event_base *base, int evsignal, short old, short events,
+    void *p)
+{
+	struct evsig_info *sig = &base->sig;
+	sigset_t set;
+	int ret = 0;
+
+	EVUTIL_ASSERT(evsignal >= 0 && evsignal < NSIG);
+
+	event_debug(("%s: %d: removing from signalfd", __func__, evsignal));
+
+	sigdelset(&sig->sigfd_mask, evsignal);
+	if (signalfd(sig->sigfd, &sig->sigfd_mask, 0) == -1) {
+		event_warn("signalfd");
+		ret = -1;
+	}
+
+	if (sigismember(&sig->sigfd_blocked, evsignal)) {
+		sigdelset(&sig->sigfd_blocked, evsignal);
+		sigemptyset(&set);
+		sigaddset(&set, evsignal);
+		if (evsigfd_sigmask(SIG_UNBLOCK, &set, NULL) == -1) {
+			event_warn("%s: sigmask", __func__);
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+#endif
+
 void
 evsig_dealloc(struct event_base *base)
 {
@@ -323,6 +512,17 @@ evsig_dealloc(struct event_base *base)
 		event_debug_unassign(&base->sig.ev_signal);
 		base->sig.ev_signal_added = 0;
 	}
+#ifdef _EVENT_HAVE_SYS_SIGNALFD_H
+	if (base->sig.sigfd != -1) {
+		if (evsigfd_sigmask(SIG_UNBLOCK, &base->sig.sigfd_blocked,
+			NULL) == -1)
+			event_warn("%s: sigmask", __func__);
+		sigemptyset(&base->sig.sigfd_blocked);
+		sigemptyset(&base->sig.sigfd_mask);
+		close(base->sig.sigfd);
+		base->sig.sigfd = -1;
+	}
+#endif
 	for (i = 0; i < NSIG; ++i) {
 		if (i < base->sig.sh_old_max && base->sig.sh_old[i] != NULL)
 			_evsig_restore_handler(base, i);
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/event_struct.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark measures how well one event_base takes activations from
+ * other threads.  A loop thread runs the base, which has num_events
+ * events with no fd; num_threads producer threads each call event_active()
+ * on them num_calls times, round robin.  Activating an event that is
+ * already active just adds to its result, so we report the callbacks run
+ * as well as the activations made, and how often the loop woke up.
+ */
+
+static int num_events = 64, num_calls = 200000;
+static int thread_counts[] = { 1, 2, 4, 8, 16, 0 };
+
+static struct event_base *base;
+static struct event *events;
+static int num_threads;
+static long callbacks;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int running;
+
+static void
+event_cb(evutil_socket_t fd, short what, void *arg)
+{
+	++callbacks;
+}
+
+static void
+started_cb(evutil_socket_t fd, short what, void *arg)
+{
+	pthread_mutex_lock(&lock);
+	running = 1;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+static void *
+loop_thread(void *arg)
+{
+	event_base_dispatch(base);
+	return NULL;
+}
+
+static void *
+producer(void *arg)
+{
+	int i, k = (int)(size_t)arg;
+
+	for (i = 0; i < num_calls; i++) {
+		event_active(&events[k], EV_READ, 1);
+		k = (k + num_threads) % num_events;
+	}
+	return NULL;
+}
+
+static void
+run_once(void)
+{
+	pthread_t loop, *producers;
+	struct event keepalive, started;
+	struct event_dispatch_stats stats;
+	struct timeval tv = { 1000, 0 }, start, end;
+	double usec, calls;
+	int i;
+
+	producers = calloc(num_threads, sizeof(pthread_t));
+	if (producers == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	base = event_base_new();
+	for (i = 0; i < num_events; i++)
+		event_assign(&events[i], base, -1, 0, event_cb, NULL);
+	/* Keep the loop going when nothing else is pending. */
+	evtimer_assign(&keepalive, base, NULL, NULL);
+	evtimer_add(&keepalive, &tv);
+	evutil_timerclear(&tv);
+	evtimer_assign(&started, base, started_cb, NULL);
+	evtimer_add(&started, &tv);
+
+	running = 0;
+	callbacks = 0;
+	pthread_create(&loop, NULL, loop_thread, NULL);
+	pthread_mutex_lock(&lock);
+	while (!running)
+		pthread_cond_wait(&cond, &lock);
+	pthread_mutex_unlock(&lock);
+
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < num_threads; i++)
+		pthread_create(&producers[i], NULL, producer,
+		    (void *)(size_t)(i % num_events));
+	for (i = 0; i < num_threads; i++)
+		pthread_join(producers[i], NULL);
+	evutil_gettimeofday(&end, NULL);
+
+	event_base_loopbreak(base);
+	pthread_join(loop, NULL);
+	/* Run whatever the loop hadn't got to when it stopped. */
+	event_base_loop(base, EVLOOP_NONBLOCK);
+
+	evutil_timersub(&end, &start, &end);
+	usec = end.tv_sec * 1e6 + end.tv_usec;
+	calls = (double)num_threads * num_calls;
+	event_base_get_dispatch_stats(base, &stats);
+	fprintf(stdout, "%3d threads: %10.0f activations/sec  "
+	    "%8.3f usec/activation  callbacks %5.1f%%  wakeups %6.2f%%\n",
+	    num_threads, calls / usec * 1e6, usec / calls,
+	    100.0 * callbacks / calls, 100.0 * stats.n_dispatch / calls);
+
+	for (i = 0; i < num_events; i++)
+		event_del(&events[i]);
+	event_del(&keepalive);
+	event_base_free(base);
+	free(producers);
+}
+
+int
+main(int argc, char **argv)
+{
+	int c, i;
+
+	while ((c = getopt(argc, argv, "e:n:t:")) != -1) {
+		switch (c) {
+		case 'e':
+			num_events = atoi(optarg);
+			break;
+		case 'n':
+			num_calls = atoi(optarg);
+			break;
+		case 't':
+			thread_counts[0] = atoi(optarg);
+			thread_counts[1] = 0;
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (num_events <= 0 || num_calls <= 0) {
+		fprintf(stderr, "Need at least one event and one call\n");
+		exit(1);
+	}
+
+	if (evthread_use_pthreads() < 0) {
+		fprintf(stderr, "Couldn't set up pthreads locking\n");
+		exit(1);
+	}
+	events = calloc(num_events, sizeof(struct event));
+	if (events == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	fprintf(stdout, "%d events, %d activations per thread\n",
+	    num_events, num_calls);
+	for (i = 0; thread_counts[i]; i++) {
+		num_threads = thread_counts[i];
+		run_once();
+	}
+
+	exit(0);
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark measures what busy polling buys in latency and costs in
+ * CPU time.  A child process sends one byte at a time over a socketpair,
+ * waiting a fixed gap between sends, and times how long the echo takes
+ * to come back.  The parent echoes the bytes from its event loop, which
+ * spins for a different time in each run before it blocks.  We report
+ * the child's round trip times and the CPU the parent used, as a share
+ * of the time the run took.
+ *
+ * Busy polling only makes sense when the loop has a CPU to itself; on a
+ * machine with fewer than two CPUs, the spinning parent competes with the
+ * child and the numbers show that instead.
+ */
+
+static const long spins[] = { 0, 20, 100, 1000, -1 };
+
+struct result {
+	double mean;
+	long p50, p99;
+};
+
+static int num_rounds = 20000;
+static long gap_usec = 200;
+
+static long
+now_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int
+compare_long(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* The child: send, wait for the echo, note the time it took, sleep. */
+static void
+client(evutil_socket_t fd, int result_fd)
+{
+	struct timespec gap;
+	struct result res;
+	long *rtt, start;
+	double total = 0;
+	char c = 'x';
+	int i;
+
+	rtt = calloc(num_rounds, sizeof(long));
+	if (rtt == NULL)
+		exit(1);
+	gap.tv_sec = gap_usec / 1000000;
+	gap.tv_nsec = (gap_usec % 1000000) * 1000;
+
+	for (i = 0; i < num_rounds; i++) {
+		start = now_nsec();
+		if (send(fd, &c, 1, 0) != 1 || recv(fd, &c, 1, 0) != 1)
+			exit(1);
+		rtt[i] = now_nsec() - start;
+		total += rtt[i];
+		nanosleep(&gap, NULL);
+	}
+	qsort(rtt, num_rounds, sizeof(long), compare_long);
+	res.mean = total / num_rounds;
+	res.p50 = rtt[num_rounds / 2];
+	res.p99 = rtt[num_rounds * 99 / 100];
+	if (write(result_fd, &res, sizeof(res)) != sizeof(res))
+		exit(1);
+	exit(0);
+}
+
+static void
+echo_cb(evutil_socket_t fd, short what, void *arg)
+{
+	char buf[64];
+	int n;
+
+	n = recv(fd, buf, sizeof(buf), 0);
+	if (n <= 0) {
+		event_base_loopbreak(arg);
+		return;
+	}
+	send(fd, buf, n, 0);
+}
+
+static double
+cpu_usec(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec * 1e6 + ru.ru_utime.tv_usec +
+	    ru.ru_stime.tv_sec * 1e6 + ru.ru_stime.tv_usec;
+}
+
+static void
+run_once(long spin_usec)
+{
+	struct event_config *cfg;
+	struct event_base *base;
+	struct event *ev;
+	struct event_dispatch_stats st;
+	struct timeval spin;
+	struct result res;
+	evutil_socket_t pair[2];
+	int result_pipe[2];
+	long start, wall;
+	double cpu;
+	pid_t pid;
+
+	if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1 ||
+	    pipe(result_pipe) == -1) {
+		perror("socketpair");
+		exit(1);
+	}
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == -1) {
+		perror("fork");
+		exit(1);
+	} else if (pid == 0) {
+		evutil_closesocket(pair[0]);
+		close(result_pipe[0]);
+		client(pair[1], result_pipe[1]);
+	}
+	evutil_closesocket(pair[1]);
+	close(result_pipe[1]);
+
+	cfg = event_config_new();
+	spin.tv_sec = spin_usec / 1000000;
+	spin.tv_usec = spin_usec % 1000000;
+	event_config_set_busy_poll(cfg, &spin, 0);
+	base = event_base_new_with_config(cfg);
+	event_config_free(cfg);
+	if (base == NULL) {
+		fprintf(stderr, "couldn't make a base\n");
+		exit(1);
+	}
+	evutil_make_socket_nonblocking(pair[0]);
+	ev = event_new(base, pair[0], EV_READ|EV_PERSIST, echo_cb, base);
+	event_add(ev, NULL);
+
+	start = now_nsec();
+	cpu = cpu_usec();
+	event_base_dispatch(base);
+	cpu = cpu_usec() - cpu;
+	wall = (now_nsec() - start) / 1000;
+
+	if (read(result_pipe[0], &res, sizeof(res)) != sizeof(res)) {
+		fprintf(stderr, "client failed\n");
+		exit(1);
+	}
+	waitpid(pid, NULL, 0);
+	event_base_get_dispatch_stats(base, &st);
+
+	fprintf(stdout, "%-8s spin %5ld us: rtt mean %7.1f us  p50 %6.1f us  "
+	    "p99 %7.1f us  loop cpu %5.1f%%  spins that hit %5.1f%%\n",
+	    event_base_get_method(base), spin_usec, res.mean / 1000,
+	    res.p50 / 1000.0, res.p99 / 1000.0,
+	    100.0 * cpu / wall, st.n_dispatch ?
+	    100.0 * st.n_busy_poll_hits / st.n_dispatch : 0.0);
+
+	event_free(ev);
+	event_base_free(base);
+	evutil_closesocket(pair[0]);
+	close(result_pipe[0]);
+}
+
+int
+main(int argc, char **argv)
+{
+	int i, c;
+
+	while ((c = getopt(argc, argv, "n:g:")) != -1) {
+		switch (c) {
+		case 'n':
+			num_rounds = atoi(optarg);
+			break;
+		case 'g':
+			gap_usec = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (num_rounds <= 0 || gap_usec < 0) {
+		fprintf(stderr, "Need at least one round, and a gap that "
+		    "isn't negative\n");
+		exit(1);
+	}
+
+	fprintf(stdout, "%d round trips, %ld us apart, on %ld CPUs\n",
+	    num_rounds, gap_usec, sysconf(_SC_NPROCESSORS_ONLN));
+	for (i = 0; spins[i] >= 0; i++)
+		run_once(spins[i]);
+
+	exit(0);
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/event_struct.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark measures what the backend does to keep up with a lot of
+ * fds whose interest changes all the time, as in a busy server that
+ * enables and disables writing on its connections.  We watch num_fds pipes
+ * for reading, each of which also has a write event that never fires.
+ * Each iteration, num_active of the pipes get a byte to read, and the write
+ * event of num_churn of them is deleted and added again.
+ *
+ * We report the syscalls made to apply changes (epoll_ctl, or
+ * io_uring_enter), skipped changes, and how often the ready array was
+ * full, per iteration, from event_base_get_dispatch_stats().
+ */
+
+struct mode {
+	const char *method;
+	const char *name;
+	int flags;
+	int max_events;
+};
+
+static const struct mode modes[] = {
+	{ "epoll", "default", 0, 0 },
+	{ "epoll", "skip", EVENT_BASE_FLAG_EPOLL_SKIP_REDUNDANT, 0 },
+	{ "epoll", "skip", EVENT_BASE_FLAG_EPOLL_SKIP_REDUNDANT, 65536 },
+	{ "io_uring", "default", 0, 0 },
+	{ NULL, NULL, 0, 0 }
+};
+
+static int num_fds = 100000, num_active = 5000, num_churn = 10000;
+static int num_iters = 200;
+
+static evutil_socket_t *pipes;
+static struct event *readers, *writers;
+
+static ev_uint32_t rand_state;
+
+static ev_uint32_t
+next_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+static void
+read_cb(evutil_socket_t fd, short what, void *arg)
+{
+	char buf[16];
+
+	if (read(fd, buf, sizeof(buf)) < 0)
+		perror("read");
+}
+
+static void
+write_cb(evutil_socket_t fd, short what, void *arg)
+{
+	/* The read end of a pipe is never writable. */
+	fprintf(stderr, "unexpected write event on %d\n", (int)fd);
+	exit(1);
+}
+
+static void
+run_once(const struct mode *mode)
+{
+	struct event_config *cfg;
+	struct event_base *base;
+	struct event_dispatch_stats before, after;
+	struct timeval start, end;
+	const char **methods;
+	double iters = num_iters;
+	int i, j;
+
+	cfg = event_config_new();
+	for (methods = event_get_supported_methods(); *methods; ++methods)
+		if (strcmp(*methods, mode->method))
+			event_config_avoid_method(cfg, *methods);
+	event_config_set_flag(cfg, mode->flags);
+	if (mode->max_events)
+		event_config_set_max_dispatch_events(cfg, mode->max_events);
+	base = event_base_new_with_config(cfg);
+	event_config_free(cfg);
+	if (base == NULL) {
+		fprintf(stderr, "%s isn't available here\n", mode->method);
+		return;
+	}
+
+	for (i = 0; i < num_fds; i++) {
+		event_assign(&readers[i], base, pipes[2*i], EV_READ|EV_PERSIST,
+		    read_cb, NULL);
+		event_assign(&writers[i], base, pipes[2*i], EV_WRITE,
+		    write_cb, NULL);
+		event_add(&readers[i], NULL);
+		event_add(&writers[i], NULL);
+	}
+	event_base_loop(base, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+
+	rand_state = 2463534242U;
+	event_base_get_dispatch_stats(base, &before);
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < num_iters; i++) {
+		for (j = 0; j < num_active; j++) {
+			if (write(pipes[2*(next_rand() % num_fds)+1], "x", 1)
+			    != 1)
+				perror("write");
+		}
+		for (j = 0; j < num_churn; j++) {
+			struct event *ev = &writers[next_rand() % num_fds];
+			event_del(ev);
+			event_add(ev, NULL);
+		}
+		event_base_loop(base, EVLOOP_ONCE);
+	}
+	evutil_gettimeofday(&end, NULL);
+	event_base_get_dispatch_stats(base, &after);
+	evutil_timersub(&end, &start, &end);
+
+	fprintf(stdout, "%-8s %-7s max %6d: syscalls/iter %8.1f  "
+	    "skipped/iter %8.1f  full %5.1f%%  %8.1f usec/iter\n",
+	    mode->method, mode->name, after.max_nevents,
+	    (after.n_change_syscalls - before.n_change_syscalls) / iters,
+	    (after.n_changes_skipped - before.n_changes_skipped) / iters,
+	    100.0 * (after.n_full - before.n_full) /
+		(after.n_dispatch - before.n_dispatch),
+	    (end.tv_sec * 1e6 + end.tv_usec) / iters);
+
+	/* Drain anything left over so the next mode starts clean. */
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	for (i = 0; i < num_fds; i++) {
+		event_del(&readers[i]);
+		event_del(&writers[i]);
+	}
+	event_base_free(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct mode *mode;
+	struct rlimit rl;
+	int i, c;
+
+	while ((c = getopt(argc, argv, "n:a:c:i:")) != -1) {
+		switch (c) {
+		case 'n':
+			num_fds = atoi(optarg);
+			break;
+		case 'a':
+			num_active = atoi(optarg);
+			break;
+		case 'c':
+			num_churn = atoi(optarg);
+			break;
+		case 'i':
+			num_iters = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (num_fds <= 0 || num_iters <= 0) {
+		fprintf(stderr, "Need at least one fd and one iteration\n");
+		exit(1);
+	}
+
+	/* Two fds per pipe, plus a few for the base. */
+	rl.rlim_cur = rl.rlim_max = 2 * num_fds + 50;
+	if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+		/* Make do with what we're allowed. */
+		if (getrlimit(RLIMIT_NOFILE, &rl) == -1) {
+			perror("getrlimit");
+			exit(1);
+		}
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+		if (rl.rlim_cur < 2 * (rlim_t)num_fds + 50) {
+			num_fds = ((int)rl.rlim_cur - 50) / 2;
+			fprintf(stderr, "warning: fd limit; using %d pipes\n",
+			    num_fds);
+			if (num_fds <= 0)
+				exit(1);
+		}
+	}
+
+	pipes = calloc(2 * num_fds, sizeof(evutil_socket_t));
+	readers = calloc(num_fds, sizeof(struct event));
+	writers = calloc(num_fds, sizeof(struct event));
+	if (pipes == NULL || readers == NULL || writers == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < num_fds; i++) {
+		if (pipe(&pipes[2*i]) == -1) {
+			perror("pipe");
+			exit(1);
+		}
+		evutil_make_socket_nonblocking(pipes[2*i]);
+		evutil_make_socket_nonblocking(pipes[2*i+1]);
+	}
+
+	fprintf(stdout, "%d fds, %d active and %d churned per iteration\n",
+	    num_fds, num_active, num_churn);
+	for (mode = modes; mode->name; mode++)
+		run_once(mode);
+
+	exit(0);
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/event_struct.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark measures what reading the time costs with each clock
+ * source: first a bare read of the base's clock (what the loop does when
+ * the time isn't cached), and then whole loop iterations, each of which
+ * reads the clock a few times.  Each iteration runs one zero-length
+ * timeout, which adds itself again, with an idle timeout pending as well,
+ * as a busy server would have.
+ */
+
+struct source {
+	const char *name;
+	enum event_clock_source source;
+};
+
+static const struct source sources[] = {
+	{ "default", EVENT_CLOCK_DEFAULT },
+	{ "coarse", EVENT_CLOCK_MONOTONIC_COARSE },
+	{ "tsc", EVENT_CLOCK_TSC },
+	{ NULL, EVENT_CLOCK_DEFAULT }
+};
+
+static int num_iterations;
+static int count;
+
+static double
+elapsed_nsec(const struct timeval *start, int ops)
+{
+	struct timeval end;
+
+	evutil_gettimeofday(&end, NULL);
+	evutil_timersub(&end, start, &end);
+	return (end.tv_sec * 1e9 + end.tv_usec * 1e3) / ops;
+}
+
+static void
+again_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct timeval zero = { 0, 0 };
+	struct event *ev = arg;
+
+	if (++count < num_iterations)
+		evtimer_add(ev, &zero);
+}
+
+static void
+run_once(const struct source *src, int num_reads)
+{
+	struct event_config *cfg;
+	struct event_base *base;
+	struct event ev, idle;
+	struct timeval tv, start, zero = { 0, 0 }, minute = { 60, 0 };
+	double read, iteration;
+	int i;
+
+	cfg = event_config_new();
+	event_config_set_clock(cfg, src->source);
+	base = event_base_new_with_config(cfg);
+	event_config_free(cfg);
+	if (base == NULL) {
+		fprintf(stderr, "%s: couldn't make a base\n", src->name);
+		exit(1);
+	}
+	if (event_base_get_clock(base) != src->source) {
+		fprintf(stdout, "%-8s not available\n", src->name);
+		event_base_free(base);
+		return;
+	}
+
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < num_reads; i++)
+		event_base_gettimeofday_cached(base, &tv);
+	read = elapsed_nsec(&start, num_reads);
+
+	evtimer_assign(&ev, base, again_cb, &ev);
+	evtimer_assign(&idle, base, again_cb, NULL);
+	evtimer_add(&idle, &minute);
+	count = 0;
+	evutil_gettimeofday(&start, NULL);
+	evtimer_add(&ev, &zero);
+	while (count < num_iterations)
+		event_base_loop(base, EVLOOP_ONCE);
+	iteration = elapsed_nsec(&start, num_iterations);
+	event_del(&idle);
+
+	fprintf(stdout, "%-8s read %6.1f ns  loop iteration %6.1f ns\n",
+	    src->name, read, iteration);
+
+	event_base_free(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct source *src;
+	int num_reads = 1000000, c;
+
+	num_iterations = 1000000;
+	while ((c = getopt(argc, argv, "n:i:")) != -1) {
+		switch (c) {
+		case 'n':
+			num_reads = atoi(optarg);
+			break;
+		case 'i':
+			num_iterations = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (num_reads <= 0 || num_iterations <= 0) {
+		fprintf(stderr, "Need at least one read and one iteration\n");
+		exit(1);
+	}
+
+	for (src = sources; src->name; src++)
+		run_once(src, num_reads);
+
+	exit(0);
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/event_struct.h>
+#include <event2/bufferevent.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark measures what an idle connection costs in memory: we
+ * set up num_conns of them, each as an accepting server would, and count
+ * the calls to the allocator and the bytes that stay allocated.  An idle
+ * connection is either a persistent read event from event_new(), or a
+ * bufferevent reading from the socket.  All the connections are dups of
+ * one socket, since no data ever arrives on them.
+ */
+
+static long n_allocs;
+static long n_live_bytes;
+
+/* Every block starts with its size, so that we can count live bytes. */
+union mem_header {
+	size_t size;
+	double align;
+};
+
+static void *
+count_malloc(size_t sz)
+{
+	union mem_header *h = malloc(sizeof(union mem_header) + sz);
+	if (!h)
+		return NULL;
+	h->size = sz;
+	++n_allocs;
+	n_live_bytes += sz;
+	return h + 1;
+}
+
+static void *
+count_realloc(void *p, size_t sz)
+{
+	union mem_header *h = p ? ((union mem_header *)p) - 1 : NULL;
+	size_t old = h ? h->size : 0;
+
+	h = realloc(h, sizeof(union mem_header) + sz);
+	if (!h)
+		return NULL;
+	h->size = sz;
+	++n_allocs;
+	n_live_bytes += sz - old;
+	return h + 1;
+}
+
+static void
+count_free(void *p)
+{
+	union mem_header *h;
+
+	if (!p)
+		return;
+	h = ((union mem_header *)p) - 1;
+	n_live_bytes -= h->size;
+	free(h);
+}
+
+static void
+read_cb(evutil_socket_t fd, short what, void *arg)
+{
+}
+
+static void
+run_once(const char *mode, int num_conns, int fd)
+{
+	struct event_base *base;
+	struct event **events = NULL;
+	struct bufferevent **bevs = NULL;
+	long allocs0, bytes0;
+	int use_bev = !strcmp(mode, "bufferevent");
+	int i;
+
+	base = event_base_new();
+	if (use_bev)
+		bevs = calloc(num_conns, sizeof(struct bufferevent *));
+	else
+		events = calloc(num_conns, sizeof(struct event *));
+	if (base == NULL || (bevs == NULL && events == NULL)) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	allocs0 = n_allocs;
+	bytes0 = n_live_bytes;
+	for (i = 0; i < num_conns; i++) {
+		evutil_socket_t s = dup(fd);
+		if (s < 0) {
+			perror("dup");
+			exit(1);
+		}
+		evutil_make_socket_nonblocking(s);
+		if (use_bev) {
+			bevs[i] = bufferevent_socket_new(base, s,
+			    BEV_OPT_CLOSE_ON_FREE);
+			bufferevent_enable(bevs[i], EV_READ);
+		} else {
+			events[i] = event_new(base, s, EV_READ|EV_PERSIST,
+			    read_cb, NULL);
+			event_add(events[i], NULL);
+		}
+	}
+	event_base_loop(base, EVLOOP_NONBLOCK);
+
+	fprintf(stdout, "%-11s %7d conns: %7.1f bytes/conn  "
+	    "%5.2f allocs/conn\n", mode, num_conns,
+	    (double)(n_live_bytes - bytes0) / num_conns,
+	    (double)(n_allocs - allocs0) / num_conns);
+
+	for (i = 0; i < num_conns; i++) {
+		if (use_bev) {
+			bufferevent_free(bevs[i]);
+		} else {
+			evutil_socket_t s = event_get_fd(events[i]);
+			event_free(events[i]);
+			EVUTIL_CLOSESOCKET(s);
+		}
+	}
+	event_base_free(base);
+	free(bevs);
+	free(events);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct rlimit rl;
+	const char *only = NULL;
+	int num_conns = 10000, c;
+	evutil_socket_t pair[2];
+
+	event_set_mem_functions(count_malloc, count_realloc, count_free);
+
+	while ((c = getopt(argc, argv, "n:m:")) != -1) {
+		switch (c) {
+		case 'n':
+			num_conns = atoi(optarg);
+			break;
+		case 'm':
+			only = optarg;
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+
+	/* Leave room for the base's own fds. */
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+		getrlimit(RLIMIT_NOFILE, &rl);
+		if (rl.rlim_cur != RLIM_INFINITY &&
+		    (rlim_t)num_conns + 64 > rl.rlim_cur)
+			num_conns = (int)rl.rlim_cur - 64;
+	}
+	if (num_conns <= 0) {
+		fprintf(stderr, "Need at least one connection\n");
+		exit(1);
+	}
+	if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+		perror("socketpair");
+		exit(1);
+	}
+
+	if (!only || !strcmp(only, "event"))
+		run_once("event", num_conns, pair[0]);
+	if (!only || !strcmp(only, "bufferevent"))
+		run_once("bufferevent", num_conns, pair[0]);
+
+	exit(0);
+}
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark compares bufferevents that wait for readiness and then
+ * call recv() and send(), level- or edge-triggered, with the ones that
+ * hand their reads and writes to io_uring.  Each of num_conns socketpairs
+ * has a client bufferevent at one end and an echo server bufferevent at
+ * the other.  Every client sends a msg_size message, waits for all of it
+ * to come back, and sends the next, num_rounds times, with all the clients
+ * going at once.
+ *
+ * We report round trips per second and how many times the loop called
+ * into the backend per round, from event_base_get_dispatch_stats().
+ *
+ * With -b, each client instead streams bulk_size bytes to its server,
+ * whose read high-water mark is 64k, and we report megabytes per second
+ * and how many read callbacks the servers got per megabyte.
+ */
+
+struct mode {
+	const char *method;
+	const char *name;
+	int flags;
+	int bev_options;
+};
+
+static const struct mode modes[] = {
+	{ "epoll", "sock", 0, 0 },
+	{ "epoll", "et", 0, BEV_OPT_EDGE_TRIGGERED },
+	{ "io_uring", "sock", 0, 0 },
+	{ "io_uring", "et", 0, BEV_OPT_EDGE_TRIGGERED },
+	{ "io_uring", "uring", EVENT_BASE_FLAG_URING_BUFFEREVENTS, 0 },
+	{ NULL, NULL, 0, 0 }
+};
+
+static int num_conns = 1000, msg_size = 512, num_rounds = 200;
+static int bulk_size = 0;
+
+struct conn {
+	struct bufferevent *client, *server;
+	size_t received;
+	int rounds_left;
+};
+
+static struct conn *conns;
+static char *message;
+static struct event_base *base;
+static int n_running, n_readcbs;
+
+static void
+echo_read_cb(struct bufferevent *bev, void *arg)
+{
+	bufferevent_write_buffer(bev, bufferevent_get_input(bev));
+}
+
+static void
+client_read_cb(struct bufferevent *bev, void *arg)
+{
+	struct conn *c = arg;
+	struct evbuffer *input = bufferevent_get_input(bev);
+
+	c->received += evbuffer_get_length(input);
+	evbuffer_drain(input, evbuffer_get_length(input));
+	if (c->received < (size_t)msg_size)
+		return;
+	c->received -= msg_size;
+	if (--c->rounds_left > 0) {
+		bufferevent_write(bev, message, msg_size);
+	} else if (--n_running == 0) {
+		event_base_loopbreak(base);
+	}
+}
+
+/* Keep a bulk client's output buffer topped up. */
+static void
+bulk_write_cb(struct bufferevent *bev, void *arg)
+{
+	struct conn *c = arg;
+	int i;
+
+	for (i = 0; i < 16 && c->rounds_left > 0; i++, c->rounds_left--)
+		bufferevent_write(bev, message, msg_size);
+}
+
+static void
+sink_read_cb(struct bufferevent *bev, void *arg)
+{
+	struct conn *c = arg;
+	struct evbuffer *input = bufferevent_get_input(bev);
+
+	size_t n = evbuffer_get_length(input);
+
+	++n_readcbs;
+	evbuffer_drain(input, n);
+	if (c->received < (size_t)bulk_size &&
+	    c->received + n >= (size_t)bulk_size && --n_running == 0)
+		event_base_loopbreak(base);
+	c->received += n;
+}
+
+static void
+error_cb(struct bufferevent *bev, short what, void *arg)
+{
+	fprintf(stderr, "unexpected event %x on connection %d\n", what,
+	    (int)((struct conn *)arg - conns));
+	exit(1);
+}
+
+static void
+run_once(const struct mode *mode)
+{
+	struct event_config *cfg;
+	struct event_dispatch_stats before, after;
+	struct timeval start, end;
+	const char **methods;
+	double usec, round_trips;
+	evutil_socket_t pair[2];
+	int i;
+
+	cfg = event_config_new();
+	for (methods = event_get_supported_methods(); *methods; ++methods)
+		if (strcmp(*methods, mode->method))
+			event_config_avoid_method(cfg, *methods);
+	event_config_set_flag(cfg, mode->flags);
+	base = event_base_new_with_config(cfg);
+	event_config_free(cfg);
+	if (base == NULL) {
+		fprintf(stderr, "%s isn't available here\n", mode->method);
+		return;
+	}
+
+	for (i = 0; i < num_conns; i++) {
+		struct conn *c = &conns[i];
+		if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+			perror("socketpair");
+			exit(1);
+		}
+		evutil_make_socket_nonblocking(pair[0]);
+		evutil_make_socket_nonblocking(pair[1]);
+		c->client = bufferevent_socket_new(base, pair[0],
+		    BEV_OPT_CLOSE_ON_FREE|mode->bev_options);
+		c->server = bufferevent_socket_new(base, pair[1],
+		    BEV_OPT_CLOSE_ON_FREE|mode->bev_options);
+		if (!c->client || !c->server) {
+			fprintf(stderr, "couldn't make bufferevents\n");
+			exit(1);
+		}
+		c->received = 0;
+		if (bulk_size) {
+			bufferevent_setcb(c->client, NULL, bulk_write_cb,
+			    error_cb, c);
+			bufferevent_setcb(c->server, sink_read_cb, NULL,
+			    error_cb, c);
+			bufferevent_setwatermark(c->server, EV_READ, 0, 65536);
+			c->rounds_left = (bulk_size + msg_size - 1) / msg_size;
+		} else {
+			bufferevent_setcb(c->client, client_read_cb, NULL,
+			    error_cb, c);
+			bufferevent_setcb(c->server, echo_read_cb, NULL,
+			    error_cb, c);
+			c->rounds_left = num_rounds;
+		}
+		bufferevent_enable(c->client, EV_READ|EV_WRITE);
+		bufferevent_enable(c->server, EV_READ|EV_WRITE);
+	}
+	n_running = num_conns;
+	n_readcbs = 0;
+
+	event_base_get_dispatch_stats(base, &before);
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < num_conns; i++) {
+		if (bulk_size)
+			bulk_write_cb(conns[i].client, &conns[i]);
+		else
+			bufferevent_write(conns[i].client, message, msg_size);
+	}
+	event_base_dispatch(base);
+	evutil_gettimeofday(&end, NULL);
+	event_base_get_dispatch_stats(base, &after);
+	evutil_timersub(&end, &start, &end);
+
+	usec = end.tv_sec * 1e6 + end.tv_usec;
+	if (bulk_size) {
+		double mbytes = (double)num_conns * bulk_size / 1048576;
+		fprintf(stdout, "%-8s %-5s: %10.1f MB/sec  "
+		    "%8.1f read callbacks/MB  %8.1f dispatches/MB\n",
+		    mode->method, mode->name, mbytes / usec * 1e6,
+		    n_readcbs / mbytes,
+		    (after.n_dispatch - before.n_dispatch) / mbytes);
+	} else {
+		round_trips = (double)num_conns * num_rounds;
+		fprintf(stdout, "%-8s %-5s: %10.0f round trips/sec  "
+		    "%6.3f dispatches/round  %8.1f usec/round\n",
+		    mode->method, mode->name, round_trips / usec * 1e6,
+		    (after.n_dispatch - before.n_dispatch) /
+		    (double)num_rounds, usec / num_rounds);
+	}
+
+	for (i = 0; i < num_conns; i++) {
+		bufferevent_free(conns[i].client);
+		bufferevent_free(conns[i].server);
+	}
+	/* Let any reads that were still queued come back canceled. */
+	event_base_dispatch(base);
+	event_base_free(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct mode *mode;
+	struct rlimit rl;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:r:b:")) != -1) {
+		switch (c) {
+		case 'b':
+			bulk_size = atoi(optarg);
+			break;
+		case 'n':
+			num_conns = atoi(optarg);
+			break;
+		case 's':
+			msg_size = atoi(optarg);
+			break;
+		case 'r':
+			num_rounds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (num_conns <= 0 || msg_size <= 0 || num_rounds <= 0 ||
+	    bulk_size < 0) {
+		fprintf(stderr, "Need at least one connection, byte and "
+		    "round\n");
+		exit(1);
+	}
+
+	/* Two fds per connection, plus a few for the base. */
+	rl.rlim_cur = rl.rlim_max = 2 * num_conns + 50;
+	if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+		/* Make do with what we're allowed. */
+		if (getrlimit(RLIMIT_NOFILE, &rl) == -1) {
+			perror("getrlimit");
+			exit(1);
+		}
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+		if (rl.rlim_cur < 2 * (rlim_t)num_conns + 50) {
+			num_conns = ((int)rl.rlim_cur - 50) / 2;
+			fprintf(stderr, "warning: fd limit; using %d "
+			    "connections\n", num_conns);
+			if (num_conns <= 0)
+				exit(1);
+		}
+	}
+
+	conns = calloc(num_conns, sizeof(struct conn));
+	message = malloc(msg_size);
+	if (conns == NULL || message == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	memset(message, 'x', msg_size);
+
+	if (bulk_size)
+		fprintf(stdout, "%d connections, %d bytes each in %d byte "
+		    "writes\n", num_conns, bulk_size, msg_size);
+	else
+		fprintf(stdout, "%d connections, %d byte messages, %d "
+		    "rounds\n", num_conns, msg_size, num_rounds);
+	for (mode = modes; mode->name; mode++)
+		run_once(mode);
+
+	exit(0);
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/event_struct.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark measures event_add and event_del on one event_base from
+ * several threads at once, while another thread runs the base's loop.
+ * Each of num_threads threads owns num_fds read events, on fds of its
+ * own, and adds and then deletes all of them, num_rounds times over.  The
+ * fds are dups of one socket that never becomes readable, so the loop
+ * only wakes up to apply the changes.  With -r, the first num_ready fds of
+ * each thread are dups of one that stays readable instead, so the loop
+ * is also busy finding the events on ready fds the whole time.
+ */
+
+static int num_fds = 256, num_rounds = 2000, num_ready = 0;
+static int thread_counts[] = { 1, 2, 4, 8, 0 };
+
+static struct event_base *base;
+static int num_threads;
+static evutil_socket_t sock, ready_sock;
+static unsigned long num_called;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int running;
+
+static void
+read_cb(evutil_socket_t fd, short what, void *arg)
+{
+	++num_called;
+}
+
+static void
+started_cb(evutil_socket_t fd, short what, void *arg)
+{
+	pthread_mutex_lock(&lock);
+	running = 1;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+static void *
+loop_thread(void *arg)
+{
+	event_base_dispatch(base);
+	return NULL;
+}
+
+static void *
+churner(void *arg)
+{
+	struct event *events = arg;
+	int i, r;
+
+	for (r = 0; r < num_rounds; r++) {
+		for (i = 0; i < num_fds; i++)
+			event_add(&events[i], NULL);
+		for (i = 0; i < num_fds; i++)
+			event_del(&events[i]);
+	}
+	return NULL;
+}
+
+static void
+run_once(void)
+{
+	pthread_t loop, *churners;
+	struct event *events;
+	struct event keepalive, started;
+	struct event_dispatch_stats stats;
+	struct timeval tv = { 1000, 0 }, start, end;
+	double usec, ops;
+	int i;
+
+	churners = calloc(num_threads, sizeof(pthread_t));
+	events = calloc(num_threads * num_fds, sizeof(struct event));
+	if (churners == NULL || events == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	base = event_base_new();
+	for (i = 0; i < num_threads * num_fds; i++) {
+		evutil_socket_t fd =
+		    dup(i % num_fds < num_ready ? ready_sock : sock);
+		if (fd < 0) {
+			perror("dup");
+			exit(1);
+		}
+		event_assign(&events[i], base, fd, EV_READ|EV_PERSIST,
+		    read_cb, NULL);
+	}
+	/* Keep the loop going when nothing else is pending. */
+	evtimer_assign(&keepalive, base, NULL, NULL);
+	evtimer_add(&keepalive, &tv);
+	evutil_timerclear(&tv);
+	evtimer_assign(&started, base, started_cb, NULL);
+	evtimer_add(&started, &tv);
+
+	running = 0;
+	num_called = 0;
+	pthread_create(&loop, NULL, loop_thread, NULL);
+	pthread_mutex_lock(&lock);
+	while (!running)
+		pthread_cond_wait(&cond, &lock);
+	pthread_mutex_unlock(&lock);
+
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < num_threads; i++)
+		pthread_create(&churners[i], NULL, churner,
+		    &events[i * num_fds]);
+	for (i = 0; i < num_threads; i++)
+		pthread_join(churners[i], NULL);
+	evutil_gettimeofday(&end, NULL);
+
+	event_base_loopbreak(base);
+	pthread_join(loop, NULL);
+
+	evutil_timersub(&end, &start, &end);
+	usec = end.tv_sec * 1e6 + end.tv_usec;
+	ops = 2.0 * num_threads * num_fds * num_rounds;
+	event_base_get_dispatch_stats(base, &stats);
+	fprintf(stdout, "%3d threads: %10.0f add+del/sec  %8.3f usec/op  "
+	    "loop wakeups %8lu  callbacks %9lu\n", num_threads,
+	    ops / usec * 1e6, usec / ops, (unsigned long)stats.n_dispatch,
+	    num_called);
+
+	for (i = 0; i < num_threads * num_fds; i++)
+		EVUTIL_CLOSESOCKET(event_get_fd(&events[i]));
+	event_del(&keepalive);
+	event_base_free(base);
+	free(events);
+	free(churners);
+}
+
+int
+main(int argc, char **argv)
+{
+	evutil_socket_t pair[2];
+	struct rlimit rl;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "f:n:r:t:")) != -1) {
+		switch (c) {
+		case 'f':
+			num_fds = atoi(optarg);
+			break;
+		case 'n':
+			num_rounds = atoi(optarg);
+			break;
+		case 'r':
+			num_ready = atoi(optarg);
+			break;
+		case 't':
+			thread_counts[0] = atoi(optarg);
+			thread_counts[1] = 0;
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (num_fds <= 0 || num_rounds <= 0) {
+		fprintf(stderr, "Need at least one fd and one round\n");
+		exit(1);
+	}
+	if (num_ready < 0 || num_ready > num_fds) {
+		fprintf(stderr, "Need between 0 and %d ready fds\n", num_fds);
+		exit(1);
+	}
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	if (evthread_use_pthreads() < 0) {
+		fprintf(stderr, "Couldn't set up pthreads locking\n");
+		exit(1);
+	}
+	if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+		perror("socketpair");
+		exit(1);
+	}
+	sock = pair[0];
+	if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+		perror("socketpair");
+		exit(1);
+	}
+	/* Nobody reads this, so pair[0] stays readable. */
+	if (send(pair[1], "x", 1, 0) != 1) {
+		perror("send");
+		exit(1);
+	}
+	ready_sock = pair[0];
+
+	fprintf(stdout, "%d fds per thread, %d of them ready, %d rounds\n",
+	    num_fds, num_ready, num_rounds);
+	for (i = 0; thread_counts[i]; i++) {
+		num_threads = thread_counts[i];
+		run_once();
+	}
+
+	exit(0);
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/event_struct.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark measures how late short timeouts fire.  A timer adds
+ * itself again with the same timeout every time it runs, and we note how
+ * long after its deadline each run starts.  We do this with each backend
+ * and, for epoll, with and without EVENT_BASE_FLAG_PRECISE_TIMER.
+ */
+
+struct mode {
+	const char *name;
+	const char *method;
+	int flags;
+};
+
+static const struct mode modes[] = {
+	{ "epoll", "epoll", 0 },
+	{ "epoll/timerfd", "epoll", EVENT_BASE_FLAG_PRECISE_TIMER },
+	{ "io_uring", "io_uring", 0 },
+	{ NULL, NULL, 0 }
+};
+
+static struct timeval interval;
+static struct timeval deadline;
+static long *lateness;
+static int num_timeouts;
+static int count;
+
+static void
+timeout_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct event *ev = arg;
+	struct timeval now, late;
+
+	evutil_gettimeofday(&now, NULL);
+	evutil_timersub(&now, &deadline, &late);
+	lateness[count] = late.tv_sec * 1000000 + late.tv_usec;
+
+	if (++count < num_timeouts) {
+		evutil_timeradd(&now, &interval, &deadline);
+		evtimer_add(ev, &interval);
+	}
+}
+
+static int
+compare_long(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void
+run_once(const struct mode *mode)
+{
+	struct event_config *cfg;
+	struct event_base *base;
+	struct event ev;
+	struct timeval start, end;
+	double total = 0, elapsed;
+	int i;
+
+	cfg = event_config_new();
+	for (i = 0; modes[i].name; i++) {
+		if (strcmp(modes[i].method, mode->method))
+			event_config_avoid_method(cfg, modes[i].method);
+	}
+	event_config_set_flag(cfg, mode->flags);
+	base = event_base_new_with_config(cfg);
+	event_config_free(cfg);
+	if (base == NULL ||
+	    strcmp(event_base_get_method(base), mode->method)) {
+		fprintf(stdout, "%-14s not available\n", mode->name);
+		if (base)
+			event_base_free(base);
+		return;
+	}
+
+	evtimer_assign(&ev, base, timeout_cb, &ev);
+	count = 0;
+	evutil_gettimeofday(&start, NULL);
+	evutil_timeradd(&start, &interval, &deadline);
+	evtimer_add(&ev, &interval);
+	event_base_dispatch(base);
+	evutil_gettimeofday(&end, NULL);
+	evutil_timersub(&end, &start, &end);
+	elapsed = end.tv_sec * 1e6 + end.tv_usec;
+
+	for (i = 0; i < num_timeouts; i++)
+		total += lateness[i];
+	qsort(lateness, num_timeouts, sizeof(long), compare_long);
+
+	fprintf(stdout, "%-14s late: mean %7.1f us  p50 %5ld us  p99 %5ld us  "
+	    "max %6ld us  (%.1f timeouts/msec)\n", mode->name,
+	    total / num_timeouts, lateness[num_timeouts / 2],
+	    lateness[num_timeouts * 99 / 100], lateness[num_timeouts - 1],
+	    num_timeouts * 1000.0 / elapsed);
+
+	event_base_free(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct mode *mode;
+	long usec = 100;
+	int c;
+
+	num_timeouts = 10000;
+	while ((c = getopt(argc, argv, "n:u:")) != -1) {
+		switch (c) {
+		case 'n':
+			num_timeouts = atoi(optarg);
+			break;
+		case 'u':
+			usec = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (num_timeouts <= 0 || usec <= 0) {
+		fprintf(stderr, "Need at least one timeout of at least "
+		    "one usec\n");
+		exit(1);
+	}
+	interval.tv_sec = usec / 1000000;
+	interval.tv_usec = usec % 1000000;
+	lateness = calloc(num_timeouts, sizeof(long));
+	if (lateness == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (mode = modes; mode->name; mode++)
+		run_once(mode);
+
+	exit(0);
+}
@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark measures what EVENT_BASE_FLAG_NUMA_LOCAL buys a base
+ * whose loop runs on a different node from the thread that set it up, as
+ * happens when a main thread makes one base per node and then starts a
+ * thread for each.  The main thread, pinned to one CPU, makes a base
+ * pinned to another CPU, and num_conns pairs of socket bufferevents on
+ * it; then a loop thread bounces a message of msg_size bytes back and
+ * forth num_rounds times over each pair.  We report the throughput, and
+ * how many of the bufferevents and of the buffers they read into are on
+ * the loop's node.  Pages on another node cost a trip over the
+ * interconnect every time the loop touches them.
+ *
+ * This needs a machine with more than one NUMA node, and the two CPUs
+ * (-C for the main thread, -c for the loop) on different ones.  Booting a
+ * Linux kernel with numa=fake=2 splits one node in two, which shows the
+ * placement but not the cost.  With only one node, every page is local
+ * and both runs should look the same.
+ */
+
+#ifndef MPOL_F_NODE
+#define MPOL_F_NODE (1<<0)
+#define MPOL_F_ADDR (1<<1)
+#endif
+
+struct conn {
+	struct bufferevent *bev[2];
+	int rounds;
+};
+
+static int num_conns = 256, num_rounds = 200, msg_size = 4096;
+static int setup_cpu = -1, loop_cpu = -1;
+
+static struct event_base *base;
+static struct conn *conns;
+static int conns_left;
+static int loop_node = -1;
+static long bufs_seen, bufs_local;
+
+static long
+now_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+/* The node that the page at 'p' is on, or -1. */
+static int
+addr_node(const void *p)
+{
+	int node = -1;
+
+	if (syscall(SYS_get_mempolicy, &node, NULL, 0UL, p,
+		(unsigned long)(MPOL_F_NODE|MPOL_F_ADDR)) < 0)
+		return -1;
+	return node;
+}
+
+/* The node of the CPU that we are running on, or -1. */
+static int
+current_node(void)
+{
+	unsigned cpu, node;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) < 0)
+		return -1;
+	return (int)node;
+}
+
+static void
+pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+		perror("sched_setaffinity");
+		exit(1);
+	}
+}
+
+static void
+read_cb(struct bufferevent *bev, void *arg)
+{
+	struct conn *c = arg;
+	struct evbuffer *input = bufferevent_get_input(bev);
+	struct evbuffer_iovec vec;
+
+	if (evbuffer_get_length(input) < (size_t)msg_size)
+		return;
+	if (loop_node < 0)
+		loop_node = current_node();
+	if (evbuffer_peek(input, -1, NULL, &vec, 1) > 0) {
+		++bufs_seen;
+		if (addr_node(vec.iov_base) == loop_node)
+			++bufs_local;
+	}
+	if (bev == c->bev[0] && ++c->rounds == num_rounds) {
+		evbuffer_drain(input, evbuffer_get_length(input));
+		if (--conns_left == 0)
+			event_base_loopbreak(base);
+		return;
+	}
+	bufferevent_write_buffer(bev, input);
+}
+
+static void *
+loop_thread(void *arg)
+{
+	event_base_dispatch(base);
+	return NULL;
+}
+
+static void
+run_once(int numa_local)
+{
+	struct event_config *cfg;
+	pthread_t thread;
+	char *msg;
+	long start, elapsed;
+	int i, objs_local = 0;
+
+	pin(setup_cpu);
+	cfg = event_config_new();
+	event_config_set_cpu_affinity(cfg, &loop_cpu, 1);
+	if (numa_local)
+		event_config_set_flag(cfg, EVENT_BASE_FLAG_NUMA_LOCAL);
+	base = event_base_new_with_config(cfg);
+	event_config_free(cfg);
+	if (base == NULL) {
+		fprintf(stderr, "couldn't make a base\n");
+		exit(1);
+	}
+
+	msg = calloc(1, msg_size);
+	conns = calloc(num_conns, sizeof(struct conn));
+	if (msg == NULL || conns == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < num_conns; ++i) {
+		struct conn *c = &conns[i];
+		evutil_socket_t pair[2];
+		int j;
+
+		if (evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+			perror("socketpair");
+			exit(1);
+		}
+		for (j = 0; j < 2; ++j) {
+			evutil_make_socket_nonblocking(pair[j]);
+			c->bev[j] = bufferevent_socket_new(base, pair[j],
+			    BEV_OPT_CLOSE_ON_FREE);
+			bufferevent_setcb(c->bev[j], read_cb, NULL, NULL, c);
+			bufferevent_enable(c->bev[j], EV_READ|EV_WRITE);
+		}
+		bufferevent_write(c->bev[0], msg, msg_size);
+	}
+	conns_left = num_conns;
+	loop_node = -1;
+	bufs_seen = bufs_local = 0;
+
+	start = now_nsec();
+	pthread_create(&thread, NULL, loop_thread, NULL);
+	pthread_join(thread, NULL);
+	elapsed = now_nsec() - start;
+
+	for (i = 0; i < num_conns; ++i) {
+		if (addr_node(conns[i].bev[0]) == loop_node)
+			++objs_local;
+		if (addr_node(conns[i].bev[1]) == loop_node)
+			++objs_local;
+		bufferevent_free(conns[i].bev[0]);
+		bufferevent_free(conns[i].bev[1]);
+	}
+
+	fprintf(stdout, "%-10s %8.1f MB/s  bufferevents on the loop's node "
+	    "%5.1f%%  buffers %5.1f%%\n",
+	    numa_local ? "numa-local" : "default",
+	    2.0 * num_conns * num_rounds * msg_size / (elapsed / 1e9) / 1e6,
+	    100.0 * objs_local / (2 * num_conns),
+	    bufs_seen ? 100.0 * bufs_local / bufs_seen : 0.0);
+
+	event_base_free(base);
+	free(conns);
+	free(msg);
+}
+
+int
+main(int argc, char **argv)
+{
+	cpu_set_t allowed;
+	int c, cpu, last = -1;
+
+	while ((c = getopt(argc, argv, "n:r:s:C:c:")) != -1) {
+		switch (c) {
+		case 'n':
+			num_conns = atoi(optarg);
+			break;
+		case 'r':
+			num_rounds = atoi(optarg);
+			break;
+		case 's':
+			msg_size = atoi(optarg);
+			break;
+		case 'C':
+			setup_cpu = atoi(optarg);
+			break;
+		case 'c':
+			loop_cpu = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (num_conns <= 0 || num_rounds <= 0 || msg_size <= 0) {
+		fprintf(stderr, "Need at least one connection, round and "
+		    "byte\n");
+		exit(1);
+	}
+
+	/* By default, the first and the last CPUs we may use, which are
+	 * the likeliest to be on different nodes. */
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+		perror("sched_getaffinity");
+		exit(1);
+	}
+	for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if (!CPU_ISSET(cpu, &allowed))
+			continue;
+		if (setup_cpu < 0)
+			setup_cpu = cpu;
+		last = cpu;
+	}
+	if (loop_cpu < 0)
+		loop_cpu = last;
+
+	pin(loop_cpu);
+	cpu = current_node();
+	pin(setup_cpu);
+	fprintf(stdout, "%d connections, %d rounds of %d bytes; setup on CPU "
+	    "%d (node %d), loop on CPU %d (node %d)\n",
+	    num_conns, num_rounds, msg_size, setup_cpu, current_node(),
+	    loop_cpu, cpu);
+	if (cpu == current_node())
+		fprintf(stdout, "Both CPUs are on the same node, so there is "
+		    "no remote memory to avoid.\n");
+
+	run_once(0);
+	run_once(1);
+
+	exit(0);
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 4. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/event_struct.h>
+#include <event2/util.h>
+
+/*
+ * This benchmark measures what it costs to keep a large number of pending
+ * timeouts, as a server does with one idle timeout per connection: we add
+ * num_timers timeouts, re-arm random ones num_rearms times, and delete
+ * them all again, once for each timeout backend.  Nothing ever fires, so
+ * all we time is the bookkeeping in event_add and event_del.
+ *
+ * With -s, we do this for 10^3, 10^4, ... timers, up to num_timers.
+ */
+
+struct backend {
+	const char *name;
+	int flags;
+};
+
+static const struct backend backends[] = {
+	{ "heap", 0 },
+	{ "heap4", EVENT_BASE_FLAG_TIMER_HEAP4 },
+	{ "wheel", EVENT_BASE_FLAG_TIMER_WHEEL },
+	{ NULL, 0 }
+};
+
+static ev_uint32_t rand_state;
+
+/* The same sequence for every backend, whatever the libc. */
+static ev_uint32_t
+next_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+/* An idle timeout: thirty seconds, give or take up to ten. */
+static void
+random_timeout(struct timeval *tv)
+{
+	ev_uint32_t usec = next_rand() % 20000000;
+	tv->tv_sec = 20 + usec / 1000000;
+	tv->tv_usec = usec % 1000000;
+}
+
+static double
+elapsed_nsec(const struct timeval *start, int ops)
+{
+	struct timeval end;
+
+	evutil_gettimeofday(&end, NULL);
+	evutil_timersub(&end, start, &end);
+	return (end.tv_sec * 1e9 + end.tv_usec * 1e3) / ops;
+}
+
+static void
+run_once(const struct backend *backend, int num_timers, int num_rearms)
+{
+	struct event_config *cfg;
+	struct event_base *base;
+	struct event *events;
+	struct timeval tv, start;
+	double add, rearm, del;
+	int i;
+
+	cfg = event_config_new();
+	event_config_set_flag(cfg, backend->flags);
+	base = event_base_new_with_config(cfg);
+	event_config_free(cfg);
+	events = calloc(num_timers, sizeof(struct event));
+	if (base == NULL || events == NULL) {
+		fprintf(stderr, "%s: out of memory\n", backend->name);
+		exit(1);
+	}
+	for (i = 0; i < num_timers; i++)
+		event_assign(&events[i], base, -1, 0, NULL, NULL);
+
+	rand_state = 2463534242U;
+
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < num_timers; i++) {
+		random_timeout(&tv);
+		event_add(&events[i], &tv);
+	}
+	add = elapsed_nsec(&start, num_timers);
+
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < num_rearms; i++) {
+		random_timeout(&tv);
+		event_add(&events[next_rand() % num_timers], &tv);
+	}
+	rearm = elapsed_nsec(&start, num_rearms);
+
+	/* Let the loop look at its timeouts once, as it would between
+	 * bursts of I/O. */
+	event_base_loop(base, EVLOOP_NONBLOCK);
+
+	evutil_gettimeofday(&start, NULL);
+	for (i = 0; i < num_timers; i++)
+		event_del(&events[i]);
+	del = elapsed_nsec(&start, num_timers);
+
+	fprintf(stdout, "%-6s %9d timers: add %7.1f ns  rearm %7.1f ns  "
+	    "del %7.1f ns\n", backend->name, num_timers, add, rearm, del);
+
+	event_base_free(base);
+	free(events);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct backend *backend;
+	const char *only = NULL;
+	int num_timers = 1000000, num_rearms = 1000000;
+	int sweep = 0, n, c;
+
+	while ((c = getopt(argc, argv, "n:r:b:s")) != -1) {
+		switch (c) {
+		case 'n':
+			num_timers = atoi(optarg);
+			break;
+		case 'r':
+			num_rearms = atoi(optarg);
+			break;
+		case 'b':
+			only = optarg;
+			break;
+		case 's':
+			sweep = 1;
+			break;
+		default:
+			fprintf(stderr, "Illegal argument \"%c\"\n", c);
+			exit(1);
+		}
+	}
+	if (num_timers <= 0) {
+		fprintf(stderr, "Need at least one timer\n");
+		exit(1);
+	}
+	if (num_rearms <= 0)
+		num_rearms = 1;
+
+	for (n = sweep && num_timers > 1000 ? 1000 : num_timers;
+	     n <= num_timers; n *= 10) {
+		for (backend = backends; backend->name; backend++) {
+			if (only && strcmp(only, backend->name))
+				continue;
+			run_once(backend, n, num_rearms);
+		}
+		if (n > num_timers / 10)
+			break;
+	}
+
+	exit(0);
+}
@@ -61,7 +61,9 @@
 #include "event2/buffer.h"
 #include "event2/buffer_compat.h"
 #include "event2/util.h"
+#include "event2/listener.h"
 #include "event-internal.h"
+#include "evnuma-internal.h"
 #include "util-internal.h"
 #include "log-internal.h"
 
@@ -777,6 +779,216 @@ end:
 	data->base = NULL;
 }
 
+static void
+test_auto_common_timeout(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+
+	struct event_base *base = data->base;
+	int i;
+	struct common_timeout_info info[100];
+	struct event once;
+
+	struct timeval now;
+	struct timeval tv_100_ms = { 0, 100*1000 };
+	struct timeval tv_200_ms = { 0, 200*1000 };
+	struct timeval tv_1234_ms = { 1, 234*1000 };
+
+	memset(info, 0, sizeof(info));
+
+	/* A duration we only use once stays an ordinary timeout. */
+	evtimer_assign(&once, base, common_timeout_cb, &info[0]);
+	evtimer_add(&once, &tv_1234_ms);
+	tt_int_op(base->n_common_timeouts, ==, 0);
+
+	/* Durations that many events use get common timeout queues of
+	 * their own, even though we only ever hand in plain timevals. */
+	for (i=0; i<100; ++i) {
+		info[i].which = i;
+		event_assign(&info[i].ev, base, -1, EV_TIMEOUT|EV_PERSIST,
+		    common_timeout_cb, &info[i]);
+		if (i % 2) {
+			event_add(&info[i].ev, &tv_100_ms);
+		} else {
+			event_add(&info[i].ev, &tv_200_ms);
+		}
+	}
+	tt_int_op(base->n_common_timeouts, ==, 2);
+	tt_int_op(base->n_auto_common_timeouts, ==, 2);
+	tt_int_op(base->common_timeout_queues[0]->duration.tv_usec, ==,
+	    200000|0x50000000);
+	tt_int_op(base->common_timeout_queues[1]->duration.tv_usec, ==,
+	    100000|0x50100000);
+	tt_int_op(info[98].ev.ev_io_timeout.tv_usec, ==, 200000|0x50000000);
+	tt_int_op(info[99].ev.ev_io_timeout.tv_usec, ==, 100000|0x50100000);
+
+	event_del(&once);
+	event_base_dispatch(base);
+
+	evutil_gettimeofday(&now, NULL);
+
+	for (i=0; i<100; ++i) {
+		struct timeval tmp;
+		int ms_diff;
+		tt_int_op(info[i].count, ==, 6);
+		evutil_timersub(&now, &info[i].called_at, &tmp);
+		ms_diff = tmp.tv_usec/1000 + tmp.tv_sec*1000;
+		if (i % 2) {
+			tt_int_op(ms_diff, >, 500);
+			tt_int_op(ms_diff, <, 700);
+		} else {
+			tt_int_op(ms_diff, >, -100);
+			tt_int_op(ms_diff, <, 100);
+		}
+	}
+	tt_int_op(base->n_common_timeouts, ==, 2);
+
+end:
+	event_base_free(data->base); /* need to do this here before info is
+				      * out-of-scope */
+	data->base = NULL;
+}
+
+static int precise_timer_count;
+
+static void
+precise_timer_cb(evutil_socket_t fd, short event, void *arg)
+{
+	struct event *ev = arg;
+	struct timeval tv = { 0, 100 };
+
+	if (++precise_timer_count < 30)
+		event_add(ev, &tv);
+}
+
+static void
+test_precise_timer(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	struct event ev;
+	struct timeval tv = { 0, 100 }, start, end;
+	long ms;
+
+	if (strcmp(event_base_get_method(base), "epoll"))
+		tt_skip();
+
+	/* Waiting for a 100 usec timeout 30 times takes at least 30 msec
+	 * when epoll_wait() rounds it up to a millisecond each time. */
+	evtimer_assign(&ev, base, precise_timer_cb, &ev);
+	precise_timer_count = 0;
+	evutil_gettimeofday(&start, NULL);
+	event_add(&ev, &tv);
+	event_base_dispatch(base);
+	evutil_gettimeofday(&end, NULL);
+	evutil_timersub(&end, &start, &end);
+	ms = end.tv_sec * 1000 + end.tv_usec / 1000;
+
+	tt_int_op(precise_timer_count, ==, 30);
+	tt_int_op(ms, <, 25);
+
+end:
+	;
+}
+
+struct random_timer {
+	struct event ev;
+	struct timeval added;
+	struct timeval timeout;
+	int fired;
+	int early;
+};
+
+static int random_timers_fired;
+
+static void
+random_timer_cb(evutil_socket_t fd, short event, void *arg)
+{
+	struct random_timer *t = arg;
+	struct timeval now, elapsed;
+
+	evutil_gettimeofday(&now, NULL);
+	evutil_timersub(&now, &t->added, &elapsed);
+	if (evutil_timercmp(&elapsed, &t->timeout, <))
+		t->early = 1;
+	++t->fired;
+	++random_timers_fired;
+}
+
+static void
+random_timer_add(struct random_timer *t, long usec)
+{
+	t->timeout.tv_sec = usec / 1000000;
+	t->timeout.tv_usec = usec % 1000000;
+	evutil_gettimeofday(&t->added, NULL);
+	event_add(&t->ev, &t->timeout);
+}
+
+static void
+test_random_timers(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base = data->base;
+	struct random_timer *timers;
+	struct event far[2];
+	struct timeval tv;
+	int i, n_expected = 0;
+	const int n = 1000;
+
+	timers = calloc(n, sizeof(struct random_timer));
+	tt_assert(timers);
+
+	/* Spread the timers over a few hundred milliseconds, with odd
+	 * microsecond values so that most of them fall between ticks. */
+	for (i = 0; i < n; ++i) {
+		event_assign(&timers[i].ev, base, -1, EV_TIMEOUT,
+		    random_timer_cb, &timers[i]);
+		random_timer_add(&timers[i], rand() % 300000);
+	}
+	/* Delete some, and move others while they are pending. */
+	for (i = 0; i < n; ++i) {
+		if (i % 5 == 0) {
+			event_del(&timers[i].ev);
+		} else {
+			if (i % 5 == 1)
+				random_timer_add(&timers[i], rand() % 300000);
+			++n_expected;
+		}
+	}
+
+	/* These are far enough out to live in the top levels of a timing
+	 * wheel and beyond it; they must never fire. */
+	event_assign(&far[0], base, -1, EV_TIMEOUT, random_timer_cb, NULL);
+	event_assign(&far[1], base, -1, EV_TIMEOUT, random_timer_cb, NULL);
+	tv.tv_sec = 3*24*60*60;
+	tv.tv_usec = 0;
+	event_add(&far[0], &tv);
+	tv.tv_sec = 4*365*24*60*60;
+	event_add(&far[1], &tv);
+
+	tv.tv_sec = 0;
+	tv.tv_usec = 500 * 1000;
+	event_base_loopexit(base, &tv);
+
+	random_timers_fired = 0;
+	event_base_dispatch(base);
+
+	tt_int_op(random_timers_fired, ==, n_expected);
+	for (i = 0; i < n; ++i) {
+		tt_int_op(timers[i].fired, ==, (i % 5 == 0) ? 0 : 1);
+		tt_int_op(timers[i].early, ==, 0);
+	}
+	tt_assert(event_pending(&far[0], EV_TIMEOUT, NULL));
+	tt_assert(event_pending(&far[1], EV_TIMEOUT, NULL));
+
+end:
+	/* Make sure we can free the base with timers still pending. */
+	event_base_free(data->base);
+	data->base = NULL;
+	if (timers)
+		free(timers);
+}
+
 #ifndef WIN32
 static void signal_cb(evutil_socket_t fd, short event, void *arg);
 
@@ -1154,6 +1366,87 @@ test_signal_while_processing(void)
 	cleanup_test();
 	return;
 }
+
+static void
+signalfd_count_cb(evutil_socket_t sig, short event, void *arg)
+{
+	int *count = arg;
+	++*count;
+}
+
+static void
+test_signalfd(void *ptr)
+{
+	struct basic_test_data *data = ptr;
+	struct event_base *base1 = data->base, *base2 = NULL;
+	struct event_config *cfg = NULL;
+	struct event ev1, ev2;
+	int count1 = 0, count2 = 0;
+	sigset_t mask;
+#ifdef SIGRTMIN
+	struct event ev_rt;
+	int count_rt = 0;
+#endif
+
+	if (base1->sig.sigfd < 0)
+		tt_skip();
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_SIGNALFD);
+	base2 = event_base_new_with_config(cfg);
+	tt_assert(base2);
+	tt_int_op(base2->sig.sigfd, >=, 0);
+
+	/* Each base gets its own signal, whichever base added a signal
+	 * event last. */
+	evsignal_assign(&ev1, base1, SIGUSR1, signalfd_count_cb, &count1);
+	evsignal_assign(&ev2, base2, SIGUSR2, signalfd_count_cb, &count2);
+	evsignal_add(&ev1, NULL);
+	evsignal_add(&ev2, NULL);
+
+	raise(SIGUSR1);
+	raise(SIGUSR2);
+	event_base_loop(base2, EVLOOP_NONBLOCK);
+	tt_int_op(count1, ==, 0);
+	tt_int_op(count2, ==, 1);
+	event_base_loop(base1, EVLOOP_NONBLOCK);
+	tt_int_op(count1, ==, 1);
+	tt_int_op(count2, ==, 1);
+
+#ifdef SIGRTMIN
+	/* Queued signals that come in together are read in one batch,
+	 * and each one runs the callback. */
+	evsignal_assign(&ev_rt, base1, SIGRTMIN, signalfd_count_cb,
+	    &count_rt);
+	evsignal_add(&ev_rt, NULL);
+	raise(SIGRTMIN);
+	raise(SIGRTMIN);
+	raise(SIGRTMIN);
+	event_base_loop(base1, EVLOOP_NONBLOCK);
+	tt_int_op(count_rt, ==, 3);
+	evsignal_del(&ev_rt);
+#endif
+
+	/* We block the signals only while we watch them. */
+	sigprocmask(SIG_BLOCK, NULL, &mask);
+	tt_assert(sigismember(&mask, SIGUSR1));
+	tt_assert(sigismember(&mask, SIGUSR2));
+	evsignal_del(&ev1);
+	sigprocmask(SIG_BLOCK, NULL, &mask);
+	tt_assert(!sigismember(&mask, SIGUSR1));
+	tt_assert(sigismember(&mask, SIGUSR2));
+	event_base_free(base2);
+	base2 = NULL;
+	sigprocmask(SIG_BLOCK, NULL, &mask);
+	tt_assert(!sigismember(&mask, SIGUSR2));
+
+end:
+	if (base2)
+		event_base_free(base2);
+	if (cfg)
+		event_config_free(cfg);
+}
 #endif
 
 static void
@@ -2167,6 +2460,1001 @@ end:
 #undef MANY
 }
 
+static void
+count_cb(evutil_socket_t fd, short what, void *arg)
+{
+	int *count = arg;
+	++*count;
+}
+
+static void
+test_epoll_skip_redundant(void *arg)
+{
+	/* With EVENT_BASE_FLAG_EPOLL_SKIP_REDUNDANT, a del and re-add of the
+	 * same event shouldn't reach the kernel, but deleting an fd's events
+	 * and closing it must still let us reuse the fd number.  Also check
+	 * that the ready array stays within max_dispatch_events. */
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *r = NULL, *hold = NULL, *w[3];
+	struct event_dispatch_stats st;
+	evutil_socket_t pair[2] = { -1, -1 }, pair2[2] = { -1, -1 };
+	evutil_socket_t old_fd;
+	int n_read = 0, n_write = 0, n_hold = 0;
+	ev_uint64_t syscalls;
+	int i;
+
+	memset(w, 0, sizeof(w));
+	cfg = event_config_new();
+	tt_assert(cfg);
+	event_config_avoid_method(cfg, "io_uring");
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_EPOLL_SKIP_REDUNDANT);
+	tt_int_op(event_config_set_max_dispatch_events(cfg, 0), ==, -1);
+	tt_int_op(event_config_set_max_dispatch_events(cfg, 2), ==, 0);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+	if (strcmp(event_base_get_method(base), "epoll")) {
+		TT_BLATHER(("Not using epoll; skipping"));
+		tt_skip();
+	}
+
+	tt_int_op(evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0,
+		pair), ==, 0);
+	r = event_new(base, pair[0], EV_READ|EV_PERSIST, count_cb, &n_read);
+	hold = event_new(base, pair[0], EV_WRITE|EV_PERSIST, count_cb,
+	    &n_hold);
+	tt_assert(r);
+	tt_assert(hold);
+	event_add(r, NULL);
+	event_add(hold, NULL);
+	event_base_loop(base, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+	/* (The base may have added an internal event too.) */
+	tt_int_op(event_base_get_dispatch_stats(base, &st), ==, 0);
+	tt_int_op(st.n_change_syscalls, >=, 1);
+	syscalls = st.n_change_syscalls;
+
+	/* Del and add again while the fd is still in use: nothing for the
+	 * kernel to do. */
+	event_del(r);
+	event_add(r, NULL);
+	event_base_loop(base, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+	event_base_get_dispatch_stats(base, &st);
+	tt_int_op(st.n_change_syscalls, ==, syscalls);
+	tt_int_op(st.n_changes_skipped, >=, 1);
+	tt_int_op(n_hold, ==, 2);
+
+	/* Del, close, and reopen on the same fd number. */
+	event_del(r);
+	event_del(hold);
+	old_fd = pair[0];
+	evutil_closesocket(pair[0]);
+	evutil_closesocket(pair[1]);
+	tt_int_op(evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0,
+		pair), ==, 0);
+	tt_int_op(pair[0], ==, old_fd);
+	event_assign(r, base, pair[0], EV_READ|EV_PERSIST, count_cb, &n_read);
+	event_add(r, NULL);
+	tt_int_op(send(pair[1], "x", 1, 0), ==, 1);
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(n_read, ==, 1);
+
+	/* Four ready fds (pair[0] still has its byte), but room for only
+	 * two at a time. */
+	tt_int_op(evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0,
+		pair2), ==, 0);
+	w[0] = event_new(base, pair[1], EV_WRITE, count_cb, &n_write);
+	w[1] = event_new(base, pair2[0], EV_WRITE, count_cb, &n_write);
+	w[2] = event_new(base, pair2[1], EV_WRITE, count_cb, &n_write);
+	for (i = 0; i < 3; ++i)
+		event_add(w[i], NULL);
+	for (i = 0; i < 3 && n_write < 3; ++i)
+		event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(n_write, ==, 3);
+	event_base_get_dispatch_stats(base, &st);
+	tt_int_op(st.max_nevents, ==, 2);
+	tt_int_op(st.nevents, <=, 2);
+	tt_int_op(st.n_full, >=, 1);
+
+end:
+	for (i = 0; i < 3; ++i)
+		if (w[i])
+			event_free(w[i]);
+	if (r)
+		event_free(r);
+	if (hold)
+		event_free(hold);
+	for (i = 0; i < 2; ++i) {
+		if (pair[i] >= 0)
+			evutil_closesocket(pair[i]);
+		if (pair2[i] >= 0)
+			evutil_closesocket(pair2[i]);
+	}
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static int n_slow_warnings = 0;
+
+static void
+slow_log_cb(int severity, const char *msg)
+{
+	if (severity == _EVENT_LOG_WARN && strstr(msg, "Slow callback"))
+		++n_slow_warnings;
+}
+
+static void
+slow_cb(evutil_socket_t fd, short what, void *arg)
+{
+	/* Spin rather than sleep, so that we don't depend on the
+	 * scheduler. */
+	struct timeval start, now, msec30 = { 0, 30000 }, end;
+	evutil_gettimeofday(&start, NULL);
+	evutil_timeradd(&start, &msec30, &end);
+	do {
+		evutil_gettimeofday(&now, NULL);
+	} while (evutil_timercmp(&now, &end, <));
+	count_cb(fd, what, arg);
+}
+
+static void
+test_loop_stats(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct event_loop_stats st;
+	struct event *fast = NULL, *slow = NULL, *later = NULL;
+	struct timeval msec10 = { 0, 10000 }, sec100 = { 100, 0 };
+	int n_fast = 0, n_slow = 0, i;
+	ev_uint64_t total;
+
+	tt_int_op(event_base_get_loop_stats(base, &st), ==, -1);
+	tt_int_op(event_base_priority_init(base, 2), ==, 0);
+	fast = event_new(base, -1, 0, count_cb, &n_fast);
+	slow = event_new(base, -1, 0, slow_cb, &n_slow);
+	later = evtimer_new(base, count_cb, NULL);
+	tt_assert(fast);
+	tt_assert(slow);
+	tt_assert(later);
+	event_priority_set(fast, 0);
+	event_priority_set(slow, 1);
+	event_add(later, &sec100);
+
+	tt_int_op(event_base_enable_loop_stats(base, &msec10), ==, 0);
+	event_set_log_callback(slow_log_cb);
+	event_active(fast, EV_READ, 1);
+	event_active(slow, EV_READ, 1);
+	/* One iteration runs fast; since slow is still active, a second one
+	 * runs slow. */
+	event_base_loop(base, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+	event_set_log_callback(NULL);
+	tt_int_op(n_fast, ==, 1);
+	tt_int_op(n_slow, ==, 1);
+
+	tt_int_op(event_base_get_loop_stats(base, &st), ==, 0);
+	tt_int_op(st.n_iterations, ==, 2);
+	tt_int_op(st.n_callbacks, ==, 2);
+	tt_int_op(st.n_callbacks_by_priority[0], ==, 1);
+	tt_int_op(st.n_callbacks_by_priority[1], ==, 1);
+	tt_int_op(st.n_slow_callbacks, ==, 1);
+	tt_int_op(n_slow_warnings, ==, 1);
+	tt_int_op(st.callback_usec, >=, 30000);
+	tt_int_op(st.max_callback_usec, >=, 30000);
+	/* The second iteration ran only the slow event. */
+	tt_int_op(st.last_callback_usec, >=, 30000);
+	tt_int_op(st.n_active_by_priority[0], ==, 0);
+	tt_int_op(st.n_active_by_priority[1], ==, 1);
+	total = 0;
+	for (i = 0; i < EVENT_LOOP_STATS_HIST_BUCKETS; ++i)
+		total += st.callback_hist[i];
+	tt_int_op(total, ==, 2);
+	/* 30 msec is in the [2^14, 2^15) usec bucket or later. */
+	total = 0;
+	for (i = 15; i < EVENT_LOOP_STATS_HIST_BUCKETS; ++i)
+		total += st.callback_hist[i];
+	tt_int_op(total, ==, 1);
+	tt_int_op(st.n_active, ==, 0);
+	tt_int_op(st.n_deferred, ==, 0);
+	tt_int_op(st.n_timeouts, ==, 1);
+
+	/* Without a threshold, nothing is slow. */
+	tt_int_op(event_base_enable_loop_stats(base, NULL), ==, 0);
+	event_active(slow, EV_READ, 1);
+	event_base_loop(base, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+	event_base_get_loop_stats(base, &st);
+	tt_int_op(st.n_callbacks, ==, 3);
+	tt_int_op(st.n_slow_callbacks, ==, 1);
+
+	tt_int_op(event_base_disable_loop_stats(base), ==, 0);
+	tt_int_op(event_base_get_loop_stats(base, &st), ==, -1);
+	event_active(fast, EV_READ, 1);
+	event_base_loop(base, EVLOOP_ONCE|EVLOOP_NONBLOCK);
+	tt_int_op(n_fast, ==, 2);
+
+end:
+	if (fast)
+		event_free(fast);
+	if (slow)
+		event_free(slow);
+	if (later)
+		event_free(later);
+}
+
+static ev_uint64_t
+fake_clock(void *arg)
+{
+	return *(ev_uint64_t *)arg;
+}
+
+static void
+test_clock_external(void *arg)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *ev = NULL;
+	struct timeval tv, sec5 = { 5, 0 };
+	ev_uint64_t now = 1000 * (ev_uint64_t)1000000000;
+	int n = 0;
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_clock(cfg, EVENT_CLOCK_EXTERNAL), ==, -1);
+	tt_int_op(event_config_set_clock_fn(cfg, NULL, NULL), ==, -1);
+	tt_int_op(event_config_set_clock_fn(cfg, fake_clock, &now), ==, 0);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+	tt_int_op(event_base_get_clock(base), ==, EVENT_CLOCK_EXTERNAL);
+
+	tt_int_op(event_base_gettimeofday_cached(base, &tv), ==, 0);
+	tt_int_op(tv.tv_sec, ==, 1000);
+	tt_int_op(tv.tv_usec, ==, 0);
+	now += 1500;
+	event_base_gettimeofday_cached(base, &tv);
+	tt_int_op(tv.tv_usec, ==, 1);
+
+	ev = evtimer_new(base, count_cb, &n);
+	tt_assert(ev);
+	evtimer_add(ev, &sec5);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(n, ==, 0);
+	now += 4999999 * (ev_uint64_t)1000;
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(n, ==, 0);
+	now += 1000;
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(n, ==, 1);
+
+end:
+	if (ev)
+		event_free(ev);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static void
+test_clock_sources(void *arg)
+{
+	/* Every clock we can ask for either works or falls back to the
+	 * default; either way, a short timer fires, and not (much) early. */
+	static const enum event_clock_source sources[] = {
+		EVENT_CLOCK_DEFAULT, EVENT_CLOCK_MONOTONIC_COARSE,
+		EVENT_CLOCK_TSC
+	};
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *ev = NULL;
+	struct timeval msec20 = { 0, 20000 }, start, end, elapsed;
+	int i, n;
+
+	for (i = 0; i < (int)(sizeof(sources)/sizeof(sources[0])); ++i) {
+		enum event_clock_source got;
+		cfg = event_config_new();
+		tt_assert(cfg);
+		tt_int_op(event_config_set_clock(cfg, sources[i]), ==, 0);
+		base = event_base_new_with_config(cfg);
+		tt_assert(base);
+		got = event_base_get_clock(base);
+		tt_assert(got == sources[i] || got == EVENT_CLOCK_DEFAULT);
+		TT_BLATHER(("clock %d: got %d", (int)sources[i], (int)got));
+
+		n = 0;
+		ev = evtimer_new(base, count_cb, &n);
+		tt_assert(ev);
+		evutil_gettimeofday(&start, NULL);
+		evtimer_add(ev, &msec20);
+		event_base_dispatch(base);
+		evutil_gettimeofday(&end, NULL);
+		tt_int_op(n, ==, 1);
+		evutil_timersub(&end, &start, &elapsed);
+		/* A coarse clock can lag the real time by a tick. */
+		tt_int_op(elapsed.tv_sec * 1000000 + elapsed.tv_usec, >=,
+		    10000);
+
+		event_free(ev);
+		ev = NULL;
+		event_base_free(base);
+		base = NULL;
+		event_config_free(cfg);
+		cfg = NULL;
+	}
+
+end:
+	if (ev)
+		event_free(ev);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+struct sim_ticker {
+	struct event *ev;
+	int n;
+	int limit;
+};
+
+static void
+sim_tick_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct sim_ticker *t = arg;
+	if (++t->n == t->limit)
+		event_del(t->ev);
+}
+
+static void
+test_simulated_time(void *arg)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL, *real = NULL;
+	struct event *once = NULL;
+	struct sim_ticker minutely, common;
+	struct timeval tv, start, end, minute = { 60, 0 }, sec10 = { 10, 0 };
+	const struct timeval *tv_common;
+	int n_once = 0;
+
+	memset(&minutely, 0, sizeof(minutely));
+	memset(&common, 0, sizeof(common));
+
+	real = event_base_new();
+	tt_assert(real);
+	tt_int_op(event_base_advance_time(real, &sec10), ==, -1);
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_clock(cfg, EVENT_CLOCK_SIMULATED), ==, 0);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+	tt_int_op(event_base_get_clock(base), ==, EVENT_CLOCK_SIMULATED);
+	event_base_gettimeofday_cached(base, &start);
+	tt_int_op(start.tv_sec, ==, 1);
+	tt_int_op(start.tv_usec, ==, 0);
+
+	/* Time only moves when we say so... */
+	once = evtimer_new(base, count_cb, &n_once);
+	tt_assert(once);
+	evtimer_add(once, &sec10);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(n_once, ==, 0);
+	tt_int_op(event_base_advance_time(base, &sec10), ==, 0);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(n_once, ==, 1);
+	event_base_gettimeofday_cached(base, &start);
+	tt_int_op(start.tv_sec, ==, 11);
+
+	/* ...or when there is nothing to do but wait.  Run a day's worth of
+	 * once-a-minute timers, with a heap timeout and a common timeout. */
+	minutely.limit = common.limit = 24 * 60;
+	minutely.ev = event_new(base, -1, EV_PERSIST, sim_tick_cb, &minutely);
+	common.ev = event_new(base, -1, EV_PERSIST, sim_tick_cb, &common);
+	tt_assert(minutely.ev);
+	tt_assert(common.ev);
+	tv_common = event_base_init_common_timeout(base, &minute);
+	event_add(minutely.ev, &minute);
+	event_add(common.ev, tv_common);
+
+	evutil_gettimeofday(&tv, NULL);
+	tt_int_op(event_base_dispatch(base), ==, 1);
+	evutil_gettimeofday(&end, NULL);
+	evutil_timersub(&end, &tv, &tv);
+	TT_BLATHER(("A simulated day took %d.%06d sec", (int)tv.tv_sec,
+		(int)tv.tv_usec));
+	tt_int_op(tv.tv_sec, <, 10);
+
+	tt_int_op(minutely.n, ==, 24 * 60);
+	tt_int_op(common.n, ==, 24 * 60);
+	event_base_gettimeofday_cached(base, &end);
+	tt_int_op(end.tv_sec - start.tv_sec, ==, 24 * 60 * 60);
+	tt_int_op(end.tv_usec, ==, 0);
+
+end:
+	if (once)
+		event_free(once);
+	if (minutely.ev)
+		event_free(minutely.ev);
+	if (common.ev)
+		event_free(common.ev);
+	if (base)
+		event_base_free(base);
+	if (real)
+		event_base_free(real);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+/* For the scheduling tests: which loop iteration ran each callback, in
+ * the order they ran. */
+#define SCHED_MAX 64
+static struct event_base *sched_base;
+static int sched_n_run;
+static int sched_iteration[SCHED_MAX];
+static int sched_id[SCHED_MAX];
+static int sched_spin_usec;
+
+static int
+sched_current_iteration(void)
+{
+	struct event_dispatch_stats st;
+	event_base_get_dispatch_stats(sched_base, &st);
+	return (int)st.n_dispatch;
+}
+
+static void
+sched_record(int id)
+{
+	if (sched_spin_usec) {
+		struct timeval start, now, spin = { 0, 0 }, end;
+		spin.tv_usec = sched_spin_usec;
+		evutil_gettimeofday(&start, NULL);
+		evutil_timeradd(&start, &spin, &end);
+		do {
+			evutil_gettimeofday(&now, NULL);
+		} while (evutil_timercmp(&now, &end, <));
+	}
+	if (sched_n_run < SCHED_MAX) {
+		sched_iteration[sched_n_run] = sched_current_iteration();
+		sched_id[sched_n_run] = id;
+	}
+	++sched_n_run;
+}
+
+static void
+sched_cb(evutil_socket_t fd, short what, void *arg)
+{
+	sched_record((int)(ev_intptr_t)arg);
+}
+
+static void
+sched_deferred_cb(struct deferred_cb *cb, void *arg)
+{
+	sched_record((int)(ev_intptr_t)arg);
+}
+
+/* Number of callbacks in sched_iteration that ran in the same iteration
+ * as callback number 'first'. */
+static int
+sched_run_with(int first)
+{
+	int i, n = 0;
+	for (i = 0; i < sched_n_run && i < SCHED_MAX; ++i)
+		if (sched_iteration[i] == sched_iteration[first])
+			++n;
+	return n;
+}
+
+static struct event_base *
+sched_setup(struct event_config *cfg, int npriorities)
+{
+	sched_base = event_base_new_with_config(cfg);
+	sched_n_run = 0;
+	sched_spin_usec = 0;
+	memset(sched_iteration, 0, sizeof(sched_iteration));
+	memset(sched_id, 0, sizeof(sched_id));
+	if (sched_base && npriorities > 1)
+		event_base_priority_init(sched_base, npriorities);
+	return sched_base;
+}
+
+static void
+test_dispatch_budget(void *arg)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *evs[20];
+	struct timeval msec10 = { 0, 10000 };
+	int i, n;
+
+	memset(evs, 0, sizeof(evs));
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_max_dispatch_interval(cfg, NULL, 3, -1),
+	    ==, -1);
+
+	/* At most 3 callbacks per iteration. */
+	tt_int_op(event_config_set_max_dispatch_interval(cfg, NULL, 3, 0),
+	    ==, 0);
+	base = sched_setup(cfg, 1);
+	tt_assert(base);
+	for (i = 0; i < 10; ++i) {
+		evs[i] = event_new(base, -1, 0, sched_cb, (void *)(ev_intptr_t)i);
+		event_active(evs[i], EV_READ, 1);
+	}
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(sched_n_run, ==, 10);
+	for (i = 0; i < 10; ++i)
+		tt_int_op(sched_id[i], ==, i);
+	tt_int_op(sched_run_with(0), ==, 3);
+	tt_int_op(sched_run_with(3), ==, 3);
+	tt_int_op(sched_run_with(6), ==, 3);
+	tt_int_op(sched_run_with(9), ==, 1);
+	for (i = 0; i < 10; ++i) {
+		event_free(evs[i]);
+		evs[i] = NULL;
+	}
+	event_base_free(base);
+	base = NULL;
+
+	/* Priority 0 is exempt from a limit of 2 that starts at priority 1. */
+	tt_int_op(event_config_set_max_dispatch_interval(cfg, NULL, 2, 1),
+	    ==, 0);
+	base = sched_setup(cfg, 2);
+	tt_assert(base);
+	for (i = 0; i < 10; ++i) {
+		evs[i] = event_new(base, -1, 0, sched_cb, (void *)(ev_intptr_t)i);
+		event_priority_set(evs[i], i < 5 ? 0 : 1);
+		event_active(evs[i], EV_READ, 1);
+	}
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(sched_n_run, ==, 10);
+	tt_int_op(sched_run_with(0), ==, 5);
+	tt_int_op(sched_run_with(5), ==, 2);
+	tt_int_op(sched_run_with(7), ==, 2);
+	tt_int_op(sched_run_with(9), ==, 1);
+	for (i = 0; i < 10; ++i) {
+		event_free(evs[i]);
+		evs[i] = NULL;
+	}
+	event_base_free(base);
+	base = NULL;
+
+	/* A time budget: 10 msec, with callbacks that take 4 msec each. */
+	tt_int_op(event_config_set_max_dispatch_interval(cfg, &msec10, 0, 0),
+	    ==, 0);
+	base = sched_setup(cfg, 1);
+	tt_assert(base);
+	sched_spin_usec = 4000;
+	for (i = 0; i < 10; ++i) {
+		evs[i] = event_new(base, -1, 0, sched_cb, (void *)(ev_intptr_t)i);
+		event_active(evs[i], EV_READ, 1);
+	}
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(sched_n_run, ==, 10);
+	n = sched_run_with(0);
+	TT_BLATHER(("%d callbacks in the first iteration", n));
+	tt_int_op(n, >=, 1);
+	tt_int_op(n, <=, 3);
+
+end:
+	for (i = 0; i < 20; ++i)
+		if (evs[i])
+			event_free(evs[i]);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static void
+test_priority_weights(void *arg)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *evs[12];
+	static const int weights[3] = { 4, 2, 1 };
+	static const int bad_weights[3] = { 4, 0, 1 };
+	int i, per_prio[3];
+
+	memset(evs, 0, sizeof(evs));
+	cfg = event_config_new();
+	tt_assert(cfg);
+	base = sched_setup(cfg, 3);
+	tt_assert(base);
+	tt_int_op(event_base_set_priority_weights(base, bad_weights), ==, -1);
+	tt_int_op(event_base_set_priority_weights(base, weights), ==, 0);
+
+	/* Four events at each priority.  The first iteration takes 4, 2 and
+	 * 1 of them; the second takes what's left of priority 1 and one
+	 * more from priority 2; and so on. */
+	for (i = 0; i < 12; ++i) {
+		evs[i] = event_new(base, -1, 0, sched_cb, (void *)(ev_intptr_t)i);
+		event_priority_set(evs[i], i / 4);
+		event_active(evs[i], EV_READ, 1);
+	}
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(sched_n_run, ==, 12);
+
+	memset(per_prio, 0, sizeof(per_prio));
+	for (i = 0; i < sched_n_run; ++i)
+		if (sched_iteration[i] == sched_iteration[0])
+			++per_prio[sched_id[i] / 4];
+	tt_int_op(per_prio[0], ==, 4);
+	tt_int_op(per_prio[1], ==, 2);
+	tt_int_op(per_prio[2], ==, 1);
+	/* Priority 2 ran in every one of the four iterations. */
+	tt_int_op(sched_iteration[11] - sched_iteration[0], ==, 3);
+
+	/* Back to strict priorities: all of priority 0 runs alone. */
+	tt_int_op(event_base_set_priority_weights(base, NULL), ==, 0);
+	sched_n_run = 0;
+	for (i = 0; i < 12; ++i)
+		event_active(evs[i], EV_READ, 1);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(sched_n_run, ==, 12);
+	tt_int_op(sched_run_with(0), ==, 4);
+
+end:
+	for (i = 0; i < 12; ++i)
+		if (evs[i])
+			event_free(evs[i]);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static void
+test_deferred_budget(void *arg)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct deferred_cb_queue *queue;
+	struct deferred_cb cbs[7];
+	int i;
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_max_deferred_callbacks(cfg, -1), ==, -1);
+	tt_int_op(event_config_set_max_deferred_callbacks(cfg, 3), ==, 0);
+	base = sched_setup(cfg, 1);
+	tt_assert(base);
+	queue = event_base_get_deferred_cb_queue(base);
+
+	for (i = 0; i < 7; ++i) {
+		event_deferred_cb_init(&cbs[i], sched_deferred_cb,
+		    (void *)(ev_intptr_t)i);
+		event_deferred_cb_schedule(queue, &cbs[i]);
+	}
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(sched_n_run, ==, 7);
+	tt_int_op(sched_run_with(0), ==, 3);
+	tt_int_op(sched_run_with(3), ==, 3);
+	tt_int_op(sched_run_with(6), ==, 1);
+
+end:
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static void
+busy_poll_write_cb(evutil_socket_t fd, short what, void *arg)
+{
+	send(*(evutil_socket_t *)arg, "x", 1, 0);
+}
+
+static void
+busy_poll_read_cb(evutil_socket_t fd, short what, void *arg)
+{
+	char c;
+
+	recv(fd, &c, 1, 0);
+	event_base_loopbreak(arg);
+}
+
+static void
+test_busy_poll(void *arg)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *r = NULL, *t = NULL;
+	struct event_dispatch_stats st;
+	evutil_socket_t pair[2] = { -1, -1 };
+	struct timeval spin = { 1, 0 }, bad = { 0, 1000000 };
+	struct timeval tv, start, end;
+	long ms;
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_busy_poll(cfg, &bad, 0), ==, -1);
+	tt_int_op(event_config_set_busy_poll(cfg, &spin, -1), ==, -1);
+	tt_int_op(event_config_set_busy_poll(cfg, &spin, 0), ==, 0);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+
+	tt_int_op(evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM, 0,
+		pair), ==, 0);
+	r = event_new(base, pair[0], EV_READ|EV_PERSIST, busy_poll_read_cb,
+	    base);
+	t = evtimer_new(base, busy_poll_write_cb, &pair[1]);
+	tt_assert(r);
+	tt_assert(t);
+
+	/* The spin stops at the timeout, so the timer is on time even
+	 * though we spin for up to a second; then a spin finds the byte
+	 * that the timer sent. */
+	event_add(r, NULL);
+	tv.tv_sec = 0;
+	tv.tv_usec = 20 * 1000;
+	event_add(t, &tv);
+	evutil_gettimeofday(&start, NULL);
+	event_base_dispatch(base);
+	evutil_gettimeofday(&end, NULL);
+	evutil_timersub(&end, &start, &end);
+	ms = end.tv_sec * 1000 + end.tv_usec / 1000;
+	tt_int_op(ms, >=, 15);
+	tt_int_op(ms, <, 500);
+
+	tt_int_op(event_base_get_dispatch_stats(base, &st), ==, 0);
+	tt_assert(st.n_busy_polls > 1);
+	tt_assert(st.n_busy_poll_hits == 1);
+
+end:
+	if (r)
+		event_free(r);
+	if (t)
+		event_free(t);
+	if (pair[0] >= 0)
+		evutil_closesocket(pair[0]);
+	if (pair[1] >= 0)
+		evutil_closesocket(pair[1]);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+static void
+test_cpu_affinity(void *arg)
+{
+	struct event_config *cfg = NULL;
+	struct event_base *base = NULL;
+	struct event *ev = NULL;
+	struct evconnlistener *lev = NULL;
+	struct timeval tv = { 0, 1000 };
+	int cpus[64], n, cpu, bad = -1;
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	tt_int_op(event_config_set_cpu_affinity(cfg, NULL, 1), ==, -1);
+	tt_int_op(event_config_set_cpu_affinity(cfg, &bad, 1), ==, -1);
+	tt_int_op(event_config_set_cpu_affinity(cfg, cpus, -1), ==, -1);
+	tt_int_op(event_config_set_cpu_affinity(cfg, NULL, 0), ==, 0);
+
+	if ((n = evnuma_allowed_cpus(cpus, 64)) <= 0)
+		tt_skip();
+	/* The last CPU we may use, so that with more than one the loop's
+	 * set has to shrink. */
+	cpu = cpus[n - 1];
+	tt_int_op(event_config_set_cpu_affinity(cfg, &cpu, 1), ==, 0);
+	tt_int_op(event_config_set_flag(cfg, EVENT_BASE_FLAG_NUMA_LOCAL),
+	    ==, 0);
+	base = event_base_new_with_config(cfg);
+	tt_assert(base);
+	tt_int_op(event_base_get_numa_node(base), ==, evnuma_cpu_node(cpu));
+
+	/* Nothing is pinned until the loop runs. */
+	tt_int_op(evnuma_allowed_cpus(cpus, 64), ==, n);
+
+	/* This comes out of the base's node-local slab. */
+	ev = evtimer_new(base, dummy_read_cb, NULL);
+	tt_assert(ev);
+	event_add(ev, &tv);
+	event_base_dispatch(base);
+	tt_int_op(evnuma_allowed_cpus(cpus, 64), ==, 1);
+	tt_int_op(cpus[0], ==, cpu);
+	if (evnuma_current_cpu() >= 0)
+		tt_int_op(evnuma_current_cpu(), ==, cpu);
+
+#ifdef SO_INCOMING_CPU
+	{
+		struct sockaddr_in sin;
+		int val = -1;
+		socklen_t len = sizeof(val);
+
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		sin.sin_addr.s_addr = htonl(0x7f000001);
+		lev = evconnlistener_new_bind(base, NULL, NULL,
+		    LEV_OPT_CLOSE_ON_FREE, -1, (struct sockaddr *)&sin,
+		    sizeof(sin));
+		tt_assert(lev);
+		tt_int_op(getsockopt(evconnlistener_get_fd(lev), SOL_SOCKET,
+			SO_INCOMING_CPU, &val, &len), ==, 0);
+		tt_int_op(val, ==, cpu);
+	}
+#endif
+
+end:
+	if (lev)
+		evconnlistener_free(lev);
+	if (ev)
+		event_free(ev);
+	if (base)
+		event_base_free(base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
+struct group_test {
+	int n_calls;
+	int n_items;
+	int seen[8];
+	int free_group;
+};
+
+static void
+group_cb(struct event_group *group, const struct event_group_item *items,
+    int n, void *arg)
+{
+	struct group_test *t = arg;
+	char buf[16];
+	int i;
+
+	++t->n_calls;
+	t->n_items += n;
+	for (i = 0; i < n; ++i) {
+		int idx = (int)(ev_intptr_t)items[i].arg;
+		if (items[i].what & EV_READ)
+			recv(items[i].fd, buf, sizeof(buf), 0);
+		++t->seen[idx];
+	}
+	if (t->free_group)
+		event_group_free(group);
+}
+
+static void
+test_event_group(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct event_group *group = NULL;
+	struct event *members[8];
+	evutil_socket_t pairs[8][2];
+	struct group_test t;
+	int i;
+
+	memset(&t, 0, sizeof(t));
+	for (i = 0; i < 8; ++i)
+		pairs[i][0] = pairs[i][1] = -1;
+	for (i = 0; i < 8; ++i) {
+		tt_int_op(evutil_socketpair(LOCAL_SOCKETPAIR_AF, SOCK_STREAM,
+			0, pairs[i]), ==, 0);
+		evutil_make_socket_nonblocking(pairs[i][0]);
+	}
+
+	tt_assert(event_group_new(base, NULL, NULL) == NULL);
+	group = event_group_new(base, group_cb, &t);
+	tt_assert(group);
+	tt_assert(event_group_add(group, pairs[0][0], EV_SIGNAL, NULL) == NULL);
+	for (i = 0; i < 8; ++i) {
+		members[i] = event_group_add(group, pairs[i][0], EV_READ,
+		    (void *)(ev_intptr_t)i);
+		tt_assert(members[i]);
+	}
+
+	/* Five ready sockets arrive in one batch. */
+	for (i = 0; i < 5; ++i)
+		send(pairs[i][1], "x", 1, 0);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(t.n_calls, ==, 1);
+	tt_int_op(t.n_items, ==, 5);
+	for (i = 0; i < 8; ++i)
+		tt_int_op(t.seen[i], ==, i < 5 ? 1 : 0);
+
+	/* Members are persistent; deleting or freeing one that is ready
+	 * takes it out of the batch. */
+	memset(&t, 0, sizeof(t));
+	event_active(members[5], EV_READ, 1);
+	event_active(members[6], EV_READ, 1);
+	event_active(members[7], EV_READ, 1);
+	event_del(members[6]);
+	event_free(members[7]);
+	members[7] = NULL;
+	send(pairs[0][1], "x", 1, 0);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(t.n_calls, ==, 1);
+	tt_int_op(t.n_items, ==, 2);
+	tt_int_op(t.seen[0], ==, 1);
+	tt_int_op(t.seen[5], ==, 1);
+	tt_int_op(t.seen[6], ==, 0);
+
+	/* The group can free itself, members and all, from its callback. */
+	memset(&t, 0, sizeof(t));
+	t.free_group = 1;
+	send(pairs[1][1], "x", 1, 0);
+	send(pairs[2][1], "x", 1, 0);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	group = NULL;
+	tt_int_op(t.n_calls, ==, 1);
+	tt_int_op(t.n_items, ==, 2);
+	send(pairs[3][1], "x", 1, 0);
+	event_base_loop(base, EVLOOP_NONBLOCK);
+	tt_int_op(t.n_calls, ==, 1);
+
+end:
+	if (group)
+		event_group_free(group);
+	for (i = 0; i < 8; ++i) {
+		if (pairs[i][0] >= 0)
+			EVUTIL_CLOSESOCKET(pairs[i][0]);
+		if (pairs[i][1] >= 0)
+			EVUTIL_CLOSESOCKET(pairs[i][1]);
+	}
+}
+
+static int slab_order[4];
+static int slab_n_order;
+
+static void
+slab_order_cb(evutil_socket_t fd, short what, void *arg)
+{
+	if (slab_n_order < 4)
+		slab_order[slab_n_order++] = (int)(ev_intptr_t)arg;
+}
+
+static void
+test_event_slab(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct event_base *base = data->base;
+	struct event *ev[4] = { NULL, NULL, NULL, NULL };
+	struct event *again = NULL;
+	int i;
+
+	/* Several events on one fd fire in the order they were added, even
+	 * after one in the middle goes away. */
+	for (i = 0; i < 4; ++i) {
+		ev[i] = event_new(base, data->pair[0], EV_READ|EV_PERSIST,
+		    slab_order_cb, (void *)(ev_intptr_t)i);
+		tt_assert(ev[i]);
+		tt_int_op(event_add(ev[i], NULL), ==, 0);
+	}
+	event_free(ev[1]);
+	/* Freed events get reused first. */
+	again = event_new(base, data->pair[0], EV_READ|EV_PERSIST,
+	    slab_order_cb, (void *)(ev_intptr_t)1);
+	tt_ptr_op(again, ==, ev[1]);
+	ev[1] = NULL;
+	tt_int_op(event_add(again, NULL), ==, 0);
+
+	write(data->pair[1], "x", 1);
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(slab_n_order, ==, 4);
+	tt_int_op(slab_order[0], ==, 0);
+	tt_int_op(slab_order[1], ==, 2);
+	tt_int_op(slab_order[2], ==, 3);
+	tt_int_op(slab_order[3], ==, 1);
+
+	/* Deleting the first and last leaves the others in place. */
+	event_del(ev[0]);
+	event_del(again);
+	slab_n_order = 0;
+	event_base_loop(base, EVLOOP_ONCE);
+	tt_int_op(slab_n_order, ==, 2);
+	tt_int_op(slab_order[0], ==, 2);
+	tt_int_op(slab_order[1], ==, 3);
+
+end:
+	for (i = 0; i < 4; ++i)
+		if (ev[i])
+			event_free(ev[i]);
+	if (again)
+		event_free(again);
+}
+
 static void
 test_struct_event_size(void *arg)
 {
@@ -2197,6 +3485,31 @@ struct testcase_t main_testcases[] = {
 	LEGACY(priorities, TT_FORK|TT_NEED_BASE),
 	{ "common_timeout", test_common_timeout, TT_FORK|TT_NEED_BASE,
 	  &basic_setup, NULL },
+	{ "persistent_active_timeout_wheel", test_persistent_active_timeout,
+	  TT_FORK|TT_NEED_BASE|TT_TIMER_WHEEL, &basic_setup, NULL },
+	{ "common_timeout_wheel", test_common_timeout,
+	  TT_FORK|TT_NEED_BASE|TT_TIMER_WHEEL, &basic_setup, NULL },
+	BASIC(random_timers, TT_FORK|TT_NEED_BASE),
+	{ "random_timers_wheel", test_random_timers,
+	  TT_FORK|TT_NEED_BASE|TT_TIMER_WHEEL, &basic_setup, NULL },
+	{ "persistent_active_timeout_heap4", test_persistent_active_timeout,
+	  TT_FORK|TT_NEED_BASE|TT_TIMER_HEAP4, &basic_setup, NULL },
+	{ "common_timeout_heap4", test_common_timeout,
+	  TT_FORK|TT_NEED_BASE|TT_TIMER_HEAP4, &basic_setup, NULL },
+	{ "auto_common_timeout", test_auto_common_timeout,
+	  TT_FORK|TT_NEED_BASE|TT_AUTO_TIMEOUTS, &basic_setup, NULL },
+	{ "common_timeout_auto", test_common_timeout,
+	  TT_FORK|TT_NEED_BASE|TT_AUTO_TIMEOUTS, &basic_setup, NULL },
+	{ "random_timers_auto", test_random_timers,
+	  TT_FORK|TT_NEED_BASE|TT_AUTO_TIMEOUTS, &basic_setup, NULL },
+	{ "precise_timer", test_precise_timer,
+	  TT_FORK|TT_NEED_BASE|TT_PRECISE_TIMER, &basic_setup, NULL },
+	{ "common_timeout_precise", test_common_timeout,
+	  TT_FORK|TT_NEED_BASE|TT_PRECISE_TIMER, &basic_setup, NULL },
+	{ "random_timers_precise", test_random_timers,
+	  TT_FORK|TT_NEED_BASE|TT_PRECISE_TIMER, &basic_setup, NULL },
+	{ "random_timers_heap4", test_random_timers,
+	  TT_FORK|TT_NEED_BASE|TT_TIMER_HEAP4, &basic_setup, NULL },
 
 	/* These legacy tests may not all need all of these flags. */
 	LEGACY(simpleread, TT_ISOLATED),
@@ -2215,10 +3528,27 @@ struct testcase_t main_testcases[] = {
 	LEGACY(multiple_events_for_same_fd, TT_ISOLATED),
 	LEGACY(want_only_once, TT_ISOLATED),
 	{ "event_once", test_event_once, TT_ISOLATED, &basic_setup, NULL },
+	{ "event_once_wheel", test_event_once, TT_ISOLATED|TT_TIMER_WHEEL,
+	  &basic_setup, NULL },
+	{ "event_once_heap4", test_event_once, TT_ISOLATED|TT_TIMER_HEAP4,
+	  &basic_setup, NULL },
 	{ "event_pending", test_event_pending, TT_ISOLATED, &basic_setup,
 	  NULL },
 	{ "mm_functions", test_mm_functions, TT_FORK, NULL, NULL },
 	BASIC(many_events, TT_ISOLATED),
+	{ "epoll_skip_redundant", test_epoll_skip_redundant, TT_FORK,
+	  NULL, NULL },
+	BASIC(loop_stats, TT_FORK|TT_NEED_BASE),
+	{ "clock_external", test_clock_external, TT_FORK, NULL, NULL },
+	{ "clock_sources", test_clock_sources, TT_FORK, NULL, NULL },
+	{ "simulated_time", test_simulated_time, TT_FORK, NULL, NULL },
+	{ "dispatch_budget", test_dispatch_budget, TT_FORK, NULL, NULL },
+	{ "priority_weights", test_priority_weights, TT_FORK, NULL, NULL },
+	{ "deferred_budget", test_deferred_budget, TT_FORK, NULL, NULL },
+	{ "busy_poll", test_busy_poll, TT_FORK, NULL, NULL },
+	{ "cpu_affinity", test_cpu_affinity, TT_FORK, NULL, NULL },
+	BASIC(event_group, TT_FORK|TT_NEED_BASE),
+	BASIC(event_slab, TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR),
 
 	{ "struct_event_size", test_struct_event_size, 0, NULL, NULL },
 
@@ -2248,6 +3578,8 @@ struct testcase_t signal_testcases[] = {
 	LEGACY(signal_restore, TT_ISOLATED),
 	LEGACY(signal_assert, TT_ISOLATED),
 	LEGACY(signal_while_processing, TT_ISOLATED),
+	{ "signalfd", test_signalfd, TT_FORK|TT_NEED_BASE|TT_SIGNALFD,
+	  &basic_setup, NULL },
 #endif
 	END_OF_TESTCASES
 };
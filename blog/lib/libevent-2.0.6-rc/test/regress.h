@@ -39,6 +39,7 @@ extern struct testcase_t evtag_testcases[];
 extern struct testcase_t evbuffer_testcases[];
 extern struct testcase_t bufferevent_testcases[];
 extern struct testcase_t bufferevent_iocp_testcases[];
+extern struct testcase_t bufferevent_uring_testcases[];
 extern struct testcase_t util_testcases[];
 extern struct testcase_t signal_testcases[];
 extern struct testcase_t http_testcases[];
@@ -52,6 +53,11 @@ extern struct testcase_t listener_testcases[];
 extern struct testcase_t listener_iocp_testcases[];
 
 void regress_threads(void *);
+void regress_thread_active(void *);
+void regress_thread_deferred_write(void *);
+void regress_thread_io_churn(void *);
+void regress_pool(void *);
+void regress_pool_numa(void *);
 void test_bufferevent_zlib(void *);
 
 /* Helpers to wrap old testcases */
@@ -86,6 +92,12 @@ void run_legacy_test_fn(void *ptr);
 #define TT_NO_LOGS		(TT_FIRST_USER_FLAG<<5)
 #define TT_ENABLE_IOCP_FLAG	(TT_FIRST_USER_FLAG<<6)
 #define TT_ENABLE_IOCP		(TT_ENABLE_IOCP_FLAG|TT_NEED_THREADS)
+#define TT_TIMER_WHEEL		(TT_FIRST_USER_FLAG<<7)
+#define TT_TIMER_HEAP4		(TT_FIRST_USER_FLAG<<8)
+#define TT_URING_BEV		(TT_FIRST_USER_FLAG<<9)
+#define TT_AUTO_TIMEOUTS	(TT_FIRST_USER_FLAG<<10)
+#define TT_SIGNALFD		(TT_FIRST_USER_FLAG<<11)
+#define TT_PRECISE_TIMER	(TT_FIRST_USER_FLAG<<12)
 
 /* All the flags that a legacy test needs. */
 #define TT_ISOLATED TT_FORK|TT_NEED_SOCKETPAIR|TT_NEED_BASE
@@ -115,8 +115,10 @@ errorcb(struct bufferevent *bev, short what, void *arg)
 	test_ok = -2;
 }
 
+/* If 'base' is set, make socket bufferevents with bufferevent_socket_new()
+ * on it, instead of with bufferevent_new() on the current base. */
 static void
-test_bufferevent_impl(int use_pair)
+test_bufferevent_impl(int use_pair, struct event_base *base)
 {
 	struct bufferevent *bev1 = NULL, *bev2 = NULL;
 	char buffer[8333];
@@ -133,6 +135,13 @@ test_bufferevent_impl(int use_pair)
 		tt_ptr_op(bufferevent_get_underlying(bev1), ==, NULL);
 		tt_ptr_op(bufferevent_pair_get_partner(bev1), ==, bev2);
 		tt_ptr_op(bufferevent_pair_get_partner(bev2), ==, bev1);
+	} else if (base) {
+		bev1 = bufferevent_socket_new(base, pair[0], 0);
+		bev2 = bufferevent_socket_new(base, pair[1], 0);
+		tt_assert(bev1 && bev2);
+		bufferevent_setcb(bev1, readcb, writecb, errorcb, NULL);
+		bufferevent_setcb(bev2, readcb, writecb, errorcb, NULL);
+		tt_int_op(bufferevent_getfd(bev1), ==, pair[0]);
 	} else {
 		bev1 = bufferevent_new(pair[0], readcb, writecb, errorcb, NULL);
 		bev2 = bufferevent_new(pair[1], readcb, writecb, errorcb, NULL);
@@ -153,7 +162,10 @@ test_bufferevent_impl(int use_pair)
 
 	bufferevent_write(bev1, buffer, sizeof(buffer));
 
-	event_dispatch();
+	if (base)
+		event_base_dispatch(base);
+	else
+		event_dispatch();
 
 	bufferevent_free(bev1);
 	tt_ptr_op(bufferevent_pair_get_partner(bev2), ==, NULL);
@@ -168,13 +180,27 @@ end:
 static void
 test_bufferevent(void)
 {
-	test_bufferevent_impl(0);
+	test_bufferevent_impl(0, NULL);
 }
 
 static void
 test_bufferevent_pair(void)
 {
-	test_bufferevent_impl(1);
+	test_bufferevent_impl(1, NULL);
+}
+
+static void
+test_bufferevent_on_base(void *arg)
+{
+	struct basic_test_data *data = arg;
+
+	test_ok = 0;
+	pair[0] = data->pair[0];
+	pair[1] = data->pair[1];
+	test_bufferevent_impl(0, data->base);
+	tt_int_op(test_ok, ==, 2);
+end:
+	;
 }
 
 /*
@@ -221,7 +247,8 @@ wm_errorcb(struct bufferevent *bev, short what, void *arg)
 }
 
 static void
-test_bufferevent_watermarks_impl(int use_pair)
+test_bufferevent_watermarks_impl(int use_pair, struct event_base *base,
+    int options)
 {
 	struct bufferevent *bev1 = NULL, *bev2 = NULL;
 	char buffer[65000];
@@ -235,6 +262,12 @@ test_bufferevent_watermarks_impl(int use_pair)
 		bev2 = pair[1];
 		bufferevent_setcb(bev1, NULL, wm_writecb, errorcb, NULL);
 		bufferevent_setcb(bev2, wm_readcb, NULL, errorcb, NULL);
+	} else if (base) {
+		bev1 = bufferevent_socket_new(base, pair[0], options);
+		bev2 = bufferevent_socket_new(base, pair[1], options);
+		tt_assert(bev1 && bev2);
+		bufferevent_setcb(bev1, NULL, wm_writecb, wm_errorcb, NULL);
+		bufferevent_setcb(bev2, wm_readcb, NULL, wm_errorcb, NULL);
 	} else {
 		bev1 = bufferevent_new(pair[0], NULL, wm_writecb, wm_errorcb, NULL);
 		bev2 = bufferevent_new(pair[1], wm_readcb, NULL, wm_errorcb, NULL);
@@ -254,7 +287,10 @@ test_bufferevent_watermarks_impl(int use_pair)
 
 	bufferevent_write(bev1, buffer, sizeof(buffer));
 
-	event_dispatch();
+	if (base)
+		event_base_dispatch(base);
+	else
+		event_dispatch();
 
 	tt_int_op(test_ok, ==, 2);
 
@@ -270,13 +306,118 @@ end:
 static void
 test_bufferevent_watermarks(void)
 {
-	test_bufferevent_watermarks_impl(0);
+	test_bufferevent_watermarks_impl(0, NULL, 0);
 }
 
 static void
 test_bufferevent_pair_watermarks(void)
 {
-	test_bufferevent_watermarks_impl(1);
+	test_bufferevent_watermarks_impl(1, NULL, 0);
+}
+
+static void
+test_bufferevent_watermarks_on_base(void *arg)
+{
+	struct basic_test_data *data = arg;
+
+	pair[0] = data->pair[0];
+	pair[1] = data->pair[1];
+	test_bufferevent_watermarks_impl(0, data->base, 0);
+}
+
+/*
+ * test edge-triggered socket bufferevents
+ */
+
+static void
+test_bufferevent_watermarks_et(void *arg)
+{
+	struct basic_test_data *data = arg;
+
+	pair[0] = data->pair[0];
+	pair[1] = data->pair[1];
+	test_bufferevent_watermarks_impl(0, data->base,
+	    BEV_OPT_EDGE_TRIGGERED);
+}
+
+#define ET_BULK_LEN (1024*1024)
+
+struct et_bulk {
+	size_t received;
+	int n_readcbs;
+	int ok;
+};
+
+static void
+et_bulk_readcb(struct bufferevent *bev, void *arg)
+{
+	struct et_bulk *b = arg;
+	struct evbuffer *input = bufferevent_get_input(bev);
+	unsigned char buf[1024];
+	size_t n;
+
+	++b->n_readcbs;
+	/* Reaching the high-water mark suspends reading, but the read
+	 * event stays where it is. */
+	if (!event_pending(&bev->ev_read, EV_READ, NULL))
+		b->ok = 0;
+	while ((n = evbuffer_remove(input, buf, sizeof(buf))) > 0) {
+		size_t i;
+		for (i = 0; i < n; ++i) {
+			if (buf[i] != (unsigned char)((b->received + i) % 251))
+				b->ok = 0;
+		}
+		b->received += n;
+	}
+	if (b->received == ET_BULK_LEN)
+		event_base_loopexit(bev->ev_base, NULL);
+}
+
+static void
+test_bufferevent_et_bulk(void *arg)
+{
+	struct basic_test_data *data = arg;
+	struct bufferevent *bev1 = NULL, *bev2 = NULL;
+	struct et_bulk b = { 0, 0, 1 };
+	unsigned char *buffer = NULL;
+	size_t i;
+
+	if (!(event_base_get_features(data->base) & EV_FEATURE_ET))
+		tt_skip();
+
+	buffer = malloc(ET_BULK_LEN);
+	tt_assert(buffer);
+	for (i = 0; i < ET_BULK_LEN; ++i)
+		buffer[i] = (unsigned char)(i % 251);
+
+	bev1 = bufferevent_socket_new(data->base, data->pair[0],
+	    BEV_OPT_EDGE_TRIGGERED);
+	bev2 = bufferevent_socket_new(data->base, data->pair[1],
+	    BEV_OPT_EDGE_TRIGGERED);
+	tt_assert(bev1 && bev2);
+	tt_assert(bev1->ev_read.ev_events & EV_ET);
+	bufferevent_setcb(bev2, et_bulk_readcb, NULL, NULL, &b);
+	bufferevent_setwatermark(bev2, EV_READ, 0, 32768);
+	bufferevent_enable(bev1, EV_WRITE);
+	bufferevent_enable(bev2, EV_READ);
+
+	tt_int_op(bufferevent_write(bev1, buffer, ET_BULK_LEN), ==, 0);
+	event_base_dispatch(data->base);
+
+	tt_int_op(b.received, ==, ET_BULK_LEN);
+	tt_assert(b.ok);
+	/* Each callback should have read up to the high-water mark, not
+	 * just one evbuffer_read()'s worth. */
+	tt_int_op(b.n_readcbs, <, ET_BULK_LEN / 4096);
+	TT_BLATHER(("%d read callbacks", b.n_readcbs));
+
+end:
+	if (bev1)
+		bufferevent_free(bev1);
+	if (bev2)
+		bufferevent_free(bev2);
+	if (buffer)
+		free(buffer);
 }
 
 /*
@@ -772,6 +913,151 @@ end:
 		bufferevent_free(bev2);
 }
 
+struct setfd_result {
+	struct event_base *base;
+	struct evbuffer *got;
+};
+
+static void
+setfd_read_cb(struct bufferevent *bev, void *arg)
+{
+	struct setfd_result *res = arg;
+	evbuffer_add_buffer(res->got, bufferevent_get_input(bev));
+	if (evbuffer_get_length(res->got) >= 6)
+		event_base_loopexit(res->base, NULL);
+}
+
+static void
+test_bufferevent_setfd(void *arg)
+{
+	/* A bufferevent made without an fd should start reading and
+	 * writing once it is given one. */
+	struct basic_test_data *data = arg;
+	struct bufferevent *bev = NULL;
+	struct setfd_result res;
+	struct evbuffer *got = evbuffer_new();
+	struct timeval tv = { 2, 0 };
+	char buf[16];
+	int n;
+
+	res.base = data->base;
+	res.got = got;
+	bev = bufferevent_socket_new(data->base, -1, 0);
+	tt_assert(bev);
+	bufferevent_setcb(bev, setfd_read_cb, NULL, NULL, &res);
+	bufferevent_enable(bev, EV_READ|EV_WRITE);
+	bufferevent_write(bev, "pong\n", 5);
+
+	tt_int_op(bufferevent_setfd(bev, data->pair[0]), ==, 0);
+	tt_int_op(bufferevent_getfd(bev), ==, data->pair[0]);
+	tt_int_op(send(data->pair[1], "ping\n", 5, 0), ==, 5);
+	tt_int_op(send(data->pair[1], "!", 1, 0), ==, 1);
+
+	event_base_loopexit(data->base, &tv);
+	event_base_dispatch(data->base);
+
+	tt_int_op(evbuffer_get_length(got), ==, 6);
+	tt_assert(!memcmp(evbuffer_pullup(got, -1), "ping\n!", 6));
+	n = recv(data->pair[1], buf, sizeof(buf), 0);
+	tt_int_op(n, ==, 5);
+	tt_assert(!memcmp(buf, "pong\n", 5));
+
+end:
+	if (bev)
+		bufferevent_free(bev);
+	evbuffer_free(got);
+}
+
+/* A client pings a server over a bufferevent pair every 20 seconds for a
+ * day, in simulated time.  The server drops the connection after 30 idle
+ * seconds, which should be exactly 30 seconds after the last ping. */
+struct sim_keepalive {
+	struct event_base *base;
+	struct bufferevent *client, *server;
+	struct event *pinger;
+	int n_pings, n_received;
+	struct timeval last_ping, timed_out;
+};
+
+static void
+sim_ping_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct sim_keepalive *k = arg;
+	bufferevent_write(k->client, "ping", 4);
+	event_base_gettimeofday_cached(k->base, &k->last_ping);
+	if (++k->n_pings == 24 * 60 * 3)
+		event_del(k->pinger);
+}
+
+static void
+sim_server_read_cb(struct bufferevent *bev, void *arg)
+{
+	struct sim_keepalive *k = arg;
+	struct evbuffer *input = bufferevent_get_input(bev);
+	k->n_received += evbuffer_get_length(input) / 4;
+	evbuffer_drain(input, evbuffer_get_length(input));
+}
+
+static void
+sim_server_event_cb(struct bufferevent *bev, short what, void *arg)
+{
+	struct sim_keepalive *k = arg;
+	if (what & BEV_EVENT_TIMEOUT) {
+		event_base_gettimeofday_cached(k->base, &k->timed_out);
+		bufferevent_disable(bev, EV_READ);
+	}
+}
+
+static void
+test_bufferevent_pair_simulated(void *arg)
+{
+	struct event_config *cfg = NULL;
+	struct sim_keepalive k;
+	struct bufferevent *pair[2] = { NULL, NULL };
+	struct timeval sec20 = { 20, 0 }, sec30 = { 30, 0 }, idle;
+
+	memset(&k, 0, sizeof(k));
+	cfg = event_config_new();
+	tt_assert(cfg);
+	event_config_set_clock(cfg, EVENT_CLOCK_SIMULATED);
+	k.base = event_base_new_with_config(cfg);
+	tt_assert(k.base);
+
+	tt_int_op(bufferevent_pair_new(k.base, 0, pair), ==, 0);
+	k.client = pair[0];
+	k.server = pair[1];
+	bufferevent_setcb(k.server, sim_server_read_cb, NULL,
+	    sim_server_event_cb, &k);
+	bufferevent_set_timeouts(k.server, &sec30, NULL);
+	bufferevent_enable(k.client, EV_WRITE);
+	bufferevent_enable(k.server, EV_READ);
+
+	k.pinger = event_new(k.base, -1, EV_PERSIST, sim_ping_cb, &k);
+	tt_assert(k.pinger);
+	event_add(k.pinger, &sec20);
+
+	event_base_dispatch(k.base);
+
+	tt_int_op(k.n_pings, ==, 24 * 60 * 3);
+	tt_int_op(k.n_received, ==, k.n_pings);
+	tt_assert(evutil_timerisset(&k.timed_out));
+	evutil_timersub(&k.timed_out, &k.last_ping, &idle);
+	tt_int_op(idle.tv_sec, ==, 30);
+	tt_int_op(idle.tv_usec, ==, 0);
+
+end:
+	if (k.pinger)
+		event_free(k.pinger);
+	if (pair[0])
+		bufferevent_free(pair[0]);
+	if (pair[1])
+		bufferevent_free(pair[1]);
+	if (k.base)
+		event_base_free(k.base);
+	if (cfg)
+		event_config_free(cfg);
+}
+
 struct testcase_t bufferevent_testcases[] = {
 
 	LEGACY(bufferevent, TT_ISOLATED),
@@ -802,6 +1088,14 @@ struct testcase_t bufferevent_testcases[] = {
 	  TT_FORK|TT_NEED_BASE, &basic_setup, (void*)"filter" },
 	{ "bufferevent_timeout_filter_pair", test_bufferevent_timeouts,
 	  TT_FORK|TT_NEED_BASE, &basic_setup, (void*)"filter pair" },
+	{ "bufferevent_setfd", test_bufferevent_setfd,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR, &basic_setup, NULL },
+	{ "bufferevent_pair_simulated", test_bufferevent_pair_simulated,
+	  TT_FORK, NULL, NULL },
+	{ "bufferevent_watermarks_et", test_bufferevent_watermarks_et,
+	  TT_ISOLATED, &basic_setup, NULL },
+	{ "bufferevent_et_bulk", test_bufferevent_et_bulk,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR, &basic_setup, NULL },
 #ifdef _EVENT_HAVE_LIBZ
 	LEGACY(bufferevent_zlib, TT_ISOLATED),
 #else
@@ -834,3 +1128,33 @@ struct testcase_t bufferevent_iocp_testcases[] = {
 
 	END_OF_TESTCASES,
 };
+
+/* Some of the same tests, with bufferevents that read and write with
+ * io_uring. */
+struct testcase_t bufferevent_uring_testcases[] = {
+
+	{ "bufferevent", test_bufferevent_on_base,
+	  TT_ISOLATED|TT_URING_BEV, &basic_setup, NULL },
+	{ "bufferevent_watermarks", test_bufferevent_watermarks_on_base,
+	  TT_ISOLATED|TT_URING_BEV, &basic_setup, NULL },
+	{ "bufferevent_connect", test_bufferevent_connect,
+	  TT_FORK|TT_NEED_BASE|TT_URING_BEV, &basic_setup, (void*)"" },
+	{ "bufferevent_connect_defer", test_bufferevent_connect,
+	  TT_FORK|TT_NEED_BASE|TT_URING_BEV, &basic_setup, (void*)"defer" },
+	{ "bufferevent_connect_lock", test_bufferevent_connect,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_THREADS|TT_URING_BEV, &basic_setup,
+	  (void*)"lock" },
+	{ "bufferevent_connect_lock_defer", test_bufferevent_connect,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_THREADS|TT_URING_BEV, &basic_setup,
+	  (void*)"defer lock" },
+	{ "bufferevent_connect_fail", test_bufferevent_connect_fail,
+	  TT_FORK|TT_NEED_BASE|TT_URING_BEV, &basic_setup, NULL },
+	{ "bufferevent_timeout", test_bufferevent_timeouts,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR|TT_URING_BEV, &basic_setup,
+	  (void*)"" },
+	{ "bufferevent_setfd", test_bufferevent_setfd,
+	  TT_FORK|TT_NEED_BASE|TT_NEED_SOCKETPAIR|TT_URING_BEV, &basic_setup,
+	  NULL },
+
+	END_OF_TESTCASES,
+};
@@ -2639,6 +2639,271 @@ http_terminate_chunked_test(void)
 		evhttp_free(http);
 }
 
+/* counts the callbacks seen by http_on_complete_test */
+static int on_complete_calls;
+
+static void
+http_on_complete_done_cb(struct evhttp_request *req, void *arg)
+{
+	struct timeval start;
+
+	evhttp_request_get_start_time(req, &start);
+	if (evhttp_request_get_response_code(req) == HTTP_OK &&
+	    evutil_timerisset(&start))
+		++on_complete_calls;
+	if (++test_ok == 2)
+		event_loopexit(NULL);
+}
+
+static void
+http_on_complete_cb(struct evhttp_request *req, void *arg)
+{
+	struct evbuffer *evb = evbuffer_new();
+
+	evhttp_request_set_on_complete_cb(req, http_on_complete_done_cb, NULL);
+	evbuffer_add_printf(evb, BASIC_REQUEST_BODY);
+	evhttp_send_reply(req, HTTP_OK, "Everything is fine", evb);
+	evbuffer_free(evb);
+}
+
+static void
+http_on_complete_request_done(struct evhttp_request *req, void *arg)
+{
+	/* the client side should never see the server's completion hook */
+	if (req->response_code != HTTP_OK || on_complete_calls > 1)
+		test_ok = -10;
+	else if (++test_ok == 2)
+		event_loopexit(NULL);
+}
+
+static void
+http_on_complete_test(void)
+{
+	short port = -1;
+	struct evhttp_connection *evcon = NULL;
+	struct evhttp_request *req = NULL;
+
+	test_ok = 0;
+	on_complete_calls = 0;
+
+	http = http_setup(&port, NULL);
+	tt_assert(evhttp_set_cb(http, "/oncomplete",
+		http_on_complete_cb, NULL) == 0);
+
+	evcon = evhttp_connection_new("127.0.0.1", port);
+	tt_assert(evcon);
+
+	req = evhttp_request_new(http_on_complete_request_done, NULL);
+	evhttp_add_header(req->output_headers, "Host", "somehost");
+	evhttp_add_header(req->output_headers, "Connection", "close");
+
+	if (evhttp_make_request(evcon, req, EVHTTP_REQ_GET,
+		"/oncomplete") == -1) {
+		tt_abort_msg("Couldn't make request");
+	}
+
+	event_dispatch();
+
+	tt_int_op(test_ok, ==, 2);
+	tt_int_op(on_complete_calls, ==, 1);
+
+ end:
+	if (evcon)
+		evhttp_connection_free(evcon);
+	if (http)
+		evhttp_free(http);
+}
+
+static void
+http_default_header_cb(struct evhttp_request *req, void *arg)
+{
+	struct evbuffer *evb = evbuffer_new();
+
+	/* overrides the server's default Content-Type */
+	evhttp_add_header(req->output_headers, "Content-Type", "text/plain");
+	evbuffer_add_printf(evb, BASIC_REQUEST_BODY);
+	evhttp_send_reply(req, HTTP_OK, "Everything is fine", evb);
+	evbuffer_free(evb);
+}
+
+static void
+http_default_header_done(struct evhttp_request *req, void *arg)
+{
+	const char *want_type = arg;
+	const char *type = evhttp_find_header(req->input_headers,
+	    "Content-Type");
+	const char *extra = evhttp_find_header(req->input_headers,
+	    "X-Default");
+	struct evkeyval *header;
+	int types = 0;
+
+	TAILQ_FOREACH(header, req->input_headers, next) {
+		if (!evutil_ascii_strcasecmp(header->key, "Content-Type"))
+			++types;
+	}
+
+	/* A reply without a body gets no default Content-Type. */
+	if (req->response_code != HTTP_OK ||
+	    evhttp_find_header(req->input_headers, "Date") == NULL ||
+	    (want_type == NULL ? type != NULL :
+		(type == NULL || strcmp(type, want_type) || types != 1)) ||
+	    extra == NULL || strcmp(extra, "yes")) {
+		test_ok = -10;
+		event_loopexit(NULL);
+		return;
+	}
+
+	if (++test_ok == 3)
+		event_loopexit(NULL);
+}
+
+static void
+http_default_header_test(void)
+{
+	short port = -1;
+	struct evhttp_connection *evcon = NULL;
+	struct evhttp_request *req = NULL;
+
+	test_ok = 0;
+
+	http = http_setup(&port, NULL);
+	tt_assert(evhttp_add_default_header(http, "Content-Type",
+		"text/html; charset=utf-8") == 0);
+	tt_assert(evhttp_add_default_header(http, "X-Default", "yes") == 0);
+	tt_assert(evhttp_add_default_header(http, "X-Bad", "a\r\nb") == -1);
+	tt_assert(evhttp_set_cb(http, "/defaultheader",
+		http_default_header_cb, NULL) == 0);
+
+	evcon = evhttp_connection_new("127.0.0.1", port);
+	tt_assert(evcon);
+
+	req = evhttp_request_new(http_default_header_done,
+	    (void *)"text/html; charset=utf-8");
+	evhttp_add_header(req->output_headers, "Host", "somehost");
+	if (evhttp_make_request(evcon, req, EVHTTP_REQ_GET, "/test") == -1)
+		tt_abort_msg("Couldn't make request");
+
+	req = evhttp_request_new(http_default_header_done,
+	    (void *)"text/plain");
+	evhttp_add_header(req->output_headers, "Host", "somehost");
+	if (evhttp_make_request(evcon, req, EVHTTP_REQ_GET,
+		"/defaultheader") == -1)
+		tt_abort_msg("Couldn't make request");
+
+	req = evhttp_request_new(http_default_header_done, NULL);
+	evhttp_add_header(req->output_headers, "Host", "somehost");
+	if (evhttp_make_request(evcon, req, EVHTTP_REQ_HEAD, "/test") == -1)
+		tt_abort_msg("Couldn't make request");
+
+	event_dispatch();
+
+	tt_int_op(test_ok, ==, 3);
+
+ end:
+	if (evcon)
+		evhttp_connection_free(evcon);
+	if (http)
+		evhttp_free(http);
+}
+
+/* counts the requests freed with an on-free callback set */
+static int on_free_calls;
+
+static void
+http_on_free_done_cb(struct evhttp_request *req, void *arg)
+{
+	++on_free_calls;
+}
+
+static void
+http_on_free_cb(struct evhttp_request *req, void *arg)
+{
+	struct evbuffer *evb;
+
+	evhttp_request_set_on_free_cb(req, http_on_free_done_cb, NULL);
+	if (arg != NULL) {
+		/* never answered: freed along with its connection */
+		event_loopexit(NULL);
+		return;
+	}
+	evb = evbuffer_new();
+	evbuffer_add_printf(evb, BASIC_REQUEST_BODY);
+	evhttp_send_reply(req, HTTP_OK, "Everything is fine", evb);
+	evbuffer_free(evb);
+}
+
+static void
+http_idle_check_cb(evutil_socket_t fd, short what, void *arg)
+{
+	/* the keep-alive connection is waiting for its next request */
+	if (on_free_calls == 1 && evhttp_get_connection_count(http) == 1 &&
+	    evhttp_close_idle_connections(http) == 1 &&
+	    evhttp_get_connection_count(http) == 0)
+		test_ok = 1;
+	event_loopexit(NULL);
+}
+
+static void
+http_on_free_request_done(struct evhttp_request *req, void *arg)
+{
+	struct timeval tv = { 0, 100 * 1000 };
+
+	if (req->response_code != HTTP_OK) {
+		test_ok = -10;
+		event_loopexit(NULL);
+		return;
+	}
+	event_once(-1, EV_TIMEOUT, http_idle_check_cb, NULL, &tv);
+}
+
+static void
+http_on_free_test(void)
+{
+	short port = -1;
+	struct evhttp_connection *evcon = NULL;
+	struct evhttp_request *req = NULL;
+
+	test_ok = 0;
+	on_free_calls = 0;
+
+	http = http_setup(&port, NULL);
+	tt_assert(evhttp_set_cb(http, "/onfree", http_on_free_cb, NULL) == 0);
+	tt_assert(evhttp_set_cb(http, "/noreply", http_on_free_cb,
+		(void *)"noreply") == 0);
+
+	evcon = evhttp_connection_new("127.0.0.1", port);
+	tt_assert(evcon);
+	req = evhttp_request_new(http_on_free_request_done, NULL);
+	evhttp_add_header(req->output_headers, "Host", "somehost");
+	if (evhttp_make_request(evcon, req, EVHTTP_REQ_GET, "/onfree") == -1)
+		tt_abort_msg("Couldn't make request");
+	event_dispatch();
+	tt_int_op(test_ok, ==, 1);
+	evhttp_connection_free(evcon);
+
+	/* A request that is never answered is still freed, and counted as
+	 * an open connection until then. */
+	evcon = evhttp_connection_new("127.0.0.1", port);
+	tt_assert(evcon);
+	req = evhttp_request_new(http_on_free_request_done, NULL);
+	evhttp_add_header(req->output_headers, "Host", "somehost");
+	if (evhttp_make_request(evcon, req, EVHTTP_REQ_GET, "/noreply") == -1)
+		tt_abort_msg("Couldn't make request");
+	event_dispatch();
+	tt_int_op(evhttp_get_connection_count(http), ==, 1);
+	tt_int_op(evhttp_close_idle_connections(http), ==, 0);
+	tt_int_op(on_free_calls, ==, 1);
+	evhttp_free(http);
+	http = NULL;
+	tt_int_op(on_free_calls, ==, 2);
+
+ end:
+	if (evcon)
+		evhttp_connection_free(evcon);
+	if (http)
+		evhttp_free(http);
+}
+
 #define HTTP_LEGACY(name)						\
 	{ #name, run_legacy_test_fn, TT_ISOLATED|TT_LEGACY, &legacy_setup, \
 		    http_##name##_test }
@@ -2679,6 +2944,9 @@ struct testcase_t http_testcases[] = {
 
 	HTTP_LEGACY(connection_retry),
 	HTTP_LEGACY(data_length_constraints),
+	HTTP_LEGACY(on_complete),
+	HTTP_LEGACY(default_header),
+	HTTP_LEGACY(on_free),
 
 	END_OF_TESTCASES
 };
@@ -201,13 +201,49 @@ basic_test_setup(const struct testcase_t *testcase)
 		}
 	}
 	if (testcase->flags & TT_NEED_BASE) {
-		if (testcase->flags & TT_LEGACY)
+		if (testcase->flags & TT_LEGACY) {
 			base = event_init();
-		else
+		} else if (testcase->flags &
+		    (TT_TIMER_WHEEL|TT_TIMER_HEAP4|TT_URING_BEV|
+			TT_AUTO_TIMEOUTS|TT_SIGNALFD|TT_PRECISE_TIMER)) {
+			struct event_config *cfg = event_config_new();
+			if (!cfg)
+				exit(1);
+			if (testcase->flags & TT_TIMER_WHEEL)
+				event_config_set_flag(cfg,
+				    EVENT_BASE_FLAG_TIMER_WHEEL);
+			if (testcase->flags & TT_TIMER_HEAP4)
+				event_config_set_flag(cfg,
+				    EVENT_BASE_FLAG_TIMER_HEAP4);
+			if (testcase->flags & TT_URING_BEV)
+				event_config_set_flag(cfg,
+				    EVENT_BASE_FLAG_URING_BUFFEREVENTS);
+			if (testcase->flags & TT_AUTO_TIMEOUTS)
+				event_config_set_flag(cfg,
+				    EVENT_BASE_FLAG_AUTO_COMMON_TIMEOUTS);
+			if (testcase->flags & TT_SIGNALFD)
+				event_config_set_flag(cfg,
+				    EVENT_BASE_FLAG_SIGNALFD);
+			if (testcase->flags & TT_PRECISE_TIMER) {
+				/* io_uring ignores the flag; test epoll. */
+				event_config_set_flag(cfg,
+				    EVENT_BASE_FLAG_PRECISE_TIMER);
+				event_config_avoid_method(cfg, "io_uring");
+			}
+			base = event_base_new_with_config(cfg);
+			event_config_free(cfg);
+		} else {
 			base = event_base_new();
+		}
 		if (!base)
 			exit(1);
 	}
+	if (testcase->flags & TT_URING_BEV) {
+		if (strcmp(event_base_get_method(base), "io_uring")) {
+			event_base_free(base);
+			return (void*)TT_SKIP;
+		}
+	}
 	if (testcase->flags & TT_ENABLE_IOCP_FLAG) {
 		if (event_base_start_iocp(base)<0) {
 			event_base_free(base);
@@ -329,8 +365,19 @@ const struct testcase_setup_t legacy_setup = {
 struct testcase_t thread_testcases[] = {
 #if defined(_EVENT_HAVE_PTHREADS) && !defined(_EVENT_DISABLE_THREAD_SUPPORT)
 	{ "pthreads", regress_threads, TT_FORK, NULL, NULL, },
+	{ "active", regress_thread_active, TT_FORK, NULL, NULL, },
+	{ "deferred_write", regress_thread_deferred_write, TT_FORK, NULL,
+	  NULL, },
+	{ "io_churn", regress_thread_io_churn, TT_FORK, NULL, NULL, },
+	{ "pool", regress_pool, TT_FORK, NULL, NULL, },
+	{ "pool_numa", regress_pool_numa, TT_FORK, NULL, NULL, },
 #else
 	{ "pthreads", NULL, TT_SKIP, NULL, NULL },
+	{ "active", NULL, TT_SKIP, NULL, NULL },
+	{ "deferred_write", NULL, TT_SKIP, NULL, NULL },
+	{ "io_churn", NULL, TT_SKIP, NULL, NULL },
+	{ "pool", NULL, TT_SKIP, NULL, NULL },
+	{ "pool_numa", NULL, TT_SKIP, NULL, NULL },
 #endif
 	END_OF_TESTCASES
 };
@@ -343,6 +390,7 @@ struct testgroup_t testgroups[] = {
 	{ "signal/", signal_testcases },
 	{ "util/", util_testcases },
 	{ "bufferevent/", bufferevent_testcases },
+	{ "bufferevent/uring/", bufferevent_uring_testcases },
 	{ "http/", http_testcases },
 	{ "dns/", dns_testcases },
 	{ "evtag/", evtag_testcases },
@@ -30,6 +30,7 @@
 #include "tinytest.h"
 #include "tinytest_macros.h"
 #include "../minheap-internal.h"
+#include "../minheap4-internal.h"
 
 static void
 set_random_timeout(struct event *ev)
@@ -92,7 +93,69 @@ end:
 	min_heap_dtor(&heap);
 }
 
+static void
+check_heap4(struct min_heap4 *heap)
+{
+	unsigned i;
+	tt_want(heap->n == 0 || ((ev_uintptr_t)&heap->p[1] & 63) == 0);
+	for (i = 0; i < heap->n; ++i) {
+		struct event *ev = heap->p[i].ev;
+		tt_want(ev->ev_timeout_pos.min_heap_idx == (int)i);
+		tt_want(heap->p[i].key == min_heap4_key(&ev->ev_timeout));
+		if (i > 0)
+			tt_want(heap->p[i].key >= heap->p[(i-1)/4].key);
+	}
+}
+
+static void
+test_heap4_randomized(void *ptr)
+{
+	struct min_heap4 heap;
+	struct event *inserted[1024];
+	struct event *e, *last_e;
+	int i;
+
+	min_heap4_ctor(&heap);
+
+	for (i = 0; i < 1024; ++i) {
+		inserted[i] = malloc(sizeof(struct event));
+		set_random_timeout(inserted[i]);
+		min_heap4_push(&heap, inserted[i]);
+		if (0 == (i % 100))
+			check_heap4(&heap);
+	}
+	check_heap4(&heap);
+
+	tt_assert(min_heap4_size(&heap) == 1024);
+	tt_assert(min_heap_elt_is_top(min_heap4_top(&heap)));
+
+	for (i = 0; i < 512; ++i) {
+		min_heap4_erase(&heap, inserted[i]);
+		tt_want(inserted[i]->ev_timeout_pos.min_heap_idx == -1);
+		if (0 == (i % 32))
+			check_heap4(&heap);
+	}
+	tt_assert(min_heap4_size(&heap) == 512);
+
+	last_e = min_heap4_pop(&heap);
+	while (1) {
+		e = min_heap4_pop(&heap);
+		if (!e)
+			break;
+		tt_want(evutil_timercmp(&last_e->ev_timeout,
+			&e->ev_timeout, <=));
+		last_e = e;
+	}
+	tt_assert(min_heap4_size(&heap) == 0);
+end:
+	for (i = 0; i < 1024; ++i)
+		free(inserted[i]);
+
+	min_heap4_dtor(&heap);
+}
+
 struct testcase_t minheap_testcases[] = {
 	{ "randomized", test_heap_randomized, 0, NULL, NULL },
+	{ "randomized4", test_heap4_randomized, 0, NULL, NULL },
 	END_OF_TESTCASES
 };
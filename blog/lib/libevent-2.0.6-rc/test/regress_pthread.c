@@ -27,8 +27,10 @@
 #include "event2/event-config.h"
 
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <pthread.h>
 #include <assert.h>
@@ -37,6 +39,13 @@
 #include "event2/event.h"
 #include "event2/event_struct.h"
 #include "event2/thread.h"
+#include "event2/pool.h"
+#include "event2/buffer.h"
+#include "event2/bufferevent.h"
+#include "event2/bufferevent_struct.h"
+#include "../defer-internal.h"
+#include "../bufferevent-internal.h"
+#include "../evnuma-internal.h"
 #include "regress.h"
 #include "tinytest_macros.h"
 
@@ -146,3 +155,727 @@ regress_threads(void *arg)
 end:
 	;
 }
+
+struct active_test {
+	struct event_base *base;
+	struct event ev;
+	struct deferred_cb cb;
+	struct event_group *group;
+	struct event *member;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int done;
+	int ev_calls;
+	int cb_calls;
+	int group_calls;
+	int timed_out;
+};
+
+static void
+active_test_check(struct active_test *t)
+{
+	if (t->ev_calls && t->cb_calls)
+		event_base_loopbreak(t->base);
+}
+
+static void
+active_ev_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct active_test *t = arg;
+	++t->ev_calls;
+	active_test_check(t);
+}
+
+static void
+active_deferred_cb(struct deferred_cb *cb, void *arg)
+{
+	struct active_test *t = arg;
+	++t->cb_calls;
+	active_test_check(t);
+}
+
+static void
+active_group_cb(struct event_group *group,
+    const struct event_group_item *items, int n, void *arg)
+{
+	struct active_test *t = arg;
+	++t->group_calls;
+}
+
+static void *
+active_thread(void *arg)
+{
+	struct active_test *t = arg;
+	event_active(&t->ev, EV_READ, 1);
+	event_deferred_cb_schedule(event_base_get_deferred_cb_queue(t->base),
+	    &t->cb);
+	return NULL;
+}
+
+/* Activates, then cancels, while the loop is stuck in active_block_cb. */
+static void *
+active_cancel_thread(void *arg)
+{
+	struct active_test *t = arg;
+	struct deferred_cb_queue *queue =
+	    event_base_get_deferred_cb_queue(t->base);
+
+	event_active(&t->ev, EV_READ, 1);
+	event_deferred_cb_schedule(queue, &t->cb);
+	assert(event_pending(&t->ev, EV_READ, NULL));
+	event_del(&t->ev);
+	event_deferred_cb_cancel(queue, &t->cb);
+	/* Freeing a group member has to take it out of the inbox too. */
+	event_active(t->member, EV_READ, 1);
+	event_free(t->member);
+	t->member = NULL;
+
+	assert(pthread_mutex_lock(&t->lock) == 0);
+	t->done = 1;
+	assert(pthread_cond_broadcast(&t->cond) == 0);
+	assert(pthread_mutex_unlock(&t->lock) == 0);
+	return NULL;
+}
+
+static void
+active_start_cb(evutil_socket_t fd, short what, void *arg)
+{
+	pthread_t thread;
+	pthread_create(&thread, NULL, active_thread, arg);
+	pthread_detach(thread);
+}
+
+static void
+active_block_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct active_test *t = arg;
+	struct timeval tv = { 0, 50000 };
+	pthread_t thread;
+
+	pthread_create(&thread, NULL, active_cancel_thread, t);
+	assert(pthread_mutex_lock(&t->lock) == 0);
+	while (!t->done)
+		assert(pthread_cond_wait(&t->cond, &t->lock) == 0);
+	assert(pthread_mutex_unlock(&t->lock) == 0);
+	pthread_join(thread, NULL);
+
+	/* Give the loop a chance to run anything that wasn't cancelled. */
+	event_base_loopexit(t->base, &tv);
+}
+
+static void
+active_timeout_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct active_test *t = arg;
+	t->timed_out = 1;
+	event_base_loopbreak(t->base);
+}
+
+/* event_active() and event_deferred_cb_schedule() from another thread
+ * while the loop runs, which goes through the base's inbox if it has
+ * one. */
+void
+regress_thread_active(void *arg)
+{
+	struct active_test t;
+	struct event start, timeout;
+	struct timeval tv = { 10, 0 };
+	evutil_socket_t pair[2] = { -1, -1 };
+	(void) arg;
+
+	memset(&t, 0, sizeof(t));
+	assert(pthread_mutex_init(&t.lock, NULL) == 0);
+	assert(pthread_cond_init(&t.cond, NULL) == 0);
+
+	if (evthread_use_pthreads()<0)
+		tt_abort_msg("Couldn't initialize pthreads!");
+	t.base = event_base_new();
+	tt_assert(t.base);
+
+	event_assign(&t.ev, t.base, -1, 0, active_ev_cb, &t);
+	event_deferred_cb_init(&t.cb, active_deferred_cb, &t);
+	evtimer_assign(&timeout, t.base, active_timeout_cb, &t);
+	evtimer_add(&timeout, &tv);
+
+	/* The loop has to wake up for them. */
+	evutil_timerclear(&tv);
+	evtimer_assign(&start, t.base, active_start_cb, &t);
+	evtimer_add(&start, &tv);
+	event_base_dispatch(t.base);
+	tt_int_op(t.timed_out, ==, 0);
+	tt_int_op(t.ev_calls, ==, 1);
+	tt_int_op(t.cb_calls, ==, 1);
+
+	/* Deleting and cancelling them afterwards has to work, even though
+	 * the loop hasn't looked at them yet. */
+	tt_int_op(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair), ==, 0);
+	t.group = event_group_new(t.base, active_group_cb, &t);
+	tt_assert(t.group);
+	t.member = event_group_add(t.group, pair[0], EV_READ, NULL);
+	tt_assert(t.member);
+	evtimer_assign(&start, t.base, active_block_cb, &t);
+	evtimer_add(&start, &tv);
+	event_base_dispatch(t.base);
+	tt_int_op(t.timed_out, ==, 0);
+	tt_int_op(t.ev_calls, ==, 1);
+	tt_int_op(t.cb_calls, ==, 1);
+	tt_int_op(t.group_calls, ==, 0);
+
+end:
+	if (t.group)
+		event_group_free(t.group);
+	if (t.base) {
+		event_del(&timeout);
+		event_base_free(t.base);
+	}
+	if (pair[0] >= 0)
+		EVUTIL_CLOSESOCKET(pair[0]);
+	if (pair[1] >= 0)
+		EVUTIL_CLOSESOCKET(pair[1]);
+	pthread_cond_destroy(&t.cond);
+	pthread_mutex_destroy(&t.lock);
+}
+
+struct deferred_write_test {
+	struct event_base *base;
+	struct bufferevent *sock;
+	struct bufferevent *pair[2];
+	int n_read;
+};
+
+static void
+deferred_write_read_cb(struct bufferevent *bev, void *arg)
+{
+	struct deferred_write_test *t = arg;
+	struct evbuffer *input = bufferevent_get_input(bev);
+	t->n_read += evbuffer_get_length(input);
+	evbuffer_drain(input, evbuffer_get_length(input));
+}
+
+static void *
+deferred_write_thread(void *arg)
+{
+	struct deferred_write_test *t = arg;
+	int i;
+
+	for (i = 0; i < 3; ++i) {
+		bufferevent_write(t->sock, "x", 1);
+		bufferevent_write(t->pair[0], "x", 1);
+	}
+	return NULL;
+}
+
+/* Writes from another thread while the loop is busy, so that every
+ * schedule after the first finds the deferred callback still in the
+ * inbox. */
+static void
+deferred_write_block_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct deferred_write_test *t = arg;
+	struct timeval tv = { 0, 100000 };
+	pthread_t thread;
+
+	pthread_create(&thread, NULL, deferred_write_thread, t);
+	pthread_join(thread, NULL);
+	event_base_loopexit(t->base, &tv);
+}
+
+/* Deferred callbacks that other threads schedule hold one reference on
+ * their bufferevent or evbuffer, however many times they are scheduled
+ * before the loop gets to them. */
+void
+regress_thread_deferred_write(void *arg)
+{
+	struct deferred_write_test t;
+	struct event start;
+	struct timeval tv = { 0, 0 };
+	const int options =
+	    BEV_OPT_THREADSAFE|BEV_OPT_DEFER_CALLBACKS|BEV_OPT_CLOSE_ON_FREE;
+	evutil_socket_t pair[2] = { -1, -1 };
+	char buf[16];
+	int n, got = 0;
+	(void) arg;
+
+	memset(&t, 0, sizeof(t));
+	if (evthread_use_pthreads()<0)
+		tt_abort_msg("Couldn't initialize pthreads!");
+	t.base = event_base_new();
+	tt_assert(t.base);
+	tt_int_op(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair), ==, 0);
+	evutil_make_socket_nonblocking(pair[0]);
+	evutil_make_socket_nonblocking(pair[1]);
+
+	t.sock = bufferevent_socket_new(t.base, pair[0], options);
+	tt_assert(t.sock);
+	pair[0] = -1;
+	tt_int_op(bufferevent_pair_new(t.base, options, t.pair), ==, 0);
+	bufferevent_setcb(t.pair[1], deferred_write_read_cb, NULL, NULL, &t);
+	bufferevent_enable(t.pair[1], EV_READ);
+
+	evtimer_assign(&start, t.base, deferred_write_block_cb, &t);
+	evtimer_add(&start, &tv);
+	event_base_dispatch(t.base);
+	tt_int_op(t.n_read, ==, 3);
+
+	/* Nothing is pending now, so only the references we hold are
+	 * left. */
+	tt_int_op(BEV_UPCAST(t.sock)->refcnt, ==, 1);
+	tt_int_op(BEV_UPCAST(t.pair[0])->refcnt, ==, 1);
+	tt_int_op(BEV_UPCAST(t.pair[1])->refcnt, ==, 1);
+
+	/* Freeing the socket bufferevent closes its fd. */
+	bufferevent_free(t.sock);
+	t.sock = NULL;
+	while ((n = recv(pair[1], buf, sizeof(buf), 0)) > 0)
+		got += n;
+	tt_int_op(got, ==, 3);
+	tt_int_op(n, ==, 0);
+
+end:
+	if (t.sock)
+		bufferevent_free(t.sock);
+	/* pair[0] owns the lock that the two share, so it goes last. */
+	if (t.pair[1])
+		bufferevent_free(t.pair[1]);
+	if (t.pair[0])
+		bufferevent_free(t.pair[0]);
+	if (t.base)
+		event_base_free(t.base);
+	if (pair[0] >= 0)
+		EVUTIL_CLOSESOCKET(pair[0]);
+	if (pair[1] >= 0)
+		EVUTIL_CLOSESOCKET(pair[1]);
+}
+
+#define IO_CHURN_EVENTS	16
+#define IO_CHURN_ROUNDS	5000
+
+struct io_churn_test;
+
+struct io_churn_slot {
+	struct io_churn_test *t;
+	struct event *ev;
+	int deleted;
+};
+
+struct io_churn_test {
+	struct event_base *base;
+	evutil_socket_t fd;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int n_called;
+	int n_late;
+	struct io_churn_slot slots[IO_CHURN_EVENTS];
+};
+
+static void
+io_churn_cb(evutil_socket_t fd, short what, void *arg)
+{
+	struct io_churn_slot *slot = arg;
+
+	pthread_mutex_lock(&slot->t->lock);
+	++slot->t->n_called;
+	if (slot->deleted)
+		++slot->t->n_late;
+	pthread_cond_broadcast(&slot->t->cond);
+	pthread_mutex_unlock(&slot->t->lock);
+}
+
+static void
+io_churn_keepalive_cb(evutil_socket_t fd, short what, void *arg)
+{
+}
+
+static void *
+io_churn_loop(void *arg)
+{
+	struct io_churn_test *t = arg;
+	event_base_dispatch(t->base);
+	return NULL;
+}
+
+/* The loop finds the events on a ready fd without th_base_lock, so make
+ * sure that deleting or freeing one from another thread still cancels
+ * it, even while the loop is handing it to itself. */
+void
+regress_thread_io_churn(void *arg)
+{
+	struct io_churn_test t;
+	struct io_churn_slot *slot;
+	struct event *keepalive = NULL;
+	struct timeval hour = { 3600, 0 };
+	evutil_socket_t pair[2] = { -1, -1 };
+	pthread_t thread;
+	int i, n, running = 0;
+	(void) arg;
+
+	memset(&t, 0, sizeof(t));
+	pthread_mutex_init(&t.lock, NULL);
+	pthread_cond_init(&t.cond, NULL);
+	if (evthread_use_pthreads()<0)
+		tt_abort_msg("Couldn't initialize pthreads!");
+	t.base = event_base_new();
+	tt_assert(t.base);
+	tt_int_op(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, pair), ==, 0);
+	/* We never read it, so pair[0] stays readable. */
+	tt_int_op(send(pair[1], "x", 1, 0), ==, 1);
+	t.fd = pair[0];
+
+	/* Keeps the loop going while all the io events are deleted. */
+	keepalive = event_new(t.base, -1, EV_PERSIST, io_churn_keepalive_cb,
+	    NULL);
+	tt_assert(keepalive);
+	event_add(keepalive, &hour);
+	for (i = 0; i < IO_CHURN_EVENTS; ++i) {
+		slot = &t.slots[i];
+		slot->t = &t;
+		slot->ev = event_new(t.base, t.fd, EV_READ|EV_PERSIST,
+		    io_churn_cb, slot);
+		tt_assert(slot->ev);
+		event_add(slot->ev, NULL);
+	}
+	tt_int_op(pthread_create(&thread, NULL, io_churn_loop, &t), ==, 0);
+	running = 1;
+
+	/* Each round deletes one event, or frees it and makes a new one, and
+	 * adds back the one from the round before, once the loop has run
+	 * the others for a while. */
+	for (i = 0; i < IO_CHURN_ROUNDS; ++i) {
+		slot = &t.slots[i % IO_CHURN_EVENTS];
+		/* Once this returns, the callback isn't running, and must
+		 * not run again until we add the event back. */
+		event_del(slot->ev);
+		pthread_mutex_lock(&t.lock);
+		slot->deleted = 1;
+		pthread_mutex_unlock(&t.lock);
+		if (i & 1) {
+			event_free(slot->ev);
+			slot->ev = event_new(t.base, t.fd, EV_READ|EV_PERSIST,
+			    io_churn_cb, slot);
+			tt_assert(slot->ev);
+		}
+
+		if (i) {
+			slot = &t.slots[(i - 1) % IO_CHURN_EVENTS];
+			pthread_mutex_lock(&t.lock);
+			slot->deleted = 0;
+			pthread_mutex_unlock(&t.lock);
+			event_add(slot->ev, NULL);
+		}
+
+		pthread_mutex_lock(&t.lock);
+		n = t.n_called + IO_CHURN_EVENTS;
+		while (t.n_called < n)
+			pthread_cond_wait(&t.cond, &t.lock);
+		pthread_mutex_unlock(&t.lock);
+	}
+
+	event_base_loopbreak(t.base);
+	pthread_join(thread, NULL);
+	running = 0;
+	tt_int_op(t.n_late, ==, 0);
+	tt_int_op(t.n_called, >, 0);
+
+end:
+	if (running) {
+		event_base_loopbreak(t.base);
+		pthread_join(thread, NULL);
+	}
+	for (i = 0; i < IO_CHURN_EVENTS; ++i) {
+		if (t.slots[i].ev)
+			event_free(t.slots[i].ev);
+	}
+	if (keepalive)
+		event_free(keepalive);
+	if (t.base)
+		event_base_free(t.base);
+	if (pair[0] >= 0)
+		EVUTIL_CLOSESOCKET(pair[0]);
+	if (pair[1] >= 0)
+		EVUTIL_CLOSESOCKET(pair[1]);
+	pthread_cond_destroy(&t.cond);
+	pthread_mutex_destroy(&t.lock);
+}
+
+#define POOL_LOOPS	4
+#define POOL_PRODUCERS	4
+#define POOL_POSTS	5000
+#define POOL_HOPS	1000
+
+struct pool_test {
+	struct event_base_pool *pool;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int remaining;
+	int wrong_thread;
+	int out_of_order;
+	/* Written only from the loop that owns [loop]. */
+	int last_seq[POOL_LOOPS][POOL_PRODUCERS];
+};
+
+struct pool_post {
+	struct pool_test *t;
+	int loop;
+	int producer;
+	int seq;
+};
+
+static void
+pool_done_one(struct pool_test *t)
+{
+	assert(pthread_mutex_lock(&t->lock) == 0);
+	if (--t->remaining == 0)
+		assert(pthread_cond_broadcast(&t->cond) == 0);
+	assert(pthread_mutex_unlock(&t->lock) == 0);
+}
+
+static void
+pool_post_cb(void *arg)
+{
+	struct pool_post *p = arg;
+	struct pool_test *t = p->t;
+	int cur = event_base_pool_current(t->pool);
+
+	if (cur < 0 || (p->loop >= 0 && cur != p->loop)) {
+		++t->wrong_thread;
+	} else {
+		if (p->seq <= t->last_seq[cur][p->producer])
+			++t->out_of_order;
+		t->last_seq[cur][p->producer] = p->seq;
+	}
+	pool_done_one(t);
+}
+
+static void *
+pool_producer(void *arg)
+{
+	struct pool_post *posts = arg;
+	int i;
+
+	/* Every fourth post lets the pool choose the loop. */
+	for (i = 0; i < POOL_POSTS; ++i) {
+		struct pool_post *p = &posts[i];
+		assert(event_base_pool_post(p->t->pool, p->loop, pool_post_cb,
+			p) == 0);
+	}
+	return NULL;
+}
+
+struct pool_hop {
+	struct pool_test *t;
+	int hops;
+};
+
+/* Bounces from loop to loop, posting from inside the pool. */
+static void
+pool_hop_cb(void *arg)
+{
+	struct pool_hop *h = arg;
+	int cur = event_base_pool_current(h->t->pool);
+
+	if (cur < 0) {
+		++h->t->wrong_thread;
+		pool_done_one(h->t);
+	} else if (--h->hops == 0) {
+		pool_done_one(h->t);
+	} else {
+		assert(event_base_pool_post(h->t->pool,
+			(cur + 1) % POOL_LOOPS, pool_hop_cb, h) == 0);
+	}
+}
+
+/* Tries to stop and free the pool from one of its own loops. */
+static void
+pool_free_inside_cb(void *arg)
+{
+	struct pool_test *t = arg;
+
+	if (event_base_pool_stop(t->pool) != -1)
+		++t->wrong_thread;
+	event_base_pool_free(t->pool);
+	/* Still here, so this doesn't touch freed memory. */
+	if (event_base_pool_current(t->pool) < 0)
+		++t->wrong_thread;
+	pool_done_one(t);
+}
+
+void
+regress_pool(void *arg)
+{
+	struct pool_test t;
+	struct pool_post *posts = NULL;
+	struct pool_hop hop;
+	pthread_t producers[POOL_PRODUCERS];
+	struct event ev[2];
+	int i, j;
+	(void) arg;
+
+	memset(&t, 0, sizeof(t));
+	memset(ev, 0, sizeof(ev));
+	assert(pthread_mutex_init(&t.lock, NULL) == 0);
+	assert(pthread_cond_init(&t.cond, NULL) == 0);
+
+	t.pool = event_base_pool_new(POOL_LOOPS, NULL);
+	tt_assert(t.pool);
+	tt_int_op(event_base_pool_size(t.pool), ==, POOL_LOOPS);
+	tt_assert(event_base_pool_get_base(t.pool, POOL_LOOPS) == NULL);
+	tt_int_op(event_base_pool_current(t.pool), ==, -1);
+
+	tt_int_op(event_base_pool_assign(t.pool, 6, EVENT_BASE_POOL_BY_HASH),
+	    ==, 6 % POOL_LOOPS);
+	/* Loops 0 and 1 have an event each, so 2 is the least loaded. */
+	for (i = 0; i < 2; ++i) {
+		struct timeval tv = { 1000, 0 };
+		evtimer_assign(&ev[i], event_base_pool_get_base(t.pool, i),
+		    NULL, NULL);
+		event_add(&ev[i], &tv);
+	}
+	tt_int_op(event_base_pool_assign(t.pool, 0, EVENT_BASE_POOL_BY_LOAD),
+	    ==, 2);
+	for (i = 0; i < 2; ++i)
+		event_del(&ev[i]);
+
+	/* Closures posted before the loops start run once they do. */
+	t.remaining = POOL_PRODUCERS * POOL_POSTS + 1;
+	hop.t = &t;
+	hop.hops = POOL_HOPS;
+	tt_int_op(event_base_pool_post(t.pool, 0, pool_hop_cb, &hop), ==, 0);
+	tt_int_op(event_base_pool_start(t.pool), ==, 0);
+
+	posts = calloc(POOL_PRODUCERS * POOL_POSTS, sizeof(*posts));
+	tt_assert(posts);
+	for (i = 0; i < POOL_PRODUCERS; ++i) {
+		for (j = 0; j < POOL_POSTS; ++j) {
+			struct pool_post *p = &posts[i * POOL_POSTS + j];
+			p->t = &t;
+			p->producer = i;
+			p->seq = j + 1;
+			p->loop = (j % 4 == 3) ? -1 : j % POOL_LOOPS;
+		}
+		pthread_create(&producers[i], NULL, pool_producer,
+		    &posts[i * POOL_POSTS]);
+	}
+	for (i = 0; i < POOL_PRODUCERS; ++i)
+		pthread_join(producers[i], NULL);
+
+	assert(pthread_mutex_lock(&t.lock) == 0);
+	while (t.remaining)
+		assert(pthread_cond_wait(&t.cond, &t.lock) == 0);
+	assert(pthread_mutex_unlock(&t.lock) == 0);
+
+	tt_int_op(hop.hops, ==, 0);
+	tt_int_op(t.wrong_thread, ==, 0);
+	tt_int_op(t.out_of_order, ==, 0);
+
+	tt_int_op(event_base_pool_stop(t.pool), ==, 0);
+	/* A stopped pool can be started again. */
+	tt_int_op(event_base_pool_start(t.pool), ==, 0);
+
+	/* Its own loops can neither stop nor free it. */
+	t.remaining = 1;
+	tt_int_op(event_base_pool_post(t.pool, 1, pool_free_inside_cb, &t),
+	    ==, 0);
+	assert(pthread_mutex_lock(&t.lock) == 0);
+	while (t.remaining)
+		assert(pthread_cond_wait(&t.cond, &t.lock) == 0);
+	assert(pthread_mutex_unlock(&t.lock) == 0);
+	tt_int_op(t.wrong_thread, ==, 0);
+
+end:
+	if (t.pool)
+		event_base_pool_free(t.pool);
+	if (posts)
+		free(posts);
+	pthread_cond_destroy(&t.cond);
+	pthread_mutex_destroy(&t.lock);
+}
+
+#define POOL_NUMA_LOOPS 3
+
+struct pool_numa_test {
+	struct event_base_pool *pool;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int remaining;
+	/* For each loop: how many CPUs it may run on, and which loop
+	 * EVENT_BASE_POOL_BY_NODE picked from it. */
+	int n_cpus[POOL_NUMA_LOOPS];
+	int assigned[POOL_NUMA_LOOPS];
+};
+
+static void
+pool_numa_cb(void *arg)
+{
+	struct pool_numa_test *t = arg;
+	int cpus[64];
+	int cur = event_base_pool_current(t->pool);
+
+	assert(cur >= 0 && cur < POOL_NUMA_LOOPS);
+	t->n_cpus[cur] = evnuma_allowed_cpus(cpus, 64);
+	t->assigned[cur] = event_base_pool_assign(t->pool, -1,
+	    EVENT_BASE_POOL_BY_NODE);
+
+	assert(pthread_mutex_lock(&t->lock) == 0);
+	if (--t->remaining == 0)
+		assert(pthread_cond_signal(&t->cond) == 0);
+	assert(pthread_mutex_unlock(&t->lock) == 0);
+}
+
+void
+regress_pool_numa(void *arg)
+{
+	struct pool_numa_test t;
+	struct event_config *cfg = NULL;
+	int cpus[64], n, i;
+
+	memset(&t, 0, sizeof(t));
+	pthread_mutex_init(&t.lock, NULL);
+	pthread_cond_init(&t.cond, NULL);
+
+	if ((n = evnuma_allowed_cpus(cpus, 64)) <= 0)
+		tt_skip();
+
+	cfg = event_config_new();
+	tt_assert(cfg);
+	event_config_set_flag(cfg, EVENT_BASE_FLAG_NUMA_LOCAL);
+	t.pool = event_base_pool_new(POOL_NUMA_LOOPS, cfg);
+	tt_assert(t.pool);
+	for (i = 0; i < POOL_NUMA_LOOPS; ++i) {
+		struct event_base *base = event_base_pool_get_base(t.pool, i);
+		t.assigned[i] = -1;
+		/* Loop i got the i'th CPU we may use, and its node. */
+		tt_int_op(event_base_get_numa_node(base), ==,
+		    evnuma_cpu_node(cpus[i % n]));
+	}
+
+	t.remaining = POOL_NUMA_LOOPS;
+	tt_int_op(event_base_pool_start(t.pool), ==, 0);
+	for (i = 0; i < POOL_NUMA_LOOPS; ++i)
+		tt_int_op(event_base_pool_post(t.pool, i, pool_numa_cb, &t),
+		    ==, 0);
+	assert(pthread_mutex_lock(&t.lock) == 0);
+	while (t.remaining)
+		assert(pthread_cond_wait(&t.cond, &t.lock) == 0);
+	assert(pthread_mutex_unlock(&t.lock) == 0);
+
+	for (i = 0; i < POOL_NUMA_LOOPS; ++i) {
+		struct event_base *base;
+		tt_int_op(t.n_cpus[i], ==, 1);
+		tt_int_op(t.assigned[i], >=, 0);
+		tt_int_op(t.assigned[i], <, POOL_NUMA_LOOPS);
+		/* Connections handed on from loop i stay on its node. */
+		base = event_base_pool_get_base(t.pool, t.assigned[i]);
+		tt_int_op(event_base_get_numa_node(base), ==,
+		    event_base_get_numa_node(
+			event_base_pool_get_base(t.pool, i)));
+	}
+	tt_int_op(event_base_pool_stop(t.pool), ==, 0);
+
+end:
+	if (t.pool)
+		event_base_pool_free(t.pool);
+	if (cfg)
+		event_config_free(cfg);
+	pthread_cond_destroy(&t.cond);
+	pthread_mutex_destroy(&t.lock);
+}
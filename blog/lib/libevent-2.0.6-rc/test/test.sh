@@ -34,6 +34,7 @@ setup () {
 	EVENT_NOPOLL=yes; export EVENT_NOPOLL
 	EVENT_NOSELECT=yes; export EVENT_NOSELECT
 	EVENT_NOEPOLL=yes; export EVENT_NOEPOLL
+	EVENT_NOIO_URING=yes; export EVENT_NOIO_URING
 	EVENT_NOEVPORT=yes; export EVENT_NOEVPORT
 	EVENT_NOWIN32=yes; export EVENT_NOWIN32
 }
@@ -134,6 +135,11 @@ unset EVENT_NOEPOLL
 announce "EPOLL"
 run_tests
 
+setup
+unset EVENT_NOIO_URING
+announce "IO_URING"
+run_tests
+
 setup
 unset EVENT_NOEVPORT
 announce "EVPORT"
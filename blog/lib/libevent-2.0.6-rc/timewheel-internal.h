@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _TIMEWHEEL_INTERNAL_H_
+#define _TIMEWHEEL_INTERNAL_H_
+
+/*
+  A hierarchical timing wheel: an alternative to the min_heap for an
+  event_base's (non-common) timeouts, used when the base is created with
+  EVENT_BASE_FLAG_TIMER_WHEEL.
+
+  Time is counted in millisecond ticks.  Each of TIMEWHEEL_LEVELS levels
+  has TIMEWHEEL_SLOTS slots; a slot at level L covers 64^L ticks.  An event
+  goes into the lowest level whose span reaches its deadline, so adding and
+  deleting a timeout are O(1) list operations no matter how many timeouts
+  there are.  As time passes, the slots of the higher levels are
+  "cascaded" down into the lower ones, and the level-0 slot for each tick
+  is moved onto a list of due events.
+
+  Deadlines are rounded up to a whole tick, so a timeout never fires early,
+  but may fire up to a millisecond late.  Events are linked through
+  ev_timeout_pos.ev_next_with_common_timeout, which is free because an
+  event with a common timeout never goes into the wheel.
+ */
+
+#include "event2/event-config.h"
+#include "event2/event_struct.h"
+
+#define TIMEWHEEL_BITS 6
+#define TIMEWHEEL_SLOTS (1 << TIMEWHEEL_BITS)
+#define TIMEWHEEL_LEVELS 6
+
+struct timewheel {
+	/** Every tick up to and including this one has been processed. */
+	ev_uint64_t now_tick;
+	/** Number of events in the wheel, including due ones. */
+	unsigned n;
+	/** Bit i of occupied[L] is set if slots[L][i] may be nonempty.  Bits
+	 * are cleared lazily, when we look for the next occupied slot. */
+	ev_uint64_t occupied[TIMEWHEEL_LEVELS];
+	struct event *slots[TIMEWHEEL_LEVELS][TIMEWHEEL_SLOTS];
+	/** Events too far in the future for the top level.  We look at them
+	 * again each time the top level wraps around. */
+	struct event *far;
+	/** Events whose deadline has passed, oldest first. */
+	struct event_list due;
+};
+
+struct timewheel *timewheel_new(const struct timeval *now);
+void timewheel_free(struct timewheel *w);
+
+/** Add 'ev', whose ev_timeout is already set, to the wheel. */
+void timewheel_insert(struct timewheel *w, struct event *ev);
+/** Remove 'ev' from the wheel. */
+void timewheel_erase(struct timewheel *w, struct event *ev);
+
+/** Set 'when' to a time no later than the earliest deadline in the wheel.
+ * Return 0 if the wheel is empty, 1 otherwise. */
+int timewheel_next(struct timewheel *w, struct timeval *when);
+/** Return true if no event in the wheel can expire before 'ev'. */
+int timewheel_elt_is_top(struct timewheel *w, struct event *ev);
+
+/** Move every event whose deadline is at or before 'now' onto the due
+ * list. */
+void timewheel_advance(struct timewheel *w, const struct timeval *now);
+/** Return the first due event, without removing it, or NULL. */
+struct event *timewheel_first_due(struct timewheel *w);
+/** Return some event in the wheel, or NULL if it is empty. */
+struct event *timewheel_any(struct timewheel *w);
+
+/** The clock jumped backwards by 'off' to 'now': move every deadline back
+ * by 'off' and rebuild the wheel around the new time. */
+void timewheel_correct(struct timewheel *w, const struct timeval *off,
+    const struct timeval *now);
+
+#define timewheel_empty(w) ((w)->n == 0)
+
+#endif /* _TIMEWHEEL_INTERNAL_H_ */
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2007-2010 Niels Provos and Nick Mathewson
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "event2/event-config.h"
+
+#include <sys/types.h>
+#if !defined(WIN32) && defined(_EVENT_HAVE_SYS_TIME_H)
+#include <sys/time.h>
+#endif
+#include <sys/queue.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "event-internal.h"
+#include "timewheel-internal.h"
+#include "mm-internal.h"
+#include "util-internal.h"
+
+#define SLOT_MASK (TIMEWHEEL_SLOTS - 1)
+/** Ticks covered by the whole wheel. */
+#define SPAN_BITS (TIMEWHEEL_LEVELS * TIMEWHEEL_BITS)
+#define NO_TICK (~(ev_uint64_t)0)
+
+#define wheel_link ev_timeout_pos.ev_next_with_common_timeout
+
+/** The first tick at or after 'tv'. */
+static inline ev_uint64_t
+tick_ceil(const struct timeval *tv)
+{
+	return (ev_uint64_t)tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
+}
+
+/** The last tick at or before 'tv'. */
+static inline ev_uint64_t
+tick_floor(const struct timeval *tv)
+{
+	return (ev_uint64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+}
+
+static inline int
+lowest_bit(ev_uint64_t bits)
+{
+#if defined(__GNUC__) && (__GNUC__ >= 4)
+	return __builtin_ctzll(bits);
+#else
+	int i = 0;
+	while (!(bits & 1)) {
+		bits >>= 1;
+		++i;
+	}
+	return i;
+#endif
+}
+
+/* The slot lists have no head structure of their own: tqe_prev points at
+ * whatever points to us, so an event can be unlinked without knowing which
+ * slot it is in. */
+static inline void
+list_push(struct event **head, struct event *ev)
+{
+	struct event *next = *head;
+	ev->wheel_link.tqe_next = next;
+	if (next)
+		next->wheel_link.tqe_prev = &ev->wheel_link.tqe_next;
+	*head = ev;
+	ev->wheel_link.tqe_prev = head;
+}
+
+static inline void
+list_remove(struct event *ev)
+{
+	struct event *next = ev->wheel_link.tqe_next;
+	if (next)
+		next->wheel_link.tqe_prev = ev->wheel_link.tqe_prev;
+	*ev->wheel_link.tqe_prev = next;
+}
+
+/** Put 'ev' in the right place for the current now_tick. */
+static void
+place(struct timewheel *w, struct event *ev)
+{
+	ev_uint64_t tick = tick_ceil(&ev->ev_timeout);
+	ev_uint64_t diff;
+	int level, idx;
+
+	if (tick <= w->now_tick) {
+		TAILQ_INSERT_TAIL(&w->due, ev, wheel_link);
+		return;
+	}
+	/* The level is given by the highest digit in which the deadline
+	 * differs from now. */
+	diff = tick ^ w->now_tick;
+	if (diff >> SPAN_BITS) {
+		list_push(&w->far, ev);
+		return;
+	}
+	level = 0;
+	while (diff >> ((level + 1) * TIMEWHEEL_BITS))
+		++level;
+	idx = (int)(tick >> (level * TIMEWHEEL_BITS)) & SLOT_MASK;
+	list_push(&w->slots[level][idx], ev);
+	w->occupied[level] |= (ev_uint64_t)1 << idx;
+}
+
+/** Return the first tick after now_tick at which something in the slots or
+ * the far list needs attention, or NO_TICK. */
+static ev_uint64_t
+next_tick(struct timewheel *w)
+{
+	ev_uint64_t now = w->now_tick;
+	int level;
+
+	/* Everything in a slot at some level is later than everything at the
+	 * levels below it, so the first occupied slot we find wins. */
+	for (level = 0; level < TIMEWHEEL_LEVELS; ++level) {
+		int shift = level * TIMEWHEEL_BITS;
+		int cur = (int)(now >> shift) & SLOT_MASK;
+		ev_uint64_t bits =
+		    w->occupied[level] & ~(((ev_uint64_t)2 << cur) - 1);
+		while (bits) {
+			int idx = lowest_bit(bits);
+			if (w->slots[level][idx]) {
+				return ((now >> (shift + TIMEWHEEL_BITS)) <<
+				    (shift + TIMEWHEEL_BITS)) |
+				    ((ev_uint64_t)idx << shift);
+			}
+			bits &= ~((ev_uint64_t)1 << idx);
+			w->occupied[level] &= ~((ev_uint64_t)1 << idx);
+		}
+	}
+	if (w->far)
+		return ((now >> SPAN_BITS) + 1) << SPAN_BITS;
+	return NO_TICK;
+}
+
+/** Re-place every event on the list at 'head'. */
+static void
+replace_all(struct timewheel *w, struct event **head)
+{
+	struct event *ev = *head, *next;
+	*head = NULL;
+	for (; ev; ev = next) {
+		next = ev->wheel_link.tqe_next;
+		place(w, ev);
+	}
+}
+
+/** Process tick 't', where t == now_tick. */
+static void
+run_tick(struct timewheel *w, ev_uint64_t t)
+{
+	int level;
+
+	if (!(t & (((ev_uint64_t)1 << SPAN_BITS) - 1)))
+		replace_all(w, &w->far);
+	/* Cascade any higher-level slot that starts now; its events all land
+	 * in lower levels or on the due list. */
+	for (level = TIMEWHEEL_LEVELS - 1; level > 0; --level) {
+		int shift = level * TIMEWHEEL_BITS;
+		if (t & (((ev_uint64_t)1 << shift) - 1))
+			continue;
+		replace_all(w, &w->slots[level][(t >> shift) & SLOT_MASK]);
+	}
+	replace_all(w, &w->slots[0][t & SLOT_MASK]);
+}
+
+struct timewheel *
+timewheel_new(const struct timeval *now)
+{
+	struct timewheel *w;
+
+	if ((w = mm_calloc(1, sizeof(struct timewheel))) == NULL)
+		return NULL;
+	w->now_tick = tick_floor(now);
+	TAILQ_INIT(&w->due);
+	return w;
+}
+
+void
+timewheel_free(struct timewheel *w)
+{
+	EVUTIL_ASSERT(timewheel_empty(w));
+	mm_free(w);
+}
+
+void
+timewheel_insert(struct timewheel *w, struct event *ev)
+{
+	++w->n;
+	place(w, ev);
+}
+
+void
+timewheel_erase(struct timewheel *w, struct event *ev)
+{
+	/* Anything due has been moved to the due list, and nothing else has.
+	 * That is how we know which kind of list 'ev' is on. */
+	if (tick_ceil(&ev->ev_timeout) <= w->now_tick)
+		TAILQ_REMOVE(&w->due, ev, wheel_link);
+	else
+		list_remove(ev);
+	--w->n;
+}
+
+int
+timewheel_next(struct timewheel *w, struct timeval *when)
+{
+	ev_uint64_t tick;
+
+	if (timewheel_empty(w))
+		return 0;
+	if (!TAILQ_EMPTY(&w->due)) {
+		evutil_timerclear(when);
+		return 1;
+	}
+	tick = next_tick(w);
+	EVUTIL_ASSERT(tick != NO_TICK);
+	when->tv_sec = (time_t)(tick / 1000);
+	when->tv_usec = (long)(tick % 1000) * 1000;
+	return 1;
+}
+
+int
+timewheel_elt_is_top(struct timewheel *w, struct event *ev)
+{
+	ev_uint64_t tick = tick_ceil(&ev->ev_timeout);
+	ev_uint64_t diff, start;
+	int level;
+
+	if (tick <= w->now_tick)
+		return 1;
+	diff = tick ^ w->now_tick;
+	if (diff >> SPAN_BITS) {
+		start = ((w->now_tick >> SPAN_BITS) + 1) << SPAN_BITS;
+	} else {
+		level = 0;
+		while (diff >> ((level + 1) * TIMEWHEEL_BITS))
+			++level;
+		start = (tick >> (level * TIMEWHEEL_BITS)) <<
+		    (level * TIMEWHEEL_BITS);
+	}
+	return TAILQ_EMPTY(&w->due) && start <= next_tick(w);
+}
+
+void
+timewheel_advance(struct timewheel *w, const struct timeval *now)
+{
+	ev_uint64_t target = tick_floor(now);
+	ev_uint64_t tick;
+
+	if (target <= w->now_tick)
+		return;
+	while ((tick = next_tick(w)) <= target) {
+		w->now_tick = tick;
+		run_tick(w, tick);
+	}
+	w->now_tick = target;
+}
+
+struct event *
+timewheel_first_due(struct timewheel *w)
+{
+	return TAILQ_FIRST(&w->due);
+}
+
+struct event *
+timewheel_any(struct timewheel *w)
+{
+	int level, idx;
+
+	if (timewheel_empty(w))
+		return NULL;
+	if (!TAILQ_EMPTY(&w->due))
+		return TAILQ_FIRST(&w->due);
+	for (level = 0; level < TIMEWHEEL_LEVELS; ++level) {
+		for (idx = 0; idx < TIMEWHEEL_SLOTS; ++idx) {
+			if (w->slots[level][idx])
+				return w->slots[level][idx];
+		}
+	}
+	EVUTIL_ASSERT(w->far);
+	return w->far;
+}
+
+void
+timewheel_correct(struct timewheel *w, const struct timeval *off,
+    const struct timeval *now)
+{
+	struct event *all = NULL, *ev, *next;
+	int level, idx;
+
+	/* String every event onto one list, then start over. */
+	for (ev = TAILQ_FIRST(&w->due); ev; ev = next) {
+		next = TAILQ_NEXT(ev, wheel_link);
+		ev->wheel_link.tqe_next = all;
+		all = ev;
+	}
+	for (level = 0; level < TIMEWHEEL_LEVELS; ++level) {
+		for (idx = 0; idx < TIMEWHEEL_SLOTS; ++idx) {
+			for (ev = w->slots[level][idx]; ev; ev = next) {
+				next = ev->wheel_link.tqe_next;
+				ev->wheel_link.tqe_next = all;
+				all = ev;
+			}
+		}
+	}
+	for (ev = w->far; ev; ev = next) {
+		next = ev->wheel_link.tqe_next;
+		ev->wheel_link.tqe_next = all;
+		all = ev;
+	}
+
+	memset(w->occupied, 0, sizeof(w->occupied));
+	memset(w->slots, 0, sizeof(w->slots));
+	w->far = NULL;
+	TAILQ_INIT(&w->due);
+	w->now_tick = tick_floor(now);
+
+	for (ev = all; ev; ev = next) {
+		next = ev->wheel_link.tqe_next;
+		evutil_timersub(&ev->ev_timeout, off, &ev->ev_timeout);
+		place(w, ev);
+	}
+}
@@ -0,0 +1,406 @@
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <ftw.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Throughput and latency benchmark for blog. Starts the server on loopback
+// with a posts directory of known sizes, then drives it with a built-in
+// client across a matrix of connection counts, keep-alive, pipelining
+// depth and body size. One CSV row per cell is appended to the output, so
+// runs from different builds line up side by side.
+//
+// Usage: bench <blog binary> <out.csv> [label] [seconds per cell]
+
+static const int CONNECTIONS[] = { 1, 16, 64 };
+static const int BODIES[] = { 64, 4096, 65536 };
+
+// (keep-alive, pipelining depth) pairs. Without keep-alive there is only
+// ever one request per connection, so depth doesn't apply.
+static const int MODES[][2] = { { 0, 1 }, { 1, 1 }, { 1, 8 } };
+
+typedef struct bench bench_t;
+
+typedef struct {
+    bench_t *bench;
+    struct bufferevent *bev;
+    std::deque<uint64_t> sent;
+    bool in_body;
+    size_t body_left;
+} conn_t;
+
+struct bench {
+    struct event_base *base;
+    struct sockaddr_in address;
+    std::string request;
+    bool keepalive;
+    int depth;
+    bool stopping;
+
+    uint64_t requests;
+    uint64_t errors;
+    std::vector<uint32_t> latencies;
+};
+
+static void error(const char *format, ...) {
+    va_list arguments;
+    va_start(arguments, format);
+    vfprintf(stderr, format, arguments);
+    va_end(arguments);
+    exit(EXIT_FAILURE);
+}
+
+static uint64_t now_usec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void conn_open(conn_t *conn);
+
+// Keeps `depth` requests in flight on the connection.
+static void conn_fill(conn_t *conn) {
+    bench_t *bench = conn->bench;
+    struct evbuffer *output = bufferevent_get_output(conn->bev);
+    while (!bench->stopping && (int) conn->sent.size() < bench->depth) {
+        evbuffer_add(output, bench->request.data(), bench->request.size());
+        conn->sent.push_back(now_usec());
+    }
+}
+
+static void conn_close(conn_t *conn) {
+    if (conn->bev) {
+        bufferevent_free(conn->bev);
+        conn->bev = NULL;
+    }
+    conn->sent.clear();
+    conn->in_body = false;
+}
+
+static void conn_reopen(conn_t *conn) {
+    conn_close(conn);
+    if (!conn->bench->stopping) {
+        conn_open(conn);
+    }
+}
+
+// Content-Length from a header block, or -1.
+static long content_length(const char *headers, size_t length) {
+    static const char name[] = "\r\ncontent-length:";
+    size_t n = sizeof(name) - 1;
+    for (size_t i = 0; i + n <= length; i++) {
+        if (strncasecmp(headers + i, name, n) == 0) {
+            return strtol(headers + i + n, NULL, 10);
+        }
+    }
+    return -1;
+}
+
+static void read_cb(struct bufferevent *bev, void *arg) {
+    conn_t *conn = (conn_t *) arg;
+    bench_t *bench = conn->bench;
+    struct evbuffer *input = bufferevent_get_input(bev);
+
+    for (;;) {
+        if (!conn->in_body) {
+            struct evbuffer_ptr end = evbuffer_search(input, "\r\n\r\n", 4, NULL);
+            if (end.pos < 0) {
+                return;
+            }
+            size_t length = end.pos + 4;
+            const char *headers = (const char *) evbuffer_pullup(input, length);
+            long body = content_length(headers, length);
+            if (length < 12 || memcmp(headers + 9, "200", 3) != 0 || body < 0) {
+                bench->errors++;
+                conn_reopen(conn);
+                return;
+            }
+            evbuffer_drain(input, length);
+            conn->in_body = true;
+            conn->body_left = body;
+        }
+
+        size_t have = evbuffer_get_length(input);
+        if (have < conn->body_left) {
+            conn->body_left -= have;
+            evbuffer_drain(input, have);
+            return;
+        }
+        evbuffer_drain(input, conn->body_left);
+        conn->in_body = false;
+
+        uint64_t elapsed = now_usec() - conn->sent.front();
+        conn->sent.pop_front();
+        if (!bench->stopping) {
+            bench->requests++;
+            bench->latencies.push_back(elapsed > UINT32_MAX ? UINT32_MAX : (uint32_t) elapsed);
+        }
+
+        if (!bench->keepalive) {
+            conn_reopen(conn);
+            return;
+        }
+        conn_fill(conn);
+    }
+}
+
+static void event_cb(struct bufferevent *, short what, void *arg) {
+    conn_t *conn = (conn_t *) arg;
+    if (what & BEV_EVENT_CONNECTED) {
+        conn_fill(conn);
+        return;
+    }
+    if (!conn->bench->stopping) {
+        conn->bench->errors++;
+    }
+    conn_reopen(conn);
+}
+
+static void conn_open(conn_t *conn) {
+    bench_t *bench = conn->bench;
+    conn->bev = bufferevent_socket_new(bench->base, -1, BEV_OPT_CLOSE_ON_FREE);
+    assert(conn->bev && "bench: bufferevent_socket_new");
+    bufferevent_setcb(conn->bev, read_cb, NULL, event_cb, conn);
+    bufferevent_enable(conn->bev, EV_READ | EV_WRITE);
+    if (bufferevent_socket_connect(conn->bev, (struct sockaddr *) &bench->address,
+                                   sizeof(bench->address)) != 0) {
+        bench->errors++;
+        conn_close(conn);
+    }
+}
+
+static void stop_cb(evutil_socket_t, short, void *arg) {
+    bench_t *bench = (bench_t *) arg;
+    bench->stopping = true;
+    event_base_loopexit(bench->base, NULL);
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t i = (size_t) (fraction * sorted.size());
+    return sorted[i < sorted.size() ? i : sorted.size() - 1];
+}
+
+// Runs one cell of the matrix and appends its row to `csv`.
+static void run(FILE *csv, const char *label, const struct sockaddr_in *address,
+                int connections, int keepalive, int depth, int body, double seconds) {
+    bench_t bench;
+    bench.base = event_base_new();
+    bench.address = *address;
+    bench.keepalive = keepalive;
+    bench.depth = depth;
+    bench.stopping = false;
+    bench.requests = bench.errors = 0;
+
+    char request[128];
+    snprintf(request, sizeof(request),
+             "GET /body-%d HTTP/1.1\r\nHost: bench\r\nConnection: %s\r\n\r\n",
+             body, keepalive ? "keep-alive" : "close");
+    bench.request = request;
+
+    std::vector<conn_t> conns(connections);
+    for (int i = 0; i < connections; i++) {
+        conns[i].bench = &bench;
+        conns[i].bev = NULL;
+        conns[i].in_body = false;
+        conn_open(&conns[i]);
+    }
+
+    struct timeval tv = { (time_t) seconds, (suseconds_t) ((seconds - (time_t) seconds) * 1e6) };
+    struct event *stop = evtimer_new(bench.base, stop_cb, &bench);
+    evtimer_add(stop, &tv);
+    uint64_t start = now_usec();
+    event_base_dispatch(bench.base);
+    double elapsed = (now_usec() - start) / 1e6;
+
+    for (int i = 0; i < connections; i++) {
+        conn_close(&conns[i]);
+    }
+    event_free(stop);
+    event_base_free(bench.base);
+
+    std::vector<uint32_t> &sorted = bench.latencies;
+    std::sort(sorted.begin(), sorted.end());
+    uint64_t total = 0;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        total += sorted[i];
+    }
+
+    fprintf(csv, "%s,%d,%d,%d,%d,%.3f,%llu,%llu,%.0f,%llu,%u,%u,%u,%u,%u\n",
+            label, connections, keepalive, depth, body, elapsed,
+            (unsigned long long) bench.requests, (unsigned long long) bench.errors,
+            bench.requests / elapsed,
+            (unsigned long long) (sorted.empty() ? 0 : total / sorted.size()),
+            percentile(sorted, 0.5), percentile(sorted, 0.9),
+            percentile(sorted, 0.99), percentile(sorted, 0.999),
+            sorted.empty() ? 0 : sorted.back());
+    fflush(csv);
+    printf("[log] bench: %d conns, keep-alive %d, depth %d, %d bytes: "
+           "%.0f req/s, p99 %uus, %llu errors\n",
+           connections, keepalive, depth, body, bench.requests / elapsed,
+           percentile(sorted, 0.99), (unsigned long long) bench.errors);
+}
+
+// Writes posts whose bodies are `body` bytes of text, served at /body-N.
+static void write_posts(const std::string &root) {
+    std::string posts = root + "/posts";
+    if (mkdir(posts.c_str(), 0755) != 0) {
+        error("Unable to create %s: %s\n", posts.c_str(), strerror(errno));
+    }
+    for (size_t i = 0; i < sizeof(BODIES) / sizeof(BODIES[0]); i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "/body-%d.md", BODIES[i]);
+        FILE *file = fopen((posts + name).c_str(), "w");
+        if (file == NULL) {
+            error("Unable to write %s%s\n", posts.c_str(), name);
+        }
+        for (int n = 0; n < BODIES[i]; n += 64) {
+            fputs("Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do\n", file);
+        }
+        fclose(file);
+    }
+}
+
+static int remove_entry(const char *path, const struct stat *, int, struct FTW *) {
+    return remove(path);
+}
+
+// A port that was free a moment ago.
+static int free_port() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in sin;
+    socklen_t length = sizeof(sin);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || bind(fd, (struct sockaddr *) &sin, sizeof(sin)) != 0 ||
+        getsockname(fd, (struct sockaddr *) &sin, &length) != 0) {
+        error("Unable to find a free port\n");
+    }
+    close(fd);
+    return ntohs(sin.sin_port);
+}
+
+// Runs `blog <root> 127.0.0.1 <port> posts` from inside `root`, so the
+// posts path works whether or not blog chroots.
+static pid_t start_server(const char *blog, const std::string &root, int port) {
+    char port_string[8];
+    snprintf(port_string, sizeof(port_string), "%d", port);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        error("Unable to fork: %s\n", strerror(errno));
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        if (chdir(root.c_str()) != 0) {
+            _exit(EXIT_FAILURE);
+        }
+        execl(blog, blog, root.c_str(), "127.0.0.1", port_string, "posts", (char *) NULL);
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+// Waits for the server to accept connections, for up to five seconds.
+static void wait_for_server(const struct sockaddr_in *address, pid_t pid) {
+    for (int i = 0; i < 500; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int ret = connect(fd, (const struct sockaddr *) address, sizeof(*address));
+        close(fd);
+        if (ret == 0) {
+            return;
+        }
+        if (waitpid(pid, NULL, WNOHANG) == pid) {
+            error("Server exited during startup\n");
+        }
+        usleep(10000);
+    }
+    kill(pid, SIGTERM);
+    error("Server didn't come up\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3 || argc > 5) {
+        error("Usage: %s <blog> <out.csv> [label] [seconds]\n", argv[0]);
+    }
+    const char *label = argc > 3 ? argv[3] : "unlabeled";
+    double seconds = argc > 4 ? atof(argv[4]) : 2.0;
+    if (seconds <= 0) {
+        error("Invalid duration: %s\n", argv[4]);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    char root_template[] = "/tmp/blog-bench.XXXXXX";
+    if (mkdtemp(root_template) == NULL) {
+        error("Unable to create a scratch directory: %s\n", strerror(errno));
+    }
+    std::string root = root_template;
+    write_posts(root);
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(free_port());
+
+    char blog[PATH_MAX];
+    if (realpath(argv[1], blog) == NULL) {
+        error("Unable to find %s: %s\n", argv[1], strerror(errno));
+    }
+    pid_t server = start_server(blog, root, ntohs(address.sin_port));
+    wait_for_server(&address, server);
+
+    struct stat info;
+    bool fresh = stat(argv[2], &info) != 0 || info.st_size == 0;
+    FILE *csv = fopen(argv[2], "a");
+    if (csv == NULL) {
+        kill(server, SIGTERM);
+        error("Unable to open %s: %s\n", argv[2], strerror(errno));
+    }
+    if (fresh) {
+        fprintf(csv, "label,connections,keepalive,depth,body_bytes,seconds,requests,"
+                     "errors,rps,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n");
+    }
+
+    for (size_t b = 0; b < sizeof(BODIES) / sizeof(BODIES[0]); b++) {
+        for (size_t m = 0; m < sizeof(MODES) / sizeof(MODES[0]); m++) {
+            for (size_t c = 0; c < sizeof(CONNECTIONS) / sizeof(CONNECTIONS[0]); c++) {
+                run(csv, label, &address, CONNECTIONS[c], MODES[m][0], MODES[m][1],
+                    BODIES[b], seconds);
+            }
+        }
+    }
+
+    fclose(csv);
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    nftw(root.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return 0;
+}
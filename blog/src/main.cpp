@@ -1,14 +1,53 @@
 #include <assert.h>
+#include <sys/queue.h> // before libevent, so evkeyvalq is complete
 #include <event.h>
 #include <evhttp.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <sstream>
+#include <string>
 
+#include "posts.hpp"
+#include "reload.hpp"
+#include "stats.hpp"
 #include "util.hpp"
 
+// How long a replaced server keeps going after it stops accepting: at least
+// DRAIN_GRACE_MSEC, so keep-alive clients get a last reply telling them to
+// reconnect, and at most DRAIN_TIMEOUT_MSEC, however busy it still is. In
+// between, it exits once it has no connections and no requests left.
+#define DRAIN_GRACE_MSEC 1000
+#define DRAIN_TIMEOUT_MSEC 30000
+
+// The listening side of one running server, and what it needs to hand that
+// over to its successor on SIGUSR2.
+typedef struct {
+    struct event_base *base;
+    struct evhttp *http;
+    struct evhttp_bound_socket *bound;
+    reload_t reload;
+    struct event *verdict;
+    struct event *drain;
+    struct timeval drain_start;
+    bool draining;
+    int in_flight;
+} server_t;
+
+// What evhttp hands back to each handler: which stats route to count the
+// request against, the server (whose base's cached clock timed it), and
+// the rendered posts (if any) to serve.
+typedef struct {
+    int stats;
+    struct event_base *base;
+    site_t *site;
+    server_t *server;
+} route_t;
+
 void error(const char *format, ...) {
     va_list arguments;
     va_start(arguments, format);
@@ -17,28 +56,216 @@ void error(const char *format, ...) {
     exit(EXIT_FAILURE);
 }
 
-// A generic callback for evhttp. Turns on UTF-8 and sends 200 BUTTS
-// lovingly.
+// Called once the reply has been written. Charges the time since the
+// request's first byte to its route. Both ends come from the event loop's
+// cached clock, so this costs no syscalls.
+static void request_done(struct evhttp_request *request, void *arg) {
+    route_t *info = (route_t *) arg;
+    struct timeval start, now, elapsed;
+
+    evhttp_request_get_start_time(request, &start);
+    event_base_gettimeofday_cached(info->base, &now);
+    if (!evutil_timerisset(&start) || evutil_timercmp(&now, &start, <)) {
+        start = now;
+    }
+    evutil_timersub(&now, &start, &elapsed);
+
+    stats_record(info->stats, evhttp_request_get_response_code(request),
+                 (uint64_t) elapsed.tv_sec * 1000000 + elapsed.tv_usec);
+}
+
+// Called when evhttp frees the request, whether its reply got out or the
+// client went away first.
+static void request_freed(struct evhttp_request *, void *arg) {
+    ((route_t *) arg)->server->in_flight--;
+}
+
+// Every handler starts here: counts the request as in flight until it is
+// freed, and while draining tells keep-alive clients to take their next
+// request to our successor.
+static void request_begin(struct evhttp_request *request, route_t *info) {
+    evhttp_request_set_on_complete_cb(request, request_done, info);
+    evhttp_request_set_on_free_cb(request, request_freed, info);
+    info->server->in_flight++;
+    if (info->server->draining) {
+        struct evkeyvalq *headers = evhttp_request_get_output_headers(request);
+        evhttp_add_header(headers, "Connection", "close");
+    }
+}
+
+// A generic callback for evhttp. Sends the rendered post at that path, or
+// 200 BUTTS lovingly if there isn't one. UTF-8 comes from the server's
+// default Content-Type, so this adds no headers of its own.
 void route(struct evhttp_request *request, void *arg) {
-    int ret;
+    route_t *info = (route_t *) arg;
+
+    request_begin(request, info);
 
     struct evbuffer *buf = evbuffer_new();
+
+    std::map<std::string, std::string>::const_iterator page = info->site->pages.end();
+    if (info->site->dir) {
+        std::string path = evhttp_request_get_uri(request);
+        path = path.substr(0, path.find('?'));
+        page = info->site->pages.find(path);
+    }
+
+    if (page != info->site->pages.end()) {
+        evbuffer_add(buf, page->second.data(), page->second.size());
+        evhttp_send_reply(request, HTTP_OK, "OK", buf);
+    } else {
+        evbuffer_add_printf(buf, "<3");
+        evhttp_send_reply(request, HTTP_OK, "BUTTS", buf);
+    }
+    evbuffer_free(buf);
+}
+
+// Serves /_stats: per-route counters and latency percentiles as a text
+// table, or as JSON with ?format=json.
+void route_stats(struct evhttp_request *request, void *arg) {
+    int ret;
+    struct evkeyvalq query;
+    stats_format_t format = STATS_TEXT;
+
+    request_begin(request, (route_t *) arg);
+
+    evhttp_parse_query(evhttp_request_get_uri(request), &query);
+    const char *wanted = evhttp_find_header(&query, "format");
+    if (wanted && strcmp(wanted, "json") == 0) {
+        format = STATS_JSON;
+    }
+    evhttp_clear_headers(&query);
+
     struct evkeyvalq *headers = evhttp_request_get_output_headers(request);
-    ret = evhttp_add_header(headers, "Content-Type", "text/html; charset=utf-8");
+    ret = evhttp_add_header(headers, "Content-Type",
+                            format == STATS_JSON ? "application/json"
+                                                 : "text/plain; charset=utf-8");
     if (ret != 0) {
         error("Unable to add Content-Type header\n");
     }
 
-    evbuffer_add_printf(buf, "<3");
-    evhttp_send_reply(request, HTTP_OK, "BUTTS", buf);
+    std::string body;
+    stats_dump(&body, format);
+
+    struct evbuffer *buf = evbuffer_new();
+    evbuffer_add(buf, body.data(), body.size());
+    evhttp_send_reply(request, HTTP_OK, "OK", buf);
     evbuffer_free(buf);
 }
 
+// Brings the page cache up to date and says what it took.
+static int build(site_t *site) {
+    build_stats_t stats;
+    if (site_build(site, &stats) != 0) {
+        return -1;
+    }
+    printf("[log] build: %d posts, %d rendered, %d loaded, %d unchanged, "
+           "%d removed in %.1fms\n", stats.scanned, stats.rendered,
+           stats.loaded, stats.unchanged, stats.removed, stats.msec);
+    fflush(stdout);
+    return 0;
+}
+
+// SIGHUP: pick up edited posts without a restart. Runs on the loop, so
+// nobody is reading the page cache while it changes.
+static void rebuild(evutil_socket_t, short, void *arg) {
+    build((site_t *) arg);
+}
+
+static long msec_since(struct event_base *base, const struct timeval *start) {
+    struct timeval now, elapsed;
+    event_base_gettimeofday_cached(base, &now);
+    evutil_timersub(&now, start, &elapsed);
+    return elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000;
+}
+
+// Ticks while draining; stops the loop once we're idle or out of time.
+// Connections count as well as requests, so a request that is still being
+// read keeps us going. Keep-alive connections between requests are closed
+// here: their clients reconnect to our successor.
+static void drain_check(evutil_socket_t, short, void *arg) {
+    server_t *server = (server_t *) arg;
+    long msec = msec_since(server->base, &server->drain_start);
+    evhttp_close_idle_connections(server->http);
+    int connections = evhttp_get_connection_count(server->http);
+    if ((server->in_flight == 0 && connections == 0 &&
+         msec >= DRAIN_GRACE_MSEC) || msec >= DRAIN_TIMEOUT_MSEC) {
+        printf("[log] reload: drained after %ldms, %d in flight, "
+               "%d connections\n", msec, server->in_flight, connections);
+        fflush(stdout);
+        event_base_loopexit(server->base, NULL);
+    }
+}
+
+// Our successor either came up (stop accepting and drain) or died.
+static void reload_done(evutil_socket_t, short, void *arg) {
+    server_t *server = (server_t *) arg;
+    event_free(server->verdict);
+    server->verdict = NULL;
+
+    if (reload_verdict(&server->reload) != 0) {
+        printf("[log] reload: new server failed, still serving\n");
+        fflush(stdout);
+        return;
+    }
+
+    printf("[log] reload: new server is up, draining\n");
+    fflush(stdout);
+    evhttp_del_accept_socket(server->http, server->bound);
+    server->bound = NULL;
+    server->draining = true;
+    event_base_gettimeofday_cached(server->base, &server->drain_start);
+
+    struct timeval tick = { 0, 100 * 1000 };
+    server->drain = event_new(server->base, -1, EV_PERSIST, drain_check, server);
+    event_add(server->drain, &tick);
+}
+
+// SIGUSR2: exec a fresh copy of the binary and hand it our listening
+// socket. We keep accepting until it says it's serving too.
+static void start_reload(evutil_socket_t, short, void *arg) {
+    server_t *server = (server_t *) arg;
+    if (server->draining || server->verdict) {
+        return;
+    }
+
+    int fd = evhttp_bound_socket_get_fd(server->bound);
+    if (reload_handoff(&server->reload, fd) != 0) {
+        printf("[log] reload: unable to hand over the listening socket\n");
+        fflush(stdout);
+        return;
+    }
+    printf("[log] reload: starting %s\n", server->reload.exe);
+    fflush(stdout);
+    server->verdict = event_new(server->base, server->reload.standby, EV_READ,
+                                reload_done, server);
+    event_add(server->verdict, NULL);
+}
+
+static int cpus() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+}
+
+// Usage: blog <root> <address> <port> [posts]
+//        blog build <posts>
+// Posts are looked up after dropping privileges, so inside <root>.
+// SIGHUP rebuilds the posts; SIGUSR2 replaces the running binary.
 int main(int argc, char **argv) {
     int ret;
+    site_t site;
+    server_t server;
+
+    if (argc == 3 && strcmp(argv[1], "build") == 0) {
+        site_init(&site, argv[2], cpus());
+        return build(&site) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    assert(argc == 4 && "Invalid arguments");
+    assert((argc == 4 || argc == 5) && "Invalid arguments");
+    memset(&server, 0, sizeof(server));
+    reload_init(&server.reload, argv);
     drop_privileges(argv[1]);
+    site_init(&site, argc == 5 ? argv[4] : NULL, cpus());
 
     ev_uint16_t port;
     std::stringstream port_stream(argv[3]);
@@ -53,15 +280,57 @@ int main(int argc, char **argv) {
 
     struct event_base *base = event_base_new();
     struct evhttp *http = evhttp_new(base);
-    ret = evhttp_bind_socket(http, argv[2], port);
-    if (ret != 0) {
+    server.base = base;
+    server.http = http;
+    if (server.reload.inherited >= 0) {
+        printf("[log] reload: taking over fd %d\n", server.reload.inherited);
+        server.bound = evhttp_accept_socket_with_handle(http, server.reload.inherited);
+    } else {
+        server.bound = evhttp_bind_socket_with_handle(http, argv[2], port);
+    }
+    if (server.bound == NULL) {
         evhttp_free(http);
         event_base_free(base);
         error("Unable to bind to %s:%d\n", argv[2], port);
     }
 
-    evhttp_set_gencb(http, route, NULL);
+    // Sent with every reply that doesn't set its own: formatted once here
+    // instead of allocated per request.
+    ret = evhttp_add_default_header(http, "Content-Type", "text/html; charset=utf-8");
+    if (ret != 0) {
+        error("Unable to add Content-Type header\n");
+    }
+
+    struct event *hup = NULL;
+    if (site.dir) {
+        build(&site);
+        hup = evsignal_new(base, SIGHUP, rebuild, &site);
+        evsignal_add(hup, NULL);
+    }
+
+    struct event *usr2 = evsignal_new(base, SIGUSR2, start_reload, &server);
+    evsignal_add(usr2, NULL);
+
+    route_t page = { stats_route("page"), base, &site, &server };
+    route_t stats = { stats_route("_stats"), base, &site, &server };
+    evhttp_set_cb(http, "/_stats", route_stats, &stats);
+    evhttp_set_gencb(http, route, &page);
+
+    // Only now are we really ready to serve.
+    fflush(stdout);
+    reload_announce(&server.reload);
     event_base_dispatch(base);
+
+    if (hup) {
+        event_free(hup);
+    }
+    event_free(usr2);
+    if (server.verdict) {
+        event_free(server.verdict);
+    }
+    if (server.drain) {
+        event_free(server.drain);
+    }
     evhttp_free(http);
     event_base_free(base);
     return 0;
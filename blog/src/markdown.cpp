@@ -0,0 +1,274 @@
+#include <string.h>
+
+#include "markdown.hpp"
+
+typedef enum {
+    BLOCK_NONE,
+    BLOCK_PARAGRAPH,
+    BLOCK_QUOTE,
+    BLOCK_UL,
+    BLOCK_OL,
+    BLOCK_CODE
+} block_t;
+
+static void escape(const char *p, const char *end, std::string *out) {
+    const char *run = p;
+    for (; p < end; p++) {
+        const char *entity;
+        switch (*p) {
+        case '&': entity = "&amp;"; break;
+        case '<': entity = "&lt;"; break;
+        case '>': entity = "&gt;"; break;
+        case '"': entity = "&quot;"; break;
+        default: continue;
+        }
+        out->append(run, p - run);
+        out->append(entity);
+        run = p + 1;
+    }
+    out->append(run, p - run);
+}
+
+/* Escapes &, <, > and " in `p` for use in HTML text or attributes. */
+void html_escape(const char *p, size_t length, std::string *out) {
+    escape(p, p + length, out);
+}
+
+/* Finds `marker` (of `n` bytes) in [p, end), or returns NULL. Outside of
+   code, a backslash hides the character after it. */
+static const char *find(const char *p, const char *end,
+                        const char *marker, size_t n, bool code = false) {
+    for (; p + n <= end; p++) {
+        if (!code && *p == '\\') {
+            p++;
+        } else if (*p == *marker && memcmp(p, marker, n) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Inline markup within one line. Openers only count if their closer is
+   further along the same line, so unbalanced markers come out as text and
+   the HTML always nests. */
+static void inline_render(const char *p, const char *end, std::string *out) {
+    const char *run = p;
+
+    while (p < end) {
+        const char *close;
+        char c = *p;
+
+        if (c == '\\' && p + 1 < end && strchr("\\`*_[]()#+-.!", p[1])) {
+            escape(run, p, out);
+            escape(p + 1, p + 2, out);
+            p += 2;
+            run = p;
+        } else if (c == '`' && (close = find(p + 1, end, "`", 1, true))) {
+            escape(run, p, out);
+            out->append("<code>");
+            escape(p + 1, close, out);
+            out->append("</code>");
+            p = run = close + 1;
+        } else if ((c == '*' || c == '_') && p + 1 < end && p[1] == c &&
+                   (close = find(p + 2, end, p, 2)) && close > p + 2) {
+            escape(run, p, out);
+            out->append("<strong>");
+            inline_render(p + 2, close, out);
+            out->append("</strong>");
+            p = run = close + 2;
+        } else if ((c == '*' || c == '_') && p + 1 < end && p[1] != ' ' &&
+                   (close = find(p + 1, end, p, 1)) && close > p + 1) {
+            escape(run, p, out);
+            out->append("<em>");
+            inline_render(p + 1, close, out);
+            out->append("</em>");
+            p = run = close + 1;
+        } else if (c == '[' && (close = find(p + 1, end, "](", 2))) {
+            const char *url_end = find(close + 2, end, ")", 1);
+            if (url_end == NULL) {
+                p++;
+                continue;
+            }
+            escape(run, p, out);
+            out->append("<a href=\"");
+            escape(close + 2, url_end, out);
+            out->append("\">");
+            inline_render(p + 1, close, out);
+            out->append("</a>");
+            p = run = url_end + 1;
+        } else {
+            p++;
+        }
+    }
+    escape(run, end, out);
+}
+
+static void close_block(block_t *block, bool *item_open, std::string *out) {
+    if (*item_open) {
+        out->append("</li>\n");
+        *item_open = false;
+    }
+    switch (*block) {
+    case BLOCK_PARAGRAPH: out->append("</p>\n"); break;
+    case BLOCK_QUOTE: out->append("</p>\n</blockquote>\n"); break;
+    case BLOCK_UL: out->append("</ul>\n"); break;
+    case BLOCK_OL: out->append("</ol>\n"); break;
+    case BLOCK_CODE: out->append("</code></pre>\n"); break;
+    case BLOCK_NONE: break;
+    }
+    *block = BLOCK_NONE;
+}
+
+static bool is_rule(const char *p, const char *end) {
+    char c = *p;
+    int n = 0;
+    if (c != '-' && c != '*' && c != '_') {
+        return false;
+    }
+    for (; p < end; p++) {
+        if (*p == c) {
+            n++;
+        } else if (*p != ' ') {
+            return false;
+        }
+    }
+    return n >= 3;
+}
+
+/* If [p, end) starts a list item, returns where its text starts and sets
+   `kind`; otherwise returns NULL. */
+static const char *list_item(const char *p, const char *end, block_t *kind) {
+    if (end - p >= 2 && (*p == '-' || *p == '*' || *p == '+') && p[1] == ' ') {
+        *kind = BLOCK_UL;
+        return p + 2;
+    }
+    const char *q = p;
+    while (q < end && *q >= '0' && *q <= '9') {
+        q++;
+    }
+    if (q > p && q + 1 < end && q[0] == '.' && q[1] == ' ') {
+        *kind = BLOCK_OL;
+        return q + 2;
+    }
+    return NULL;
+}
+
+void markdown_render(const char *in, size_t length, std::string *out) {
+    const char *end = in + length;
+    block_t block = BLOCK_NONE;
+    bool item_open = false;
+
+    while (in < end) {
+        const char *eol = (const char *) memchr(in, '\n', end - in);
+        const char *next = eol ? eol + 1 : end;
+        const char *line_end = eol ? eol : end;
+        if (line_end > in && line_end[-1] == '\r') {
+            line_end--;
+        }
+
+        const char *line = in;
+        const char *p = in;
+        while (p < line_end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        in = next;
+
+        if (block == BLOCK_CODE) {
+            if (line_end - p >= 3 && memcmp(p, "```", 3) == 0) {
+                close_block(&block, &item_open, out);
+            } else {
+                /* Code keeps its indentation. */
+                escape(line, line_end, out);
+                out->push_back('\n');
+            }
+            continue;
+        }
+
+        if (p == line_end) {
+            close_block(&block, &item_open, out);
+            continue;
+        }
+
+        if (line_end - p >= 3 && memcmp(p, "```", 3) == 0) {
+            close_block(&block, &item_open, out);
+            out->append("<pre><code>");
+            block = BLOCK_CODE;
+            continue;
+        }
+
+        if (*p == '#') {
+            const char *text = p;
+            while (text < line_end && *text == '#') {
+                text++;
+            }
+            int level = (int) (text - p);
+            if (level <= 6 && (text == line_end || *text == ' ')) {
+                close_block(&block, &item_open, out);
+                while (text < line_end && *text == ' ') {
+                    text++;
+                }
+                const char *stop = line_end;
+                while (stop > text && (stop[-1] == '#' || stop[-1] == ' ')) {
+                    stop--;
+                }
+                char tag[5] = { '<', 'h', (char) ('0' + level), '>', 0 };
+                out->append(tag);
+                inline_render(text, stop, out);
+                out->append("</");
+                out->append(tag + 1);
+                out->push_back('\n');
+                continue;
+            }
+        }
+
+        if (is_rule(p, line_end)) {
+            close_block(&block, &item_open, out);
+            out->append("<hr>\n");
+            continue;
+        }
+
+        if (*p == '>') {
+            p++;
+            if (p < line_end && *p == ' ') {
+                p++;
+            }
+            if (block != BLOCK_QUOTE) {
+                close_block(&block, &item_open, out);
+                out->append("<blockquote>\n<p>");
+                block = BLOCK_QUOTE;
+            } else {
+                out->push_back('\n');
+            }
+            inline_render(p, line_end, out);
+            continue;
+        }
+
+        block_t kind;
+        const char *text = list_item(p, line_end, &kind);
+        if (text) {
+            if (block != kind) {
+                close_block(&block, &item_open, out);
+                out->append(kind == BLOCK_UL ? "<ul>\n" : "<ol>\n");
+                block = kind;
+            } else if (item_open) {
+                out->append("</li>\n");
+            }
+            out->append("<li>");
+            item_open = true;
+            inline_render(text, line_end, out);
+            continue;
+        }
+
+        /* Plain text continues whatever paragraph, quote or list item is
+           open; otherwise it starts a new paragraph. */
+        if (block == BLOCK_NONE) {
+            out->append("<p>");
+            block = BLOCK_PARAGRAPH;
+        } else {
+            out->push_back('\n');
+        }
+        inline_render(p, line_end, out);
+    }
+
+    close_block(&block, &item_open, out);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <string>
+
+/* Renders the Markdown in `in` to HTML, appending it to `out`. One pass
+   over the input, line by line; nothing is ever re-read. Handles headings,
+   paragraphs, block quotes, lists, fenced code, rules, emphasis, inline
+   code and links. Anything else comes out as (escaped) text. */
+void markdown_render(const char *in, size_t length, std::string *out);
+void html_escape(const char *in, size_t length, std::string *out);
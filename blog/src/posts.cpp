@@ -0,0 +1,398 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <set>
+#include <vector>
+
+#include "markdown.hpp"
+#include "posts.hpp"
+
+#define POSTS_BUILD_DIR ".build"
+#define POSTS_MANIFEST "manifest"
+
+typedef enum {
+    // mtime and size match the manifest: just need the HTML in memory.
+    JOB_LOAD,
+    // Something moved: read the source and re-render if its hash changed.
+    JOB_CHECK
+} job_kind_t;
+
+typedef enum {
+    RESULT_FAILED,
+    RESULT_UNCHANGED,
+    RESULT_LOADED,
+    RESULT_RENDERED
+} job_result_t;
+
+typedef struct {
+    job_kind_t kind;
+    std::string name;
+    post_stamp_t stamp;
+    bool have_old;
+    uint64_t old_hash;
+    bool cached;
+
+    job_result_t result;
+    std::string html;
+} job_t;
+
+typedef struct {
+    const site_t *site;
+    std::vector<job_t> *jobs;
+    size_t next;
+} pool_t;
+
+static double now_msec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static std::string path_of(const site_t *site, const std::string &file) {
+    return std::string(site->dir) + "/" + file;
+}
+
+static std::string output_of(const site_t *site, const std::string &name) {
+    return path_of(site, POSTS_BUILD_DIR "/" + name + ".html");
+}
+
+static bool read_file(const std::string &path, std::string *out) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat stats;
+    if (fstat(fd, &stats) != 0) {
+        close(fd);
+        return false;
+    }
+
+    out->resize(stats.st_size);
+    size_t have = 0;
+    while (have < out->size()) {
+        ssize_t n = read(fd, &(*out)[have], out->size() - have);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        have += n;
+    }
+    out->resize(have);
+    close(fd);
+    return true;
+}
+
+// Writes beside the target and renames over it, so the server (or a
+// concurrent `blog build`) never sees half a file.
+static bool write_file(const std::string &path, const std::string &data) {
+    std::string tmp = path + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    ok = fclose(file) == 0 && ok;
+    if (ok && rename(tmp.c_str(), path.c_str()) == 0) {
+        return true;
+    }
+    unlink(tmp.c_str());
+    return false;
+}
+
+// FNV-1a. Only needs to tell "touched" apart from "edited".
+static uint64_t hash_of(const std::string &data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < data.size(); i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void wrap_page(const std::string &title, const std::string &body,
+                      std::string *out) {
+    out->reserve(body.size() + title.size() + 96);
+    out->append("<!DOCTYPE html>\n<meta charset=\"utf-8\">\n<title>");
+    html_escape(title.data(), title.size(), out);
+    out->append("</title>\n");
+    out->append(body);
+}
+
+static void render(const site_t *site, job_t *job, const std::string &source) {
+    std::string body;
+    body.reserve(source.size() + source.size() / 4);
+    markdown_render(source.data(), source.size(), &body);
+
+    wrap_page(job->name, body, &job->html);
+    if (!write_file(output_of(site, job->name), job->html)) {
+        fprintf(stderr, "[log] build: unable to write %s: %s\n",
+                output_of(site, job->name).c_str(), strerror(errno));
+    }
+    job->result = RESULT_RENDERED;
+}
+
+static void run_job(const site_t *site, job_t *job) {
+    std::string source;
+
+    if (job->kind == JOB_LOAD) {
+        if (read_file(output_of(site, job->name), &job->html)) {
+            job->result = RESULT_LOADED;
+            return;
+        }
+        job->html.clear();
+    }
+
+    if (!read_file(path_of(site, job->name + ".md"), &source)) {
+        fprintf(stderr, "[log] build: unable to read %s.md: %s\n",
+                job->name.c_str(), strerror(errno));
+        job->result = RESULT_FAILED;
+        return;
+    }
+    job->stamp.hash = hash_of(source);
+
+    if (job->kind == JOB_CHECK && job->have_old && job->old_hash == job->stamp.hash) {
+        if (job->cached) {
+            job->result = RESULT_UNCHANGED;
+            return;
+        }
+        if (read_file(output_of(site, job->name), &job->html)) {
+            job->result = RESULT_LOADED;
+            return;
+        }
+        job->html.clear();
+    }
+    render(site, job, source);
+}
+
+static void *worker(void *arg) {
+    pool_t *pool = (pool_t *) arg;
+    size_t i;
+    while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->jobs->size()) {
+        run_job(pool->site, &(*pool->jobs)[i]);
+    }
+    return NULL;
+}
+
+// Spreads `jobs` over up to `site->threads` threads. Workers only touch
+// their own job and their own output file; everything shared is updated
+// afterwards, on this thread.
+static void run_jobs(const site_t *site, std::vector<job_t> *jobs) {
+    pool_t pool = { site, jobs, 0 };
+    int threads = site->threads;
+    if ((size_t) threads > jobs->size() / 4) {
+        threads = (int) (jobs->size() / 4);
+    }
+
+    std::vector<pthread_t> ids;
+    for (int i = 1; i < threads; i++) {
+        pthread_t id;
+        if (pthread_create(&id, NULL, worker, &pool) != 0) {
+            break;
+        }
+        ids.push_back(id);
+    }
+    worker(&pool);
+    for (size_t i = 0; i < ids.size(); i++) {
+        pthread_join(ids[i], NULL);
+    }
+}
+
+static void load_manifest(site_t *site) {
+    site->manifest_loaded = true;
+
+    FILE *file = fopen(path_of(site, POSTS_BUILD_DIR "/" POSTS_MANIFEST).c_str(), "r");
+    if (file == NULL) {
+        return;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        long long sec, nsec, size;
+        unsigned long long hash;
+        int offset = 0;
+        if (sscanf(line, "%lld %lld %lld %llx %n", &sec, &nsec, &size, &hash, &offset) < 4 ||
+            offset == 0) {
+            continue;
+        }
+        std::string name(line + offset);
+        while (!name.empty() && name[name.size() - 1] == '\n') {
+            name.erase(name.size() - 1);
+        }
+        if (name.empty()) {
+            continue;
+        }
+        post_stamp_t stamp = { sec, nsec, size, hash };
+        site->manifest[name] = stamp;
+    }
+    fclose(file);
+}
+
+static void save_manifest(const site_t *site) {
+    std::string data;
+    char line[128];
+    std::map<std::string, post_stamp_t>::const_iterator it;
+    for (it = site->manifest.begin(); it != site->manifest.end(); ++it) {
+        snprintf(line, sizeof(line), "%lld %lld %lld %016llx ",
+                 (long long) it->second.mtime_sec, (long long) it->second.mtime_nsec,
+                 (long long) it->second.size, (unsigned long long) it->second.hash);
+        data.append(line);
+        data.append(it->first);
+        data.push_back('\n');
+    }
+
+    std::string path = path_of(site, POSTS_BUILD_DIR "/" POSTS_MANIFEST);
+    if (!write_file(path, data)) {
+        fprintf(stderr, "[log] build: unable to write %s: %s\n",
+                path.c_str(), strerror(errno));
+    }
+}
+
+// The front page: every post, by name. Built as Markdown so it
+// goes through the same escaping as everything else.
+static void build_index(site_t *site) {
+    std::string source = "# Posts\n\n";
+    std::map<std::string, post_stamp_t>::const_iterator it;
+    for (it = site->manifest.begin(); it != site->manifest.end(); ++it) {
+        source += "- [" + it->first + "](/" + it->first + ")\n";
+    }
+
+    std::string body;
+    markdown_render(source.data(), source.size(), &body);
+    wrap_page("Posts", body, &site->pages["/"]);
+}
+
+void site_init(site_t *site, const char *dir, int threads) {
+    site->dir = dir;
+    site->threads = threads > 0 ? threads : 1;
+    site->manifest_loaded = false;
+    site->manifest.clear();
+    site->pages.clear();
+}
+
+/* Brings `site->pages` and the on-disk build up to date with the posts in
+   `site->dir`. Posts whose mtime and size match the manifest aren't even
+   opened; ones that were only touched are hashed but not re-rendered.
+   Returns 0, or -1 if the posts directory can't be read. */
+int site_build(site_t *site, build_stats_t *stats) {
+    double start = now_msec();
+    memset(stats, 0, sizeof(*stats));
+
+    if (!site->manifest_loaded) {
+        load_manifest(site);
+    }
+    mkdir(path_of(site, POSTS_BUILD_DIR).c_str(), 0755);
+
+    DIR *dir = opendir(site->dir);
+    if (dir == NULL) {
+        fprintf(stderr, "[log] build: unable to open %s: %s\n",
+                site->dir, strerror(errno));
+        return -1;
+    }
+
+    std::vector<job_t> jobs;
+    std::set<std::string> seen;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (entry->d_name[0] == '.' || length <= 3 ||
+            strcmp(entry->d_name + length - 3, ".md") != 0) {
+            continue;
+        }
+
+        std::string name(entry->d_name, length - 3);
+        struct stat info;
+        if (fstatat(dirfd(dir), entry->d_name, &info, 0) != 0 ||
+            !S_ISREG(info.st_mode)) {
+            continue;
+        }
+        stats->scanned++;
+        seen.insert(name);
+
+        post_stamp_t stamp = { (int64_t) info.st_mtim.tv_sec,
+                               (int64_t) info.st_mtim.tv_nsec,
+                               (int64_t) info.st_size, 0 };
+        std::map<std::string, post_stamp_t>::const_iterator old = site->manifest.find(name);
+        bool cached = site->pages.count("/" + name) != 0;
+        bool same = old != site->manifest.end() &&
+                    old->second.mtime_sec == stamp.mtime_sec &&
+                    old->second.mtime_nsec == stamp.mtime_nsec &&
+                    old->second.size == stamp.size;
+        if (same && cached) {
+            stats->unchanged++;
+            continue;
+        }
+
+        job_t job;
+        job.kind = same ? JOB_LOAD : JOB_CHECK;
+        job.name = name;
+        job.stamp = stamp;
+        job.stamp.hash = same ? old->second.hash : 0;
+        job.have_old = old != site->manifest.end();
+        job.old_hash = job.have_old ? old->second.hash : 0;
+        job.cached = cached;
+        job.result = RESULT_FAILED;
+        jobs.push_back(job);
+    }
+    closedir(dir);
+
+    bool dirty = false;
+    std::map<std::string, post_stamp_t>::iterator it = site->manifest.begin();
+    while (it != site->manifest.end()) {
+        if (seen.count(it->first)) {
+            ++it;
+            continue;
+        }
+        unlink(output_of(site, it->first).c_str());
+        site->pages.erase("/" + it->first);
+        site->manifest.erase(it++);
+        stats->removed++;
+        dirty = true;
+    }
+
+    run_jobs(site, &jobs);
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        job_t *job = &jobs[i];
+        switch (job->result) {
+        case RESULT_FAILED:
+            continue;
+        case RESULT_UNCHANGED:
+            stats->unchanged++;
+            break;
+        case RESULT_LOADED:
+            stats->loaded++;
+            site->pages["/" + job->name].swap(job->html);
+            break;
+        case RESULT_RENDERED:
+            stats->rendered++;
+            site->pages["/" + job->name].swap(job->html);
+            break;
+        }
+        if (job->kind == JOB_CHECK) {
+            dirty = true;
+        }
+        site->manifest[job->name] = job->stamp;
+    }
+
+    if (dirty) {
+        save_manifest(site);
+    }
+    if (dirty || !site->pages.count("/")) {
+        build_index(site);
+    }
+
+    stats->msec = now_msec() - start;
+    return 0;
+}
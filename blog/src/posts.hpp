@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+/* Turns a directory of Markdown posts into HTML pages. Rendered pages are
+   written under <dir>/.build next to a manifest of what they were rendered
+   from, so a rebuild -- in this process or the next -- only re-renders the
+   posts that actually changed. */
+
+typedef struct {
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t size;
+    uint64_t hash;
+} post_stamp_t;
+
+typedef struct {
+    const char *dir;
+    int threads;
+    bool manifest_loaded;
+    std::map<std::string, post_stamp_t> manifest;
+    // URL path ("/", "/<post>") to the page served there.
+    std::map<std::string, std::string> pages;
+} site_t;
+
+typedef struct {
+    int scanned;
+    int rendered;
+    int loaded;
+    int unchanged;
+    int removed;
+    double msec;
+} build_stats_t;
+
+void site_init(site_t *site, const char *dir, int threads);
+int site_build(site_t *site, build_stats_t *stats);
@@ -0,0 +1,201 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "reload.hpp"
+
+#define RELOAD_LISTEN_ENV "BLOG_LISTEN_FD"
+#define RELOAD_PREDECESSOR_ENV "BLOG_RELOAD_FD"
+
+// Takes an fd number out of the environment, so it isn't passed on again.
+static int take_fd(const char *name) {
+    const char *value = getenv(name);
+    int fd = -1;
+    if (value) {
+        char *end;
+        long n = strtol(value, &end, 10);
+        if (*value && *end == '\0' && n >= 0 && n <= INT_MAX) {
+            fd = (int) n;
+        }
+        unsetenv(name);
+    }
+    return fd;
+}
+
+static void set_cloexec(int fd) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags >= 0) {
+        fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+    }
+}
+
+// The standby's whole life: wait for a listening socket, then become the
+// next server. If the server goes away without handing one over, so do we.
+static void standby(reload_t *reload, int sock) {
+    char byte;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { &byte, 1 };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &message, 0);
+    } while (n < 0 && errno == EINTR);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    if (n <= 0 || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS) {
+        _exit(EXIT_SUCCESS);
+    }
+    int listener;
+    memcpy(&listener, CMSG_DATA(cmsg), sizeof(int));
+
+    char value[16];
+    snprintf(value, sizeof(value), "%d", listener);
+    setenv(RELOAD_LISTEN_ENV, value, 1);
+    snprintf(value, sizeof(value), "%d", sock);
+    setenv(RELOAD_PREDECESSOR_ENV, value, 1);
+
+    execv(reload->exe, reload->argv);
+    fprintf(stderr, "[log] reload: exec %s: %s\n", reload->exe, strerror(errno));
+    _exit(EXIT_FAILURE);
+}
+
+static void spawn_standby(reload_t *reload) {
+    int pair[2];
+    reload->standby = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        perror("[log] reload: socketpair");
+        return;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("[log] reload: fork");
+        close(pair[0]);
+        close(pair[1]);
+        return;
+    }
+    if (pid == 0) {
+        close(pair[0]);
+        if (reload->inherited >= 0) {
+            close(reload->inherited);
+        }
+        if (reload->predecessor >= 0) {
+            close(reload->predecessor);
+        }
+        standby(reload, pair[1]);
+    }
+
+    close(pair[1]);
+    set_cloexec(pair[0]);
+    reload->standby = pair[0];
+}
+
+/* Picks up anything a predecessor handed over and forks the standby for
+   the next reload. Call this first thing, while we can still exec
+   ourselves -- that is, before drop_privileges(). */
+void reload_init(reload_t *reload, char **argv) {
+    reload->argv = argv;
+    reload->inherited = take_fd(RELOAD_LISTEN_ENV);
+    reload->predecessor = take_fd(RELOAD_PREDECESSOR_ENV);
+    if (reload->predecessor >= 0) {
+        set_cloexec(reload->predecessor);
+    }
+
+    ssize_t n = readlink("/proc/self/exe", reload->exe, sizeof(reload->exe) - 1);
+    if (n < 0) {
+        perror("[log] reload: readlink");
+        reload->standby = -1;
+        return;
+    }
+    reload->exe[n] = '\0';
+    spawn_standby(reload);
+}
+
+/* Hands `listener` to the standby, which execs the next server. Returns 0
+   if it was sent; wait for reload->standby to become readable and then ask
+   reload_verdict() how it went. */
+int reload_handoff(reload_t *reload, int listener) {
+    if (reload->standby < 0) {
+        return -1;
+    }
+
+    char byte = 'l';
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { &byte, 1 };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &listener, sizeof(int));
+
+    ssize_t n;
+    do {
+        n = sendmsg(reload->standby, &message, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n != 1) {
+        perror("[log] reload: sendmsg");
+        return -1;
+    }
+    return 0;
+}
+
+/* 0 if the next server is up and accepting, so we can stop; -1 if it died
+   first, in which case we carry on and have a fresh standby for the next
+   try. Fresh standbys forked after drop_privileges() can't chroot again,
+   so a failed reload of a chrooted server needs a restart to retry. */
+int reload_verdict(reload_t *reload) {
+    char byte;
+    ssize_t n;
+    do {
+        n = read(reload->standby, &byte, 1);
+    } while (n < 0 && errno == EINTR);
+
+    close(reload->standby);
+    reload->standby = -1;
+    if (n == 1) {
+        return 0;
+    }
+
+    // The successor was our child; don't leave it as a zombie.
+    while (waitpid(-1, NULL, WNOHANG) > 0) {
+    }
+    spawn_standby(reload);
+    return -1;
+}
+
+/* Tells our predecessor, if we have one, that we're accepting connections
+   and it can stop. */
+void reload_announce(reload_t *reload) {
+    if (reload->predecessor < 0) {
+        return;
+    }
+    char byte = 'r';
+    if (write(reload->predecessor, &byte, 1) != 1) {
+        perror("[log] reload: write");
+    }
+    close(reload->predecessor);
+    reload->predecessor = -1;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <limits.h>
+
+/* Zero-downtime binary reloads. At startup, before dropping privileges,
+   blog forks a standby copy of itself that waits on a Unix socket. To
+   reload, the server hands its listening socket to the standby with
+   SCM_RIGHTS; the standby execs the (possibly new) binary, which starts
+   accepting on the same socket and then reports back. Only then does the
+   old server stop accepting and drain, so the socket is never closed and
+   no connection is ever refused. */
+
+typedef struct {
+    char exe[PATH_MAX];
+    char **argv;
+    // Our end of the socket to the standby process, or -1.
+    int standby;
+    // The listening socket our predecessor handed over, or -1 on a cold
+    // start.
+    int inherited;
+    // Where to tell our predecessor that we're serving, or -1.
+    int predecessor;
+} reload_t;
+
+void reload_init(reload_t *reload, char **argv);
+int reload_handoff(reload_t *reload, int listener);
+int reload_verdict(reload_t *reload);
+void reload_announce(reload_t *reload);
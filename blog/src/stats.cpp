@@ -0,0 +1,232 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.hpp"
+
+/* HDR-style log-linear buckets. Values below STATS_SUB microseconds get a
+   bucket each; above that every power of two is split into STATS_SUB
+   linear slots, so a bucket is never more than ~6% wide. Anything past
+   2^STATS_MAX_BITS microseconds (about 19 hours) lands in the last one. */
+#define STATS_SUB_BITS 4
+#define STATS_SUB (1 << STATS_SUB_BITS)
+#define STATS_MAX_BITS 36
+#define STATS_BUCKETS ((STATS_MAX_BITS - STATS_SUB_BITS + 1) * STATS_SUB)
+
+typedef struct {
+    uint64_t requests;
+    uint64_t status[5];
+    uint64_t usec_total;
+    uint64_t usec_max;
+    uint64_t buckets[STATS_BUCKETS];
+} route_stats_t;
+
+/* One per recording thread. Only the owning thread writes to it, so plain
+   relaxed stores are enough; shards are never freed so that a thread going
+   away doesn't take its numbers with it. */
+typedef struct shard {
+    route_stats_t routes[STATS_MAX_ROUTES];
+    struct shard *next;
+} shard_t;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static shard_t *shards = NULL;
+static const char *names[STATS_MAX_ROUTES];
+static int nroutes = 0;
+static __thread shard_t *mine = NULL;
+
+static inline void bump(uint64_t *counter, uint64_t n) {
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t peek(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+static inline unsigned bucket_of(uint64_t usec) {
+    if (usec < STATS_SUB) {
+        return (unsigned) usec;
+    }
+    if (usec >> STATS_MAX_BITS) {
+        return STATS_BUCKETS - 1;
+    }
+    unsigned exp = 63 - __builtin_clzll(usec);
+    unsigned sub = (unsigned) (usec >> (exp - STATS_SUB_BITS)) & (STATS_SUB - 1);
+    return (exp - STATS_SUB_BITS + 1) * STATS_SUB + sub;
+}
+
+/* Smallest value that lands in `bucket`. */
+static uint64_t bucket_floor(unsigned bucket) {
+    if (bucket < STATS_SUB) {
+        return bucket;
+    }
+    unsigned group = bucket / STATS_SUB;
+    uint64_t sub = bucket % STATS_SUB;
+    return (STATS_SUB + sub) << (group - 1);
+}
+
+static shard_t *shard_new() {
+    shard_t *shard = (shard_t *) calloc(1, sizeof(shard_t));
+    assert(shard && "stats: calloc");
+
+    pthread_mutex_lock(&lock);
+    shard->next = shards;
+    shards = shard;
+    pthread_mutex_unlock(&lock);
+
+    mine = shard;
+    return shard;
+}
+
+/* Registers a route called `name` and returns the id to record against.
+   Call this before any requests are served; `name` must outlive us. */
+int stats_route(const char *name) {
+    pthread_mutex_lock(&lock);
+    assert(nroutes < STATS_MAX_ROUTES && "stats: too many routes");
+    int id = nroutes;
+    names[id] = name;
+    __atomic_store_n(&nroutes, nroutes + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&lock);
+    return id;
+}
+
+/* Counts one request on `route` that finished with HTTP `status` after
+   `usec` microseconds. This is on every request's path, so it stays a
+   handful of stores into the calling thread's shard. */
+void stats_record(int route, int status, uint64_t usec) {
+    shard_t *shard = mine;
+    if (shard == NULL) {
+        shard = shard_new();
+    }
+
+    route_stats_t *stats = &shard->routes[route];
+    bump(&stats->requests, 1);
+    if (status >= 100 && status < 600) {
+        bump(&stats->status[status / 100 - 1], 1);
+    }
+    bump(&stats->usec_total, usec);
+    if (usec > stats->usec_max) {
+        __atomic_store_n(&stats->usec_max, usec, __ATOMIC_RELAXED);
+    }
+    bump(&stats->buckets[bucket_of(usec)], 1);
+}
+
+/* Adds up every shard's numbers for `route` into `total`. */
+static void collect(int route, route_stats_t *total) {
+    memset(total, 0, sizeof(*total));
+
+    pthread_mutex_lock(&lock);
+    for (shard_t *shard = shards; shard; shard = shard->next) {
+        const route_stats_t *stats = &shard->routes[route];
+        total->requests += peek(&stats->requests);
+        for (int i = 0; i < 5; i++) {
+            total->status[i] += peek(&stats->status[i]);
+        }
+        total->usec_total += peek(&stats->usec_total);
+        uint64_t max = peek(&stats->usec_max);
+        if (max > total->usec_max) {
+            total->usec_max = max;
+        }
+        for (int i = 0; i < STATS_BUCKETS; i++) {
+            total->buckets[i] += peek(&stats->buckets[i]);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/* The latency that `fraction` of requests came in under, rounded up to the
+   top of its bucket and never more than the slowest request we saw. */
+static uint64_t percentile(const route_stats_t *stats, double fraction) {
+    uint64_t seen = 0;
+    uint64_t want = (uint64_t) (fraction * stats->requests + 0.5);
+    if (want == 0) {
+        want = 1;
+    }
+
+    for (unsigned i = 0; i < STATS_BUCKETS; i++) {
+        seen += stats->buckets[i];
+        if (seen >= want) {
+            uint64_t top = i + 1 < STATS_BUCKETS ? bucket_floor(i + 1) - 1
+                                                 : stats->usec_max;
+            return top < stats->usec_max ? top : stats->usec_max;
+        }
+    }
+    return stats->usec_max;
+}
+
+static void appendf(std::string *out, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void appendf(std::string *out, const char *format, ...) {
+    char buf[512];
+    va_list arguments;
+    va_start(arguments, format);
+    vsnprintf(buf, sizeof(buf), format, arguments);
+    va_end(arguments);
+    out->append(buf);
+}
+
+/* Appends a snapshot of every route's numbers to `out`. Latencies are in
+   microseconds, from the first byte of a request to the last of its
+   reply. */
+void stats_dump(std::string *out, stats_format_t format) {
+    static const double fractions[] = { 0.5, 0.9, 0.99, 0.999 };
+    static const char *labels[] = { "p50", "p90", "p99", "p999" };
+    route_stats_t *total = (route_stats_t *) malloc(sizeof(route_stats_t));
+    assert(total && "stats: malloc");
+    int n = __atomic_load_n(&nroutes, __ATOMIC_ACQUIRE);
+
+    if (format == STATS_JSON) {
+        out->append("{\"unit\":\"us\",\"routes\":{");
+    } else {
+        appendf(out, "%-16s %10s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+                "route", "requests", "1xx", "2xx", "3xx", "4xx", "5xx",
+                "mean", "p50", "p90", "p99", "p999", "max");
+    }
+
+    for (int route = 0; route < n; route++) {
+        collect(route, total);
+        uint64_t mean = total->requests ? total->usec_total / total->requests : 0;
+        uint64_t points[4];
+        for (int i = 0; i < 4; i++) {
+            points[i] = total->requests ? percentile(total, fractions[i]) : 0;
+        }
+
+        if (format == STATS_JSON) {
+            appendf(out, "%s\"%s\":{\"requests\":%llu,\"status\":{",
+                    route ? "," : "", names[route],
+                    (unsigned long long) total->requests);
+            for (int i = 0; i < 5; i++) {
+                appendf(out, "%s\"%dxx\":%llu", i ? "," : "", i + 1,
+                        (unsigned long long) total->status[i]);
+            }
+            appendf(out, "},\"latency\":{\"mean\":%llu",
+                    (unsigned long long) mean);
+            for (int i = 0; i < 4; i++) {
+                appendf(out, ",\"%s\":%llu", labels[i],
+                        (unsigned long long) points[i]);
+            }
+            appendf(out, ",\"max\":%llu}}",
+                    (unsigned long long) total->usec_max);
+        } else {
+            appendf(out, "%-16s %10llu", names[route],
+                    (unsigned long long) total->requests);
+            for (int i = 0; i < 5; i++) {
+                appendf(out, " %8llu", (unsigned long long) total->status[i]);
+            }
+            appendf(out, " %8llu", (unsigned long long) mean);
+            for (int i = 0; i < 4; i++) {
+                appendf(out, " %8llu", (unsigned long long) points[i]);
+            }
+            appendf(out, " %8llu\n", (unsigned long long) total->usec_max);
+        }
+    }
+
+    if (format == STATS_JSON) {
+        out->append("}}\n");
+    }
+    free(total);
+}
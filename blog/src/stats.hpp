@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+/* Per-route request counters and latency histograms. Every thread that
+   records gets its own shard, so recording never takes a lock; readers sum
+   the shards when somebody asks for /_stats. */
+
+#define STATS_MAX_ROUTES 16
+
+typedef enum {
+    STATS_TEXT,
+    STATS_JSON
+} stats_format_t;
+
+int stats_route(const char *name);
+void stats_record(int route, int status, uint64_t usec);
+void stats_dump(std::string *out, stats_format_t format);